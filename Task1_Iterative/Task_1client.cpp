@@ -13,6 +13,7 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #pragma comment(lib, "ws2_32.lib")
+#define SHUT_RDWR SD_BOTH
 #else
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -30,6 +31,7 @@
 #include <string>
 #include <thread>
 
+#include "../common/framing.h"
 
 using namespace std;
 
@@ -42,11 +44,11 @@ const char *MY_NAME = "Arjun Rajesh: 23208";
 atomic<bool> running(true);
 
 void receiveMessages(SOCKET sock) {
-  char buffer[1024];
+  RecvBuffer recvBuffer;
 
   while (running) {
-    memset(buffer, 0, sizeof(buffer));
-    int bytesRead = recv(sock, buffer, sizeof(buffer) - 1, 0);
+    char *space = recvBuffer.prepare(RECV_CHUNK_SIZE);
+    int bytesRead = recv(sock, space, (int)recvBuffer.writable(), 0);
 
     if (bytesRead <= 0) {
       if (running) {
@@ -55,9 +57,21 @@ void receiveMessages(SOCKET sock) {
       running = false;
       break;
     }
+    recvBuffer.commit(bytesRead);
 
-    buffer[bytesRead] = '\0';
-    cout << "\n[Server]: " << buffer << endl;
+    // Print every complete message; partial ones wait for the next recv()
+    string_view payload;
+    FrameStatus status;
+    while ((status = recvBuffer.nextFrame(payload)) == FrameStatus::Complete) {
+      cout << "\n[Server]: " << payload << endl;
+    }
+    if (status == FrameStatus::TooLarge) {
+      // The stream cannot be resynchronised: disconnect
+      cout << "\n[Error] Server sent an oversized frame; disconnecting." << endl;
+      shutdown(sock, SHUT_RDWR);
+      running = false;
+      break;
+    }
     cout << "[You]: " << flush;
   }
 }
@@ -79,7 +93,8 @@ void sendMessages(SOCKET sock) {
     }
 
     if (!input.empty()) {
-      send(sock, input.c_str(), input.length(), 0);
+      string frame = makeFrame(input);
+      send(sock, frame.data(), (int)frame.size(), 0);
     }
   }
 }
@@ -137,7 +152,8 @@ int main() {
 
   // Send greeting message
   string greeting = string(MY_NAME) + " here!";
-  send(clientSocket, greeting.c_str(), greeting.length(), 0);
+  string greetingFrame = makeFrame(greeting);
+  send(clientSocket, greetingFrame.data(), (int)greetingFrame.size(), 0);
   cout << "[Client] Sent: " << greeting << endl;
 
   cout << "[Client] Type 'exit' to disconnect." << endl;
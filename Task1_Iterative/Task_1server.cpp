@@ -18,6 +18,7 @@
     #include <ws2tcpip.h>
     #pragma comment(lib, "ws2_32.lib")
     typedef int socklen_t;
+    #define SHUT_RDWR SD_BOTH
 #else
     // Linux/Unix-specific headers for socket programming
     #include <sys/socket.h>
@@ -35,6 +36,8 @@
 #include <thread>
 #include <atomic>
 
+#include "../common/framing.h"
+
 using namespace std;
 
 // Global flag to signal threads to stop
@@ -47,15 +50,15 @@ atomic<bool> running(true);
  * 
  * This function runs in a separate thread and displays incoming
  * messages from the client. It terminates when the client disconnects.
+ * Messages are length-prefixed frames (see common/framing.h).
  */
 void receiveMessages(SOCKET sock) {
-    char buffer[1024];  // Buffer to store incoming messages
+    RecvBuffer recvBuffer;  // Reassembles messages split across recv() calls
     
     while (running) {
-        memset(buffer, 0, sizeof(buffer));  // Clear buffer before receiving
-        
-        // Receive data from client (blocking call)
-        int bytesRead = recv(sock, buffer, sizeof(buffer) - 1, 0);
+        // Receive data from client (blocking call) straight into the buffer
+        char* space = recvBuffer.prepare(RECV_CHUNK_SIZE);
+        int bytesRead = recv(sock, space, (int)recvBuffer.writable(), 0);
         
         if (bytesRead <= 0) {
             // Client disconnected or error occurred
@@ -63,9 +66,21 @@ void receiveMessages(SOCKET sock) {
             running = false;
             break;
         }
+        recvBuffer.commit(bytesRead);
         
-        buffer[bytesRead] = '\0';  // Null-terminate the received string
-        cout << "\n[Client]: " << buffer << endl;
+        // Display every complete message received so far
+        string_view payload;
+        FrameStatus status;
+        while ((status = recvBuffer.nextFrame(payload)) == FrameStatus::Complete) {
+            cout << "\n[Client]: " << payload << endl;
+        }
+        if (status == FrameStatus::TooLarge) {
+            // The stream cannot be resynchronised: drop the client
+            cout << "\n[Error] Client sent an oversized frame; closing the connection." << endl;
+            shutdown(sock, SHUT_RDWR);
+            running = false;
+            break;
+        }
         cout << "[You]: " << flush;  // Prompt for next message
     }
 }
@@ -94,8 +109,9 @@ void sendMessages(SOCKET sock) {
             break;
         }
         
-        // Send message to client
-        send(sock, buffer, strlen(buffer), 0);
+        // Send message to client as one frame
+        string frame = makeFrame(buffer);
+        send(sock, frame.data(), (int)frame.size(), 0);
     }
 }
 
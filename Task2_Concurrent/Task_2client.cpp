@@ -1,10 +1,21 @@
 /**
  * Task 2: Concurrent Client - Multi-Client Chat Application
  *
- * This client connects to the C++ concurrent server for group chat.
+ * This client connects to the C++ concurrent server for group chat. The
+ * connection itself is a ChatClient (see chat_client.h): it never blocks,
+ * queues messages typed while the server is unreachable and reconnects
+ * with backoff, re-entering the current room.
  *
  * Compile (Windows): g++ -o client.exe client.cpp -lws2_32
  *
+ * Usage: client [--profile default|low-latency|throughput] [--unix PATH [--shm]]
+ *               [--binary]
+ *   --profile: socket tuning, see common/socket_profile.h
+ *   --unix:    connect to the server's --unix-socket instead of TCP (Linux)
+ *   --shm:     then exchange messages through shared memory
+ *   --binary:  ask for typed messages (binary_protocol.h) and show them
+ *              by type
+ *
  * Course: 23CSE312 - Distributed Systems
  * Lab: Socket Programming (Concurrent Chat Application)
  */
@@ -26,10 +37,13 @@
 
 #include <atomic>
 #include <cstring>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <thread>
 
+#include "chat_client.h"
 
 using namespace std;
 
@@ -40,53 +54,140 @@ const char *MY_NAME = "Arjun Rajesh: 23208";
 // =======================================================
 
 atomic<bool> running(true);
+mutex inputMutex;
+deque<string> inputLines; // Typed lines waiting for the network loop
 
-void receiveMessages(SOCKET sock) {
-  char buffer[1024];
-
-  while (running) {
-    memset(buffer, 0, sizeof(buffer));
-    int bytesRead = recv(sock, buffer, sizeof(buffer) - 1, 0);
-
-    if (bytesRead <= 0) {
-      if (running) {
-        cout << "\n[Disconnected from server]" << endl;
-      }
-      running = false;
-      break;
-    }
+const int INPUT_POLL_MS = 20; // Longest a typed line waits to be sent
 
-    buffer[bytesRead] = '\0';
-    cout << "\r" << buffer << endl;
-    cout << "[You]: " << flush;
+/**
+ * Function: describe
+ * Purpose: Renders a typed message from the server as a console line
+ *          (text messages are shown as they are)
+ */
+string describe(string_view payload) {
+  WireChat chat;
+  WireJoin join;
+  WireLeave leave;
+  WireNotice notice;
+  WireError error;
+  auto who = [](uint32_t client, uint32_t node) {
+    return "Client " + to_string(client) + (node ? "@" + to_string(node) : "");
+  };
+  switch (wireType(payload)) {
+  case WireType::Chat:
+    if (!wireDecode(payload, chat)) break;
+    return "[" + who(chat.client, chat.node) + " in " + string(chat.room) + "]: " + string(chat.text);
+  case WireType::Join:
+    if (!wireDecode(payload, join)) break;
+    return "(join) " + who(join.client, join.node) + " -> " + string(join.room) +
+           ((join.flags & WIRE_CONNECTED) ? ", connected from " + string(join.address) : "");
+  case WireType::Leave:
+    if (!wireDecode(payload, leave)) break;
+    return "(leave) " + who(leave.client, leave.node) + " <- " + string(leave.room) +
+           ((leave.flags & WIRE_CONNECTED) ? ", disconnected" : "");
+  case WireType::Notice:
+    if (!wireDecode(payload, notice)) break;
+    return "(notice) " + string(notice.text);
+  case WireType::Error:
+    if (!wireDecode(payload, error)) break;
+    return "(error " + to_string(error.code) + ") " + string(error.text);
+  case WireType::None:
+    return string(payload);
   }
+  return "(malformed message)";
 }
 
-void sendMessages(SOCKET sock) {
+/**
+ * Function: readInput
+ * Purpose: Reads console lines (blocking) and hands them to the network loop
+ */
+void readInput() {
   string input;
 
   while (running) {
     cout << "[You]: " << flush;
-    getline(cin, input);
-
-    if (!running)
-      break;
-
-    if (input == "exit") {
+    if (!getline(cin, input) || input == "exit") {
       cout << "[Client] Disconnecting..." << endl;
       running = false;
       break;
     }
-
     if (!input.empty()) {
-      // Send message with name prefix
-      string fullMessage = string(MY_NAME) + ": " + input;
-      send(sock, fullMessage.c_str(), fullMessage.length(), 0);
+      lock_guard<mutex> lock(inputMutex);
+      inputLines.push_back(input);
+    }
+  }
+}
+
+/**
+ * Function: sendInput
+ * Purpose: Sends the lines typed since the last call; room commands go out
+ *          as they are (and are repeated after a reconnect), chat lines
+ *          with the name prefix
+ */
+void sendInput(ChatClient &client) {
+  deque<string> lines;
+  {
+    lock_guard<mutex> lock(inputMutex);
+    lines.swap(inputLines);
+  }
+  for (const string &line : lines) {
+    bool queued;
+    if (line.rfind("/join ", 0) == 0) {
+      queued = client.join(line.substr(6));
+    } else if (line == "/leave") {
+      queued = client.leave();
+    } else {
+      queued = client.send(string(MY_NAME) + ": " + line);
+    }
+    if (!queued) {
+      cout << "\r[Client] Not connected and too much is queued; message dropped." << endl;
     }
   }
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+  ChatClientOptions options;
+  options.host = SERVER_IP;
+  options.port = SERVER_PORT;
+  for (int i = 1; i < argc; i++) {
+    const char *original = argv[i];
+    string arg = argv[i];
+    string value;
+    size_t eq = arg.find('=');
+    if (eq != string::npos) {
+      value = arg.substr(eq + 1);
+      arg = arg.substr(0, eq);
+    } else if (arg == "--shm" || arg == "--binary") {
+      value = "on"; // Switches take no value
+    } else if (i + 1 < argc) {
+      value = argv[++i];
+    }
+    if (arg == "--profile" && parseSocketProfile(value, options.profile)) {
+      // Parsed in the condition
+    } else if (arg == "--unix" && !value.empty()) {
+      options.unixPath = value;
+    } else if (arg == "--shm") {
+      options.sharedMemory = (value != "off");
+    } else if (arg == "--binary") {
+      options.binary = (value != "off");
+    } else {
+      cerr << "[Error] Invalid argument: " << original << endl;
+      cerr << "Usage: client [--profile default|low-latency|throughput] [--unix PATH [--shm]]" << endl
+           << "              [--binary]" << endl;
+      return 1;
+    }
+  }
+#ifndef __linux__
+  if (!options.unixPath.empty()) {
+    cerr << "[Error] --unix is only available on Linux." << endl;
+    return 1;
+  }
+#endif
+  if (options.sharedMemory && options.unixPath.empty()) {
+    cerr << "[Error] --shm needs --unix PATH." << endl;
+    return 1;
+  }
+
   cout << "==========================================" << endl;
   cout << "  Task 2: Concurrent Client (Group Chat) " << endl;
   cout << "==========================================" << endl;
@@ -99,60 +200,61 @@ int main() {
   }
 #endif
 
-  SOCKET clientSocket = socket(AF_INET, SOCK_STREAM, 0);
-  if (clientSocket == INVALID_SOCKET) {
-    cerr << "[Error] Failed to create socket!" << endl;
-#ifdef _WIN32
-    WSACleanup();
-#endif
-    return 1;
-  }
-
-  sockaddr_in serverAddress;
-  memset(&serverAddress, 0, sizeof(serverAddress));
-  serverAddress.sin_family = AF_INET;
-  serverAddress.sin_port = htons(SERVER_PORT);
+  ChatClient client(options);
+  bool everConnected = false;
+  client.onMessage([&](string_view payload) {
+    if (options.binary) {
+      cout << "\r" << describe(payload) << endl;
+    } else {
+      cout << "\r" << payload << endl;
+    }
+    cout << "[You]: " << flush;
+  });
+  client.onStateChange([&](ChatClient::State state, const string &reason) {
+    if (state == ChatClient::State::Connected) {
+      cout << "\r[Client] Connected to chat server!" << endl;
+      everConnected = true;
+    } else if (state == ChatClient::State::Waiting) {
+      cout << "\r[Client] " << (everConnected ? "Connection lost" : "Cannot connect")
+           << " (" << reason << "); retrying..." << endl;
+    }
+  });
 
-  if (inet_pton(AF_INET, SERVER_IP, &serverAddress.sin_addr) <= 0) {
-    cerr << "[Error] Invalid server address!" << endl;
-    closesocket(clientSocket);
-#ifdef _WIN32
-    WSACleanup();
-#endif
-    return 1;
+  if (options.unixPath.empty()) {
+    cout << "[Client] Connecting to " << SERVER_IP << ":" << SERVER_PORT << "..."
+         << endl;
+  } else {
+    cout << "[Client] Connecting to " << options.unixPath
+         << (options.sharedMemory ? " (shared memory)..." : "...") << endl;
   }
-
-  cout << "[Client] Connecting to " << SERVER_IP << ":" << SERVER_PORT << "..."
-       << endl;
-
-  if (connect(clientSocket, (sockaddr *)&serverAddress,
-              sizeof(serverAddress)) == SOCKET_ERROR) {
-    cerr << "[Error] Connection failed! Is the server running?" << endl;
-    closesocket(clientSocket);
+  if (!client.start()) {
+    cerr << "[Error] Invalid server address!" << endl;
 #ifdef _WIN32
     WSACleanup();
 #endif
     return 1;
   }
 
-  cout << "[Client] Connected to chat server!" << endl;
-
-  // Send greeting message
+  // Queued now, sent as soon as the connection is up
   string greeting = string(MY_NAME) + " here!";
-  send(clientSocket, greeting.c_str(), greeting.length(), 0);
+  client.send(greeting);
   cout << "[Client] Sent: " << greeting << endl;
 
   cout << "[Client] Type messages and press Enter. Type 'exit' to leave."
        << endl;
+  cout << "[Client] Use /join <room> to switch chat rooms, /leave for the lobby."
+       << endl;
   cout << "------------------------------------------" << endl;
 
-  thread recvThread(receiveMessages, clientSocket);
-  thread sendThread(sendMessages, clientSocket);
-
-  recvThread.join();
-  sendThread.join();
-
-  closesocket(clientSocket);
+  // The console blocks in its own thread; the connection is driven here
+  thread inputThread(readInput);
+  ChatClient *clients[] = {&client};
+  while (running) {
+    ChatClient::pollClients(clients, 1, INPUT_POLL_MS);
+    sendInput(client);
+  }
+  client.close();
+  inputThread.join();
 
 #ifdef _WIN32
   WSACleanup();
@@ -0,0 +1,797 @@
+/**
+ * Task 2: Load Generator - Benchmark for the Concurrent Chat Server
+ *
+ * Simulates thousands of chat clients from one process so the server modes
+ * can be compared and regressions caught before deploying. The clients are
+ * non-blocking sockets spread over a few epoll worker threads:
+ *   1. every client connects and waits for the server's welcome message
+ *      (connection-setup rate);
+ *   2. with --rooms N the clients are spread over N rooms with /join;
+ *   3. a subset of clients (--senders) sends --size byte messages at --rate
+ *      messages per second each, for --duration seconds;
+ *   4. every client timestamps the messages it receives, giving the
+ *      fan-out latency from send() by the sender to arrival at each
+ *      recipient (all clients share one clock, being in one process).
+ *
+ * The report lists connections answered (welcomed or refused) per second,
+ * messages sent and delivered per second, delivered vs. expected (room
+ * size - 1 per message) and the p50/p99/p999 fan-out latency.
+ *
+ * Start the server with a large enough --max-clients, e.g.
+ *   ./server --mode epoll --max-clients 20000
+ *   ./loadgen --clients 5000 --senders 50 --rate 20 --size 128 --duration 10
+ *
+ * Compile (Linux): g++ -O2 -o loadgen loadgen.cpp -pthread
+ *
+ * Usage: loadgen [--host IP] [--port N] [--clients N] [--senders N]
+ *                [--rate MSGS_PER_SEC] [--size BYTES] [--duration SECONDS]
+ *                [--rooms N] [--threads N] [--profile default|low-latency|throughput]
+ *                [--udp-port N] [--binary] [--connect-timeout SECONDS]
+ *                [--connect-burst N]
+ *
+ * --profile sets the client sockets' TCP options (see
+ * common/socket_profile.h); compare profiles with the server started with
+ * the same --profile.
+ *
+ * With --udp-port N the clients are UDP subscribers of the server's feed
+ * (server --udp-port N, see udp_feed.h) instead of TCP connections. The
+ * phases are the same; the report adds how many datagrams the clients saw
+ * missing from their sequence numbers.
+ *
+ * --connect-timeout bounds the wait for the welcomes (and the room joins);
+ * the run goes on with the clients admitted by then, so servers that only
+ * serve some clients at once (--mode iterative or pool) can be measured.
+ *
+ * With --binary every client asks for typed messages (binary_protocol.h)
+ * as soon as it is connected, and recognises chat messages and its room
+ * join by their type instead of by their text. Being the first to send,
+ * such clients are also accepted at once by a server with --defer-accept.
+ *
+ * --connect-burst sets how many connects each worker has in flight (256
+ * by default). Setting it to the number of clients connects them all at
+ * once, like a fleet reconnecting after a network blip; the connection
+ * rate in the report is then the server's accept rate under that storm.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef __linux__
+    #error "The load generator is built on epoll and needs Linux."
+#endif
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <csignal>
+#define SOCKET int
+#define INVALID_SOCKET -1
+#define closesocket close
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <string>
+
+#include "../common/framing.h"
+#include "../common/socket_profile.h"
+#include "latency_histogram.h"
+#include "udp_feed.h"
+#include "binary_protocol.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct LoadConfig {
+    string host = "127.0.0.1";
+    int port = 8080;
+    int clients = 1000;
+    int senders = 10;               // Clients that send; all of them receive
+    double rate = 10;               // Messages per second per sender
+    size_t size = 64;               // Payload bytes per message
+    double duration = 10;           // Seconds of sending
+    int rooms = 1;                  // 1 keeps everyone in the lobby
+    int threads = 2;                // epoll worker threads
+    SocketProfile profile = SocketProfile::LowLatency;  // Client socket options
+    int udpPort = 0;                // Subscribe to the UDP feed instead (0 = TCP)
+    bool binary = false;            // Ask for typed messages (TCP only)
+    int connectTimeout = 30;        // Seconds to wait for every welcome (and every room join)
+    int connectBurst = 256;         // Connects each worker keeps in flight
+};
+
+LoadConfig config;
+
+const int DRAIN_MILLISECONDS = 1000;    // Receive-only time after the last send
+const char* const STAMP_MARKER = "lg:"; // Payload starts "lg:<send time ns>:"
+const char* const WELCOME_PREFIX = "[Server] Welcome! You are Client ";
+
+// Benchmark phases, advanced by the main thread
+enum Phase { Connecting, Joining, Running, Draining, Done };
+
+atomic<int> phase(Connecting);
+Clock::time_point epoch;                // Timestamps are nanoseconds since this
+Clock::time_point runStart;             // Set before phase becomes Running
+
+atomic<int> admittedCount(0);           // Welcomed by the server
+atomic<int> refusedCount(0);            // "Server is full"
+atomic<int> failedCount(0);             // Connect or socket error
+atomic<int> joinedCount(0);             // Confirmed in their room
+unique_ptr<atomic<int>[]> roomSizes;    // Admitted clients per room
+
+uint64_t nowNs() {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(Clock::now() - epoch).count();
+}
+
+/**
+ * Struct: SimClient
+ * Purpose: State of one simulated chat client
+ */
+struct SimClient {
+    SOCKET sock = INVALID_SOCKET;
+    uint32_t id = 0;                // Its client ID, from the welcome (--binary)
+    uint32_t node = 0;              // ... and its server's node ID, if clustered
+    int room = 0;
+    bool sender = false;
+    bool connecting = false;        // Non-blocking connect in progress
+    bool settled = false;           // Admitted, refused or failed
+    bool admitted = false;
+    bool joinSent = false;
+    bool closed = false;
+    bool writeArmed = false;        // EPOLLOUT registered for unsent bytes
+    RecvBuffer recvBuffer;
+    string pending;                 // Framed bytes the socket has not taken yet
+    size_t pendingOffset = 0;
+    uint64_t nextSequence = 1;      // UDP only: numbers the datagrams sent
+    SequenceTracker feed;           // UDP only: gaps in the datagrams received
+};
+
+/**
+ * Struct: WorkerStats
+ * Purpose: Results of one worker thread, merged by main after the run
+ */
+struct WorkerStats {
+    uint64_t sent = 0;              // Messages sent
+    uint64_t expected = 0;          // Deliveries those messages should cause
+    uint64_t delivered = 0;         // Timestamped messages received
+    uint64_t bytesIn = 0;
+    uint64_t lost = 0;              // UDP datagrams missing from the sequence
+    Clock::time_point lastAnswer;   // Last welcome or refusal, for the connection rate
+    LatencyHistogram latency;
+};
+
+/**
+ * Class: Worker
+ * Purpose: Drives a slice of the simulated clients with one epoll loop
+ */
+class Worker {
+public:
+    Worker(int first, int count) : first(first), count(count) {}
+    ~Worker() {
+        if (epollFd >= 0) close(epollFd);
+    }
+
+    void run();
+    WorkerStats stats;
+
+private:
+    void startConnects();
+    void onEvent(SimClient& client, uint32_t events);
+    void onConnected(SimClient& client);
+    void readClient(SimClient& client);
+    void readDatagrams(SimClient& client);
+    void handlePayload(SimClient& client, string_view payload);
+    void handleTyped(SimClient& client, string_view payload);
+    void sendDue();
+    void queueFrame(SimClient& client, string_view payload);
+    void sendDatagram(SimClient& client, string_view payload);
+    void flush(SimClient& client);
+    void fail(SimClient& client);
+
+    int first;                      // Global index of clients[0]
+    int count;
+    int epollFd = -1;
+    vector<SimClient> clients;
+    vector<SimClient*> senders;     // Admitted senders, round-robin order
+    int nextConnect = 0;            // Next client to start connecting
+    int inFlight = 0;
+    size_t nextSender = 0;
+    string payloadTemplate;         // Padding reused for every message
+    DatagramReceiver receiver;      // UDP only: shared by this worker's clients
+};
+
+/**
+ * Function: Worker::run
+ * Purpose: Event loop for this worker's clients, following the global phase
+ */
+void Worker::run() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    clients.resize(count);
+    for (int i = 0; i < count; i++) {
+        int index = first + i;
+        clients[i].room = index % config.rooms;
+        clients[i].sender = index < config.senders;
+    }
+    payloadTemplate.assign(max(config.size, (size_t)32), 'x');
+
+    const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+
+    while (phase != Done) {
+        if (phase == Connecting) startConnects();
+        if (phase == Joining) {
+            for (SimClient& client : clients) {
+                if (client.admitted && !client.joinSent && !client.closed) {
+                    client.joinSent = true;
+                    queueFrame(client, "/join lg" + to_string(client.room));
+                }
+            }
+        }
+        if (phase == Running) sendDue();
+
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, phase == Running ? 1 : 10);
+        for (int i = 0; i < ready; i++) {
+            onEvent(clients[events[i].data.u32], events[i].events);
+        }
+    }
+
+    for (SimClient& client : clients) {
+        if (client.sock == INVALID_SOCKET) continue;
+        if (config.udpPort > 0) {
+            sendDatagram(client, "/unsubscribe");  // Rather than waiting to time out
+            stats.lost += client.feed.missing();
+        }
+        closesocket(client.sock);
+    }
+}
+
+/**
+ * Function: Worker::startConnects
+ * Purpose: Starts non-blocking connects, keeping at most --connect-burst
+ *          outstanding per worker (so a small accept backlog is not overrun,
+ *          or, with a large burst, to simulate a reconnect storm)
+ */
+void Worker::startConnects() {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.udpPort > 0 ? config.udpPort : config.port);
+    inet_pton(AF_INET, config.host.c_str(), &address.sin_addr);
+
+    while (inFlight < config.connectBurst && nextConnect < count) {
+        SimClient& client = clients[nextConnect];
+        epoll_event ev{};
+        ev.data.u32 = (uint32_t)nextConnect;
+        nextConnect++;
+        inFlight++;  // Until settled
+
+        if (config.udpPort > 0) {
+            // A connected UDP socket: send() without an address, and only
+            // the server's datagrams are received
+            client.sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (client.sock == INVALID_SOCKET ||
+                connect(client.sock, (sockaddr*)&address, sizeof(address)) != 0) {
+                fail(client);
+                continue;
+            }
+            ev.events = EPOLLIN;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, client.sock, &ev);
+            sendDatagram(client, "/subscribe");  // Admitted on the welcome, as over TCP
+            continue;
+        }
+
+        client.sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (client.sock == INVALID_SOCKET) {
+            fail(client);
+            continue;
+        }
+        applySocketProfile(client.sock, config.profile);  // Before connect(): window scale
+
+        int result = connect(client.sock, (sockaddr*)&address, sizeof(address));
+        if (result != 0 && errno != EINPROGRESS) {
+            fail(client);
+            continue;
+        }
+        client.connecting = true;
+        ev.events = EPOLLIN | EPOLLOUT;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, client.sock, &ev);
+    }
+}
+
+/**
+ * Function: Worker::onEvent
+ * Purpose: Dispatches readiness for one client
+ */
+void Worker::onEvent(SimClient& client, uint32_t events) {
+    if (client.closed) return;
+    if (client.connecting) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(client.sock, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0) {
+            fail(client);
+            return;
+        }
+        onConnected(client);
+    }
+    if (events & EPOLLOUT) flush(client);
+    if (!client.closed && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) readClient(client);
+}
+
+/**
+ * Function: Worker::onConnected
+ * Purpose: Switches a freshly connected socket to read interest; a --binary
+ *          client asks for typed messages right away (so it speaks first)
+ */
+void Worker::onConnected(SimClient& client) {
+    client.connecting = false;
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u32 = (uint32_t)(&client - clients.data());
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, client.sock, &ev);
+    if (config.binary) queueFrame(client, BINARY_COMMAND);
+}
+
+/**
+ * Function: Worker::readClient
+ * Purpose: Reads everything available and handles each complete frame
+ */
+void Worker::readClient(SimClient& client) {
+    if (config.udpPort > 0) {
+        readDatagrams(client);
+        return;
+    }
+    while (true) {
+        char* space = client.recvBuffer.prepare(RECV_CHUNK_SIZE);
+        ssize_t bytesRead = recv(client.sock, space, client.recvBuffer.writable(), 0);
+        if (bytesRead < 0 && errno == EINTR) continue;
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (bytesRead <= 0) {
+            fail(client);
+            return;
+        }
+        client.recvBuffer.commit(bytesRead);
+        if (phase >= Running) stats.bytesIn += bytesRead;  // Not the join notices
+
+        string_view payload;
+        while (!client.closed && client.recvBuffer.nextFrame(payload) == FrameStatus::Complete) {
+            handlePayload(client, payload);
+        }
+        if (client.closed) return;
+    }
+}
+
+/**
+ * Function: Worker::readDatagrams
+ * Purpose: readClient for a UDP subscriber - takes its queued datagrams a
+ *          batch at a time and notes gaps in their sequence numbers
+ */
+void Worker::readDatagrams(SimClient& client) {
+    int count;
+    while (!client.closed && (count = receiver.receive(client.sock)) > 0) {
+        for (int i = 0; i < count && !client.closed; i++) {
+            string_view datagram = receiver.datagram(i);
+            uint64_t sequence;
+            string_view payload;
+            if (!readSequence(datagram, sequence, payload)) continue;
+            client.feed.observe(sequence);
+            if (phase >= Running) stats.bytesIn += datagram.size();
+            handlePayload(client, payload);
+        }
+    }
+}
+
+/**
+ * Function: Worker::handlePayload
+ * Purpose: Records a timestamped chat message, answers a heartbeat, or
+ *          tracks the server notices that complete admission and room joins
+ */
+void Worker::handlePayload(SimClient& client, string_view payload) {
+    if (payload.empty()) {
+        queueFrame(client, payload);  // Heartbeat: answer so the server keeps the connection
+        return;
+    }
+    if (wireType(payload) != WireType::None) {
+        handleTyped(client, payload);
+        return;
+    }
+    size_t marker = payload.find(STAMP_MARKER);
+    bool chat = payload.compare(0, 8, "[Client ") == 0 || payload.compare(0, 5, "[UDP ") == 0;
+    if (marker != string_view::npos && chat) {
+        if (phase < Running) return;  // History replayed on join (--history-dir), not live traffic
+        uint64_t sentAt = strtoull(payload.data() + marker + strlen(STAMP_MARKER), nullptr, 10);
+        uint64_t now = nowNs();
+        stats.latency.record(now > sentAt ? now - sentAt : 0);
+        stats.delivered++;
+        return;
+    }
+
+    if (!client.settled && payload.compare(0, strlen(WELCOME_PREFIX), WELCOME_PREFIX) == 0) {
+        client.settled = true;
+        client.admitted = true;
+        inFlight--;
+        stats.lastAnswer = Clock::now();
+        roomSizes[client.room]++;
+        admittedCount++;
+        if (client.sender) senders.push_back(&client);
+        if (config.binary) {
+            char* end = nullptr;
+            client.id = (uint32_t)strtoul(payload.data() + strlen(WELCOME_PREFIX), &end, 10);
+            if (*end == '@') client.node = (uint32_t)strtoul(end + 1, nullptr, 10);
+        }
+    } else if (!client.settled && payload.find("server is full") != string_view::npos) {
+        client.settled = true;
+        inFlight--;
+        stats.lastAnswer = Clock::now();
+        refusedCount++;
+        client.closed = true;
+        closesocket(client.sock);
+        client.sock = INVALID_SOCKET;
+    } else if (payload.compare(0, 28, "[Server] You are now in room") == 0) {
+        joinedCount++;
+    }
+}
+
+/**
+ * Function: Worker::handleTyped
+ * Purpose: handlePayload for a typed message (--binary): a timestamped
+ *          chat message, or the Join confirming the client's own move
+ */
+void Worker::handleTyped(SimClient& client, string_view payload) {
+    WireChat chat;
+    WireJoin join;
+    if (wireDecode(payload, chat)) {
+        size_t marker = chat.text.find(STAMP_MARKER);
+        if (marker == string_view::npos || phase < Running) return;
+        uint64_t sentAt = strtoull(chat.text.data() + marker + strlen(STAMP_MARKER), nullptr, 10);
+        uint64_t now = nowNs();
+        stats.latency.record(now > sentAt ? now - sentAt : 0);
+        stats.delivered++;
+    } else if (wireDecode(payload, join) && join.client == client.id && join.node == client.node &&
+               join.room.compare(0, 2, "lg") == 0) {
+        joinedCount++;
+    }
+}
+
+/**
+ * Function: Worker::sendDue
+ * Purpose: Sends the messages that are due, pacing this worker's senders
+ *          round-robin at their combined rate
+ */
+void Worker::sendDue() {
+    if (senders.empty() || config.rate <= 0) return;
+
+    double elapsed = chrono::duration<double>(Clock::now() - runStart).count();
+    uint64_t target = (uint64_t)(elapsed * config.rate * (double)senders.size());
+    uint64_t burst = 0;
+    while (stats.sent < target && burst++ < 10000) {
+        SimClient& client = *senders[nextSender];
+        nextSender = (nextSender + 1) % senders.size();
+        if (client.closed) continue;
+
+        // "lg:<ns>:" then padding up to the configured size
+        string stamp = STAMP_MARKER + to_string(nowNs()) + ":";
+        string payload = stamp + payloadTemplate.substr(0, config.size > stamp.size() ? config.size - stamp.size() : 0);
+        queueFrame(client, payload);
+        stats.sent++;
+        stats.expected += (uint64_t)max(roomSizes[client.room].load() - 1, 0);
+    }
+}
+
+/**
+ * Function: Worker::queueFrame
+ * Purpose: Frames a payload and writes it, keeping what the socket refuses
+ */
+void Worker::queueFrame(SimClient& client, string_view payload) {
+    if (config.udpPort > 0) {
+        sendDatagram(client, payload);
+        return;
+    }
+    appendFrame(client.pending, payload);
+    if (!client.writeArmed) flush(client);
+}
+
+/**
+ * Function: Worker::sendDatagram
+ * Purpose: Sends one payload to the UDP feed with the client's next
+ *          sequence number; a datagram the socket refuses is lost, as it
+ *          would be on the network
+ */
+void Worker::sendDatagram(SimClient& client, string_view payload) {
+    unsigned char header[FEED_SEQUENCE_BYTES];
+    writeSequence(header, client.nextSequence++);
+    iovec parts[2] = {{header, FEED_SEQUENCE_BYTES}, {const_cast<char*>(payload.data()), payload.size()}};
+    msghdr message{};
+    message.msg_iov = parts;
+    message.msg_iovlen = 2;
+    ssize_t ignored = sendmsg(client.sock, &message, MSG_DONTWAIT);
+    (void)ignored;
+}
+
+/**
+ * Function: Worker::flush
+ * Purpose: Writes pending bytes; arms EPOLLOUT while some remain
+ */
+void Worker::flush(SimClient& client) {
+    while (client.pendingOffset < client.pending.size()) {
+        ssize_t sent = send(client.sock, client.pending.data() + client.pendingOffset,
+                            client.pending.size() - client.pendingOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (sent <= 0) {
+            fail(client);
+            return;
+        }
+        client.pendingOffset += sent;
+    }
+    if (client.pendingOffset == client.pending.size()) {
+        client.pending.clear();
+        client.pendingOffset = 0;
+    }
+
+    bool wantWrite = !client.pending.empty();
+    if (wantWrite != client.writeArmed && !client.connecting) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | (wantWrite ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.u32 = (uint32_t)(&client - clients.data());
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, client.sock, &ev);
+        client.writeArmed = wantWrite;
+    }
+}
+
+/**
+ * Function: Worker::fail
+ * Purpose: Closes a client after a socket error or disconnect
+ */
+void Worker::fail(SimClient& client) {
+    if (!client.settled) {
+        client.settled = true;
+        inFlight--;
+        failedCount++;
+    }
+    client.connecting = false;
+    client.closed = true;
+    if (client.sock != INVALID_SOCKET) {
+        closesocket(client.sock);
+        client.sock = INVALID_SOCKET;
+    }
+}
+
+/**
+ * Function: waitFor
+ * Purpose: Sleeps until a condition holds or the timeout passes
+ * Returns: true if the condition was met
+ */
+template <typename Predicate>
+bool waitFor(Predicate done, chrono::milliseconds timeout) {
+    auto deadline = Clock::now() + timeout;
+    while (!done()) {
+        if (Clock::now() >= deadline) return false;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    return true;
+}
+
+/**
+ * Function: raiseFileLimit
+ * Purpose: Lifts the soft descriptor limit to the hard limit - thousands of
+ *          client sockets need more than the usual 1024
+ */
+void raiseFileLimit() {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+/**
+ * Function: formatNs
+ * Purpose: Renders a latency in the most readable unit
+ */
+string formatNs(uint64_t ns) {
+    char text[32];
+    if (ns < 10000) snprintf(text, sizeof(text), "%llu ns", (unsigned long long)ns);
+    else if (ns < 10000000) snprintf(text, sizeof(text), "%.1f us", ns / 1e3);
+    else snprintf(text, sizeof(text), "%.2f ms", ns / 1e6);
+    return text;
+}
+
+/**
+ * Function: parseArguments
+ * Purpose: Fills the global configuration from command-line flags
+ * Returns: false if an argument is unknown or invalid (usage is printed)
+ */
+bool parseArguments(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const char* original = argv[i];
+        string arg = argv[i];
+        string value;
+        size_t eq = arg.find('=');
+        if (eq != string::npos) {
+            value = arg.substr(eq + 1);
+            arg = arg.substr(0, eq);
+        } else if (arg == "--binary") {
+            value = "on";  // Switches take no value
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        }
+
+        if (arg == "--host" && !value.empty()) {
+            config.host = value;
+        } else if (arg == "--port" && atoi(value.c_str()) > 0) {
+            config.port = atoi(value.c_str());
+        } else if (arg == "--clients" && atoi(value.c_str()) > 0) {
+            config.clients = atoi(value.c_str());
+        } else if (arg == "--senders" && atoi(value.c_str()) >= 0 && !value.empty()) {
+            config.senders = atoi(value.c_str());
+        } else if (arg == "--rate" && atof(value.c_str()) >= 0 && !value.empty()) {
+            config.rate = atof(value.c_str());
+        } else if (arg == "--size" && atol(value.c_str()) > 0 && (size_t)atol(value.c_str()) <= MAX_FRAME_PAYLOAD) {
+            config.size = (size_t)atol(value.c_str());
+        } else if (arg == "--duration" && atof(value.c_str()) > 0) {
+            config.duration = atof(value.c_str());
+        } else if (arg == "--rooms" && atoi(value.c_str()) > 0) {
+            config.rooms = atoi(value.c_str());
+        } else if (arg == "--threads" && atoi(value.c_str()) > 0) {
+            config.threads = atoi(value.c_str());
+        } else if (arg == "--profile" && parseSocketProfile(value, config.profile)) {
+            // Parsed in the condition
+        } else if (arg == "--udp-port" && atoi(value.c_str()) > 0) {
+            config.udpPort = atoi(value.c_str());
+        } else if (arg == "--binary") {
+            config.binary = (value != "off");
+        } else if (arg == "--connect-timeout" && atoi(value.c_str()) > 0) {
+            config.connectTimeout = atoi(value.c_str());
+        } else if (arg == "--connect-burst" && atoi(value.c_str()) > 0) {
+            config.connectBurst = atoi(value.c_str());
+        } else {
+            cerr << "[Error] Invalid argument: " << original << endl;
+            cerr << "Usage: loadgen [--host IP] [--port N] [--clients N] [--senders N]" << endl
+                 << "               [--rate MSGS_PER_SEC] [--size BYTES] [--duration SECONDS]" << endl
+                 << "               [--rooms N] [--threads N] [--profile default|low-latency|throughput]" << endl
+                 << "               [--udp-port N] [--binary] [--connect-timeout SECONDS]" << endl
+                 << "               [--connect-burst N]" << endl;
+            return false;
+        }
+    }
+
+    in_addr probe;
+    if (inet_pton(AF_INET, config.host.c_str(), &probe) != 1) {
+        cerr << "[Error] Invalid server address!" << endl;
+        return false;
+    }
+    if (config.binary && config.udpPort > 0) {
+        cerr << "[Error] --binary needs TCP clients (not --udp-port)." << endl;
+        return false;
+    }
+    // A datagram carries the sequence number, the "[UDP N]: " prefix and the payload
+    if (config.udpPort > 0 && config.size > FEED_MAX_DATAGRAM - FEED_SEQUENCE_BYTES - 32) {
+        cerr << "[Error] --size must be at most " << FEED_MAX_DATAGRAM - FEED_SEQUENCE_BYTES - 32
+             << " bytes with --udp-port." << endl;
+        return false;
+    }
+    config.senders = min(config.senders, config.clients);
+    config.threads = min(config.threads, config.clients);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (!parseArguments(argc, argv)) {
+        return 1;
+    }
+
+    cout << "==========================================" << endl;
+    cout << "  Task 2: Load Generator (Chat Benchmark) " << endl;
+    cout << "==========================================" << endl;
+
+    signal(SIGPIPE, SIG_IGN);
+    raiseFileLimit();
+    epoch = Clock::now();
+    roomSizes.reset(new atomic<int>[config.rooms]);
+    for (int i = 0; i < config.rooms; i++) roomSizes[i] = 0;
+
+    // Step 1: Connect every client (each worker owns a contiguous slice)
+    if (config.udpPort > 0) {
+        cout << "[LoadGen] Subscribing " << config.clients << " UDP clients to " << config.host << ":"
+             << config.udpPort << " from " << config.threads << " threads..." << endl;
+    } else {
+        cout << "[LoadGen] Connecting " << config.clients << " clients to " << config.host << ":"
+             << config.port << " from " << config.threads << " threads (socket profile "
+             << socketProfileName(config.profile) << ")..." << endl;
+    }
+    vector<unique_ptr<Worker>> workers;
+    vector<thread> threads;
+    int first = 0;
+    for (int i = 0; i < config.threads; i++) {
+        int count = config.clients / config.threads + (i < config.clients % config.threads ? 1 : 0);
+        workers.emplace_back(new Worker(first, count));
+        first += count;
+    }
+    auto connectStart = Clock::now();
+    for (auto& worker : workers) {
+        Worker* w = worker.get();
+        threads.emplace_back([w] { w->run(); });
+    }
+
+    bool allConnected = waitFor([] {
+        return admittedCount + refusedCount + failedCount >= config.clients;
+    }, chrono::seconds(config.connectTimeout));
+    int admitted = admittedCount;
+    if (!allConnected) {
+        cerr << "[LoadGen] Timed out with " << admitted << " of " << config.clients << " clients admitted." << endl;
+    }
+    if (admitted == 0) {
+        cerr << "[Error] No client was admitted. Is the server running (with a large enough --max-clients)?" << endl;
+        phase = Done;
+        for (thread& t : threads) t.join();
+        return 1;
+    }
+
+    // Step 2: Spread the clients over the rooms
+    if (config.rooms > 1) {
+        phase = Joining;
+        if (!waitFor([admitted] { return joinedCount >= admitted; }, chrono::seconds(config.connectTimeout))) {
+            cerr << "[LoadGen] Only " << joinedCount << " of " << admitted << " clients joined their room." << endl;
+        }
+    }
+
+    // Step 3: Send for the configured duration, then let the fan-out drain
+    cout << "[LoadGen] Sending for " << config.duration << " s..." << endl;
+    runStart = Clock::now();
+    phase = Running;
+    this_thread::sleep_for(chrono::duration<double>(config.duration));
+    phase = Draining;
+    this_thread::sleep_for(chrono::milliseconds(DRAIN_MILLISECONDS));
+    phase = Done;
+    for (thread& t : threads) t.join();
+
+    // Step 4: Report
+    WorkerStats total;
+    Clock::time_point lastAnswer = connectStart;
+    for (auto& worker : workers) {
+        total.sent += worker->stats.sent;
+        total.expected += worker->stats.expected;
+        total.delivered += worker->stats.delivered;
+        total.bytesIn += worker->stats.bytesIn;
+        total.lost += worker->stats.lost;
+        total.latency.merge(worker->stats.latency);
+        lastAnswer = max(lastAnswer, worker->stats.lastAnswer);
+    }
+    double connectSeconds = chrono::duration<double>(lastAnswer - connectStart).count();
+    int answered = admitted + refusedCount;  // A refusal costs the server an accept too
+    double runSeconds = config.duration;
+
+    cout << fixed << setprecision(1);
+    cout << "------------------------------------------" << endl;
+    cout << "[LoadGen] Connections: " << admitted << " admitted, " << refusedCount << " refused, "
+         << failedCount << " failed in " << setprecision(3) << connectSeconds << " s ("
+         << setprecision(0) << (connectSeconds > 0 ? answered / connectSeconds : 0) << " conn/s)" << endl;
+    cout << setprecision(0);
+    cout << "[LoadGen] Sent:        " << total.sent << " messages of " << config.size << " bytes ("
+         << total.sent / runSeconds << " msg/s)" << endl;
+    cout << "[LoadGen] Delivered:   " << total.delivered << " of " << total.expected << " expected ("
+         << total.delivered / runSeconds << " msg/s, " << setprecision(1)
+         << total.bytesIn / runSeconds / (1024 * 1024) << " MiB/s in)" << endl;
+    if (config.udpPort > 0) {
+        cout << "[LoadGen] Lost:        " << total.lost << " datagrams by sequence gaps ("
+             << setprecision(2) << 100.0 * total.lost / max<uint64_t>(total.delivered + total.lost, 1)
+             << "%)" << endl;
+    }
+    cout << "[LoadGen] Fan-out latency: p50 " << formatNs(total.latency.percentile(0.50))
+         << "  p99 " << formatNs(total.latency.percentile(0.99))
+         << "  p999 " << formatNs(total.latency.percentile(0.999))
+         << "  max " << formatNs(total.latency.max()) << endl;
+    return 0;
+}
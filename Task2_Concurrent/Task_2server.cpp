@@ -3,10 +3,71 @@
  * 
  * This server handles MULTIPLE client connections simultaneously using threads.
  * Each client gets its own thread for communication, allowing concurrent access.
- * Messages from any client are broadcast to all other connected clients.
+ * Messages from any client are broadcast to the other clients in the same
+ * chat room ("/join <room>" switches rooms, see room_index.h).
+ * Every message on the wire is length-prefixed (see common/framing.h).
+ * 
+ * On Linux the server can alternatively run as a single-threaded epoll
+ * reactor (--mode epoll) that multiplexes every client socket on one loop
+ * instead of spawning a thread per connection, or as the same loop driven
+ * by io_uring (--mode uring, Linux 6.0+, falls back to epoll otherwise),
+ * which batches a whole broadcast fan-out into one system call. The
+ * classic alternatives run the same server too: --mode iterative serves
+ * one client at a time, --mode pool a fixed set of threads that each serve
+ * one client at a time, and --mode prefork (Linux) forks worker processes
+ * that share the listener, each an epoll server clustered with the others
+ * (compare_models.sh runs the same load against every mode). --mode coro
+ * (Linux, C++20) writes each client's handler as a coroutine: one thread
+ * resumes them all from epoll, and an idle client costs two coroutine
+ * frames instead of two threads (see coro_socket.h).
  * 
  * Compile (Windows): g++ -o server.exe server.cpp -lws2_32
  * Compile (Linux):   g++ -o server server.cpp -pthread
+ *                    (add -std=c++20 for --mode coro)
+ * 
+ * Usage: server [--mode threads|iterative|pool|prefork|coro|epoll|uring]
+ *               [--pool-threads N] [--processes N] [--port N] [--max-clients N]
+ *               [--queue-limit BYTES] [--slow-policy drop|disconnect]
+ *               [--batch-bytes N] [--batch-iov N] [--cork] [--flush-deadline-us N]
+ *               [--shards N] [--stats-port N]
+ *               [--log-level error|warning|info|debug] [--log-sample N]
+ *               [--history-dir DIR] [--history-count N] [--history-seconds S]
+ *               [--history-sync-ms N] [--profile default|low-latency|throughput]
+ *               [--unix-socket PATH] [--udp-port N] [--udp-timeout SECONDS]
+ *               [--node-id N] [--peer-port N] [--peers HOST:PORT,...]
+ *               [--restart-socket PATH] [--workers N|auto]
+ *               [--heartbeat S] [--read-timeout S] [--idle-timeout S]
+ *               [--write-timeout S] [--backlog N] [--defer-accept S]
+ *               [--acceptors N]
+ * 
+ * Live counters and latency histograms are printed by the console command
+ * "stats" and served as text on 127.0.0.1:<stats-port> (see server_stats.h).
+ * Per-client console output is written by a background thread from
+ * per-thread rings, so logging never blocks a client (see async_log.h).
+ * With --history-dir, chat messages are also appended to an on-disk log and
+ * a client entering a room is sent its recent messages (see message_log.h).
+ * --profile tunes every socket for latency or for throughput (see
+ * common/socket_profile.h). With --unix-socket, clients on the same host
+ * can also connect through a Unix domain socket, and from there switch to
+ * shared-memory rings (see shm_transport.h). With --udp-port, a lossy UDP
+ * feed with its own subscribers runs next to the TCP chat, receiving and
+ * fanning out datagrams in batches (see udp_feed.h). With --peer-port and
+ * --peers, several servers form a cluster that relays room messages
+ * between them, so clients of any node share the rooms (see federation.h).
+ * With --restart-socket, a new server binary started with the same flag
+ * takes the running one's listener and client connections over, so a
+ * restart costs the clients nothing (see hot_restart.h). With --workers,
+ * the threads mode's handler threads only read and a work-stealing pool of
+ * N threads processes the messages (see work_pool.h). Silent clients are
+ * sent heartbeats, and connections that miss their read, idle or write
+ * deadline are closed; all of a mode's timers share one timing wheel per
+ * thread that runs them (see timer_wheel.h). A client that sends "/binary"
+ * is sent typed binary messages (chat, join, leave, notice, error) instead
+ * of text (see binary_protocol.h). For reconnect storms, --backlog sizes
+ * the listen queue, --defer-accept leaves connections in the kernel until
+ * they send, and --acceptors N has N threads accept in threads mode; an
+ * acceptor only counts the connection and starts its thread, which does
+ * the rest of the admission.
  * 
  * Course: 23CSE312 - Distributed Systems
  * Lab: Socket Programming (Concurrent Chat Application)
@@ -21,22 +82,68 @@
 #else
     // Linux/Unix-specific headers for socket programming
     #include <sys/socket.h>
+    #include <sys/uio.h>
     #include <netinet/in.h>
     #include <arpa/inet.h>
     #include <unistd.h>
+    #include <fcntl.h>
+    #include <cerrno>
+    #include <csignal>
     #define SOCKET int
     #define INVALID_SOCKET -1
     #define SOCKET_ERROR -1
     #define closesocket close
 #endif
 
+#ifdef _WIN32
+    #define MSG_NOSIGNAL 0        // Windows never raises SIGPIPE
+    #define MSG_DONTWAIT 0        // Only used for notices a new socket's buffer always takes
+    #define SHUT_RDWR SD_BOTH
+#endif
+
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
 #include <thread>
 #include <vector>
 #include <mutex>
+#include <condition_variable>
+#include <memory>
 #include <atomic>
+#include <chrono>
 #include <algorithm>
+#include <string>
+
+#include "../common/framing.h"
+#include "../common/socket_profile.h"
+#include "message_pool.h"
+#include "binary_protocol.h"
+#include "outbound_queue.h"
+#include "room_index.h"
+#include "server_stats.h"
+#include "async_log.h"
+#include "client_registry.h"
+#include "federation.h"
+#include "work_pool.h"
+#include "timer_wheel.h"
+
+#ifdef __linux__
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <sys/un.h>
+    #include <sys/stat.h>
+    #include <sys/wait.h>
+    #include <sys/prctl.h>
+    #include <poll.h>
+    #include <unordered_map>
+    #include "io_uring.h"
+    #include "spsc_ring.h"
+    #include "message_log.h"
+    #include "shm_transport.h"
+    #include "udp_feed.h"
+    #include "hot_restart.h"
+    #include "coro_socket.h"
+#endif
 
 using namespace std;
 
@@ -44,257 +151,5343 @@ using namespace std;
 const int PORT = 8080;
 const int MAX_CLIENTS = 10;
 
+// Concurrency model selected at startup
+enum class ServerMode {
+    Threads,        // A handler thread per client
+    Epoll,          // Non-blocking event loop(s)
+    Uring,          // The event loop driven by io_uring
+    Iterative,      // One client at a time on the accepting thread
+    Pool,           // A fixed set of threads, each serving one client at a time
+    Prefork,        // Worker processes sharing the listener, each an epoll loop
+    Coro            // A coroutine per client, resumed by one epoll loop
+};
+
+struct ServerConfig {
+    ServerMode mode = ServerMode::Threads;
+    int port = PORT;
+    int maxClients = MAX_CLIENTS;
+    OutboundLimits outbound;        // Per-client send queue bound and policy
+    BatchLimits batch;              // Bytes/messages per gather write
+    bool cork = false;              // Hold writes until a batch fills or the deadline passes
+    int flushDeadlineUs = 1000;     // Longest a queued message waits in cork mode
+    int shards = 1;                 // Event loops sharing the port via SO_REUSEPORT
+    int statsPort = 0;              // Local text stats endpoint (0 = off)
+    LogLevel logLevel = LogLevel::Info;
+    unsigned logSample = 1;         // Log one in every N chat messages
+    string historyDir;              // Message log directory (empty = no history)
+    int historyCount = 20;          // Messages replayed to a client entering a room
+    int historySeconds = 0;         // ... no older than this (0 = any age)
+    int historySyncMs = 200;        // Longest logged messages stay unsynced
+    SocketProfile profile = SocketProfile::Default;  // TCP options for every socket
+    string unixSocket;              // Path of the local listener (empty = none)
+    int udpPort = 0;                // UDP feed port (0 = off)
+    int udpTimeout = 30;            // Seconds a silent UDP subscriber stays registered
+    int nodeId = 0;                 // This server's ID in a cluster (0 = the port)
+    int peerPort = 0;               // Port for links from other nodes (0 = not clustered)
+    vector<pair<string, int>> peers;  // Nodes this one relays to
+    string restartSocket;           // Hand-over socket for hot restarts (empty = none)
+    unsigned workers = 0;           // Message processing threads in threads mode (0 = the handler threads)
+    int heartbeat = 15;             // Seconds of client silence before a heartbeat is sent (0 = never)
+    int readTimeout = 45;           // Seconds without any frame, heartbeat answers included (0 = no limit)
+    int idleTimeout = 0;            // Seconds without a chat message or command (0 = no limit)
+    int writeTimeout = 0;           // Seconds queued output may wait without any of it being taken (0 = no limit)
+    int poolThreads = 8;            // Serving threads in pool mode
+    int processes = 4;              // Worker processes in prefork mode
+    int backlog = 4096;             // Listen queue for connections not yet accepted (capped by net.core.somaxconn)
+    int deferAccept = 0;            // Seconds TCP_DEFER_ACCEPT waits for a client's first bytes (0 = off)
+    int acceptors = 1;              // Threads accepting connections in threads mode
+};
+
+ServerConfig config;                // Runtime configuration (from command line)
+
+int preforkWorker = 0;              // This process's number among the prefork workers (0 = not one)
+
+// The models in which clients are served by blocking handler threads
+inline bool threadedMode() {
+    return config.mode == ServerMode::Threads || config.mode == ServerMode::Iterative ||
+           config.mode == ServerMode::Pool;
+}
+
+// The models whose clients are ClientConnections in clientRegistry
+inline bool registryMode() {
+    return threadedMode() || config.mode == ServerMode::Coro;
+}
+
+const char* const ROOM_USAGE = "[Server] Usage: /join <room> (up to 15 letters, digits, '-' or '_'), "
+                               "or /leave to return to the lobby.";
+const char* const UNSUPPORTED_MESSAGE = "[Server] Clients can only send Chat, Join and Leave messages.";
+// Longest "[Client N@node]: " prefix: both numbers are ints (up to 11 characters)
+const size_t MAX_PREFIX_SIZE = sizeof("[Client @]: ") - 1 + 2 * 11;
+// Longest chat message: with its prefix, or in a relay frame (room, no typed
+// copy at this size), it still fits into MAX_FRAME_PAYLOAD
+const size_t MAX_CHAT_PAYLOAD = MAX_FRAME_PAYLOAD - MAX_PREFIX_SIZE - RELAY_HEADER_SIZE - MAX_ROOM_NAME;
+static_assert(MAX_PREFIX_SIZE >= WireLayout<WireChat>::headerSize + MAX_ROOM_NAME,
+              "The typed Chat encoding must fit wherever the prefixed text does");
+
 // Thread-safe client list management
-vector<SOCKET> clientSockets;      // List of connected client sockets
-mutex clientMutex;                  // Mutex for thread-safe access to client list
+/**
+ * Struct: ClientConnection
+ * Purpose: Per-client state shared by the client's reader and writer threads
+ *          (or coroutines, in coro mode)
+ * 
+ * Broadcasters only append to the outbound queue; the client's own writer
+ * thread performs the (blocking) sends, so a client with a full socket
+ * buffer stalls nobody but itself.
+ */
+struct ClientConnection {
+    SOCKET sock;
+    int id;
+    string ip;
+    string prefix;                  // "[Client N]: ", formatted once
+    mutex queueMutex;               // Guards outbound and closing
+    condition_variable queueReady;  // Wakes the writer thread
+    OutboundQueue outbound;         // Frames waiting to be sent
+    bool closing = false;           // Writer drains what is queued, then stops
+    SlotHandle handle;              // Slot in clientRegistry
+    int64_t joinedAt = 0;           // When it entered its room (history before this is replayed)
+    SharedRoom<ClientConnection>* room = nullptr;  // Changed only by whoever processes its messages
+    size_t roomSlot = 0;            // Its slot in room (SharedRoomIndex)
+    atomic<bool> binary{false};     // Sent BINARY_COMMAND: gets the typed encodings queued
+    TimerNode<ClientConnection> timer;  // Its deadlines (in connectionTimers)
+    atomic<uint64_t> heard{0};      // Timer ticks: last frame of any kind (handler thread)
+    atomic<uint64_t> spoke{0};      // ... last frame other than a heartbeat answer
+    atomic<uint64_t> writing{0};    // ... start of the send in progress, 0 if none (writer thread)
+    uint64_t pinged = 0;            // ... last heartbeat sent (timer thread)
+    mutex workMutex;                // Guards pendingWork, workReceived and workScheduled (--workers)
+    condition_variable workIdle;    // Backlog shrank, or the last task finished
+    string pendingWork;             // Received frames not yet taken by a work task
+    string workBatch;               // What the running work task took
+    chrono::steady_clock::time_point workReceived;  // When the oldest pending frame arrived
+    bool workScheduled = false;     // A work task for this client is queued or running
+#ifdef __linux__
+    unique_ptr<ShmChannel> shm;     // Shared-memory transport (local clients that asked for it)
+#endif
+#ifdef CORO_SOCKETS
+    CoroEvent outputReady;          // Wakes its writer coroutine instead (coro mode)
+#endif
+};
+
+/**
+ * Function: wakeWriter
+ * Purpose: Tells whoever writes a client's output that it has more, or
+ *          that the connection is closing: its writer thread or coroutine
+ */
+inline void wakeWriter(ClientConnection& conn) {
+#ifdef CORO_SOCKETS
+    if (conn.outputReady.attached()) {
+        conn.outputReady.set();
+        return;
+    }
+#endif
+    conn.queueReady.notify_one();
+}
+
+// Threads mode: read lock-free by broadcasters (see client_registry.h)
+SlotRegistry<ClientConnection> clientRegistry;   // Connected clients
+SharedRoomIndex<ClientConnection> sharedRooms;   // Room -> members
 atomic<bool> serverRunning(true);   // Flag to control server shutdown
 atomic<int> clientCount(0);         // Number of connected clients
+const chrono::steady_clock::time_point serverStart = chrono::steady_clock::now();
+
+#ifdef __linux__
+MessageLog history;                 // On-disk chat history (--history-dir)
+#endif
+
+// Cluster (--peer-port/--peers, see federation.h)
+string nodeTag;                     // "@<node-id>" after client IDs when clustered, else ""
+vector<unique_ptr<PeerLink>> peerLinks;   // One dialled link per peer
+mutex relayMutex;                   // Makes sequence order the order on every link
+uint64_t relaySequence = 0;         // Last sequence number relayed (guarded by relayMutex)
+uint64_t nodeIncarnation = 0;       // Start time, tells peers this run from an earlier one
+
+atomic<int> binaryClients(0);       // Connections that asked for typed messages (BINARY_COMMAND)
 
 /**
- * Function: broadcastMessage
- * Purpose: Sends a message to all connected clients except the sender
- * Parameters: 
- *   - message: The message to broadcast
- *   - senderSocket: Socket of the sender (excluded from broadcast)
+ * Function: wireNode
+ * Purpose: The node field of this server's typed messages (0 when alone)
+ */
+uint32_t wireNode() {
+    return nodeTag.empty() ? 0 : (uint32_t)config.nodeId;
+}
+
+/**
+ * Function: typedMessage
+ * Purpose: Attaches the typed encoding of a message (binary_protocol.h) to
+ *          its text, for the recipients that asked for typed messages
  * 
- * This function is thread-safe and broadcasts messages to all clients.
+ * Skipped while nobody here has asked and there are no peers (whose
+ * clients might have), so text-only servers do not pay for it.
  */
-void broadcastMessage(const string& message, SOCKET senderSocket) {
-    lock_guard<mutex> lock(clientMutex);  // Acquire lock for thread safety
-    
-    for (SOCKET sock : clientSockets) {
-        if (sock != senderSocket) {  // Don't send to the original sender
-            send(sock, message.c_str(), message.length(), 0);
+template <typename T>
+MessageRef typedMessage(MessageRef text, const T& typed) {
+    if (binaryClients.load(memory_order_relaxed) > 0 || !peerLinks.empty()) {
+        text.attachTyped(makeTypedMessage(typed));
+    }
+    return text;
+}
+
+/**
+ * Function: serverNotice
+ * Purpose: typedMessage for a "[Server] ..." text: a Notice with the text
+ *          after the prefix
+ */
+MessageRef serverNotice(MessageRef text) {
+    string_view body = text.payload();
+    if (body.compare(0, 9, "[Server] ") == 0) body.remove_prefix(9);
+    return typedMessage(move(text), WireNotice{body});
+}
+
+/**
+ * Function: serverError
+ * Purpose: serverNotice for a refused request: an Error with `code`
+ */
+MessageRef serverError(uint16_t code, MessageRef text) {
+    string_view body = text.payload();
+    if (body.compare(0, 9, "[Server] ") == 0) body.remove_prefix(9);
+    return typedMessage(move(text), WireError{code, body});
+}
+
+/**
+ * Function: parseRequest
+ * Purpose: parseRoomCommand for a client that may send typed messages
+ * Parameters:
+ *   - payload: The frame's payload; a typed Chat is replaced by its text
+ *   - binary: The client switched to typed messages (only they are read)
+ *   - command: Receives the room command, or None for a chat message
+ *   - target: Receives the room to move to
+ * Returns: false for a typed message clients may not send, or a malformed one
+ */
+bool parseRequest(string_view& payload, bool binary, RoomCommand& command, string& target) {
+    WireType type = binary ? wireType(payload) : WireType::None;
+    if (type == WireType::None) {
+        command = parseRoomCommand(payload, target);
+        return true;
+    }
+    if (type == WireType::Chat) {
+        WireChat chat;
+        if (!wireDecode(payload, chat)) return false;
+        payload = chat.text;
+        command = RoomCommand::None;
+        return true;
+    }
+    if (type == WireType::Join) {
+        WireJoin join;
+        if (!wireDecode(payload, join)) return false;
+        command = validRoomName(join.room) ? RoomCommand::Join : RoomCommand::Invalid;
+        target.assign(join.room.data(), join.room.size());
+        return true;
+    }
+    WireLeave leave;
+    if (type != WireType::Leave || !wireDecode(payload, leave)) return false;
+    command = RoomCommand::Leave;
+    target = DEFAULT_ROOM;
+    return true;
+}
+
+/**
+ * Function: historyClock
+ * Purpose: Current time on the message log's clock (see joinedAt)
+ */
+int64_t historyClock() {
+#ifdef __linux__
+    return MessageLog::now();
+#else
+    return 0;
+#endif
+}
+
+const int TIMER_TICK_MS = 10;       // Resolution of the connection deadlines
+
+/**
+ * Function: timerTick
+ * Purpose: The clock of the connection timer wheels - ticks since the
+ *          server started, counting from 1 (0 means "never")
+ */
+uint64_t timerTick(chrono::steady_clock::time_point at = chrono::steady_clock::now()) {
+    return (uint64_t)(chrono::duration_cast<chrono::milliseconds>(at - serverStart).count() / TIMER_TICK_MS) + 1;
+}
+
+uint64_t secondsToTicks(int seconds) {
+    return (uint64_t)seconds * 1000 / TIMER_TICK_MS;
+}
+
+bool deadlinesEnabled() {
+    return config.heartbeat > 0 || config.readTimeout > 0 || config.idleTimeout > 0 || config.writeTimeout > 0;
+}
+
+/**
+ * Struct: ConnectionTimes
+ * Purpose: What one connection's deadlines are measured from, in ticks
+ */
+struct ConnectionTimes {
+    uint64_t heard = 0;     // Last frame of any kind, heartbeat answers included
+    uint64_t spoke = 0;     // Last frame that was not a heartbeat answer
+    uint64_t pinged = 0;    // Last heartbeat sent
+    uint64_t writing = 0;   // Since when output has waited without progress (0 = none waiting)
+};
+
+enum class DeadlineAction { None, Heartbeat, Close };
+
+/**
+ * Function: checkDeadlines
+ * Purpose: Decides what a connection's timer does when it fires
+ * Parameters:
+ *   - now: Current tick
+ *   - times: The connection's activity
+ *   - next: Set to the tick at which to check again (unless closing)
+ *   - reason: Set to why the connection is to be closed
+ * Returns: Close, Heartbeat (the caller sends one and sets pinged), or None
+ * 
+ * A heartbeat is an empty frame, which every client answers with an
+ * empty frame (see chat_client.h). It goes out after --heartbeat seconds
+ * without a frame from the client, and again every --heartbeat seconds
+ * while the client stays silent, so a connection whose peer vanished
+ * without a FIN runs into --read-timeout. The write deadline counts from
+ * the moment queued output stopped moving, so a client with a dead
+ * receive window is found even when no heartbeat can get through.
+ */
+DeadlineAction checkDeadlines(uint64_t now, const ConnectionTimes& times, uint64_t& next, const char*& reason) {
+    uint64_t heartbeat = secondsToTicks(config.heartbeat);
+    uint64_t readLimit = secondsToTicks(config.readTimeout);
+    uint64_t idleLimit = secondsToTicks(config.idleTimeout);
+    uint64_t writeLimit = secondsToTicks(config.writeTimeout);
+
+    if (readLimit > 0 && now >= times.heard + readLimit) {
+        reason = "nothing received";
+        return DeadlineAction::Close;
+    }
+    if (idleLimit > 0 && now >= times.spoke + idleLimit) {
+        reason = "idle";
+        return DeadlineAction::Close;
+    }
+    if (writeLimit > 0 && times.writing > 0 && now >= times.writing + writeLimit) {
+        reason = "output not taken";
+        return DeadlineAction::Close;
+    }
+
+    DeadlineAction action = DeadlineAction::None;
+    next = UINT64_MAX;
+    if (heartbeat > 0) {
+        uint64_t last = max(times.heard, times.pinged);
+        if (now >= last + heartbeat) {
+            action = DeadlineAction::Heartbeat;
+            last = now;
         }
+        next = min(next, last + heartbeat);
     }
+    if (readLimit > 0) next = min(next, times.heard + readLimit);
+    if (idleLimit > 0) next = min(next, times.spoke + idleLimit);
+    if (writeLimit > 0) next = min(next, (times.writing > 0 ? times.writing : now) + writeLimit);
+    return action;
 }
 
 /**
- * Function: removeClient
- * Purpose: Removes a client from the list of connected clients
- * Parameters: sock - Socket of the client to remove
+ * Function: reportTimeout
+ * Purpose: Logs and counts a connection closed by checkDeadlines
+ */
+void reportTimeout(int id, const char* reason) {
+    threadStats().add(StatTimeouts);
+    logLine(LogLevel::Warning, {"[Server] Client ", NumberText(id), " timed out (", reason, "); disconnecting."});
+}
+
+/**
+ * Function: recordHistory
+ * Purpose: Appends a broadcast chat message to the history log, if enabled
+ * Parameters:
+ *   - message: The message as broadcast
+ *   - room: Room it was sent to, or "" for every room (console messages)
+ */
+void recordHistory(const MessageRef& message, const string& room) {
+#ifdef __linux__
+    if (history.isOpen()) history.append(message, room);
+#else
+    (void)message;
+    (void)room;
+#endif
+}
+
+/**
+ * Function: relayToPeers
+ * Purpose: Sends a message that originated on this node to every peer
+ * Parameters:
+ *   - message: The message as broadcast locally
+ *   - room: Its room, or "" for every room (console messages)
+ *   - chat: true for chat messages (peers add them to their history),
+ *           false for notices
  * 
- * This function is thread-safe and updates the client list.
+ * Only appends to each link's buffer; the links' threads do the writing.
+ * The sequence number is assigned and the frame queued under one lock,
+ * so every link carries the messages in sequence order.
  */
-void removeClient(SOCKET sock) {
-    lock_guard<mutex> lock(clientMutex);  // Acquire lock for thread safety
-    
-    auto it = find(clientSockets.begin(), clientSockets.end(), sock);
-    if (it != clientSockets.end()) {
-        clientSockets.erase(it);
-        clientCount--;
+void relayToPeers(const MessageRef& message, const string& room, bool chat) {
+    if (peerLinks.empty()) return;
+    thread_local string frame;
+    RelayMessage relay;
+    relay.origin = (uint32_t)config.nodeId;
+    relay.incarnation = nodeIncarnation;
+    relay.flags = chat ? RELAY_CHAT : 0;
+    relay.room = room;
+    relay.text = message.payload();
+    MessageRef typed = message.typed();
+    if (message.hasTyped() && typed.payload().size() <= 0xFFFF) {
+        relay.typed = typed.payload();  // Longer ones reach the peers' binary clients as text
     }
-    closesocket(sock);
+
+    ThreadStats& stats = threadStats();
+    lock_guard<mutex> lock(relayMutex);
+    relay.sequence = ++relaySequence;
+    frame.clear();
+    appendRelay(frame, relay);
+    for (auto& link : peerLinks) {
+        if (!link->enqueue(frame)) stats.add(StatRelayDropped);
+    }
+    stats.add(StatRelayedOut);
 }
 
 /**
- * Function: handleClient
- * Purpose: Handles communication with a single client (runs in separate thread)
- * Parameters: 
- *   - clientSocket: Socket for this client
- *   - clientId: Unique identifier for this client
- *   - clientIP: IP address of the client
+ * Function: recentHistory
+ * Purpose: Looks up what was said in a room before a client entered it
+ * Parameters:
+ *   - room: The room entered
+ *   - joinedAt: historyClock() just before the client joined
+ *   - notice: Receives a header line announcing the replay
+ *   - messages: Receives the messages, back to back in one block
+ * Returns: false if history is off or the room has none
+ */
+bool recentHistory(const string& room, int64_t joinedAt, MessageRef& notice, MessageRef& messages) {
+#ifdef __linux__
+    if (!history.isOpen()) return false;
+    size_t count;
+    messages = history.replay(room, (size_t)config.historyCount, config.historySeconds * 1000000000LL,
+                              joinedAt, config.outbound.highWaterBytes / 2, count);
+    if (count == 0) return false;
+    notice = serverNotice(makeMessage({"[Server] Earlier messages in room ", room, " (",
+                                       NumberText((long long)count), "):"}));
+    return true;
+#else
+    (void)room;
+    (void)joinedAt;
+    (void)notice;
+    (void)messages;
+    return false;
+#endif
+}
+
+/**
+ * Function: elapsedNs
+ * Purpose: Nanoseconds from `since` until now (for the latency histograms)
+ */
+uint64_t elapsedNs(chrono::steady_clock::time_point since) {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - since).count();
+}
+
+/**
+ * Function: sendAll
+ * Purpose: Blocking send that retries until every byte has been written
+ * Returns: false if the connection failed part-way
  * 
- * This function runs in its own thread, handling all messages from one client.
- * It receives messages and broadcasts them to all other connected clients.
+ * send() may accept only part of the buffer; the rest must be resent or the
+ * receiver sees a truncated frame.
  */
-void handleClient(SOCKET clientSocket, int clientId, string clientIP) {
-    char buffer[1024];
-    string welcomeMsg = "[Server] Client " + to_string(clientId) + " (" + clientIP + ") joined the chat!";
-    
-    // Notify all clients about the new connection
-    broadcastMessage(welcomeMsg, clientSocket);
-    cout << welcomeMsg << endl;
-    
-    // Send welcome message to the new client
-    string personalWelcome = "[Server] Welcome! You are Client " + to_string(clientId) + 
-                             ". There are " + to_string(clientCount.load()) + " clients connected.";
-    send(clientSocket, personalWelcome.c_str(), personalWelcome.length(), 0);
-    
-    // Main message handling loop for this client
-    while (serverRunning) {
-        memset(buffer, 0, sizeof(buffer));  // Clear buffer
-        
-        // Receive message from client
-        int bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-        
-        if (bytesRead <= 0) {
-            // Client disconnected
-            string disconnectMsg = "[Server] Client " + to_string(clientId) + " (" + clientIP + ") left the chat.";
-            cout << disconnectMsg << endl;
-            broadcastMessage(disconnectMsg, clientSocket);
-            break;
+bool sendAll(SOCKET sock, const char* data, size_t length) {
+    ThreadStats& stats = threadStats();
+    while (length > 0) {
+        int sent = send(sock, data, (int)length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+#ifndef _WIN32
+            if (sent < 0 && errno == EINTR) continue;
+#endif
+            return false;
         }
-        
-        buffer[bytesRead] = '\0';  // Null-terminate
-        
-        // Format message with client identifier
-        string message = "[Client " + to_string(clientId) + "]: " + string(buffer);
-        cout << message << endl;  // Display on server console
-        
-        // Broadcast message to all other clients
-        broadcastMessage(message, clientSocket);
+        stats.add(StatWrites);
+        if ((size_t)sent < length) stats.add(StatPartialWrites);
+        data += sent;
+        length -= sent;
     }
-    
-    // Clean up - remove client from list
-    removeClient(clientSocket);
+    return true;
 }
 
 /**
- * Function: serverConsole
- * Purpose: Handles server-side input for broadcasting messages to all clients
+ * Function: sendBatch
+ * Purpose: Writes several messages with one gather write (writev-style)
+ * Parameters:
+ *   - sock: Destination socket (blocking)
+ *   - batch: Messages to send, in order
+ *   - count: Number of messages
+ * Returns: false if the connection failed part-way
  * 
- * This function runs in a separate thread and allows the server operator
- * to send messages to all connected clients. Type "quit" to shutdown server.
+ * A short write resumes mid-message, so frames are never truncated.
  */
-void serverConsole() {
-    char buffer[1024];
-    
-    cout << "[Server] Server console ready. Type messages to broadcast, or 'quit' to shutdown." << endl;
+bool sendBatch(SOCKET sock, const MessageRef* batch, size_t count) {
+#ifdef _WIN32
+    for (size_t i = 0; i < count; i++) {
+        if (!sendAll(sock, batch[i].frame().data(), batch[i].size())) return false;
+    }
+    return true;
+#else
+    iovec iov[MAX_BATCH_SLICES];
+    for (size_t i = 0; i < count; i++) {
+        iov[i].iov_base = (void*)batch[i].frame().data();
+        iov[i].iov_len = batch[i].size();
+    }
     
-    while (serverRunning) {
-        cin.getline(buffer, sizeof(buffer));
+    ThreadStats& stats = threadStats();
+    size_t first = 0;
+    while (first < count) {
+        msghdr msg{};
+        msg.msg_iov = iov + first;
+        msg.msg_iovlen = count - first;
+        ssize_t sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        stats.add(StatWrites);
         
-        if (strcmp(buffer, "quit") == 0) {
-            cout << "[Server] Shutting down server..." << endl;
-            serverRunning = false;
-            
-            // Notify all clients about server shutdown
-            string shutdownMsg = "[Server] Server is shutting down. Goodbye!";
-            lock_guard<mutex> lock(clientMutex);
-            for (SOCKET sock : clientSockets) {
-                send(sock, shutdownMsg.c_str(), shutdownMsg.length(), 0);
-                closesocket(sock);
-            }
-            clientSockets.clear();
-            break;
+        // Skip fully written messages; trim a partially written one
+        size_t remaining = (size_t)sent;
+        while (first < count && remaining >= iov[first].iov_len) {
+            remaining -= iov[first].iov_len;
+            first++;
         }
-        
-        if (strlen(buffer) > 0) {
-            string serverMsg = "[Server]: " + string(buffer);
-            cout << serverMsg << endl;
-            
-            // Broadcast to all clients
-            lock_guard<mutex> lock(clientMutex);
-            for (SOCKET sock : clientSockets) {
-                send(sock, serverMsg.c_str(), serverMsg.length(), 0);
-            }
+        if (remaining > 0) {
+            iov[first].iov_base = (char*)iov[first].iov_base + remaining;
+            iov[first].iov_len -= remaining;
         }
+        if (first < count) stats.add(StatPartialWrites);
     }
+    return true;
+#endif
 }
 
-int main() {
-    cout << "==========================================" << endl;
-    cout << "  Task 2: Concurrent Server (Multi-Chat) " << endl;
-    cout << "==========================================" << endl;
-    
-#ifdef _WIN32
-    // Initialize Winsock (Windows only)
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        cerr << "[Error] WSAStartup failed!" << endl;
-        return 1;
+/**
+ * Function: enqueueFrame
+ * Purpose: Queues a framed message for one client and wakes its writer
+ * Parameters:
+ *   - conn: Recipient
+ *   - frame: Shared pooled message (the queue keeps a reference, not a copy)
+ * 
+ * Never blocks on the network. If the client's queue overflows under the
+ * Disconnect policy the socket is shut down, which ends both its threads.
+ */
+void enqueueFrame(ClientConnection& conn, const MessageRef& frame) {
+    EnqueueResult result;
+    size_t depth;
+    {
+        lock_guard<mutex> lock(conn.queueMutex);
+        if (conn.closing) return;
+        result = conn.outbound.push(conn.binary ? frame.typed() : frame, config.outbound);
+        depth = conn.outbound.depth();
+        if (result == EnqueueResult::Overflow) {
+            conn.closing = true;
+        }
     }
-    cout << "[Server] Winsock initialized successfully." << endl;
-#endif
 
-    // Step 1: Create a TCP socket
-    SOCKET serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (serverSocket == INVALID_SOCKET) {
-        cerr << "[Error] Failed to create socket!" << endl;
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return 1;
+    ThreadStats& stats = threadStats();
+    stats.queueDepth.record(depth);
+    if (result == EnqueueResult::DroppedOldest) {
+        stats.add(StatDropped);
+        logLine(LogLevel::Debug, {"[Server] Client ", NumberText(conn.id),
+                                  " is not reading; dropped its oldest queued message."});
     }
-    cout << "[Server] Socket created successfully." << endl;
-    
-    // Step 2: Set socket options
-    int opt = 1;
-    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
+    if (result == EnqueueResult::DroppedNew) {
+        stats.add(StatDroppedNew);
+        logLine(LogLevel::Debug, {"[Server] Client ", NumberText(conn.id),
+                                  " is not reading; dropped a message larger than its queue limit."});
+    }
+    if (result == EnqueueResult::Overflow) {
+        stats.add(StatSlowDisconnects);
+        logLine(LogLevel::Warning, {"[Server] Client ", NumberText(conn.id),
+                                    " is not reading; outbound queue full, disconnecting."});
+        shutdown(conn.sock, SHUT_RDWR);
+    }
+    wakeWriter(conn);
+}
+
+/**
+ * Function: broadcastMessage
+ * Purpose: Sends a message to all connected clients except the sender
+ * Parameters: 
+ *   - message: The message to broadcast (built once with makeMessage)
+ *   - senderSocket: Socket of the sender (excluded from broadcast)
+ * 
+ * This function is thread-safe without taking a lock: it walks the client
+ * registry inside an epoch section and only appends a reference to the
+ * shared message to each recipient's outbound queue, so the message bytes
+ * are never copied.
+ */
+void broadcastMessage(const MessageRef& message, SOCKET senderSocket) {
+    EpochGuard guard;  // Connections seen below stay alive until it ends
     
-    // Step 3: Configure server address
-    sockaddr_in serverAddress;
-    memset(&serverAddress, 0, sizeof(serverAddress));
-    serverAddress.sin_family = AF_INET;
-    serverAddress.sin_port = htons(PORT);
-    serverAddress.sin_addr.s_addr = INADDR_ANY;
+    uint64_t recipients = 0;
+    clientRegistry.forEach([&](ClientConnection& conn) {
+        if (conn.sock != senderSocket) {  // Don't send to the original sender
+            enqueueFrame(conn, message);
+            recipients++;
+        }
+    });
+    threadStats().add(StatBroadcasts);
+    threadStats().add(StatFanout, recipients);
+}
+
+/**
+ * Function: broadcastToRoom
+ * Purpose: Sends a message to the members of one room except the sender
+ * Parameters:
+ *   - room: The room (see SharedRoomIndex for when the pointer is valid)
+ *   - message: The message to broadcast (built once with makeMessage)
+ *   - senderSocket: Socket of the sender (excluded from broadcast)
+ * 
+ * Only the room's own members are visited, so the cost does not depend on
+ * how many clients are connected in total. The member slots are read
+ * without a lock: clients joining or leaving meanwhile do not hold up the
+ * broadcast.
+ */
+void broadcastToRoom(const SharedRoom<ClientConnection>& room, const MessageRef& message, SOCKET senderSocket) {
+    EpochGuard guard;
     
-    // Step 4: Bind socket
-    if (bind(serverSocket, (sockaddr*)&serverAddress, sizeof(serverAddress)) == SOCKET_ERROR) {
-        cerr << "[Error] Failed to bind socket to port " << PORT << "!" << endl;
-        closesocket(serverSocket);
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return 1;
+    uint64_t recipients = 0;
+    SharedRoomIndex<ClientConnection>::forEachMember(room, [&](ClientConnection& member) {
+        if (member.sock != senderSocket) {
+            enqueueFrame(member, message);
+            recipients++;
+        }
+    });
+    threadStats().add(StatBroadcasts);
+    threadStats().add(StatFanout, recipients);
+}
+
+/**
+ * Function: publishToRoom
+ * Purpose: broadcastToRoom for a message that originated on this node -
+ *          also relays it to the peers (messages from peers are only
+ *          broadcast)
+ */
+void publishToRoom(const SharedRoom<ClientConnection>& room, const MessageRef& message, SOCKET senderSocket,
+                   bool chat = false) {
+    broadcastToRoom(room, message, senderSocket);
+    relayToPeers(message, room.name, chat);
+}
+
+/**
+ * Function: switchRoom
+ * Purpose: Carries out a /join or /leave command from a client
+ * Parameters:
+ *   - conn: Client that sent the command
+ *   - command: Parsed command (Join, Leave or Invalid)
+ *   - target: Room to move to
+ * 
+ * Only the thread processing the client's messages changes conn.room (its
+ * handler thread, or with --workers its one work task), so it can be read
+ * there without synchronisation.
+ */
+void switchRoom(ClientConnection& conn, RoomCommand command, const string& target) {
+    const string& room = conn.room->name;
+    if (command == RoomCommand::Invalid) {
+        enqueueFrame(conn, serverError(WIRE_BAD_COMMAND, makeMessage({ROOM_USAGE})));
+        return;
     }
-    cout << "[Server] Socket bound to port " << PORT << "." << endl;
-    
-    // Step 5: Listen for connections (backlog = MAX_CLIENTS for concurrent server)
-    if (listen(serverSocket, MAX_CLIENTS) == SOCKET_ERROR) {
-        cerr << "[Error] Failed to listen on socket!" << endl;
-        closesocket(serverSocket);
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return 1;
+    if (target == room) {
+        enqueueFrame(conn, serverError(WIRE_ALREADY_IN_ROOM, makeMessage({"[Server] You are already in room ", room, "."})));
+        return;
     }
-    cout << "[Server] Listening for up to " << MAX_CLIENTS << " concurrent connections..." << endl;
-    cout << "[Server] Server is ready! Waiting for clients..." << endl;
-    cout << "------------------------------------------" << endl;
-    
-    // Start server console thread
-    thread consoleThread(serverConsole);
-    consoleThread.detach();  // Let console run independently
     
-    int nextClientId = 1;  // Client ID counter
+    // The old room may be retired once we leave it; the guard keeps it readable
+    EpochGuard guard;
+    SharedRoom<ClientConnection>* previous = conn.room;
+    conn.joinedAt = historyClock();
+    conn.room = sharedRooms.join(conn, previous, target);
     
-    // Main loop: Accept new client connections
-    while (serverRunning) {
-        sockaddr_in clientAddress;
-        socklen_t clientLen = sizeof(clientAddress);
-        
-        // Accept new connection (blocking call)
-        SOCKET clientSocket = accept(serverSocket, (sockaddr*)&clientAddress, &clientLen);
-        
-        if (clientSocket == INVALID_SOCKET) {
-            if (serverRunning) {
-                cerr << "[Error] Failed to accept connection!" << endl;
-            }
-            continue;
-        }
-        
-        // Check if we've reached max clients
-        if (clientCount >= MAX_CLIENTS) {
-            const char* fullMsg = "[Server] Sorry, server is full. Try again later.";
-            send(clientSocket, fullMsg, strlen(fullMsg), 0);
-            closesocket(clientSocket);
-            continue;
+    NumberText idText(conn.id);
+    WireLeave left{(uint32_t)conn.id, wireNode(), 0, previous->name};
+    WireJoin joined{(uint32_t)conn.id, wireNode(), 0, target, ""};
+    publishToRoom(*previous, typedMessage(makeMessage({"[Server] Client ", idText, nodeTag, " left room ",
+                                                       previous->name, "."}), left), conn.sock);
+    publishToRoom(*conn.room, typedMessage(makeMessage({"[Server] Client ", idText, nodeTag, " joined room ",
+                                                        target, "."}), joined), conn.sock);
+    enqueueFrame(conn, typedMessage(makeMessage({"[Server] You are now in room ", target, "."}), joined));
+    MessageRef notice, backlog;
+    if (recentHistory(target, conn.joinedAt, notice, backlog)) {
+        enqueueFrame(conn, notice);
+        enqueueFrame(conn, backlog);
+    }
+    logLine(LogLevel::Info, {"[Server] Client ", idText, " moved from room ", previous->name, " to room ", target, "."});
+}
+
+/**
+ * Function: rejectClient
+ * Purpose: Turns a new connection away because the server is full
+ * Parameters: sock - The accepted socket (closed here)
+ * 
+ * The notice fits into the empty send buffer of a new socket, so it is
+ * sent without waiting: a storm of refused reconnects never holds up the
+ * thread that accepts them.
+ */
+void rejectClient(SOCKET sock) {
+    static const string fullMsg = makeFrame("[Server] Sorry, server is full. Try again later.");
+    send(sock, fullMsg.data(), (int)fullMsg.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    closesocket(sock);
+    threadStats().add(StatRejected);
+}
+
+/**
+ * Function: reserveClient
+ * Purpose: Counts a new connection against --max-clients, or turns it away
+ * Parameters: sock - The accepted socket
+ * Returns: false if the server is full (the client is told, socket closed)
+ * 
+ * The check and the count update are one step, as the TCP acceptors and
+ * the local acceptor thread admit concurrently.
+ */
+bool reserveClient(SOCKET sock) {
+    if (clientCount.fetch_add(1) >= config.maxClients) {
+        clientCount--;
+        rejectClient(sock);
+        return false;
+    }
+    threadStats().add(StatAccepted);
+    return true;
+}
+
+const int ACCEPT_PAUSE_MIN_MS = 10;     // First pause after accept() runs out of resources
+const int ACCEPT_PAUSE_MAX_MS = 1000;   // Doubling stops here
+
+/**
+ * Struct: AcceptBackoff
+ * Purpose: One acceptor's reaction to failed accepts - how long to stop
+ *          accepting, and a log line at most once a second
+ * 
+ * Out of descriptors (EMFILE, ENFILE) or kernel memory (ENOBUFS, ENOMEM),
+ * accept() fails at once for as long as the connection stays queued, so
+ * retrying straight away spins. The pause doubles while the failures last.
+ */
+struct AcceptBackoff {
+    int pauseMs = 0;                            // Last pause; 0 once an accept succeeds
+    chrono::steady_clock::time_point nextLog{};
+    uint64_t unlogged = 0;                      // Failures since the last line
+
+    /**
+     * Function: failed
+     * Purpose: Reports a failed accept
+     * Parameters: error - Its errno
+     * Returns: Milliseconds to stop accepting, or 0 to go on (the error
+     *          used up the connection)
+     */
+    int failed(int error) {
+        auto now = chrono::steady_clock::now();
+        if (now >= nextLog) {
+            if (unlogged == 0) {
+                logLine(LogLevel::Error, {"[Error] Failed to accept connection: ", strerror(error)});
+            } else {
+                logLine(LogLevel::Error, {"[Error] Failed to accept connection: ", strerror(error), " (",
+                                          NumberText((long long)unlogged), " more since the last report)"});
+            }
+            unlogged = 0;
+            nextLog = now + chrono::seconds(1);
+        } else {
+            unlogged++;
+        }
+        if (error != EMFILE && error != ENFILE && error != ENOBUFS && error != ENOMEM) return 0;
+        pauseMs = pauseMs == 0 ? ACCEPT_PAUSE_MIN_MS : min(pauseMs * 2, ACCEPT_PAUSE_MAX_MS);
+        return pauseMs;
+    }
+
+    void succeeded() { pauseMs = 0; }
+};
+
+#ifdef __linux__
+mutex reserveMutex;     // Guards reserveFd (acceptors of every thread share it)
+int reserveFd = -1;     // Spare descriptor, given up to refuse a connection when out of them
+
+/**
+ * Function: openReserveFd
+ * Purpose: Sets the spare descriptor aside at startup, while there are some
+ */
+void openReserveFd() {
+    reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+/**
+ * Function: shedConnection
+ * Purpose: Refuses one queued connection while the process is out of
+ *          descriptors, with the spare one
+ * Parameters: listener - The listening socket accept() failed on
+ * Returns: true if a connection was refused
+ * 
+ * A connection accept() has no descriptor for stays queued, and its
+ * client waits for an answer that never comes. Closing the spare makes
+ * room to accept it, tell it the server is full and close it again.
+ * Every listener is non-blocking, so if another acceptor got there first
+ * the accept fails with EAGAIN and the spare is taken back at once.
+ */
+bool shedConnection(SOCKET listener) {
+    lock_guard<mutex> lock(reserveMutex);
+    if (reserveFd < 0) {
+        openReserveFd();  // Given up by a failed reopen; take the next one freed
+        return false;
+    }
+    close(reserveFd);
+    SOCKET sock;
+    do {
+        sock = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    } while (sock == INVALID_SOCKET && errno == EINTR);
+    if (sock != INVALID_SOCKET) rejectClient(sock);  // Else EAGAIN: nothing left to shed
+    openReserveFd();
+    return sock != INVALID_SOCKET;
+}
+#else
+void openReserveFd() {}
+bool shedConnection(SOCKET) { return false; }
+#endif
+
+/**
+ * Function: removeClient
+ * Purpose: Removes a client from its room and the client registry
+ * Parameters: conn - The client to remove
+ * 
+ * This function is thread-safe and O(1) in the number of clients (plus a
+ * copy of the client's room). Broadcasts that may still be holding the
+ * connection keep it alive: the registry's reference is retired to the
+ * epoch domain instead of being dropped.
+ */
+void removeClient(const shared_ptr<ClientConnection>& conn) {
+    sharedRooms.leave(*conn, *conn->room);
+    if (clientRegistry.remove(conn->handle) != nullptr) {
+        EpochDomain::instance().retire(new shared_ptr<ClientConnection>(conn));
+        clientCount--;
+    }
+    closesocket(conn->sock);
+}
+
+#ifdef __linux__
+/**
+ * Function: writeShared
+ * Purpose: sendBatch for a shared-memory client - copies the messages into
+ *          its ring, sleeping on the write doorbell while the ring is full
+ * Returns: false if the client went away while the ring was full
+ */
+bool writeShared(ClientConnection& conn, const MessageRef* batch, size_t count) {
+    ThreadStats& stats = threadStats();
+    pollfd fds[2] = {{conn.shm->spaceBell(), POLLIN, 0}, {conn.sock, POLLRDHUP, 0}};
+    for (size_t i = 0; i < count; i++) {
+        const char* data = batch[i].frame().data();
+        size_t length = batch[i].size();
+        while (length > 0) {
+            size_t written = conn.shm->write(data, length);
+            if (written > 0) {
+                stats.add(StatWrites);
+                data += written;
+                length -= written;
+                continue;
+            }
+            if (poll(fds, 2, -1) < 0 && errno != EINTR) return false;
+            if (fds[1].revents & (POLLRDHUP | POLLHUP | POLLERR)) return false;
+            if (fds[0].revents & POLLIN) ShmChannel::drainBell(fds[0].fd);
+        }
+    }
+    return true;
+}
+
+/**
+ * Function: serveShared
+ * Purpose: handleClient's receive loop for a shared-memory client - handles
+ *          the frames in its ring until the socket becomes readable
+ * Parameters:
+ *   - conn: The client
+ *   - handle: Called with each payload and the time it was picked up
+ * Returns: true when the socket needs reading (normally the client going
+ *          away), false if the client corrupted its ring
+ * 
+ * Sleeps on the read doorbell and the socket together. Payloads are
+ * handled in place; ring space is handed back every few frames so a
+ * burst does not stall the client.
+ */
+template <typename Handler>
+bool serveShared(ClientConnection& conn, Handler handle) {
+    const int FRAMES_PER_RELEASE = 64;
+    ShmChannel& shm = *conn.shm;
+    ThreadStats& stats = threadStats();
+    pollfd fds[2] = {{shm.dataBell(), POLLIN, 0}, {conn.sock, POLLIN | POLLRDHUP, 0}};
+    while (true) {
+        auto received = chrono::steady_clock::now();
+        string_view payload;
+        ShmRead result;
+        int frames = 0;
+        while ((result = shm.read(payload)) == ShmRead::Frame) {
+            stats.add(StatBytesIn, FRAME_HEADER_SIZE + payload.size());
+            handle(payload, received);
+            if (++frames % FRAMES_PER_RELEASE == 0) shm.release();
+        }
+        shm.release();
+        if (result == ShmRead::Corrupt) {
+            logLine(LogLevel::Error, {"[Error] Client ", NumberText(conn.id), " sent a malformed shared-memory frame."});
+            return false;
+        }
+        if (!shm.idle()) continue;  // More arrived while we were busy
+        
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) return true;
+        if (fds[0].revents & POLLIN) ShmChannel::drainBell(fds[0].fd);
+        if (fds[1].revents) return true;
+    }
+}
+#endif
+
+/**
+ * Function: clientWriter
+ * Purpose: Drains one client's outbound queue (runs in its own thread)
+ * Parameters: conn - The client whose queue this thread owns
+ * 
+ * Everything queued since the last write (up to the batch limits) goes out
+ * in a single sendBatch call. In cork mode the writer additionally waits up
+ * to the flush deadline for a full batch before writing.
+ * 
+ * Blocks in send() only on behalf of its own client. When the connection is
+ * closing it finishes what is queued and then shuts the socket down, which
+ * also wakes the reader thread blocked in recv().
+ */
+void clientWriter(shared_ptr<ClientConnection> conn) {
+    MessageRef batch[MAX_BATCH_SLICES];
+    bool timed = config.writeTimeout > 0;  // Whether the timer thread watches our sends
+    
+    while (true) {
+        size_t count;
+        {
+            unique_lock<mutex> lock(conn->queueMutex);
+            conn->queueReady.wait(lock, [&] { return !conn->outbound.empty() || conn->closing; });
+            if (config.cork && !conn->closing) {
+                // Let a fuller batch build up, but never past the flush deadline
+                auto deadline = chrono::steady_clock::now() + chrono::microseconds(config.flushDeadlineUs);
+                conn->queueReady.wait_until(lock, deadline, [&] {
+                    return conn->outbound.bytes() >= config.batch.maxBytes || conn->closing;
+                });
+            }
+            count = conn->outbound.popBatch(batch, config.batch);
+            if (count == 0) {
+                break;  // Closing and fully drained
+            }
+        }
+        if (timed) conn->writing.store(timerTick(), memory_order_relaxed);
+#ifdef __linux__
+        bool sent = conn->shm ? writeShared(*conn, batch, count) : sendBatch(conn->sock, batch, count);
+#else
+        bool sent = sendBatch(conn->sock, batch, count);
+#endif
+        if (timed) conn->writing.store(0, memory_order_relaxed);
+        size_t bytes = 0;
+        for (size_t i = 0; i < count; i++) {
+            bytes += batch[i].size();
+            batch[i].reset();  // Last reference returns the buffer to the pool
+        }
+        if (!sent) {
+            break;
+        }
+        threadStats().add(StatMessagesOut, count);
+        threadStats().add(StatBytesOut, bytes);
+    }
+    
+    {
+        lock_guard<mutex> lock(conn->queueMutex);
+        conn->closing = true;
+    }
+    shutdown(conn->sock, SHUT_RDWR);
+}
+
+// Threads mode: every connection's deadlines, run by connectionTimerThread
+mutex timerMutex;                   // Guards connectionTimers and the clients' pinged
+condition_variable timerChanged;    // A timer was armed; the thread may need to wake sooner
+TimerWheel<ClientConnection> connectionTimers(timerTick());
+
+/**
+ * Function: checkConnection
+ * Purpose: Runs when a threads-mode connection's timer fires (timerMutex
+ *          held) - sends a heartbeat, re-arms, or closes the connection
+ * 
+ * Closing only shuts the socket down; the handler thread wakes up in
+ * recv() and cleans up as for any other disconnect.
+ */
+void checkConnection(ClientConnection& conn) {
+    uint64_t now = connectionTimers.now();
+    ConnectionTimes times;
+    times.heard = conn.heard.load(memory_order_relaxed);
+    times.spoke = conn.spoke.load(memory_order_relaxed);
+    times.pinged = conn.pinged;
+    times.writing = conn.writing.load(memory_order_relaxed);
+
+    uint64_t next = 0;
+    const char* reason = "";
+    DeadlineAction action = checkDeadlines(now, times, next, reason);
+    if (action == DeadlineAction::Close) {
+        reportTimeout(conn.id, reason);
+        shutdown(conn.sock, SHUT_RDWR);
+        return;
+    }
+    if (action == DeadlineAction::Heartbeat) {
+        conn.pinged = now;
+        threadStats().add(StatHeartbeats);
+        enqueueFrame(conn, makeMessage({}));
+    }
+    connectionTimers.arm(conn.timer, next);
+}
+
+/**
+ * Function: connectionTimerThread
+ * Purpose: Advances connectionTimers (runs in its own thread, threads mode)
+ * 
+ * One thread and one wheel serve every connection: the thread sleeps
+ * until the next tick that has a timer in it.
+ */
+void connectionTimerThread() {
+    unique_lock<mutex> lock(timerMutex);
+    while (serverRunning) {
+        connectionTimers.advance(timerTick(), checkConnection);
+        long long ticks = connectionTimers.ticksUntilNext();
+        if (ticks < 0) {
+            timerChanged.wait(lock);
+        } else {
+            timerChanged.wait_for(lock, chrono::milliseconds(ticks * TIMER_TICK_MS));
+        }
+    }
+}
+
+/**
+ * Function: watchConnection
+ * Purpose: Starts a new threads-mode connection's deadlines
+ */
+void watchConnection(ClientConnection& conn) {
+    uint64_t now = timerTick();
+    conn.heard = now;
+    conn.spoke = now;
+    conn.timer.owner = &conn;
+    {
+        lock_guard<mutex> lock(timerMutex);
+        connectionTimers.arm(conn.timer, now);  // Checked on the next tick, which sets the real expiry
+    }
+    timerChanged.notify_one();
+}
+
+/**
+ * Function: unwatchConnection
+ * Purpose: Cancels a connection's timer; once this returns it no longer
+ *          fires, so the socket may be closed
+ */
+void unwatchConnection(ClientConnection& conn) {
+    lock_guard<mutex> lock(timerMutex);
+    connectionTimers.cancel(conn.timer);
+}
+
+/**
+ * Function: switchToBinary
+ * Purpose: Carries out BINARY_COMMAND: from now on the client is queued the
+ *          typed encodings, starting with a Join telling it its ID and room
+ */
+void switchToBinary(ClientConnection& conn) {
+    if (!conn.binary.exchange(true)) binaryClients++;
+    enqueueFrame(conn, makeTypedMessage(WireJoin{(uint32_t)conn.id, wireNode(), 0, conn.room->name, conn.ip}));
+}
+
+/**
+ * Function: processPayload
+ * Purpose: Carries out one message from a client: a room command, or a chat
+ *          message broadcast to the rest of its room (and the other nodes)
+ * Parameters:
+ *   - conn: Client that sent it
+ *   - payload: The frame's payload
+ *   - received: When it arrived (for the recv-to-broadcast latency)
+ */
+void processPayload(ClientConnection& conn, string_view payload, chrono::steady_clock::time_point received) {
+    ThreadStats& stats = threadStats();
+    stats.add(StatMessagesIn);
+    if (payload == BINARY_COMMAND) {
+        switchToBinary(conn);
+        return;
+    }
+    string target;
+    RoomCommand command;
+    if (!parseRequest(payload, conn.binary, command, target)) {
+        enqueueFrame(conn, serverError(WIRE_BAD_MESSAGE, makeMessage({UNSUPPORTED_MESSAGE})));
+        return;
+    }
+    if (command != RoomCommand::None) {
+        switchRoom(conn, command, target);
+        return;
+    }
+    if (payload.size() > MAX_CHAT_PAYLOAD) {
+        NumberText limit((long long)MAX_CHAT_PAYLOAD);
+        enqueueFrame(conn, serverError(WIRE_TOO_LONG, makeMessage({"[Server] Messages can be at most ", limit, " bytes."})));
+        return;
+    }
+    
+    // Format message with client identifier (once, into a pooled buffer)
+    MessageRef message = typedMessage(makeMessage({conn.prefix, payload}),
+                                      WireChat{(uint32_t)conn.id, wireNode(), conn.room->name, payload});
+    logSampled(LogLevel::Info, message);  // Display on server console
+    recordHistory(message, conn.room->name);
+    
+    // Broadcast message to the rest of the room (and the other nodes)
+    publishToRoom(*conn.room, message, conn.sock, true);
+    stats.recvToBroadcast.record(elapsedNs(received));
+}
+
+const size_t WORK_BACKLOG_BYTES = 1 << 20;  // Unprocessed bytes per client before its reader waits
+WorkStealingPool* workPool = nullptr;       // Message processing (--workers only; never freed)
+
+/**
+ * Function: processWork
+ * Purpose: A work task - processes everything queued for one client, then
+ *          submits itself again if more arrived meanwhile
+ * Parameters: conn - The client
+ * 
+ * Resubmitting instead of looping lets the other clients' tasks run in
+ * between, so a client that never stops sending cannot keep a worker.
+ */
+void processWork(shared_ptr<ClientConnection> conn) {
+    chrono::steady_clock::time_point received;
+    {
+        lock_guard<mutex> lock(conn->workMutex);
+        conn->workBatch.clear();
+        conn->workBatch.swap(conn->pendingWork);  // The buffers take turns, so neither is reallocated
+        received = conn->workReceived;
+    }
+    conn->workIdle.notify_all();  // The reader may be waiting for the backlog to shrink
+    
+    string_view rest = conn->workBatch;
+    string_view payload;
+    while (parseFrame(rest, payload) == FrameStatus::Complete) {
+        processPayload(*conn, payload, received);
+    }
+    
+    {
+        lock_guard<mutex> lock(conn->workMutex);
+        if (!conn->pendingWork.empty()) {
+            workPool->submit([conn] { processWork(conn); });
+            return;
+        }
+        conn->workScheduled = false;
+    }
+    conn->workIdle.notify_all();
+}
+
+/**
+ * Function: queueWork
+ * Purpose: Hands a received message to the worker pool (--workers)
+ * Parameters:
+ *   - conn: Client that sent it
+ *   - payload: The frame's payload
+ *   - received: When it arrived
+ * 
+ * A client has at most one task in the pool, which takes everything queued
+ * for it, so its messages are still processed in the order they arrived.
+ * While WORK_BACKLOG_BYTES are waiting the reader blocks here, which slows
+ * a client that sends faster than the workers keep up through TCP.
+ */
+void queueWork(const shared_ptr<ClientConnection>& conn, string_view payload,
+               chrono::steady_clock::time_point received) {
+    {
+        unique_lock<mutex> lock(conn->workMutex);
+        conn->workIdle.wait(lock, [&] { return conn->pendingWork.size() < WORK_BACKLOG_BYTES; });
+        if (conn->pendingWork.empty()) conn->workReceived = received;
+        appendFrame(conn->pendingWork, payload);
+        if (conn->workScheduled) return;  // The running task will find it
+        conn->workScheduled = true;
+    }
+    workPool->submit([conn] { processWork(conn); });
+}
+
+/**
+ * Function: greetClient
+ * Purpose: Announces a new client to its room and queues its welcome (and
+ *          the room's recent history)
+ */
+void greetClient(ClientConnection& conn) {
+    NumberText idText(conn.id);
+    MessageRef welcomeMsg = typedMessage(
+        makeMessage({"[Server] Client ", idText, nodeTag, " (", conn.ip, ") joined the chat!"}),
+        WireJoin{(uint32_t)conn.id, wireNode(), WIRE_CONNECTED, conn.room->name, conn.ip});
+    
+    // Notify the lobby (joined when the client was accepted)
+    publishToRoom(*conn.room, welcomeMsg, conn.sock);
+    logMessage(LogLevel::Info, welcomeMsg);
+    
+    // Send welcome message to the new client
+    enqueueFrame(conn, makeMessage({"[Server] Welcome! You are Client ", idText, nodeTag, ". There are ",
+                                    NumberText(clientCount.load()), " clients connected. You are in room ",
+                                    conn.room->name, "; type /join <room> to switch."}));
+    MessageRef notice, backlog;
+    if (recentHistory(conn.room->name, conn.joinedAt, notice, backlog)) {
+        enqueueFrame(conn, notice);
+        enqueueFrame(conn, backlog);
+    }
+}
+
+/**
+ * Function: receivePayload
+ * Purpose: Takes one frame received from a client: notes the time for its
+ *          deadlines and processes it (or queues it for the workers)
+ */
+void receivePayload(const shared_ptr<ClientConnection>& conn, string_view payload,
+                    chrono::steady_clock::time_point received) {
+    uint64_t tick = timerTick(received);
+    conn->heard.store(tick, memory_order_relaxed);
+    if (payload.empty()) return;  // A heartbeat answer
+    conn->spoke.store(tick, memory_order_relaxed);
+    if (workPool) {
+        queueWork(conn, payload, received);
+    } else {
+        processPayload(*conn, payload, received);
+    }
+}
+
+/**
+ * Function: farewellClient
+ * Purpose: Removes a client whose writer has stopped and, if it went away
+ *          by itself, tells its room
+ * Parameters:
+ *   - conn: The client
+ *   - connected: false if the client disconnected (rather than the server
+ *                shutting down)
+ */
+void farewellClient(const shared_ptr<ClientConnection>& conn, bool connected) {
+    // Clean up - remove client from list before announcing the departure
+    // (the guard keeps its room readable even if that empties it)
+    EpochGuard guard;
+    SharedRoom<ClientConnection>* room = conn->room;
+    removeClient(conn);
+    
+    if (conn->binary) binaryClients--;
+    if (!connected) {
+        MessageRef disconnectMsg = typedMessage(
+            makeMessage({"[Server] Client ", NumberText(conn->id), nodeTag, " (", conn->ip, ") left the chat."}),
+            WireLeave{(uint32_t)conn->id, wireNode(), WIRE_CONNECTED, room->name});
+        logMessage(LogLevel::Info, disconnectMsg);
+        publishToRoom(*room, disconnectMsg, INVALID_SOCKET);
+    }
+}
+
+/**
+ * Function: handleClient
+ * Purpose: Handles communication with a single client (runs in separate thread)
+ * Parameters: conn - The client (socket, id, IP address and outbound queue)
+ * 
+ * This function runs in its own thread, handling all messages from one client.
+ * It receives messages and broadcasts them to the other clients in its room,
+ * or carries out its room commands. Outgoing traffic is written by a
+ * companion clientWriter thread. A shared-memory client's messages come
+ * from its ring instead (serveShared); its socket is still read, for the
+ * end of the connection. With --workers the thread only reads: its messages
+ * are processed by the worker pool (queueWork).
+ */
+void handleClient(shared_ptr<ClientConnection> conn) {
+    SOCKET clientSocket = conn->sock;
+    RecvBuffer recvBuffer;  // Reassembles frames across recv() calls
+    ThreadStats& stats = threadStats();
+    
+    thread writerThread(clientWriter, conn);
+    if (deadlinesEnabled()) watchConnection(*conn);
+    greetClient(*conn);
+    
+    auto handlePayload = [&](string_view payload, chrono::steady_clock::time_point received) {
+        receivePayload(conn, payload, received);
+    };
+    
+    // Main message handling loop for this client
+    bool connected = true;
+    while (serverRunning && connected) {
+#ifdef __linux__
+        if (conn->shm && !serveShared(*conn, handlePayload)) {
+            connected = false;
+            break;
+        }
+#endif
+        // Receive straight into the frame buffer (no clearing needed)
+        char* space = recvBuffer.prepare(RECV_CHUNK_SIZE);
+        int bytesRead = recv(clientSocket, space, (int)recvBuffer.writable(), 0);
+        
+        if (bytesRead <= 0) {
+            connected = false;  // Client disconnected
+            break;
+        }
+        auto received = chrono::steady_clock::now();
+        recvBuffer.commit(bytesRead);
+        stats.add(StatBytesIn, bytesRead);
+        
+        // One recv() may carry several messages, or only part of one
+        string_view payload;
+        FrameStatus status;
+        while ((status = recvBuffer.nextFrame(payload)) == FrameStatus::Complete) {
+            handlePayload(payload, received);
+        }
+        if (status == FrameStatus::TooLarge) {
+            logLine(LogLevel::Error, {"[Error] Client ", NumberText(conn->id), " sent an oversized frame."});
+            connected = false;
+        }
+    }
+    
+    unwatchConnection(*conn);
+    
+    // Let the workers finish its messages; after that nothing else moves it between rooms
+    if (workPool) {
+        unique_lock<mutex> lock(conn->workMutex);
+        conn->workIdle.wait(lock, [&] { return !conn->workScheduled; });
+    }
+    
+    // Stop the writer (anything still queued is for a peer that is gone)
+    {
+        lock_guard<mutex> lock(conn->queueMutex);
+        conn->closing = true;
+    }
+    conn->queueReady.notify_one();
+    shutdown(clientSocket, SHUT_RDWR);
+    writerThread.join();
+    
+    farewellClient(conn, connected);
+}
+
+#ifdef __linux__
+/**
+ * Class: LoopReactor
+ * Purpose: Chat logic shared by the single-threaded event-loop backends
+ *          (epoll and io_uring; Linux only)
+ * 
+ * A single thread owns the listening socket and every client socket, so the
+ * number of clients is bounded by file descriptors rather than by thread
+ * stacks. This class keeps the per-client state and implements the chat
+ * itself (join/leave notices, rooms, broadcast, slow-consumer policy, batched
+ * and corked flushing); subclasses only move bytes between the sockets and the
+ * client buffers. Other threads (the server console, the local acceptor)
+ * hand work to the loop through an eventfd-signalled inbox.
+ * 
+ * Sends are batched: a client that receives messages during one loop
+ * iteration is only marked dirty, and all dirty clients are flushed once at
+ * the end of the iteration with one gather write each. In cork mode a dirty
+ * client is left alone until its batch fills or its flush deadline passes.
+ * 
+ * With --shards N there are N such loops, each on its own thread with its
+ * own SO_REUSEPORT listener and its own clients; the kernel spreads new
+ * connections across them. A message that originates on one shard is
+ * broadcast locally and handed to every other shard through a lock-free
+ * SPSC ring per shard pair (one eventfd wake-up per peer per iteration),
+ * so no lock is shared between the loops. Each shard indexes the rooms of
+ * its own clients; a room message carries the room name across and every
+ * shard delivers it to its local members of that room.
+ */
+class LoopReactor {
+public:
+    explicit LoopReactor(SOCKET listenSocket) : listenSocket(listenSocket) {}
+    virtual ~LoopReactor() {
+        if (wakeFd >= 0) close(wakeFd);
+    }
+
+    virtual bool init() = 0;
+    virtual void run() = 0;
+    void post(const MessageRef& message);
+    void postToRoom(const MessageRef& message, const string& room);
+    void adopt(SOCKET sock, const string& ip, unique_ptr<ShmChannel> shm);
+    static void linkShards(const vector<LoopReactor*>& shards);
+    SOCKET listener() const { return listenSocket; }
+    virtual bool servesSharedMemory() const { return false; }
+
+    // Hot restart (see hot_restart.h)
+    void pause();
+    void resume();
+    void restore(HandedClient& handed);
+    static void handOver(const vector<LoopReactor*>& shards, HandoffState& state);
+    static void takeOver(const vector<LoopReactor*>& shards, HandoffState& state);
+
+protected:
+    struct Client {
+        SOCKET sock;
+        int id;
+        string ip;
+        string prefix;              // "[Client N]: ", formatted once
+        RecvBuffer recvBuffer;      // Partial inbound frames
+        OutboundQueue outbound;     // Frames not yet accepted by the kernel
+        bool writePending = false;  // Backend flushes again by itself (EPOLLOUT armed / send in flight)
+        bool dirty = false;         // Listed in dirtyClients, awaiting a flush
+        chrono::steady_clock::time_point flushDue;  // Cork-mode deadline
+        bool closing = false;       // Scheduled for removal after this batch
+        RoomMembership<Client> membership;
+        bool binary = false;        // Sent BINARY_COMMAND: gets the typed encodings queued
+        unique_ptr<ShmChannel> shm; // Shared-memory transport (epoll only)
+        TimerNode<Client> timer;    // Its deadlines (in timers)
+        ConnectionTimes times;      // What they are measured from; writing is stale while outbound is empty
+
+        // io_uring only: outstanding operations, held-back input, the send
+        bool recvArmed = false;     // Multishot recv active
+        bool released = false;      // Reaped; erased once nothing is in flight
+        unsigned recvRound = 0;     // Loop iteration recvUsed refers to
+        unsigned recvUsed = 0;      // Buffers processed in that iteration
+        size_t deferredRecvs = 0;   // Buffers waiting in the backlog
+        unique_ptr<iovec[]> sendIov;
+        msghdr sendMsg{};
+        size_t sendBytes = 0;       // Length of the send in flight
+    };
+
+    Client* addClient(SOCKET sock, const char* ip);
+    void handleFrames(Client& client, string_view& data);
+    void handleBuffered(Client& client);
+    void handleMessage(Client& client, string_view payload);
+    void switchRoom(Client& client, RoomCommand command, const string& target);
+    void queueFrame(Client& client, const MessageRef& frame);
+    void broadcast(const MessageRef& message, SOCKET senderSocket);
+    void broadcastRoom(const string& room, const MessageRef& message, SOCKET senderSocket);
+    void publish(const MessageRef& message, SOCKET senderSocket, const string& room, bool chat = false);
+    void scheduleClose(Client& client);
+    void endIteration();
+    void drainInbox();
+    long long nextTimeoutUs();
+    FlushResult writeNow(Client& client);
+    void watchClient(Client& client);
+    void expireTimers();
+    void checkClient(Client& client);
+    void pauseAccepting(int pauseMs);
+    void resumeAccepting();
+
+    // Starts writing a dirty client's queue
+    virtual void flushClient(Client& client) = 0;
+    // Detaches a reaped client; returns true if it can be erased right away
+    virtual bool releaseClient(Client& client) = 0;
+    // Registers a connection accepted by another thread (see adopt)
+    virtual void adoptClient(SOCKET sock, const string& ip, unique_ptr<ShmChannel> shm) = 0;
+    // Starts watching a client taken over from the previous process (see restore)
+    virtual void restoreClient(Client& client) = 0;
+    // Starts or stops taking connections from the listener (see pauseAccepting);
+    // returns false if that failed
+    virtual bool setAccepting(bool accepting) = 0;
+
+    void parkIfAsked();
+
+    SOCKET listenSocket;
+    int wakeFd = -1;
+    AcceptBackoff acceptBackoff;
+    bool acceptPaused = false;     // Listener ignored until acceptResumeAt (or a client leaves)
+    chrono::steady_clock::time_point acceptResumeAt;
+    chrono::steady_clock::time_point received;  // When the bytes being handled arrived
+    static atomic<int> nextClientId;   // Shared by all shards
+    TimerWheel<Client> timers{timerTick()};  // The clients' deadlines (declared first, destroyed last)
+    unordered_map<SOCKET, Client> clients;
+    RoomIndex<Client> rooms;       // This shard's clients by room
+    vector<SOCKET> closedClients;  // Deferred so fds are not reused mid-batch
+    vector<SOCKET> dirtyClients;   // Clients with queued output to flush
+
+private:
+    // A connection handed over by the local acceptor
+    struct Adoption {
+        SOCKET sock;
+        string ip;
+        unique_ptr<ShmChannel> shm;
+    };
+
+    // A room message travelling between shards
+    struct ShardMessage {
+        MessageRef message;
+        string room;
+    };
+
+    // Link from this shard to one other shard
+    struct ShardLink {
+        LoopReactor* peer;
+        SpscRing<ShardMessage>* ring;  // Owned by the peer (its inbound side)
+        vector<ShardMessage> overflow; // Waiting for room in the ring
+        bool wakePending = false;      // Peer must be woken this iteration
+    };
+
+    void flushDirty();
+    void reapClosed();
+    void forwardToShards();
+    void wake();
+
+    mutex inboxMutex;              // Guards the inboxes and adoptions (written by other threads)
+    vector<MessageRef> inbox;      // Server broadcasts waiting for the loop
+    vector<ShardMessage> roomInbox;  // Room messages from peer nodes
+    vector<Adoption> adoptions;    // Connections waiting to join the loop
+
+    vector<ShardLink> outboundLinks;                        // To every other shard
+    vector<unique_ptr<SpscRing<ShardMessage>>> inboundRings;  // From every other shard
+
+    mutex pauseMutex;              // Guards parked; pauseRequested is written under it
+    condition_variable pauseChanged;
+    atomic<bool> pauseRequested{false};
+    bool parked = false;           // The loop is waiting in parkIfAsked
+};
+
+atomic<int> LoopReactor::nextClientId(1);
+vector<LoopReactor*> reactors;     // Active event loops (epoll/uring modes only)
+atomic<bool> handedOver(false);    // The clients now belong to a successor process
+SOCKET successorSocket = INVALID_SOCKET;  // Its hand-over connection, told when we are gone
+
+const size_t SHARD_RING_CAPACITY = 4096;   // Broadcasts in flight per shard pair
+
+/**
+ * Function: setNonBlocking
+ * Purpose: Switches a socket to non-blocking mode
+ * Returns: true on success
+ */
+bool setNonBlocking(SOCKET sock) {
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags >= 0 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/**
+ * Function: LoopReactor::post
+ * Purpose: Queues a server message for broadcast from any thread
+ * Parameters: message - Text to send to every connected client
+ * 
+ * Also used to wake the loop on shutdown (serverRunning is checked after
+ * the inbox has been drained, so the farewell message is still delivered).
+ */
+void LoopReactor::post(const MessageRef& message) {
+    {
+        lock_guard<mutex> lock(inboxMutex);
+        inbox.push_back(message);
+    }
+    wake();
+}
+
+/**
+ * Function: LoopReactor::postToRoom
+ * Purpose: Queues a message from a peer node for one room (any thread)
+ */
+void LoopReactor::postToRoom(const MessageRef& message, const string& room) {
+    {
+        lock_guard<mutex> lock(inboxMutex);
+        roomInbox.push_back(ShardMessage{message, room});
+    }
+    wake();
+}
+
+/**
+ * Function: LoopReactor::adopt
+ * Purpose: Hands a connection accepted elsewhere to this loop (callable
+ *          from any thread)
+ * Parameters:
+ *   - sock: Connected, non-blocking socket
+ *   - ip: Peer address for the notices
+ *   - shm: Its shared-memory rings, or nullptr for a plain socket client
+ */
+void LoopReactor::adopt(SOCKET sock, const string& ip, unique_ptr<ShmChannel> shm) {
+    {
+        lock_guard<mutex> lock(inboxMutex);
+        adoptions.push_back({sock, ip, move(shm)});
+    }
+    wake();
+}
+
+/**
+ * Function: LoopReactor::wake
+ * Purpose: Interrupts the loop's wait (callable from any thread)
+ */
+void LoopReactor::wake() {
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+/**
+ * Function: LoopReactor::linkShards
+ * Purpose: Creates the SPSC ring for every ordered pair of shards
+ * Parameters: shards - All event loops, before any of them runs
+ */
+void LoopReactor::linkShards(const vector<LoopReactor*>& shards) {
+    for (LoopReactor* consumer : shards) {
+        for (LoopReactor* producer : shards) {
+            if (producer == consumer) continue;
+            consumer->inboundRings.emplace_back(new SpscRing<ShardMessage>(SHARD_RING_CAPACITY));
+            producer->outboundLinks.push_back({consumer, consumer->inboundRings.back().get(), {}, false});
+        }
+    }
+}
+
+/**
+ * Function: LoopReactor::addClient
+ * Purpose: Registers an accepted connection and runs the join sequence
+ * Parameters:
+ *   - sock: Connected socket, counted by reserveClient and already set
+ *           up for the backend
+ *   - ip: Peer address for the notices
+ * Returns: The new client
+ */
+LoopReactor::Client* LoopReactor::addClient(SOCKET sock, const char* ip) {
+    applySocketProfile(sock, config.profile);
+
+    Client& client = clients[sock];
+    client.sock = sock;
+    client.id = nextClientId++;
+    client.ip = ip;
+    int64_t joinedAt = historyClock();
+    rooms.join(client, DEFAULT_ROOM);
+
+    // Same join sequence as handleClient
+    NumberText idText(client.id);
+    client.prefix = "[Client " + string(idText) + nodeTag + "]: ";
+    MessageRef welcomeMsg = typedMessage(
+        makeMessage({"[Server] Client ", idText, nodeTag, " (", client.ip, ") joined the chat!"}),
+        WireJoin{(uint32_t)client.id, wireNode(), WIRE_CONNECTED, DEFAULT_ROOM, client.ip});
+    publish(welcomeMsg, sock, DEFAULT_ROOM);
+    logMessage(LogLevel::Info, welcomeMsg);
+
+    queueFrame(client, makeMessage({"[Server] Welcome! You are Client ", idText, nodeTag, ". There are ",
+                                    NumberText(clientCount.load()), " clients connected. You are in room ",
+                                    DEFAULT_ROOM, "; type /join <room> to switch."}));
+    MessageRef notice, backlog;
+    if (recentHistory(DEFAULT_ROOM, joinedAt, notice, backlog)) {
+        queueFrame(client, notice);
+        queueFrame(client, backlog);
+    }
+    watchClient(client);
+    return &client;
+}
+
+/**
+ * Function: LoopReactor::handleFrames
+ * Purpose: Handles every complete frame at the start of `data`
+ * Parameters:
+ *   - client: Sender
+ *   - data: Received bytes; on return only an incomplete tail is left
+ * 
+ * Each payload is copied exactly once, into the pooled broadcast message,
+ * so the bytes may come straight from a kernel-provided buffer.
+ */
+void LoopReactor::handleFrames(Client& client, string_view& data) {
+    string_view payload;
+    FrameStatus status;
+    while ((status = parseFrame(data, payload)) == FrameStatus::Complete) {
+        handleMessage(client, payload);
+    }
+    if (status == FrameStatus::TooLarge) {
+        logLine(LogLevel::Error, {"[Error] Client ", NumberText(client.id), " sent an oversized frame."});
+        scheduleClose(client);
+    }
+}
+
+/**
+ * Function: LoopReactor::handleBuffered
+ * Purpose: Handles the complete frames held in the client's RecvBuffer
+ */
+void LoopReactor::handleBuffered(Client& client) {
+    string_view payload;
+    FrameStatus status;
+    while ((status = client.recvBuffer.nextFrame(payload)) == FrameStatus::Complete) {
+        handleMessage(client, payload);
+    }
+    if (status == FrameStatus::TooLarge) {
+        logLine(LogLevel::Error, {"[Error] Client ", NumberText(client.id), " sent an oversized frame."});
+        scheduleClose(client);
+    }
+}
+
+/**
+ * Function: LoopReactor::handleMessage
+ * Purpose: Broadcasts one received payload to the sender's room, or carries
+ *          out a room command
+ */
+void LoopReactor::handleMessage(Client& client, string_view payload) {
+    uint64_t tick = timerTick(received);
+    client.times.heard = tick;
+    if (payload.empty()) return;  // A heartbeat answer
+    client.times.spoke = tick;
+    ThreadStats& stats = threadStats();
+    stats.add(StatMessagesIn);
+    if (payload == BINARY_COMMAND) {
+        if (!client.binary) binaryClients++;
+        client.binary = true;
+        queueFrame(client, makeTypedMessage(WireJoin{(uint32_t)client.id, wireNode(), 0,
+                                                     client.membership.room->name, client.ip}));
+        return;
+    }
+    string target;
+    RoomCommand command;
+    if (!parseRequest(payload, client.binary, command, target)) {
+        queueFrame(client, serverError(WIRE_BAD_MESSAGE, makeMessage({UNSUPPORTED_MESSAGE})));
+        return;
+    }
+    if (command != RoomCommand::None) {
+        switchRoom(client, command, target);
+        return;
+    }
+    if (payload.size() > MAX_CHAT_PAYLOAD) {
+        NumberText limit((long long)MAX_CHAT_PAYLOAD);
+        queueFrame(client, serverError(WIRE_TOO_LONG, makeMessage({"[Server] Messages can be at most ", limit, " bytes."})));
+        return;
+    }
+
+    MessageRef message = typedMessage(makeMessage({client.prefix, payload}),
+                                      WireChat{(uint32_t)client.id, wireNode(), client.membership.room->name, payload});
+    logSampled(LogLevel::Info, message);
+    recordHistory(message, client.membership.room->name);
+    publish(message, client.sock, client.membership.room->name, true);
+    stats.recvToBroadcast.record(elapsedNs(received));
+}
+
+/**
+ * Function: LoopReactor::switchRoom
+ * Purpose: Reactor equivalent of switchRoom - moves a client to another
+ *          room and tells both rooms (on every shard)
+ */
+void LoopReactor::switchRoom(Client& client, RoomCommand command, const string& target) {
+    if (command == RoomCommand::Invalid) {
+        queueFrame(client, serverError(WIRE_BAD_COMMAND, makeMessage({ROOM_USAGE})));
+        return;
+    }
+    string room = client.membership.room->name;
+    if (target == room) {
+        queueFrame(client, serverError(WIRE_ALREADY_IN_ROOM, makeMessage({"[Server] You are already in room ", room, "."})));
+        return;
+    }
+
+    int64_t joinedAt = historyClock();
+    rooms.join(client, target);
+    NumberText idText(client.id);
+    WireLeave left{(uint32_t)client.id, wireNode(), 0, room};
+    WireJoin joined{(uint32_t)client.id, wireNode(), 0, target, ""};
+    publish(typedMessage(makeMessage({"[Server] Client ", idText, nodeTag, " left room ", room, "."}), left),
+            client.sock, room);
+    publish(typedMessage(makeMessage({"[Server] Client ", idText, nodeTag, " joined room ", target, "."}), joined),
+            client.sock, target);
+    queueFrame(client, typedMessage(makeMessage({"[Server] You are now in room ", target, "."}), joined));
+    MessageRef notice, backlog;
+    if (recentHistory(target, joinedAt, notice, backlog)) {
+        queueFrame(client, notice);
+        queueFrame(client, backlog);
+    }
+    logLine(LogLevel::Info, {"[Server] Client ", idText, " moved from room ", room, " to room ", target, "."});
+}
+
+/**
+ * Function: LoopReactor::queueFrame
+ * Purpose: Sends an already framed message to one client without blocking
+ * 
+ * The frame is only queued here; the client is marked dirty and written
+ * by flushDirty at the end of the loop iteration, together with everything
+ * else it received in the meantime. A client whose queue overflows under
+ * the Disconnect policy is closed.
+ */
+void LoopReactor::queueFrame(Client& client, const MessageRef& frame) {
+    if (client.closing) return;
+    ThreadStats& stats = threadStats();
+    if (client.outbound.empty()) client.times.writing = timers.now();  // The write deadline starts
+    EnqueueResult result = client.outbound.push(client.binary ? frame.typed() : frame, config.outbound);
+    if (result == EnqueueResult::Overflow) {
+        stats.add(StatSlowDisconnects);
+        logLine(LogLevel::Warning, {"[Server] Client ", NumberText(client.id),
+                                    " is not reading; outbound queue full, disconnecting."});
+        scheduleClose(client);
+        return;
+    }
+    if (result == EnqueueResult::DroppedOldest) {
+        stats.add(StatDropped);
+        logLine(LogLevel::Debug, {"[Server] Client ", NumberText(client.id),
+                                  " is not reading; dropped its oldest queued message."});
+    }
+    if (result == EnqueueResult::DroppedNew) {
+        stats.add(StatDroppedNew);
+        logLine(LogLevel::Debug, {"[Server] Client ", NumberText(client.id),
+                                  " is not reading; dropped a message larger than its queue limit."});
+        return;
+    }
+    stats.queueDepth.record(client.outbound.depth());
+    // Clients with a write outstanding are flushed when it completes
+    if (!client.dirty && !client.writePending) {
+        client.dirty = true;
+        client.flushDue = chrono::steady_clock::now() + chrono::microseconds(config.flushDeadlineUs);
+        dirtyClients.push_back(client.sock);
+    }
+}
+
+/**
+ * Function: LoopReactor::flushDirty
+ * Purpose: Flushes clients that received output during this iteration
+ * 
+ * In cork mode only clients whose batch is full or whose flush deadline has
+ * passed are written; the rest stay dirty for a later iteration.
+ */
+void LoopReactor::flushDirty() {
+    auto now = chrono::steady_clock::now();
+    size_t kept = 0;
+
+    for (size_t i = 0; i < dirtyClients.size(); i++) {
+        auto it = clients.find(dirtyClients[i]);
+        if (it == clients.end() || it->second.closing) continue;
+        Client& client = it->second;
+
+        if (config.cork && client.outbound.bytes() < config.batch.maxBytes && now < client.flushDue) {
+            dirtyClients[kept++] = client.sock;
+            continue;
+        }
+        client.dirty = false;
+        flushClient(client);
+    }
+    dirtyClients.resize(kept);
+}
+
+/**
+ * Function: LoopReactor::nextTimeoutUs
+ * Purpose: How long the loop may sleep - until the earliest cork deadline
+ * Returns: Microseconds, 0 to poll, or -1 to wait indefinitely
+ */
+long long LoopReactor::nextTimeoutUs() {
+    for (const ShardLink& link : outboundLinks) {
+        if (!link.overflow.empty()) return 0;  // Retry once the peer catches up
+    }
+    if (!dirtyClients.empty() && !config.cork) return 0;
+
+    auto now = chrono::steady_clock::now();
+    auto earliest = chrono::steady_clock::time_point::max();
+    for (SOCKET sock : dirtyClients) {
+        auto it = clients.find(sock);
+        if (it != clients.end()) earliest = min(earliest, it->second.flushDue);
+    }
+    if (acceptPaused) earliest = min(earliest, acceptResumeAt);
+    long long ticks = timers.ticksUntilNext();
+    if (ticks >= 0) {
+        // Tick t starts (t - 1) ticks after serverStart (see timerTick)
+        earliest = min(earliest, serverStart + chrono::milliseconds((timers.now() + ticks - 1) * TIMER_TICK_MS));
+    }
+    if (earliest == chrono::steady_clock::time_point::max()) return -1;
+    if (earliest <= now) return 0;
+    return chrono::duration_cast<chrono::microseconds>(earliest - now).count();
+}
+
+/**
+ * Function: LoopReactor::watchClient
+ * Purpose: Starts a new client's deadlines
+ */
+void LoopReactor::watchClient(Client& client) {
+    if (!deadlinesEnabled()) return;
+    uint64_t now = timerTick();
+    client.times.heard = now;
+    client.times.spoke = now;
+    client.timer.owner = &client;
+    timers.arm(client.timer, now);  // Checked on the next tick, which sets the real expiry
+}
+
+/**
+ * Function: LoopReactor::expireTimers
+ * Purpose: Runs the timers that came due while the loop was waiting
+ */
+void LoopReactor::expireTimers() {
+    timers.advance(timerTick(), [this](Client& client) { checkClient(client); });
+    if (acceptPaused && chrono::steady_clock::now() >= acceptResumeAt) resumeAccepting();
+}
+
+/**
+ * Function: LoopReactor::pauseAccepting
+ * Purpose: Stops taking connections after accept() ran out of descriptors
+ *          or memory, until the pause is over or a client leaves
+ * Parameters: pauseMs - From acceptBackoff
+ * 
+ * The connections wait in the backlog meanwhile; the clients already
+ * here are served as usual.
+ */
+void LoopReactor::pauseAccepting(int pauseMs) {
+    acceptPaused = true;
+    acceptResumeAt = chrono::steady_clock::now() + chrono::milliseconds(pauseMs);
+    setAccepting(false);
+}
+
+/**
+ * Function: LoopReactor::resumeAccepting
+ * Purpose: Ends a pause started by pauseAccepting
+ */
+void LoopReactor::resumeAccepting() {
+    if (setAccepting(true)) {
+        acceptPaused = false;
+        return;
+    }
+    acceptResumeAt = chrono::steady_clock::now() + chrono::milliseconds(ACCEPT_PAUSE_MAX_MS);  // Try again later
+}
+
+/**
+ * Function: LoopReactor::checkClient
+ * Purpose: Reactor equivalent of checkConnection - sends a heartbeat,
+ *          re-arms, or closes the client
+ */
+void LoopReactor::checkClient(Client& client) {
+    if (client.closing) return;
+    uint64_t now = timers.now();
+    ConnectionTimes times = client.times;
+    if (client.outbound.empty()) times.writing = 0;
+
+    uint64_t next = 0;
+    const char* reason = "";
+    DeadlineAction action = checkDeadlines(now, times, next, reason);
+    if (action == DeadlineAction::Close) {
+        reportTimeout(client.id, reason);
+        scheduleClose(client);
+        return;
+    }
+    if (action == DeadlineAction::Heartbeat) {
+        client.times.pinged = now;
+        threadStats().add(StatHeartbeats);
+        queueFrame(client, makeMessage({}));
+    }
+    timers.arm(client.timer, next);
+}
+
+/**
+ * Function: LoopReactor::writeNow
+ * Purpose: Writes as much queued output as the socket accepts right now,
+ *          one gather write per batch, without blocking (a shared-memory
+ *          client's output is copied into its ring instead)
+ */
+FlushResult LoopReactor::writeNow(Client& client) {
+    ThreadStats& stats = threadStats();
+    size_t queued = client.outbound.depth();
+    FlushResult result = client.outbound.flushBatched([&](const OutboundSlice* slices, int count) -> long long {
+        if (client.shm) {
+            // Copied into the ring until it is full (0 arms the write doorbell)
+            size_t written = 0;
+            for (int i = 0; i < count; i++) {
+                size_t done = 0;
+                size_t accepted;
+                while (done < slices[i].length &&
+                       (accepted = client.shm->write(slices[i].data + done, slices[i].length - done)) > 0) {
+                    done += accepted;
+                }
+                written += done;
+                if (done < slices[i].length) break;
+            }
+            if (written > 0) {
+                stats.add(StatWrites);
+                stats.add(StatBytesOut, written);
+                client.times.writing = timers.now();
+            }
+            return (long long)written;
+        }
+        iovec iov[MAX_BATCH_SLICES];
+        size_t batchBytes = 0;
+        for (int i = 0; i < count; i++) {
+            iov[i].iov_base = (void*)slices[i].data;
+            iov[i].iov_len = slices[i].length;
+            batchBytes += slices[i].length;
+        }
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        while (true) {
+            ssize_t sent = sendmsg(client.sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent >= 0) {
+                stats.add(StatWrites);
+                stats.add(StatBytesOut, sent);
+                if ((size_t)sent < batchBytes) stats.add(StatPartialWrites);
+                if (sent > 0) client.times.writing = timers.now();
+                return sent;
+            }
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+    }, config.batch);
+    stats.add(StatMessagesOut, queued - client.outbound.depth());
+    return result;
+}
+
+/**
+ * Function: LoopReactor::broadcast
+ * Purpose: Reactor equivalent of broadcastMessage - queues a message for
+ *          every client except the sender (INVALID_SOCKET sends to all)
+ */
+void LoopReactor::broadcast(const MessageRef& message, SOCKET senderSocket) {
+    uint64_t recipients = 0;
+    for (auto& entry : clients) {
+        if (entry.first != senderSocket) {
+            queueFrame(entry.second, message);
+            recipients++;
+        }
+    }
+    threadStats().add(StatFanout, recipients);
+}
+
+/**
+ * Function: LoopReactor::broadcastRoom
+ * Purpose: Queues a message for this shard's members of one room, except
+ *          the sender
+ */
+void LoopReactor::broadcastRoom(const string& room, const MessageRef& message, SOCKET senderSocket) {
+    Room<Client>* target = rooms.find(room);
+    if (target == nullptr) return;
+    uint64_t recipients = 0;
+    for (Client* member : target->members) {
+        if (member->sock != senderSocket) {
+            queueFrame(*member, message);
+            recipients++;
+        }
+    }
+    threadStats().add(StatFanout, recipients);
+}
+
+/**
+ * Function: LoopReactor::publish
+ * Purpose: Sends a message that originated on this shard to a room - on
+ *          this shard, on every other shard and on the peer nodes
+ * 
+ * The other shards receive a reference to the same pooled message; the
+ * ring hand-off and the wake-up happen in forwardToShards at the end of
+ * the iteration. `chat` is passed on to relayToPeers.
+ */
+void LoopReactor::publish(const MessageRef& message, SOCKET senderSocket, const string& room, bool chat) {
+    threadStats().add(StatBroadcasts);  // Once, however many shards deliver it
+    broadcastRoom(room, message, senderSocket);
+    relayToPeers(message, room, chat);
+    for (ShardLink& link : outboundLinks) {
+        ShardMessage copy{message, room};
+        if (!link.overflow.empty() || !link.ring->push(copy)) {
+            link.overflow.push_back(move(copy));
+        }
+        link.wakePending = true;
+    }
+}
+
+/**
+ * Function: LoopReactor::forwardToShards
+ * Purpose: Retries messages that did not fit into a shard ring and wakes
+ *          every shard that was sent something this iteration
+ */
+void LoopReactor::forwardToShards() {
+    for (ShardLink& link : outboundLinks) {
+        size_t moved = 0;
+        while (moved < link.overflow.size() && link.ring->push(link.overflow[moved])) moved++;
+        link.overflow.erase(link.overflow.begin(), link.overflow.begin() + moved);
+        if (link.wakePending || moved > 0) {
+            link.peer->wake();
+            link.wakePending = false;
+        }
+    }
+}
+
+/**
+ * Function: LoopReactor::scheduleClose
+ * Purpose: Marks a client for removal at the end of the current event batch
+ */
+void LoopReactor::scheduleClose(Client& client) {
+    if (client.closing) return;
+    client.closing = true;
+    closedClients.push_back(client.sock);
+}
+
+/**
+ * Function: LoopReactor::endIteration
+ * Purpose: Reaps closed clients and flushes dirty ones after each batch
+ *          of events
+ * 
+ * Leave notices produce output and failed flushes produce closes, so this
+ * repeats until both settle.
+ */
+void LoopReactor::endIteration() {
+    do {
+        reapClosed();
+        flushDirty();
+    } while (!closedClients.empty());
+    forwardToShards();
+}
+
+/**
+ * Function: LoopReactor::reapClosed
+ * Purpose: Removes clients scheduled for removal and announces their departure
+ * 
+ * The leave broadcast can itself fail on other sockets and schedule more
+ * closes, so this loops until the list is empty.
+ */
+void LoopReactor::reapClosed() {
+    while (!closedClients.empty()) {
+        SOCKET sock = closedClients.back();
+        closedClients.pop_back();
+
+        auto it = clients.find(sock);
+        if (it == clients.end() || it->second.released) continue;
+        Client& client = it->second;
+        string room = client.membership.room->name;
+        MessageRef disconnectMsg = typedMessage(makeMessage({"[Server] Client ", NumberText(client.id), nodeTag, " (",
+                                                             client.ip, ") left the chat."}),
+                                                WireLeave{(uint32_t)client.id, wireNode(), WIRE_CONNECTED, room});
+        rooms.leave(client);
+        if (client.binary) binaryClients--;
+
+        if (client.dirty) {
+            dirtyClients.erase(remove(dirtyClients.begin(), dirtyClients.end(), sock), dirtyClients.end());
+            client.dirty = false;
+        }
+        client.released = true;
+        timers.cancel(client.timer);
+        clientCount--;
+        if (releaseClient(client)) {
+            clients.erase(it);
+        }
+        if (acceptPaused) resumeAccepting();  // Its descriptor is free again
+
+        logMessage(LogLevel::Info, disconnectMsg);
+        publish(disconnectMsg, sock, room);
+    }
+}
+
+/**
+ * Function: LoopReactor::drainInbox
+ * Purpose: Broadcasts messages posted by other threads (the console, the
+ *          peer nodes' links and the other shards) to this shard's
+ *          clients, and admits the
+ *          connections handed over by the local acceptor
+ */
+void LoopReactor::drainInbox() {
+    vector<MessageRef> messages;
+    vector<ShardMessage> roomMessages;
+    vector<Adoption> adopted;
+    {
+        lock_guard<mutex> lock(inboxMutex);
+        messages.swap(inbox);
+        roomMessages.swap(roomInbox);
+        adopted.swap(adoptions);
+    }
+    for (const MessageRef& message : messages) {
+        broadcast(message, INVALID_SOCKET);
+    }
+    for (const ShardMessage& message : roomMessages) {
+        broadcastRoom(message.room, message.message, INVALID_SOCKET);
+    }
+    for (Adoption& adoption : adopted) {
+        adoptClient(adoption.sock, adoption.ip, move(adoption.shm));
+    }
+
+    ShardMessage forwarded;
+    for (auto& ring : inboundRings) {
+        while (ring->pop(forwarded)) {
+            broadcastRoom(forwarded.room, forwarded.message, INVALID_SOCKET);
+        }
+    }
+    forwarded.message.reset();
+}
+
+/**
+ * Function: LoopReactor::pause
+ * Purpose: Stops the loop at the end of its current iteration and waits
+ *          until it is parked there (callable from any other thread)
+ * 
+ * A parked loop touches none of its state, so the caller may use it until
+ * resume().
+ */
+void LoopReactor::pause() {
+    unique_lock<mutex> lock(pauseMutex);
+    pauseRequested = true;
+    wake();
+    pauseChanged.wait(lock, [this] { return parked; });
+}
+
+/**
+ * Function: LoopReactor::resume
+ * Purpose: Lets a paused loop carry on
+ */
+void LoopReactor::resume() {
+    {
+        lock_guard<mutex> lock(pauseMutex);
+        pauseRequested = false;
+    }
+    pauseChanged.notify_all();
+}
+
+/**
+ * Function: LoopReactor::parkIfAsked
+ * Purpose: Called by the loop between iterations; waits there while a
+ *          pause is requested
+ */
+void LoopReactor::parkIfAsked() {
+    if (!pauseRequested) return;
+    unique_lock<mutex> lock(pauseMutex);
+    parked = true;
+    pauseChanged.notify_all();
+    pauseChanged.wait(lock, [this] { return !pauseRequested; });
+    parked = false;
+}
+
+/**
+ * Function: LoopReactor::handOver
+ * Purpose: Collects the listeners and clients of every paused shard for a
+ *          successor process (hot restart, see hot_restart.h)
+ * 
+ * First every shard delivers what is still in its inboxes and rings and
+ * writes what the sockets accept, so that as little as possible has to be
+ * carried across. Shared-memory clients are left out (their rings cannot be
+ * passed on); they reconnect once this process closes them. The shards are
+ * only read, so they can resume if the transfer fails.
+ */
+void LoopReactor::handOver(const vector<LoopReactor*>& shards, HandoffState& state) {
+    for (int pass = 0; pass < 2; pass++) {  // The second delivers what the first forwarded
+        for (LoopReactor* shard : shards) {
+            shard->drainInbox();
+            shard->endIteration();
+        }
+    }
+
+    state.nextClientId = (uint32_t)nextClientId.load();
+    for (LoopReactor* shard : shards) {
+        state.listeners.push_back(shard->listenSocket);
+        for (auto& entry : shard->clients) {
+            Client& client = entry.second;
+            if (client.closing || client.shm) continue;
+            HandedClient handed;
+            handed.sock = client.sock;
+            handed.id = (uint32_t)client.id;
+            handed.ip = client.ip;
+            handed.room = client.membership.room->name;
+            handed.binary = client.binary;
+            handed.inbound = string(client.recvBuffer.unread());
+            for (size_t i = 0; i < client.outbound.depth(); i++) {
+                string_view frame = client.outbound.peek(i).frame();
+                handed.outbound.append(frame.data(), frame.size());
+            }
+            handed.outboundSent = (uint32_t)client.outbound.sentOfOldest();
+            state.clients.push_back(move(handed));
+        }
+    }
+}
+
+/**
+ * Function: LoopReactor::takeOver
+ * Purpose: Shares the clients of the previous process out among the shards
+ *          before they run, and carries on its client numbering
+ */
+void LoopReactor::takeOver(const vector<LoopReactor*>& shards, HandoffState& state) {
+    for (size_t i = 0; i < state.clients.size(); i++) {
+        shards[i % shards.size()]->restore(state.clients[i]);
+    }
+    if (nextClientId < (int)state.nextClientId) nextClientId = (int)state.nextClientId;
+}
+
+/**
+ * Function: LoopReactor::restore
+ * Purpose: Re-creates a client of the previous process - same ID, same
+ *          room, its partial frame and its unsent messages - without any
+ *          join notice
+ * 
+ * Taken-over clients count towards --max-clients but are never refused.
+ */
+void LoopReactor::restore(HandedClient& handed) {
+    Client& client = clients[handed.sock];
+    client.sock = handed.sock;
+    client.id = (int)handed.id;
+    client.ip = handed.ip;
+    client.prefix = "[Client " + to_string(client.id) + nodeTag + "]: ";
+    client.binary = handed.binary;  // Its queued frames are already in its encoding
+    if (client.binary) binaryClients++;
+    rooms.join(client, handed.room);
+    client.recvBuffer.append(handed.inbound.data(), handed.inbound.size());
+
+    // Split by the headers alone: the server built these frames, so the
+    // limit on inbound frame size does not apply
+    string_view rest = handed.outbound;
+    while (rest.size() >= FRAME_HEADER_SIZE) {
+        size_t length = readFrameHeader(rest.data());
+        if (rest.size() < FRAME_HEADER_SIZE + length) break;
+        queueFrame(client, makeMessage({rest.substr(FRAME_HEADER_SIZE, length)}));
+        rest.remove_prefix(FRAME_HEADER_SIZE + length);
+    }
+    if (!client.outbound.empty()) client.outbound.advance(handed.outboundSent);
+    watchClient(client);
+
+    clientCount++;
+    if (nextClientId <= client.id) nextClientId = client.id + 1;
+    threadStats().add(StatTakenOver);
+    restoreClient(client);
+}
+
+/**
+ * Class: EpollReactor
+ * Purpose: Readiness-based backend - multiplexes the sockets with epoll
+ * 
+ * Frames the kernel cannot accept immediately wait in the client's bounded
+ * OutboundQueue and are flushed on EPOLLOUT, which means a slow reader never
+ * blocks the loop. A shared-memory client's two server-side doorbells are
+ * registered next to its socket and play the part of EPOLLIN and EPOLLOUT.
+ */
+class EpollReactor : public LoopReactor {
+public:
+    using LoopReactor::LoopReactor;
+
+    ~EpollReactor() override {
+        if (epollFd >= 0) close(epollFd);
+    }
+
+    bool init() override;
+    void run() override;
+    bool servesSharedMemory() const override { return true; }
+
+private:
+    void acceptClients();
+    void readClient(Client& client);
+    void readShared(Client& client);
+    void handleBell(int bell, uint32_t events);
+    void flushClient(Client& client) override;
+    bool releaseClient(Client& client) override;
+    void adoptClient(SOCKET sock, const string& ip, unique_ptr<ShmChannel> shm) override;
+    void restoreClient(Client& client) override;
+    bool setAccepting(bool accepting) override;
+    bool watchListener();
+    void setWriteInterest(Client& client, bool enabled);
+    void shutdownAll();
+    void abandonAll();
+
+    int epollFd = -1;
+    unordered_map<int, SOCKET> bellOwners;  // Doorbell fd -> shared-memory client
+};
+
+/**
+ * Function: EpollReactor::init
+ * Purpose: Creates the epoll instance and wake-up eventfd and registers the
+ *          listening socket
+ * Returns: true if the reactor is ready to run
+ */
+bool EpollReactor::init() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0 || !setNonBlocking(listenSocket)) {
+        cerr << "[Error] Failed to initialise epoll reactor!" << endl;
+        return false;
+    }
+
+    if (!watchListener()) return false;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) == 0;
+}
+
+/**
+ * Function: EpollReactor::run
+ * Purpose: Event loop - dispatches accept, read and write readiness until
+ *          the server is asked to quit
+ */
+void EpollReactor::run() {
+    const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+
+    while (serverRunning) {
+        long long timeoutUs = nextTimeoutUs();
+        int timeoutMs = timeoutUs < 0 ? -1 : (int)((timeoutUs + 999) / 1000);
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, timeoutMs);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            logLine(LogLevel::Error, {"[Error] epoll_wait failed!"});
+            break;
+        }
+        expireTimers();
+
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == listenSocket) {
+                acceptClients();
+                continue;
+            }
+            if (fd == wakeFd) {
+                uint64_t count;
+                ssize_t ignored = read(wakeFd, &count, sizeof(count));
+                (void)ignored;
+                drainInbox();
+                continue;
+            }
+
+            auto it = clients.find(fd);
+            if (it == clients.end()) {
+                handleBell(fd, events[i].events);
+                continue;
+            }
+            if (it->second.closing) continue;
+            Client& client = it->second;
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                scheduleClose(client);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) flushClient(client);
+            if (!client.closing && (events[i].events & (EPOLLIN | EPOLLRDHUP))) readClient(client);
+        }
+
+        endIteration();
+        parkIfAsked();
+    }
+
+    if (handedOver) {
+        abandonAll();
+    } else {
+        shutdownAll();
+    }
+}
+
+/**
+ * Function: EpollReactor::acceptClients
+ * Purpose: Accepts every pending connection on the (non-blocking) listener
+ */
+void EpollReactor::acceptClients() {
+    if (acceptPaused) return;  // Reported before the pause began, in the same batch
+    while (true) {
+        sockaddr_in clientAddress;
+        socklen_t clientLen = sizeof(clientAddress);
+        SOCKET clientSocket = accept4(listenSocket, (sockaddr*)&clientAddress, &clientLen,
+                                      SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientSocket == INVALID_SOCKET) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            int pauseMs = acceptBackoff.failed(errno);
+            if (pauseMs == 0 || shedConnection(listenSocket)) continue;
+            pauseAccepting(pauseMs);
+            return;
+        }
+        acceptBackoff.succeeded();
+
+        char clientIP[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &clientAddress.sin_addr, clientIP, INET_ADDRSTRLEN);
+
+        // Counted first: the other shards and the local acceptor admit concurrently
+        if (!reserveClient(clientSocket)) continue;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = clientSocket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &ev) != 0) {
+            clientCount--;
+            closesocket(clientSocket);
+            continue;
+        }
+        addClient(clientSocket, clientIP);
+    }
+}
+
+/**
+ * Function: EpollReactor::readClient
+ * Purpose: Drains readable data from a client and broadcasts every complete
+ *          frame it contains
+ * 
+ * Reads are capped per wake-up so one chatty client cannot starve the rest;
+ * epoll is level-triggered and will report the socket again.
+ */
+void EpollReactor::readClient(Client& client) {
+    const int MAX_READS_PER_EVENT = 16;
+
+    for (int i = 0; i < MAX_READS_PER_EVENT && !client.closing; i++) {
+        char* space = client.recvBuffer.prepare(RECV_CHUNK_SIZE);
+        ssize_t bytesRead = recv(client.sock, space, client.recvBuffer.writable(), 0);
+
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (bytesRead < 0 && errno == EINTR) continue;
+        if (bytesRead <= 0) {
+            scheduleClose(client);
+            return;
+        }
+        received = chrono::steady_clock::now();
+        client.recvBuffer.commit(bytesRead);
+        threadStats().add(StatBytesIn, bytesRead);
+        handleBuffered(client);
+    }
+}
+
+/**
+ * Function: EpollReactor::handleBell
+ * Purpose: Reads from or writes to a shared-memory client whose doorbell
+ *          rang
+ */
+void EpollReactor::handleBell(int bell, uint32_t events) {
+    auto owner = bellOwners.find(bell);
+    if (owner == bellOwners.end() || !(events & EPOLLIN)) return;
+    auto it = clients.find(owner->second);
+    if (it == clients.end() || it->second.closing) return;
+    Client& client = it->second;
+
+    ShmChannel::drainBell(bell);
+    if (bell == client.shm->dataBell()) {
+        readShared(client);
+    } else if (client.writePending) {
+        flushClient(client);
+    }
+}
+
+/**
+ * Function: EpollReactor::readShared
+ * Purpose: readClient for a shared-memory client - handles the frames in
+ *          its ring, in place
+ * 
+ * Capped per wake-up like readClient; when frames are left over the
+ * doorbell is rung again so the next iteration comes back for them.
+ */
+void EpollReactor::readShared(Client& client) {
+    const int MAX_FRAMES_PER_EVENT = 256;
+    ShmChannel& shm = *client.shm;
+    received = chrono::steady_clock::now();
+
+    string_view payload;
+    ShmRead result = ShmRead::Empty;
+    int frames = 0;
+    while (frames < MAX_FRAMES_PER_EVENT && !client.closing && (result = shm.read(payload)) == ShmRead::Frame) {
+        threadStats().add(StatBytesIn, FRAME_HEADER_SIZE + payload.size());
+        handleMessage(client, payload);
+        frames++;
+    }
+    shm.release();
+    if (result == ShmRead::Corrupt) {
+        logLine(LogLevel::Error, {"[Error] Client ", NumberText(client.id), " sent a malformed shared-memory frame."});
+        scheduleClose(client);
+    } else if (!client.closing && (result == ShmRead::Frame || !shm.idle())) {
+        ShmChannel::ringBell(shm.dataBell());
+    }
+}
+
+/**
+ * Function: EpollReactor::flushClient
+ * Purpose: Writes what the socket accepts now and waits for EPOLLOUT if
+ *          anything is left
+ */
+void EpollReactor::flushClient(Client& client) {
+    FlushResult result = writeNow(client);
+    if (result == FlushResult::Failed) {
+        scheduleClose(client);
+        return;
+    }
+    setWriteInterest(client, result == FlushResult::WouldBlock);
+}
+
+/**
+ * Function: EpollReactor::releaseClient
+ * Purpose: Unregisters and closes a reaped client's socket
+ */
+bool EpollReactor::releaseClient(Client& client) {
+    if (client.shm) {
+        for (int bell : {client.shm->dataBell(), client.shm->spaceBell()}) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, bell, nullptr);
+            bellOwners.erase(bell);
+        }
+    }
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, client.sock, nullptr);
+    closesocket(client.sock);
+    return true;
+}
+
+/**
+ * Function: EpollReactor::adoptClient
+ * Purpose: Registers a connection from the local acceptor, with its
+ *          doorbells if it uses shared memory
+ */
+void EpollReactor::adoptClient(SOCKET sock, const string& ip, unique_ptr<ShmChannel> shm) {
+    if (!reserveClient(sock)) return;
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = sock;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, sock, &ev) != 0) {
+        clientCount--;
+        closesocket(sock);
+        return;
+    }
+    Client* client = addClient(sock, ip.c_str());
+    if (!shm) return;
+
+    for (int bell : {shm->dataBell(), shm->spaceBell()}) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = bell;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, bell, &ev);
+        bellOwners[bell] = sock;
+    }
+    client->shm = move(shm);
+    threadStats().add(StatSharedMemory);
+}
+
+/**
+ * Function: EpollReactor::watchListener
+ * Purpose: Registers the listening socket with the epoll instance
+ */
+bool EpollReactor::watchListener() {
+    // Prefork workers all wait on this listener: wake one of them per connection
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    if (preforkWorker > 0) ev.events |= EPOLLEXCLUSIVE;
+    ev.data.fd = listenSocket;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSocket, &ev) == 0;
+}
+
+/**
+ * Function: EpollReactor::setAccepting
+ * Purpose: Watches the listener again, or ignores it (it stays readable
+ *          while connections wait, and the loop would wake for nothing)
+ * 
+ * Removed and added again rather than modified: the kernel refuses
+ * EPOLL_CTL_MOD on an EPOLLEXCLUSIVE registration (prefork workers).
+ */
+bool EpollReactor::setAccepting(bool accepting) {
+    bool done = accepting ? watchListener() : epoll_ctl(epollFd, EPOLL_CTL_DEL, listenSocket, nullptr) == 0;
+    if (!done) {
+        logLine(LogLevel::Error, {"[Error] Failed to ", accepting ? "resume" : "pause", " accepting: ", strerror(errno)});
+    }
+    return done;
+}
+
+/**
+ * Function: EpollReactor::restoreClient
+ * Purpose: Watches a client taken over from the previous process
+ */
+void EpollReactor::restoreClient(Client& client) {
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = client.sock;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, client.sock, &ev) != 0) scheduleClose(client);
+}
+
+/**
+ * Function: EpollReactor::setWriteInterest
+ * Purpose: Arms or disarms EPOLLOUT for a client when its state changes
+ *          (a shared-memory client's write doorbell is always registered)
+ */
+void EpollReactor::setWriteInterest(Client& client, bool enabled) {
+    if (client.writePending == enabled) return;
+    if (client.shm) {
+        client.writePending = enabled;
+        return;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP | (enabled ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.fd = client.sock;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, client.sock, &ev);
+    client.writePending = enabled;
+}
+
+/**
+ * Function: EpollReactor::shutdownAll
+ * Purpose: Makes a last attempt to flush queued output, then closes every
+ *          client socket
+ */
+void EpollReactor::shutdownAll() {
+    drainInbox();
+    for (auto& entry : clients) {
+        Client& client = entry.second;
+        if (!client.closing) writeNow(client);
+        closesocket(entry.first);
+    }
+    rooms.clear();
+    clients.clear();
+    clientCount = 0;
+}
+
+/**
+ * Function: EpollReactor::abandonAll
+ * Purpose: After a hot restart, closes this process's copies of the client
+ *          sockets without a word to anyone - the successor has the same
+ *          connections and carries on with them (so no shutdown() either)
+ */
+void EpollReactor::abandonAll() {
+    for (auto& entry : clients) {
+        closesocket(entry.first);
+    }
+    rooms.clear();
+    clients.clear();
+    clientCount = 0;
+}
+
+/**
+ * Class: UringReactor
+ * Purpose: Completion-based backend built on io_uring (Linux 6.0+)
+ * 
+ * Instead of one system call per accept, recv and send, the loop keeps a
+ * few long-lived operations in the ring and makes one io_uring_enter per
+ * iteration:
+ *   - a multishot accept on the listener produces every new connection;
+ *   - each client has a multishot recv that picks a buffer from a shared
+ *     pool of provided buffers only when data arrives, so idle clients hold
+ *     no receive memory and frames are parsed straight out of that buffer;
+ *   - at the end of an iteration every dirty client gets one SENDMSG (a
+ *     gather write of its queued batch), and the whole broadcast fan-out is
+ *     submitted together with the next wait.
+ * Queued messages stay pinned in the OutboundQueue until their send
+ * completes, since the kernel reads the pooled buffers asynchronously.
+ * 
+ * The kernel may deliver a large burst from one client in a single batch of
+ * completions. Only URING_RECV_BUDGET buffers per client are processed per
+ * iteration (the epoll loop caps reads per wake-up the same way); the rest
+ * wait in a backlog, which keeps the fan-out in step with the sends and,
+ * once the buffer pool runs dry, pushes back on the sender through TCP.
+ */
+class UringReactor : public LoopReactor {
+public:
+    using LoopReactor::LoopReactor;
+
+    bool init() override;
+    void run() override;
+
+private:
+    // Operation kind, stored in the upper half of the SQE user_data
+    enum Op : uint32_t { OpAccept = 1, OpRecv, OpSend, OpWake };
+
+    static uint64_t tag(Op op, int fd) { return ((uint64_t)op << 32) | (uint32_t)fd; }
+
+    struct DeferredRecv {
+        SOCKET sock;
+        uint16_t bufferId;
+        int length;
+        chrono::steady_clock::time_point received;
+    };
+
+    io_uring_sqe* nextSqe();
+    void armAccept();
+    void armRecv(Client& client);
+    void armWake();
+    void handleCompletion(const io_uring_cqe& cqe);
+    void onAccept(int result, uint32_t flags);
+    void onRecv(Client& client, int result, uint32_t flags);
+    void onSend(Client& client, int result);
+    bool takeRecvBudget(Client& client);
+    void consumeBuffer(Client& client, uint16_t bufferId, int length, chrono::steady_clock::time_point arrived);
+    void drainBacklog();
+    void resumeStalled();
+    void flushClient(Client& client) override;
+    bool releaseClient(Client& client) override;
+    void adoptClient(SOCKET sock, const string& ip, unique_ptr<ShmChannel> shm) override;
+    void restoreClient(Client& client) override { armRecv(client); }
+    bool setAccepting(bool accepting) override {
+        if (accepting && !acceptArmed && serverRunning) armAccept();  // Else onAccept left it unarmed
+        return true;
+    }
+    void eraseIfIdle(Client& client);
+    void shutdownAll();
+
+    ProvidedBuffers recvBuffers;        // Declared first: the ring is torn down before it
+    IoUring uring;
+    uint64_t wakeCount = 0;             // Target of the eventfd read
+    bool acceptArmed = false;
+    unsigned round = 0;                 // Loop iteration counter
+    chrono::steady_clock::time_point reaped;  // When this iteration's completions were collected
+    vector<DeferredRecv> backlog;       // Received buffers held back, in arrival order
+    vector<SOCKET> stalledClients;      // Recv ended for lack of buffers
+};
+
+const unsigned URING_ENTRIES = 4096;        // Submission queue size
+const unsigned URING_RECV_BUFFERS = 4096;   // Provided buffers (power of two)
+const unsigned URING_RECV_BUFFER_SIZE = 4096;
+const unsigned URING_RECV_BUDGET = 4;       // Buffers processed per client per iteration
+
+/**
+ * Function: UringReactor::init
+ * Purpose: Sets up the ring, the provided receive buffers and the wake-up
+ *          eventfd
+ * Returns: false if the kernel lacks the features used (caller falls back
+ *          to epoll)
+ */
+bool UringReactor::init() {
+    if (!kernelAtLeast(6, 0)) {
+        cerr << "[Server] io_uring multishot recv needs Linux 6.0 or newer." << endl;
+        return false;
+    }
+    int error = uring.init(URING_ENTRIES);
+    if (error == 0) error = recvBuffers.init(uring, 0, URING_RECV_BUFFERS, URING_RECV_BUFFER_SIZE);
+    if (error != 0) {
+        cerr << "[Server] io_uring unavailable: " << strerror(-error) << "." << endl;
+        return false;
+    }
+    static atomic<bool> reported(false);  // Once, not once per shard
+    if (!recvBuffers.usesRing() && !reported.exchange(true)) {
+        cout << "[Server] Provided-buffer ring not usable on this kernel; using IORING_OP_PROVIDE_BUFFERS." << endl;
+    }
+
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (wakeFd < 0) return false;
+    armAccept();
+    armWake();
+    return true;
+}
+
+/**
+ * Function: UringReactor::nextSqe
+ * Purpose: Reserves a submission entry, submitting queued ones if the
+ *          submission queue is full
+ */
+io_uring_sqe* UringReactor::nextSqe() {
+    io_uring_sqe* sqe = uring.getSqe();
+    while (sqe == nullptr) {
+        uring.submit();
+        sqe = uring.getSqe();
+    }
+    return sqe;
+}
+
+/**
+ * Function: UringReactor::armAccept
+ * Purpose: Starts a multishot accept on the listening socket
+ */
+void UringReactor::armAccept() {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenSocket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = tag(OpAccept, listenSocket);
+    acceptArmed = true;
+}
+
+/**
+ * Function: UringReactor::armRecv
+ * Purpose: Starts a multishot recv that draws from the provided buffers
+ */
+void UringReactor::armRecv(Client& client) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client.sock;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = recvBuffers.group();
+    sqe->user_data = tag(OpRecv, client.sock);
+    client.recvArmed = true;
+}
+
+/**
+ * Function: UringReactor::armWake
+ * Purpose: Reads the wake-up eventfd so posts from other threads complete
+ *          a pending wait
+ */
+void UringReactor::armWake() {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd;
+    sqe->addr = (uint64_t)(uintptr_t)&wakeCount;
+    sqe->len = sizeof(wakeCount);
+    sqe->user_data = tag(OpWake, wakeFd);
+}
+
+/**
+ * Function: UringReactor::run
+ * Purpose: Event loop - submits pending operations and handles completions
+ *          until the server is asked to quit
+ */
+void UringReactor::run() {
+    while (serverRunning) {
+        // Held-back input is work to do now, not a reason to sleep
+        long long timeoutUs = backlog.empty() ? nextTimeoutUs() : 0;
+        if (timeoutUs != 0 && (timeoutUs < 0 || uring.hasExtArg())) {
+            int result = uring.submit(1, timeoutUs < 0 ? -1 : timeoutUs * 1000);
+            if (result < 0 && result != -ETIME && result != -EINTR && result != -EBUSY) {
+                logLine(LogLevel::Error, {"[Error] io_uring_enter failed: ", strerror(-result)});
+                break;
+            }
+        } else {
+            uring.submit();  // Poll (also used for cork deadlines without EXT_ARG)
+        }
+
+        round++;
+        reaped = chrono::steady_clock::now();
+        expireTimers();
+        drainBacklog();
+        uring.forEachCompletion([this](const io_uring_cqe& cqe) { handleCompletion(cqe); });
+        recvBuffers.publish();
+        resumeStalled();
+        endIteration();
+    }
+
+    shutdownAll();
+}
+
+/**
+ * Function: UringReactor::handleCompletion
+ * Purpose: Routes one completion to its handler by the operation tag
+ */
+void UringReactor::handleCompletion(const io_uring_cqe& cqe) {
+    Op op = (Op)(cqe.user_data >> 32);
+    int fd = (int)(uint32_t)cqe.user_data;
+
+    if (op == OpAccept) {
+        onAccept(cqe.res, cqe.flags);
+        return;
+    }
+    if (op == OpWake) {
+        drainInbox();
+        if (serverRunning) armWake();
+        return;
+    }
+
+    auto it = clients.find(fd);
+    if (it == clients.end()) return;
+    if (op == OpRecv) onRecv(it->second, cqe.res, cqe.flags);
+    else if (op == OpSend) onSend(it->second, cqe.res);
+}
+
+/**
+ * Function: UringReactor::onAccept
+ * Purpose: Registers a connection produced by the multishot accept
+ */
+void UringReactor::onAccept(int result, uint32_t flags) {
+    if (!(flags & IORING_CQE_F_MORE)) acceptArmed = false;
+    if (result < 0 && result != -ECONNABORTED && result != -EINTR) {
+        int pauseMs = acceptBackoff.failed(-result);
+        if (pauseMs > 0 && !shedConnection(listenSocket)) pauseAccepting(pauseMs);
+    }
+    if (!acceptArmed && !acceptPaused && serverRunning) armAccept();
+    if (result < 0) return;
+    acceptBackoff.succeeded();
+
+    sockaddr_in clientAddress{};
+    socklen_t clientLen = sizeof(clientAddress);
+    getpeername(result, (sockaddr*)&clientAddress, &clientLen);
+    char clientIP[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &clientAddress.sin_addr, clientIP, INET_ADDRSTRLEN);
+
+    if (reserveClient(result)) armRecv(*addClient(result, clientIP));
+}
+
+/**
+ * Function: UringReactor::adoptClient
+ * Purpose: Registers a connection from the local acceptor (always a plain
+ *          socket client: this backend declines shared memory)
+ */
+void UringReactor::adoptClient(SOCKET sock, const string& ip, unique_ptr<ShmChannel>) {
+    if (reserveClient(sock)) armRecv(*addClient(sock, ip.c_str()));
+}
+
+/**
+ * Function: UringReactor::onRecv
+ * Purpose: Handles data (or the end of the stream) from a multishot recv
+ */
+void UringReactor::onRecv(Client& client, int result, uint32_t flags) {
+    if (!(flags & IORING_CQE_F_MORE)) client.recvArmed = false;
+
+    if (result > 0 && (flags & IORING_CQE_F_BUFFER)) {
+        uint16_t bufferId = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+        threadStats().add(StatBytesIn, result);
+        if (client.closing) {
+            recvBuffers.recycle(bufferId);
+        } else if (client.deferredRecvs > 0 || !takeRecvBudget(client)) {
+            backlog.push_back({client.sock, bufferId, result, reaped});  // Keeps per-client order
+            client.deferredRecvs++;
+        } else {
+            consumeBuffer(client, bufferId, result, reaped);
+        }
+    } else if (result == -ENOBUFS) {
+        if (!client.closing) stalledClients.push_back(client.sock);
+    } else {
+        scheduleClose(client);  // EOF or error
+    }
+
+    // A multishot recv can also end while data keeps coming; resume it
+    if (!client.recvArmed && !client.closing && result != -ENOBUFS) armRecv(client);
+    eraseIfIdle(client);
+}
+
+/**
+ * Function: UringReactor::takeRecvBudget
+ * Purpose: Counts one received buffer against the client's per-iteration
+ *          budget
+ * Returns: false if the budget for this iteration is used up
+ */
+bool UringReactor::takeRecvBudget(Client& client) {
+    if (client.recvRound != round) {
+        client.recvRound = round;
+        client.recvUsed = 0;
+    }
+    if (client.recvUsed >= URING_RECV_BUDGET) return false;
+    client.recvUsed++;
+    return true;
+}
+
+/**
+ * Function: UringReactor::consumeBuffer
+ * Purpose: Broadcasts the frames in one provided buffer and returns the
+ *          buffer to the kernel
+ * 
+ * When no partial frame is pending the frames are parsed directly out of
+ * the provided buffer and only an incomplete tail is copied aside.
+ */
+void UringReactor::consumeBuffer(Client& client, uint16_t bufferId, int length,
+                                 chrono::steady_clock::time_point arrived) {
+    received = arrived;
+    const char* data = recvBuffers.buffer(bufferId);
+    if (client.recvBuffer.buffered() == 0) {
+        string_view input(data, (size_t)length);
+        handleFrames(client, input);
+        if (!input.empty() && !client.closing) client.recvBuffer.append(input.data(), input.size());
+    } else {
+        client.recvBuffer.append(data, (size_t)length);
+        handleBuffered(client);
+    }
+    recvBuffers.recycle(bufferId);
+}
+
+/**
+ * Function: UringReactor::drainBacklog
+ * Purpose: Processes held-back buffers as far as this iteration's budgets
+ *          allow, oldest first
+ */
+void UringReactor::drainBacklog() {
+    size_t kept = 0;
+    for (size_t i = 0; i < backlog.size(); i++) {
+        DeferredRecv entry = backlog[i];
+        auto it = clients.find(entry.sock);
+        Client& client = it->second;  // Not erased while it has deferred buffers
+
+        if (!client.closing && !takeRecvBudget(client)) {
+            backlog[kept++] = entry;
+            continue;
+        }
+        client.deferredRecvs--;
+        if (client.closing) {
+            recvBuffers.recycle(entry.bufferId);
+            eraseIfIdle(client);
+        } else {
+            consumeBuffer(client, entry.bufferId, entry.length, entry.received);
+        }
+    }
+    backlog.resize(kept);
+}
+
+/**
+ * Function: UringReactor::resumeStalled
+ * Purpose: Re-arms recvs that stopped because every buffer was in use,
+ *          once the backlog has handed some back
+ */
+void UringReactor::resumeStalled() {
+    if (stalledClients.empty() || backlog.size() >= URING_RECV_BUFFERS / 2) return;
+    for (SOCKET sock : stalledClients) {
+        auto it = clients.find(sock);
+        if (it != clients.end() && !it->second.closing && !it->second.recvArmed) armRecv(it->second);
+    }
+    stalledClients.clear();
+}
+
+/**
+ * Function: UringReactor::onSend
+ * Purpose: Accounts for a completed gather write and continues with the
+ *          rest of the queue
+ */
+void UringReactor::onSend(Client& client, int result) {
+    client.writePending = false;
+    size_t queued = client.outbound.depth();
+    client.outbound.advance(result > 0 ? (size_t)result : 0);
+    if (result > 0) client.times.writing = timers.now();
+    if (result >= 0) {
+        ThreadStats& stats = threadStats();
+        stats.add(StatWrites);
+        stats.add(StatBytesOut, result);
+        stats.add(StatMessagesOut, queued - client.outbound.depth());
+        if ((size_t)result < client.sendBytes) stats.add(StatPartialWrites);
+    }
+    if (result < 0) {
+        scheduleClose(client);
+    } else if (!client.closing && !client.outbound.empty()) {
+        flushClient(client);  // Short write or messages queued meanwhile
+    }
+    eraseIfIdle(client);
+}
+
+/**
+ * Function: UringReactor::flushClient
+ * Purpose: Queues one SENDMSG covering the client's next batch
+ * 
+ * The SQE is only submitted with the loop's next io_uring_enter, together
+ * with the sends for every other client flushed in this iteration.
+ */
+void UringReactor::flushClient(Client& client) {
+    if (client.writePending || client.closing || client.outbound.empty()) return;
+
+    OutboundSlice slices[MAX_BATCH_SLICES];
+    size_t batchBytes;
+    int count = client.outbound.gather(slices, config.batch, batchBytes);
+    client.sendBytes = batchBytes;
+    if (!client.sendIov) client.sendIov.reset(new iovec[MAX_BATCH_SLICES]);
+    for (int i = 0; i < count; i++) {
+        client.sendIov[i].iov_base = (void*)slices[i].data;
+        client.sendIov[i].iov_len = slices[i].length;
+    }
+    client.sendMsg = msghdr{};
+    client.sendMsg.msg_iov = client.sendIov.get();
+    client.sendMsg.msg_iovlen = count;
+
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = client.sock;
+    sqe->addr = (uint64_t)(uintptr_t)&client.sendMsg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = tag(OpSend, client.sock);
+    client.writePending = true;
+}
+
+/**
+ * Function: UringReactor::releaseClient
+ * Purpose: Ends a reaped client's outstanding operations
+ * 
+ * shutdown() completes the pending recv (and fails a pending send). The
+ * socket is closed only after those completions arrive and its held-back
+ * buffers are returned, so its fd - the key they carry - cannot be reused
+ * in the meantime.
+ */
+bool UringReactor::releaseClient(Client& client) {
+    shutdown(client.sock, SHUT_RDWR);
+    if (client.recvArmed || client.writePending || client.deferredRecvs > 0) return false;
+    closesocket(client.sock);
+    return true;
+}
+
+/**
+ * Function: UringReactor::eraseIfIdle
+ * Purpose: Finishes removing a released client once nothing is in flight
+ */
+void UringReactor::eraseIfIdle(Client& client) {
+    if (!client.released || client.recvArmed || client.writePending || client.deferredRecvs > 0) return;
+    SOCKET sock = client.sock;
+    closesocket(sock);
+    clients.erase(sock);
+}
+
+/**
+ * Function: UringReactor::shutdownAll
+ * Purpose: Delivers queued output (the farewell notice), then closes every
+ *          client socket once its operations have completed
+ * 
+ * In-flight sends reference client state and pooled messages, so the
+ * clients are only destroyed after the kernel has finished with them.
+ */
+void UringReactor::shutdownAll() {
+    drainInbox();
+    for (auto& entry : clients) {
+        flushClient(entry.second);  // Cork deadlines no longer matter
+    }
+
+    auto busy = [this](bool includeRecv) {
+        for (auto& entry : clients) {
+            if (entry.second.writePending || (includeRecv && entry.second.recvArmed)) return true;
+        }
+        return false;
+    };
+    // Completions are only tracked from here on, not acted upon
+    auto settle = [this](const io_uring_cqe& cqe) {
+        Op op = (Op)(cqe.user_data >> 32);
+        bool last = !(cqe.flags & IORING_CQE_F_MORE);
+        if (op == OpAccept) {
+            if (last) acceptArmed = false;
+            if (cqe.res >= 0) closesocket(cqe.res);
+            return;
+        }
+        auto it = clients.find((int)(uint32_t)cqe.user_data);
+        if (it == clients.end()) return;
+        Client& client = it->second;
+        if (op == OpSend) {
+            client.writePending = false;
+            client.outbound.advance(cqe.res > 0 ? (size_t)cqe.res : 0);
+            if (cqe.res > 0) flushClient(client);
+        }
+        if (op == OpRecv && last) client.recvArmed = false;
+    };
+
+    // Let the final sends go out, but do not wait on a stalled client forever
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(1);
+    while (busy(false) && chrono::steady_clock::now() < deadline) {
+        uring.submit(1, 10 * 1000 * 1000);
+        uring.forEachCompletion(settle);
+    }
+
+    // Shutting the sockets down completes every remaining operation
+    for (auto& entry : clients) shutdown(entry.first, SHUT_RDWR);
+    shutdown(listenSocket, SHUT_RDWR);
+    deadline = chrono::steady_clock::now() + chrono::seconds(1);
+    while ((busy(true) || acceptArmed) && chrono::steady_clock::now() < deadline) {
+        uring.submit(1, 10 * 1000 * 1000);
+        uring.forEachCompletion(settle);
+    }
+
+    for (auto& entry : clients) closesocket(entry.first);
+    rooms.clear();
+    clients.clear();
+    clientCount = 0;
+}
+#endif
+
+#ifdef __linux__
+const int UDP_EXPIRY_CHECK_MS = 1000;      // How often silent subscribers are looked for
+const int UDP_SOCKET_BUFFER = 4 << 20;     // Requested receive/send buffer (the kernel may cap it)
+const int UDP_BATCHES_PER_WAKE = 16;       // recvmmsg rounds before checking the inbox again
+
+/**
+ * Class: UdpFeed
+ * Purpose: Serves the UDP datagram mode (--udp-port) from its own thread
+ * 
+ * The first datagram from a new address registers it in the subscriber
+ * table, in the lobby ("/subscribe" registers without saying anything).
+ * After that its datagrams are handled like a TCP client's frames: chat
+ * messages go to the other subscribers in its room, "/join" and "/leave"
+ * switch rooms and "/unsubscribe" removes it. "/ping" just keeps it
+ * registered - a subscriber silent for --udp-timeout seconds is dropped.
+ * The feed keeps its own subscribers and rooms, apart from the TCP
+ * clients; console broadcasts reach both.
+ * 
+ * One recvmmsg takes up to FEED_BATCH datagrams; after handling them all,
+ * the replies and fan-outs they caused go out through sendmmsg (see
+ * udp_feed.h). Nothing is queued per subscriber: what the socket buffer
+ * cannot take is dropped and shows up as a gap in that subscriber's
+ * sequence numbers.
+ */
+class UdpFeed {
+public:
+    ~UdpFeed() {
+        if (sock != INVALID_SOCKET) closesocket(sock);
+        if (wakeFd >= 0) close(wakeFd);
+    }
+
+    bool open(int port);
+    void run();
+    void post(const MessageRef& message);
+    void stop();
+    int subscriberCount() const { return subscribed.load(); }
+
+private:
+    struct Subscriber {
+        sockaddr_in address;
+        int id;
+        string prefix;                  // "[UDP N]: ", formatted once
+        uint64_t nextSequence = 1;      // Numbers the datagrams sent to it
+        SequenceTracker received;       // Gaps in the datagrams it sends
+        chrono::steady_clock::time_point lastHeard;
+        RoomMembership<Subscriber> membership;
+    };
+
+    static uint64_t keyOf(const sockaddr_in& address) {
+        return ((uint64_t)ntohl(address.sin_addr.s_addr) << 16) | ntohs(address.sin_port);
+    }
+
+    void handleDatagram(const sockaddr_in& from, string_view datagram);
+    Subscriber* subscribe(const sockaddr_in& from);
+    void unsubscribe(Subscriber& subscriber, const char* reason);
+    void switchRoom(Subscriber& subscriber, RoomCommand command, const string& target);
+    void sendTo(Subscriber& subscriber, const MessageRef& message);
+    void publish(Room<Subscriber>* room, const MessageRef& message, const Subscriber* except);
+    void expireSilent();
+    void drainInbox();
+    void flush();
+
+    SOCKET sock = INVALID_SOCKET;
+    int wakeFd = -1;
+    int nextId = 1;
+    atomic<int> subscribed{0};      // Read by the stats report
+    atomic<bool> stopping{false};
+    chrono::steady_clock::time_point now;  // Arrival time of the batch being handled
+    unordered_map<uint64_t, Subscriber> subscribers;  // By address; nodes never move
+    RoomIndex<Subscriber> rooms;
+    DatagramReceiver receiver;
+    DatagramSender sender;
+    vector<MessageRef> pinned;      // Messages the queued datagrams point into
+
+    mutex inboxMutex;               // Guards inbox (written by the console)
+    vector<MessageRef> inbox;       // Server broadcasts waiting for the feed thread
+};
+
+UdpFeed* udpFeed = nullptr;         // Active UDP feed (--udp-port only)
+
+/**
+ * Function: UdpFeed::open
+ * Purpose: Binds the UDP socket and creates the wake-up eventfd
+ * Returns: false if either fails
+ */
+bool UdpFeed::open(int port) {
+    sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (sock == INVALID_SOCKET || wakeFd < 0) return false;
+
+    // A burst from many publishers waits here, not on the floor
+    int size = UDP_SOCKET_BUFFER;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)&size, sizeof(size));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)&size, sizeof(size));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = INADDR_ANY;
+    return bind(sock, (sockaddr*)&address, sizeof(address)) != SOCKET_ERROR;
+}
+
+/**
+ * Function: UdpFeed::run
+ * Purpose: The feed thread's loop - receives batches of datagrams, sends
+ *          what they caused, delivers console broadcasts and drops silent
+ *          subscribers, until stop() is called
+ */
+void UdpFeed::run() {
+    pollfd fds[2] = {{sock, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+    auto nextExpiry = chrono::steady_clock::now() + chrono::milliseconds(UDP_EXPIRY_CHECK_MS);
+
+    while (!stopping) {
+        int ready = poll(fds, 2, UDP_EXPIRY_CHECK_MS);
+        if (ready < 0 && errno != EINTR) break;
+        if (fds[1].revents & POLLIN) {
+            ShmChannel::drainBell(wakeFd);
+            drainInbox();
+        }
+        if (fds[0].revents & POLLIN) {
+            ThreadStats& stats = threadStats();
+            int count;
+            for (int round = 0; round < UDP_BATCHES_PER_WAKE && (count = receiver.receive(sock)) > 0; round++) {
+                stats.add(StatDatagramCalls);
+                now = chrono::steady_clock::now();
+                for (int i = 0; i < count; i++) {
+                    handleDatagram(receiver.sender(i), receiver.datagram(i));
+                }
+                flush();
+            }
+        }
+        flush();
+
+        if (chrono::steady_clock::now() >= nextExpiry) {
+            expireSilent();
+            nextExpiry = chrono::steady_clock::now() + chrono::milliseconds(UDP_EXPIRY_CHECK_MS);
+        }
+    }
+
+    drainInbox();  // The shutdown notice, posted before stop()
+    flush();
+}
+
+/**
+ * Function: UdpFeed::post
+ * Purpose: Hands a server broadcast to the feed thread (any thread)
+ */
+void UdpFeed::post(const MessageRef& message) {
+    {
+        lock_guard<mutex> lock(inboxMutex);
+        inbox.push_back(message);
+    }
+    ShmChannel::ringBell(wakeFd);
+}
+
+/**
+ * Function: UdpFeed::stop
+ * Purpose: Makes run() return once it has sent what was posted so far
+ */
+void UdpFeed::stop() {
+    stopping = true;
+    ShmChannel::ringBell(wakeFd);
+}
+
+/**
+ * Function: UdpFeed::handleDatagram
+ * Purpose: Registers a new sender, or handles a subscriber's message or
+ *          command
+ */
+void UdpFeed::handleDatagram(const sockaddr_in& from, string_view datagram) {
+    ThreadStats& stats = threadStats();
+    stats.add(StatDatagramsIn);
+    uint64_t sequence;
+    string_view payload;
+    if (!readSequence(datagram, sequence, payload)) return;  // Truncated, or not one of ours
+
+    auto it = subscribers.find(keyOf(from));
+    Subscriber* subscriber = it == subscribers.end() ? subscribe(from) : &it->second;
+    if (subscriber == nullptr) return;
+    subscriber->lastHeard = now;
+    stats.add(StatDatagramGaps, subscriber->received.observe(sequence));
+
+    if (payload == "/subscribe" || payload == "/ping") return;
+    if (payload == "/unsubscribe") {
+        unsubscribe(*subscriber, "unsubscribed");
+        return;
+    }
+    string target;
+    RoomCommand command = parseRoomCommand(payload, target);
+    if (command != RoomCommand::None) {
+        switchRoom(*subscriber, command, target);
+        return;
+    }
+
+    MessageRef message = makeMessage({subscriber->prefix, payload});
+    logSampled(LogLevel::Info, message);
+    publish(subscriber->membership.room, message, subscriber);
+    stats.recvToBroadcast.record(elapsedNs(now));
+}
+
+/**
+ * Function: UdpFeed::subscribe
+ * Purpose: Adds a new address to the subscriber table, in the lobby
+ * Returns: The subscriber, or nullptr if the table is full (it is told)
+ */
+UdpFeed::Subscriber* UdpFeed::subscribe(const sockaddr_in& from) {
+    if (subscribed.load() >= config.maxClients) {
+        MessageRef fullMsg = makeMessage({"[Server] Sorry, server is full. Try again later."});
+        pinned.push_back(fullMsg);
+        sender.queue(from, 1, fullMsg.payload());
+        threadStats().add(StatRejected);
+        return nullptr;
+    }
+    threadStats().add(StatAccepted);
+    subscribed++;
+
+    Subscriber& subscriber = subscribers[keyOf(from)];
+    subscriber.address = from;
+    subscriber.id = nextId++;
+    NumberText idText(subscriber.id);
+    subscriber.prefix = "[UDP " + string(idText) + "]: ";
+    Room<Subscriber>& lobby = rooms.join(subscriber, DEFAULT_ROOM);
+
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &from.sin_addr, ip, sizeof(ip));
+    MessageRef joinedMsg = makeMessage({"[Server] UDP ", idText, " (", ip, ":", NumberText(ntohs(from.sin_port)),
+                                        ") joined the feed!"});
+    publish(&lobby, joinedMsg, &subscriber);
+    logMessage(LogLevel::Info, joinedMsg);
+    sendTo(subscriber, makeMessage({"[Server] Welcome! You are UDP ", idText, ". There are ",
+                                    NumberText(subscribed.load()), " subscribers. You are in room ",
+                                    DEFAULT_ROOM, "; send /join <room> to switch, and anything (or /ping) at least every ",
+                                    NumberText(config.udpTimeout), " s to stay subscribed."}));
+    return &subscriber;
+}
+
+/**
+ * Function: UdpFeed::unsubscribe
+ * Purpose: Removes a subscriber and tells its room
+ * Parameters: reason - Shown in the notice ("unsubscribed", "timed out")
+ */
+void UdpFeed::unsubscribe(Subscriber& subscriber, const char* reason) {
+    MessageRef leftMsg = makeMessage({"[Server] UDP ", NumberText(subscriber.id), " left the feed (", reason, ")."});
+    publish(subscriber.membership.room, leftMsg, &subscriber);
+    logMessage(LogLevel::Info, leftMsg);
+    rooms.leave(subscriber);
+    subscribers.erase(keyOf(subscriber.address));
+    subscribed--;
+}
+
+/**
+ * Function: UdpFeed::switchRoom
+ * Purpose: Feed equivalent of switchRoom - moves a subscriber to another
+ *          room and tells both rooms
+ */
+void UdpFeed::switchRoom(Subscriber& subscriber, RoomCommand command, const string& target) {
+    if (command == RoomCommand::Invalid) {
+        sendTo(subscriber, makeMessage({ROOM_USAGE}));
+        return;
+    }
+    string room = subscriber.membership.room->name;
+    if (target == room) {
+        sendTo(subscriber, makeMessage({"[Server] You are already in room ", room, "."}));
+        return;
+    }
+
+    NumberText idText(subscriber.id);
+    publish(subscriber.membership.room, makeMessage({"[Server] UDP ", idText, " left room ", room, "."}), &subscriber);
+    Room<Subscriber>& joined = rooms.join(subscriber, target);
+    publish(&joined, makeMessage({"[Server] UDP ", idText, " joined room ", target, "."}), &subscriber);
+    sendTo(subscriber, makeMessage({"[Server] You are now in room ", target, "."}));
+    logLine(LogLevel::Info, {"[Server] UDP ", idText, " moved from room ", room, " to room ", target, "."});
+}
+
+/**
+ * Function: UdpFeed::sendTo
+ * Purpose: Queues one message for one subscriber, with its next sequence
+ *          number
+ */
+void UdpFeed::sendTo(Subscriber& subscriber, const MessageRef& message) {
+    pinned.push_back(message);
+    sender.queue(subscriber.address, subscriber.nextSequence++, message.payload());
+}
+
+/**
+ * Function: UdpFeed::publish
+ * Purpose: Queues a message for every member of a room but one
+ * Parameters:
+ *   - room: Target room (nothing happens if it is nullptr)
+ *   - message: The message; its payload is shared by every datagram
+ *   - except: Subscriber to skip (the sender), or nullptr
+ */
+void UdpFeed::publish(Room<Subscriber>* room, const MessageRef& message, const Subscriber* except) {
+    if (room == nullptr) return;
+    pinned.push_back(message);
+    size_t recipients = 0;
+    for (Subscriber* member : room->members) {
+        if (member == except) continue;
+        sender.queue(member->address, member->nextSequence++, message.payload());
+        recipients++;
+    }
+    ThreadStats& stats = threadStats();
+    stats.add(StatBroadcasts);
+    stats.add(StatFanout, recipients);
+}
+
+/**
+ * Function: UdpFeed::expireSilent
+ * Purpose: Drops the subscribers not heard from for --udp-timeout seconds
+ */
+void UdpFeed::expireSilent() {
+    auto cutoff = chrono::steady_clock::now() - chrono::seconds(config.udpTimeout);
+    vector<Subscriber*> silent;
+    for (auto& entry : subscribers) {
+        if (entry.second.lastHeard < cutoff) silent.push_back(&entry.second);
+    }
+    for (Subscriber* subscriber : silent) unsubscribe(*subscriber, "timed out");
+    flush();
+}
+
+/**
+ * Function: UdpFeed::drainInbox
+ * Purpose: Sends the posted server broadcasts to every subscriber
+ */
+void UdpFeed::drainInbox() {
+    vector<MessageRef> messages;
+    {
+        lock_guard<mutex> lock(inboxMutex);
+        messages.swap(inbox);
+    }
+    for (const MessageRef& message : messages) {
+        for (auto& entry : subscribers) sendTo(entry.second, message);
+    }
+    flush();
+}
+
+/**
+ * Function: UdpFeed::flush
+ * Purpose: Sends every queued datagram, batched by sendmmsg
+ */
+void UdpFeed::flush() {
+    if (sender.empty()) return;
+    ThreadStats& stats = threadStats();
+    size_t queued = sender.size();
+    uint64_t calls = 0;
+    size_t refused = sender.flush(sock, calls);
+    stats.add(StatDatagramCalls, calls);
+    stats.add(StatDatagramsOut, queued - refused);
+    stats.add(StatDropped, refused);
+    pinned.clear();
+}
+#endif
+
+/**
+ * Function: renderStats
+ * Purpose: Formats the summed per-thread statistics as text
+ * Returns: One "name value" line per metric (Prometheus text format)
+ * 
+ * Counters are totals since startup; rates are left to the scraper. The
+ * histograms are reported as quantiles plus _sum/_count/_max.
+ */
+string renderStats() {
+    unique_ptr<ThreadStats> total(new ThreadStats());
+    StatsRegistry::instance().collect(*total);
+    
+    string text;
+    auto line = [&text](const string& name, uint64_t value) {
+        text += name + " " + to_string(value) + "\n";
+    };
+    auto summary = [&](const string& name, const LatencyHistogram& histogram) {
+        const char* quantiles[] = {"0.5", "0.9", "0.99", "0.999"};
+        for (const char* q : quantiles) {
+            line(name + "{quantile=\"" + q + "\"}", histogram.percentile(atof(q)));
+        }
+        line(name + "_max", histogram.max());
+        line(name + "_sum", histogram.sumOfValues());
+        line(name + "_count", histogram.count());
+    };
+    
+    line("chat_uptime_seconds", (uint64_t)chrono::duration_cast<chrono::seconds>(
+                                    chrono::steady_clock::now() - serverStart).count());
+    line("chat_clients_connected", (uint64_t)max(clientCount.load(), 0));
+#ifdef __linux__
+    if (udpFeed) line("chat_udp_subscribers", (uint64_t)udpFeed->subscriberCount());
+#endif
+#ifdef CORO_SOCKETS
+    if (config.mode == ServerMode::Coro) line("chat_coroutine_frame_bytes", CoroTask::promise_type::frameBytes.load());
+#endif
+    for (int i = 0; i < STAT_COUNTER_COUNT; i++) {
+        line(string("chat_") + STAT_COUNTER_NAMES[i] + "_total", total->get((StatCounter)i));
+    }
+    summary("chat_recv_to_broadcast_ns", total->recvToBroadcast);
+    summary("chat_send_queue_depth", total->queueDepth);
+    return text;
+}
+
+/**
+ * Function: statsServer
+ * Purpose: Serves the statistics to local scrapers (runs in its own thread)
+ * Parameters: statsSocket - Listener bound to 127.0.0.1:<stats-port>
+ * 
+ * Every connection gets one snapshot and is closed. A request starting
+ * with "GET" is answered with an HTTP/1.0 header first, so both
+ * `nc 127.0.0.1 PORT` and HTTP scrapers work.
+ */
+void statsServer(SOCKET statsSocket) {
+    while (serverRunning) {
+        SOCKET sock = accept(statsSocket, nullptr, nullptr);
+        if (sock == INVALID_SOCKET) continue;
+        
+        // Give an HTTP client a moment to send its request line
+#ifdef _WIN32
+        DWORD timeout = 200;
+#else
+        timeval timeout{0, 200 * 1000};
+#endif
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+        char request[512];
+        int bytesRead = recv(sock, request, sizeof(request), 0);
+        
+        string response = renderStats();
+        if (bytesRead >= 3 && memcmp(request, "GET", 3) == 0) {
+            response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                       "Content-Length: " + to_string(response.size()) + "\r\n\r\n" + response;
+        }
+        sendAll(sock, response.data(), response.size());
+        shutdown(sock, SHUT_RDWR);
+        closesocket(sock);
+    }
+}
+
+/**
+ * Function: openStatsListener
+ * Purpose: Binds the stats endpoint to the loopback interface only
+ * Returns: The listening socket, or INVALID_SOCKET on failure
+ */
+SOCKET openStatsListener(int port) {
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == INVALID_SOCKET) return INVALID_SOCKET;
+    
+    int opt = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+        listen(sock, 16) == SOCKET_ERROR) {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+    return sock;
+}
+
+SOCKET acceptListener = INVALID_SOCKET;  // Listener of the blocking accept loops (thread-based modes)
+
+/**
+ * Function: serverConsole
+ * Purpose: Handles server-side input for broadcasting messages to all clients
+ * 
+ * This function runs in a separate thread and allows the server operator
+ * to send messages to all connected clients. Type "quit" to shutdown server,
+ * or "stats" to print the server statistics.
+ */
+void serverConsole() {
+    char buffer[1024];
+    
+    cout << "[Server] Server console ready. Type messages to broadcast, 'stats' for statistics, or 'quit' to shutdown." << endl;
+    
+    while (serverRunning) {
+        if (!cin.getline(buffer, sizeof(buffer))) {
+            if (cin.eof()) break;  // No operator (stdin closed): the server runs on
+            cin.clear();           // Overlong line: take it in pieces
+        }
+        
+        if (strcmp(buffer, "quit") == 0) {
+            cout << "[Server] Shutting down server..." << endl;
+            serverRunning = false;
+            
+            // Notify all clients about server shutdown
+            MessageRef shutdownMsg = serverNotice(makeMessage({"[Server] Server is shutting down. Goodbye!"}));
+#ifdef __linux__
+            if (udpFeed) udpFeed->post(shutdownMsg);
+            if (!reactors.empty()) {
+                for (LoopReactor* loop : reactors) {
+                    loop->post(shutdownMsg);  // Each loop delivers it, then closes everyone
+                }
+                break;
+            }
+#endif
+            // Wakes the accepting threads; serving threads finish with their client
+            if (acceptListener != INVALID_SOCKET) shutdown(acceptListener, SHUT_RDWR);
+            
+            // Each writer delivers the notice, then closes its connection
+            EpochGuard guard;
+            clientRegistry.forEach([&](ClientConnection& conn) {
+                enqueueFrame(conn, shutdownMsg);
+                {
+                    lock_guard<mutex> connLock(conn.queueMutex);
+                    conn.closing = true;
+                }
+                wakeWriter(conn);
+            });
+            break;
+        }
+        
+        if (strcmp(buffer, "stats") == 0) {
+            cout << renderStats() << flush;
+            continue;
+        }
+        
+        if (strlen(buffer) > 0) {
+            MessageRef serverMsg = typedMessage(makeMessage({"[Server]: ", buffer}), WireNotice{buffer});
+            logMessage(LogLevel::Info, serverMsg);
+            recordHistory(serverMsg, "");
+            relayToPeers(serverMsg, "", true);
+            
+#ifdef __linux__
+            if (udpFeed) udpFeed->post(serverMsg);
+            if (!reactors.empty()) {
+                threadStats().add(StatBroadcasts);
+                for (LoopReactor* loop : reactors) {
+                    loop->post(serverMsg);
+                }
+                continue;
+            }
+#endif
+            // Broadcast to all clients
+            broadcastMessage(serverMsg, INVALID_SOCKET);
+        }
+    }
+}
+
+atomic<int> nextThreadClientId(1);  // Shared by the TCP and local acceptors
+
+/**
+ * Function: listenForClients
+ * Purpose: Puts a bound TCP socket into listening state with the
+ *          configured backlog (and TCP_DEFER_ACCEPT, if asked for)
+ * Returns: true on success
+ * 
+ * When a whole fleet reconnects at once, the connections the acceptors
+ * have not reached yet wait in the backlog; a short one makes the kernel
+ * drop SYNs, and each dropped client retries only after a second or more.
+ * With --defer-accept the kernel completes the handshake but only queues
+ * the connection once its first bytes arrive (or the timeout passes), so
+ * connections that never speak never reach accept().
+ */
+bool listenForClients(SOCKET sock) {
+#ifdef TCP_DEFER_ACCEPT
+    if (config.deferAccept > 0) {
+        setsockopt(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, (char*)&config.deferAccept, sizeof(config.deferAccept));
+    }
+#endif
+    return listen(sock, config.backlog) != SOCKET_ERROR;
+}
+
+/**
+ * Function: registerClient
+ * Purpose: Sets up a reserved connection and adds it to the registry and
+ *          the lobby (thread-based modes and coro mode)
+ * Parameters: conn - The client, with its socket and IP filled in
+ * Returns: false if it could not be registered (socket closed)
+ */
+bool registerClient(const shared_ptr<ClientConnection>& conn) {
+    applySocketProfile(conn->sock, config.profile);
+    
+    conn->id = nextThreadClientId++;
+    conn->prefix = "[Client " + to_string(conn->id) + nodeTag + "]: ";
+    
+    // Add client to the registry (and to the lobby)
+    if (!clientRegistry.insert(conn.get(), conn->handle)) {
+        clientCount--;
+        closesocket(conn->sock);  // Cannot happen while clientCount is checked in reserveClient
+        return false;
+    }
+    conn->joinedAt = historyClock();
+    conn->room = sharedRooms.join(*conn, nullptr, DEFAULT_ROOM);
+    return true;
+}
+
+/**
+ * Function: admitThreadClient
+ * Purpose: Registers a new connection and starts its handler thread
+ *          (thread-based modes)
+ * Parameters:
+ *   - conn: The client, with its socket and IP filled in
+ *   - ownThread: false if the caller runs handleClient itself
+ * Returns: false if the server is full (the client is told, socket closed)
+ */
+bool admitThreadClient(const shared_ptr<ClientConnection>& conn, bool ownThread = true) {
+    if (!reserveClient(conn->sock) || !registerClient(conn)) {
+        return false;
+    }
+    
+    // Create a new thread to handle this client
+    // Thread is detached so it runs independently
+    if (ownThread) {
+        thread clientThread(handleClient, conn);
+        clientThread.detach();
+    }
+    return true;
+}
+
+/**
+ * Function: startClient
+ * Purpose: Beginning of a handler thread in threads mode: finishes the
+ *          admission the accepting thread left to it, then serves the client
+ * Parameters:
+ *   - sock: The accepted socket, already counted by reserveClient
+ *   - address: The client's address
+ * 
+ * Formatting the address, the socket options and joining the lobby all
+ * happen here, so an acceptor only accepts, counts and starts a thread,
+ * and keeps up with a reconnect storm.
+ */
+void startClient(SOCKET sock, sockaddr_in address) {
+    char clientIP[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &address.sin_addr, clientIP, INET_ADDRSTRLEN);
+    
+    auto conn = make_shared<ClientConnection>();
+    conn->sock = sock;
+    conn->ip = clientIP;
+    if (registerClient(conn)) {
+        handleClient(conn);
+    }
+}
+
+/**
+ * Function: acceptLoop
+ * Purpose: Accept loop of the thread-based modes
+ * Parameters:
+ *   - serverSocket: Listening socket
+ *   - serveInline: Serve each client on this thread until it leaves, then
+ *                  accept the next (iterative and pool modes), instead of
+ *                  spawning a handler thread for it
+ */
+void acceptLoop(SOCKET serverSocket, bool serveInline) {
+    AcceptBackoff backoff;
+#ifdef __linux__
+    // Waits in poll() instead: then no accept() blocks, not even one
+    // shedConnection makes after another acceptor took the connection
+    setNonBlocking(serverSocket);
+#endif
+    // Main loop: Accept new client connections
+    while (serverRunning) {
+        sockaddr_in clientAddress;
+        socklen_t clientLen = sizeof(clientAddress);
+        
+        // Accept new connection (the handlers block, so the accepted
+        // socket stays blocking)
+#ifdef __linux__
+        pollfd pending{serverSocket, POLLIN, 0};
+        poll(&pending, 1, -1);  // "quit" shuts the listener down, which wakes it
+        SOCKET clientSocket = accept4(serverSocket, (sockaddr*)&clientAddress, &clientLen, SOCK_CLOEXEC);
+        if (clientSocket == INVALID_SOCKET && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            continue;  // Taken by another acceptor
+        }
+#else
+        SOCKET clientSocket = accept(serverSocket, (sockaddr*)&clientAddress, &clientLen);
+#endif
+        
+        if (clientSocket == INVALID_SOCKET) {
+            if (serverRunning) {
+                int pauseMs = backoff.failed(errno);
+                if (pauseMs > 0 && !shedConnection(serverSocket)) {
+                    this_thread::sleep_for(chrono::milliseconds(pauseMs));
+                }
+            }
+            continue;
+        }
+        backoff.succeeded();
+        
+        if (!serveInline) {
+            // Count it and hand it to its own thread, which does the rest
+            if (reserveClient(clientSocket)) {
+                thread clientThread(startClient, clientSocket, clientAddress);
+                clientThread.detach();
+            }
+            continue;
+        }
+        
+        // Get client IP address
+        char clientIP[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &clientAddress.sin_addr, clientIP, INET_ADDRSTRLEN);
+        
+        auto conn = make_shared<ClientConnection>();
+        conn->sock = clientSocket;
+        conn->ip = clientIP;
+        if (admitThreadClient(conn, false)) {
+            handleClient(conn);
+        }
+    }
+}
+
+/**
+ * Function: runThreadPerClient
+ * Purpose: Original concurrency model - blocking accept loop that spawns a
+ *          detached handler thread (plus its writer thread) for every client
+ * Parameters: serverSocket - Listening socket
+ * 
+ * With --acceptors N, N threads block in accept() on the listener, so a
+ * burst of connections is taken off the backlog N at a time.
+ */
+void runThreadPerClient(SOCKET serverSocket) {
+    vector<thread> acceptors;
+    if (config.acceptors > 1) {
+        cout << "[Server] Accepting on " << config.acceptors << " threads." << endl;
+    }
+    for (int i = 1; i < config.acceptors; i++) {
+        acceptors.emplace_back(acceptLoop, serverSocket, false);
+    }
+    acceptLoop(serverSocket, false);
+    for (thread& acceptor : acceptors) {
+        acceptor.join();
+    }
+    
+    // The handler threads are detached: give them a moment to deliver the goodbye
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(1);
+    while (clientCount > 0 && chrono::steady_clock::now() < deadline) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+}
+
+/**
+ * Function: runIterative
+ * Purpose: Iterative model - the accepting thread serves one client at a
+ *          time; the next connections wait in the listen backlog until it
+ *          leaves
+ * Parameters: serverSocket - Listening socket
+ */
+void runIterative(SOCKET serverSocket) {
+    cout << "[Server] Iterative: one client at a time, the rest wait in the backlog." << endl;
+    acceptLoop(serverSocket, true);
+}
+
+/**
+ * Function: runThreadPool
+ * Purpose: Thread-pool (pre-threaded) model - --pool-threads threads share
+ *          the listener, each accepting a client and serving it until it
+ *          leaves, so at most that many clients are served at once and no
+ *          thread is created per connection
+ * Parameters: serverSocket - Listening socket
+ */
+void runThreadPool(SOCKET serverSocket) {
+    cout << "[Server] Thread pool: " << config.poolThreads
+         << " threads, each serving one client at a time." << endl;
+    vector<thread> pool;
+    for (int i = 1; i < config.poolThreads; i++) {
+        pool.emplace_back(acceptLoop, serverSocket, true);
+    }
+    acceptLoop(serverSocket, true);
+    for (thread& server : pool) {
+        server.join();
+    }
+}
+
+#ifdef CORO_SOCKETS
+const size_t CORO_RECV_SIZE = 64 * 1024;   // Receive buffer shared by the coroutines of the loop
+
+/**
+ * Function: writeCoroClient
+ * Purpose: Writer coroutine of a client in coro mode (clientWriter's
+ *          counterpart): sends what is queued, and while there is nothing
+ *          to send or no room in the socket buffer waits without a thread
+ * Parameters:
+ *   - loop: The loop resuming it
+ *   - conn: The client
+ *   - socket: Its socket, registered with the loop by serveCoroClient
+ *   - finished: Set once the writer has stopped and shut the socket down
+ */
+CoroTask writeCoroClient(CoroLoop& loop, shared_ptr<ClientConnection> conn, CoroSocket& socket,
+                         CoroEvent& finished) {
+    // Filled and sent between two suspensions, so the loop's writers share them
+    static thread_local OutboundSlice slices[MAX_BATCH_SLICES];
+    static thread_local iovec iov[MAX_BATCH_SLICES];
+    bool timed = config.writeTimeout > 0;  // Whether the timer thread watches our sends
+    ThreadStats& stats = threadStats();
+    
+    while (true) {
+        int count;
+        size_t batchBytes;
+        bool closing;
+        {
+            lock_guard<mutex> lock(conn->queueMutex);
+            count = conn->outbound.gather(slices, config.batch, batchBytes);
+            closing = conn->closing;
+        }
+        if (count == 0) {
+            if (closing) break;  // Closing and fully drained
+            co_await conn->outputReady;
+            continue;
+        }
+        
+        for (int i = 0; i < count; i++) {
+            iov[i].iov_base = (void*)slices[i].data;
+            iov[i].iov_len = slices[i].length;
+        }
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t sent;
+        do sent = sendmsg(socket.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT); while (sent < 0 && errno == EINTR);
+        bool full = sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        {
+            lock_guard<mutex> lock(conn->queueMutex);
+            size_t queued = conn->outbound.depth();
+            conn->outbound.advance(sent > 0 ? (size_t)sent : 0);  // Also unpins the rest
+            stats.add(StatMessagesOut, queued - conn->outbound.depth());
+        }
+        if (sent >= 0) {
+            stats.add(StatWrites);
+            stats.add(StatBytesOut, (uint64_t)sent);
+            if ((size_t)sent == batchBytes) continue;
+            stats.add(StatPartialWrites);
+        } else if (!full) {
+            break;
+        }
+        
+        // The socket buffer is full: wait until the client has taken some of it
+        if (timed) conn->writing.store(timerTick(), memory_order_relaxed);
+        co_await loop.writable(socket);
+        if (timed) conn->writing.store(0, memory_order_relaxed);
+    }
+    
+    {
+        lock_guard<mutex> lock(conn->queueMutex);
+        conn->closing = true;
+    }
+    shutdown(socket.fd, SHUT_RDWR);
+    finished.set();
+}
+
+/**
+ * Function: serveCoroClient
+ * Purpose: Handles communication with a single client in coro mode
+ *          (handleClient written as a coroutine)
+ * Parameters:
+ *   - loop: The loop running it
+ *   - conn: The admitted client, with a non-blocking socket
+ * 
+ * A quiet client costs two suspended coroutine frames (this one waiting
+ * in recv, its writer for output) instead of two threads. Bytes are
+ * received into one buffer shared by the loop and parsed in place; only a
+ * client with an incomplete frame keeps a RecvBuffer of its own, until the
+ * rest of the frame has arrived.
+ */
+CoroTask serveCoroClient(CoroLoop& loop, shared_ptr<ClientConnection> conn) {
+    static thread_local char sharedInput[CORO_RECV_SIZE];
+    CoroSocket socket;
+    socket.fd = conn->sock;
+    if (!loop.watch(socket)) {
+        logLine(LogLevel::Error, {"[Error] Failed to register client ", NumberText(conn->id), " with the loop!"});
+        farewellClient(conn, true);
+        co_return;
+    }
+    CoroEvent writerDone(loop);
+    writeCoroClient(loop, conn, socket, writerDone);
+    if (deadlinesEnabled()) watchConnection(*conn);
+    greetClient(*conn);
+    
+    ThreadStats& stats = threadStats();
+    unique_ptr<RecvBuffer> partial;  // The start of an incomplete frame, while there is one
+    bool connected = true;
+    while (serverRunning && connected) {
+        char* space = partial ? partial->prepare(RECV_CHUNK_SIZE) : sharedInput;
+        size_t length = partial ? partial->writable() : sizeof(sharedInput);
+        long long bytesRead = co_await loop.recv(socket, space, length);
+        
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            continue;  // Woken without data after all
+        }
+        if (bytesRead <= 0) {
+            connected = false;  // Client disconnected
+            break;
+        }
+        auto received = chrono::steady_clock::now();
+        stats.add(StatBytesIn, (uint64_t)bytesRead);
+        
+        // One recv() may carry several messages, or only part of one
+        string_view payload;
+        FrameStatus status;
+        if (partial) {
+            partial->commit((size_t)bytesRead);
+            while ((status = partial->nextFrame(payload)) == FrameStatus::Complete) {
+                receivePayload(conn, payload, received);
+            }
+            if (partial->buffered() == 0) partial.reset();
+        } else {
+            string_view input(sharedInput, (size_t)bytesRead);
+            while ((status = parseFrame(input, payload)) == FrameStatus::Complete) {
+                receivePayload(conn, payload, received);
+            }
+            if (status == FrameStatus::Incomplete && !input.empty()) {
+                partial.reset(new RecvBuffer());  // Keep it past the next recv into sharedInput
+                partial->append(input.data(), input.size());
+            }
+        }
+        if (status == FrameStatus::TooLarge) {
+            logLine(LogLevel::Error, {"[Error] Client ", NumberText(conn->id), " sent an oversized frame."});
+            connected = false;
+        }
+    }
+    
+    unwatchConnection(*conn);
+    
+    // Stop the writer (anything still queued is for a peer that is gone)
+    {
+        lock_guard<mutex> lock(conn->queueMutex);
+        conn->closing = true;
+    }
+    wakeWriter(*conn);
+    shutdown(socket.fd, SHUT_RDWR);
+    co_await writerDone;
+    loop.unwatch(socket);
+    
+    farewellClient(conn, connected);
+}
+
+/**
+ * Function: acceptCoroClients
+ * Purpose: Accepting coroutine of coro mode: admits every connection and
+ *          starts its handler coroutine, until "quit" shuts the listener
+ *          down
+ * Parameters:
+ *   - loop: The loop running it
+ *   - serverSocket: Listening socket (non-blocking)
+ */
+CoroTask acceptCoroClients(CoroLoop& loop, SOCKET serverSocket) {
+    CoroSocket listener;
+    listener.fd = serverSocket;
+    loop.watch(listener);
+    AcceptBackoff backoff;
+    while (serverRunning) {
+        sockaddr_in clientAddress;
+        long long clientSocket = co_await loop.accept(listener, clientAddress);
+        
+        if (clientSocket < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
+            if (serverRunning) {
+                int pauseMs = backoff.failed(errno);
+                if (pauseMs > 0 && !shedConnection(serverSocket)) {
+                    co_await loop.sleep(pauseMs);  // Serve the others meanwhile
+                }
+            }
+            continue;
+        }
+        backoff.succeeded();
+        
+        // Get client IP address
+        char clientIP[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &clientAddress.sin_addr, clientIP, INET_ADDRSTRLEN);
+        
+        auto conn = make_shared<ClientConnection>();
+        conn->sock = (SOCKET)clientSocket;
+        conn->ip = clientIP;
+        conn->outputReady.attach(loop);
+        if (admitThreadClient(conn, false)) {
+            serveCoroClient(loop, conn);
+        }
+    }
+    loop.unwatch(listener);
+}
+
+/**
+ * Function: runCoroutines
+ * Purpose: Coroutine model - one thread runs a CoroLoop, and every client
+ *          is a reader and a writer coroutine suspended in it while they
+ *          wait, instead of two threads blocked in the kernel
+ * Parameters: serverSocket - Listening socket
+ * 
+ * The clients are ClientConnections in clientRegistry as in threads mode,
+ * so broadcasting, rooms and the timer thread work unchanged: queueing a
+ * message for a client sets its outputReady event, which resumes its
+ * writer on the loop.
+ */
+void runCoroutines(SOCKET serverSocket) {
+    static CoroLoop loop;  // Outlives the run: other threads may still wake a writer
+    if (!loop.init() || !setNonBlocking(serverSocket)) {
+        cerr << "[Error] Failed to set up the coroutine loop!" << endl;
+        return;
+    }
+    cout << "[Server] Coroutines: one loop thread, a reader and a writer coroutine per client." << endl;
+    acceptCoroClients(loop, serverSocket);
+    while (serverRunning) {
+        loop.runOnce(100);
+    }
+    
+    // Give the writers a moment to deliver the goodbye
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(1);
+    while (clientCount > 0 && chrono::steady_clock::now() < deadline) {
+        loop.runOnce(10);
+    }
+}
+#endif
+
+#ifdef __linux__
+/**
+ * Function: openShardListener
+ * Purpose: Creates one more listening socket on the server port for an
+ *          extra reactor shard (SO_REUSEPORT lets the kernel balance new
+ *          connections between all of them)
+ * Returns: The socket, or INVALID_SOCKET on failure
+ */
+SOCKET openShardListener() {
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == INVALID_SOCKET) return INVALID_SOCKET;
+
+    int opt = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
+    setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (char*)&opt, sizeof(opt));
+    applySocketProfile(sock, config.profile);
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    address.sin_addr.s_addr = INADDR_ANY;
+    if (bind(sock, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || !listenForClients(sock)) {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+    return sock;
+}
+
+/**
+ * Function: createEventLoops
+ * Purpose: Builds the epoll or io_uring reactor(s) for the event-loop modes
+ * Parameters:
+ *   - serverSocket: Listening socket of the first shard
+ *   - inherited: Listeners taken over from the previous process, first
+ *                shard first (empty unless this is a hot restart)
+ * Returns: One initialised reactor per shard (empty on failure)
+ * 
+ * io_uring falls back to epoll when the first reactor cannot be set up.
+ */
+vector<unique_ptr<LoopReactor>> createEventLoops(SOCKET serverSocket, const vector<SOCKET>& inherited) {
+    vector<unique_ptr<LoopReactor>> loops;
+    bool useUring = (config.mode == ServerMode::Uring);
+
+    // With fewer shards than before, the surplus listeners go (and with
+    // them the connections still waiting in their backlogs)
+    for (size_t i = config.shards; i < inherited.size(); i++) closesocket(inherited[i]);
+
+    for (int i = 0; i < config.shards; i++) {
+        SOCKET listenSocket = (i == 0) ? serverSocket
+                            : (i < (int)inherited.size()) ? inherited[i] : openShardListener();
+        if (listenSocket == INVALID_SOCKET) {
+            cerr << "[Error] Failed to open listener for shard " << i << "!" << endl;
+            break;
+        }
+
+        unique_ptr<LoopReactor> loop;
+        if (useUring) {
+            loop.reset(new UringReactor(listenSocket));
+            if (!loop->init()) {
+                loop.reset();
+                if (i == 0) {
+                    cout << "[Server] Falling back to the epoll reactor." << endl;
+                    useUring = false;
+                }
+            }
+        }
+        if (!loop && !useUring) {
+            loop.reset(new EpollReactor(listenSocket));
+            if (!loop->init()) loop.reset();
+        }
+        if (!loop) {
+            if (i > 0) closesocket(listenSocket);
+            break;
+        }
+        loops.push_back(move(loop));
+    }
+
+    if ((int)loops.size() < config.shards) {
+        for (size_t i = 1; i < loops.size(); i++) closesocket(loops[i]->listener());
+        loops.clear();
+        return loops;
+    }
+
+    for (auto& loop : loops) reactors.push_back(loop.get());
+    LoopReactor::linkShards(reactors);
+
+    const char* backend = useUring ? "io_uring" : "epoll";
+    if (config.shards == 1) {
+        cout << "[Server] Running " << backend << " reactor (single event-loop thread)." << endl;
+    } else {
+        cout << "[Server] Running " << config.shards << " " << backend
+             << " reactor shards (SO_REUSEPORT, one event-loop thread each)." << endl;
+    }
+    return loops;
+}
+
+/**
+ * Function: runEventLoops
+ * Purpose: Runs every shard on its own thread (the first on this one) until
+ *          the server is asked to quit
+ */
+void runEventLoops(vector<unique_ptr<LoopReactor>>& loops) {
+    vector<thread> workers;
+    for (size_t i = 1; i < loops.size(); i++) {
+        LoopReactor* loop = loops[i].get();
+        workers.emplace_back([loop] { loop->run(); });
+    }
+    loops[0]->run();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+
+    reactors.clear();
+    for (size_t i = 1; i < loops.size(); i++) {
+        closesocket(loops[i]->listener());
+    }
+}
+
+const int HANDOFF_TIMEOUT_S = 10;   // Longest either side of a hot restart waits for the other
+
+/**
+ * Function: handOverTo
+ * Purpose: The old process's side of a hot restart - pauses the loops and
+ *          passes the listeners and clients to the successor
+ * Parameters: successor - Connection accepted on the restart socket
+ * Returns: true if the successor has taken them (the loops then close their
+ *          copies and the server winds down), false if the loops carry on
+ */
+bool handOverTo(SOCKET successor) {
+    timeval timeout{HANDOFF_TIMEOUT_S, 0};
+    setsockopt(successor, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+    setsockopt(successor, SOL_SOCKET, SO_SNDTIMEO, (char*)&timeout, sizeof(timeout));
+    logLine(LogLevel::Info, {"[Server] A new server process is taking over..."});
+
+    auto started = chrono::steady_clock::now();
+    for (LoopReactor* loop : reactors) loop->pause();
+    HandoffState state;
+    LoopReactor::handOver(reactors, state);
+    bool taken = sendHandoff(successor, state) && expectRecord(successor, HANDOFF_ACK);
+    if (taken) {
+        handedOver = true;
+        successorSocket = successor;
+        serverRunning = false;
+    }
+    for (LoopReactor* loop : reactors) loop->resume();
+
+    if (taken) {
+        logLine(LogLevel::Info, {"[Server] Handed ", NumberText((long long)state.clients.size()),
+                                 " client(s) over in ", NumberText((long long)(elapsedNs(started) / 1000)),
+                                 " us; shutting down."});
+    } else {
+        logLine(LogLevel::Error, {"[Error] Hot restart failed; carrying on."});
+    }
+    return taken;
+}
+
+/**
+ * Function: restartListener
+ * Purpose: Waits on the restart socket for a successor (runs in its own
+ *          thread); shutting the socket down ends it
+ */
+void restartListener(SOCKET restartSocket) {
+    while (serverRunning) {
+        SOCKET successor = accept4(restartSocket, nullptr, nullptr, SOCK_CLOEXEC);
+        if (successor == INVALID_SOCKET) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        if (handOverTo(successor)) return;
+        closesocket(successor);
+    }
+}
+
+/**
+ * Function: takeOverFrom
+ * Purpose: The new process's side of a hot restart - receives the
+ *          listeners and clients, then waits until the old process has
+ *          released its other ports and files
+ * Parameters:
+ *   - predecessor: Connection to the old process's restart socket
+ *   - state: Receives what was handed over
+ * Returns: false if the transfer failed (the old process carries on)
+ */
+bool takeOverFrom(SOCKET predecessor, HandoffState& state) {
+    timeval timeout{HANDOFF_TIMEOUT_S, 0};
+    setsockopt(predecessor, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+    if (!receiveHandoff(predecessor, state)) return false;
+    if (!sendRecord(predecessor, string(1, HANDOFF_ACK))) {
+        for (SOCKET listener : state.listeners) closesocket(listener);
+        for (HandedClient& client : state.clients) closesocket(client.sock);
+        state = HandoffState();
+        return false;
+    }
+    expectRecord(predecessor, HANDOFF_RELEASED);  // Or the end of the stream: it is gone
+    return true;
+}
+
+const int LOCAL_HELLO_WAIT_MS = 50;  // How long a local client has to ask for shared memory
+
+// What a local client's first bytes asked for
+enum class LocalHello { Pending, SharedMemory, Socket, Closed };
+
+/**
+ * Function: openLocalListener
+ * Purpose: Binds the Unix domain socket for clients on this host
+ * Returns: The (non-blocking) listening socket, or INVALID_SOCKET on failure
+ * 
+ * A socket file left behind by an earlier run is replaced; any other file
+ * at the path is not.
+ */
+SOCKET openLocalListener(const string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) return INVALID_SOCKET;
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    SOCKET sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (sock == INVALID_SOCKET) return INVALID_SOCKET;
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(path.c_str());
+    }
+    if (bind(sock, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+        listen(sock, config.backlog) == SOCKET_ERROR) {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+    return sock;
+}
+
+/**
+ * Function: peekHello
+ * Purpose: Looks at a new local client's first bytes without consuming
+ *          them, to see whether it opens with the SHM_HELLO frame
+ */
+LocalHello peekHello(SOCKET sock) {
+    string hello = makeFrame(SHM_HELLO);
+    char peeked[16];
+    ssize_t n = recv(sock, peeked, hello.size(), MSG_PEEK);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return LocalHello::Pending;
+    if (n <= 0) return LocalHello::Closed;
+    if (memcmp(peeked, hello.data(), n) != 0) return LocalHello::Socket;
+    return (size_t)n == hello.size() ? LocalHello::SharedMemory : LocalHello::Pending;
+}
+
+/**
+ * Function: handOverLocal
+ * Purpose: Answers a local client's request for shared memory, if it made
+ *          one, and passes the connection to the running concurrency model
+ * Parameters:
+ *   - sock: Accepted Unix socket (non-blocking)
+ *   - hello: What its first bytes asked for
+ *   - loops: The event loops (empty in threads mode), used in turn
+ *   - nextLoop: Round-robin position in loops
+ */
+void handOverLocal(SOCKET sock, LocalHello hello, const vector<LoopReactor*>& loops, size_t& nextLoop) {
+    if (hello == LocalHello::Closed) {
+        closesocket(sock);
+        return;
+    }
+    unique_ptr<ShmChannel> shm;
+    if (hello == LocalHello::SharedMemory) {
+        string request = makeFrame(SHM_HELLO);
+        ssize_t ignored = recv(sock, &request[0], request.size(), 0);  // Peeked already
+        (void)ignored;
+        if (loops.empty() || loops[0]->servesSharedMemory()) shm = ShmChannel::create();
+        bool replied;
+        if (shm) {
+            replied = sendWithDescriptors(sock, "[Server] Shared-memory transport ready.",
+                                          shm->descriptors(), SHM_DESCRIPTORS);
+        } else {
+            string decline = makeFrame("[Server] Shared memory is not available; staying on the socket.");
+            replied = send(sock, decline.data(), decline.size(), MSG_NOSIGNAL) == (ssize_t)decline.size();
         }
-        
-        // Get client IP address
-        char clientIP[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &clientAddress.sin_addr, clientIP, INET_ADDRSTRLEN);
-        
-        // Add client to list
-        {
-            lock_guard<mutex> lock(clientMutex);
-            clientSockets.push_back(clientSocket);
-            clientCount++;
+        if (!replied) {
+            closesocket(sock);
+            return;
         }
+    }
+
+    if (!loops.empty()) {
+        loops[nextLoop++ % loops.size()]->adopt(sock, "local", move(shm));
+        return;
+    }
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags & ~O_NONBLOCK);  // The handler threads block
+    auto conn = make_shared<ClientConnection>();
+    conn->sock = sock;
+    conn->ip = "local";
+    conn->shm = move(shm);
+    if (admitThreadClient(conn) && conn->shm) threadStats().add(StatSharedMemory);
+}
+
+/**
+ * Function: localAcceptor
+ * Purpose: Accepts clients on the Unix domain socket (runs in its own
+ *          thread) and hands them to the threads or the event loops
+ * Parameters:
+ *   - localSocket: Listener from openLocalListener
+ *   - loops: The event loops (empty in threads mode)
+ * 
+ * A new client is held here until its first bytes arrive or
+ * LOCAL_HELLO_WAIT_MS passes, whichever is first, to see whether it asks
+ * for shared memory. Clients that send a chat message first, or nothing
+ * at all, are handed over as plain socket clients. Shutting the listener
+ * down ends the thread.
+ */
+void localAcceptor(SOCKET localSocket, vector<LoopReactor*> loops) {
+    const int MAX_EVENTS = 64;
+    epoll_event events[MAX_EVENTS];
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = localSocket;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, localSocket, &ev);
+
+    unordered_map<SOCKET, chrono::steady_clock::time_point> pending;  // Socket -> hello deadline
+    size_t nextLoop = 0;
+    auto decide = [&](SOCKET sock, LocalHello hello) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, sock, nullptr);
+        pending.erase(sock);
+        handOverLocal(sock, hello, loops, nextLoop);
+    };
+
+    bool listening = true;
+    while (serverRunning && listening) {
+        auto now = chrono::steady_clock::now();
+        int timeoutMs = -1;
+        for (auto& entry : pending) {  // Until the earliest hello deadline
+            long long left = max<long long>(chrono::duration_cast<chrono::milliseconds>(entry.second - now).count() + 1, 0);
+            if (timeoutMs < 0 || left < timeoutMs) timeoutMs = (int)left;
+        }
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, timeoutMs);
+        if (ready < 0 && errno != EINTR) break;
+
+        for (int i = 0; i < ready; i++) {
+            SOCKET fd = events[i].data.fd;
+            if (fd != localSocket) {
+                LocalHello hello = peekHello(fd);
+                if (hello != LocalHello::Pending) decide(fd, hello);
+                continue;
+            }
+            if (events[i].events & EPOLLHUP) {
+                listening = false;  // Shut down by main
+                break;
+            }
+            while (true) {
+                SOCKET sock = accept4(localSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (sock == INVALID_SOCKET) {
+                    if (errno == EINTR || errno == ECONNABORTED) continue;
+                    break;
+                }
+                ev.events = EPOLLIN | EPOLLRDHUP;
+                ev.data.fd = sock;
+                epoll_ctl(epollFd, EPOLL_CTL_ADD, sock, &ev);
+                pending[sock] = chrono::steady_clock::now() + chrono::milliseconds(LOCAL_HELLO_WAIT_MS);
+            }
+        }
+
+        now = chrono::steady_clock::now();
+        vector<SOCKET> expired;
+        for (auto& entry : pending) {
+            if (entry.second <= now) expired.push_back(entry.first);
+        }
+        for (SOCKET sock : expired) decide(sock, LocalHello::Socket);
+    }
+
+    for (auto& entry : pending) closesocket(entry.first);
+    close(epollFd);
+}
+#endif
+
+/**
+ * Function: deliverFromPeer
+ * Purpose: Broadcasts a message relayed by another node to this node's
+ *          members of its room (every client for a console message)
+ * 
+ * It is not relayed again: every node sends its own messages to all of
+ * its peers itself.
+ */
+void deliverFromPeer(const RelayMessage& relay) {
+    if (!serverRunning) return;
+    MessageRef message = makeMessage({relay.text});
+    if (!relay.typed.empty()) message.attachTyped(makeMessage({relay.typed}));
+    string room(relay.room);
+    threadStats().add(StatRelayedIn);
+    if (relay.flags & RELAY_CHAT) {
+        logSampled(LogLevel::Info, message);
+        recordHistory(message, room);
+    }
+    
+#ifdef __linux__
+    if (!reactors.empty()) {
+        threadStats().add(StatBroadcasts);
+        for (LoopReactor* loop : reactors) {
+            if (room.empty()) loop->post(message);
+            else loop->postToRoom(message, room);
+        }
+        return;
+    }
+#endif
+    if (room.empty()) {
+        broadcastMessage(message, INVALID_SOCKET);
+        return;
+    }
+    EpochGuard guard;  // Before the lookup: the room may empty meanwhile
+    SharedRoom<ClientConnection>* shared = sharedRooms.find(room);
+    if (shared != nullptr) broadcastToRoom(*shared, message, INVALID_SOCKET);
+}
+
+/**
+ * Function: peerReader
+ * Purpose: Receives the messages a peer node relays over the link it
+ *          dialled (runs in its own thread, one per inbound link)
+ * Parameters:
+ *   - sock: Accepted peer connection (closed by the caller)
+ *   - filter: This node's OriginFilter, shared by all inbound links
+ */
+void peerReader(SOCKET sock, OriginFilter* filter) {
+    RecvBuffer recvBuffer;
+    string peer;                    // Node ID from the hello, once received
+    ThreadStats& stats = threadStats();
+    bool linked = true;
+    while (linked) {
+        char* space = recvBuffer.prepare(RECV_CHUNK_SIZE);
+        int bytesRead = recv(sock, space, (int)recvBuffer.writable(), 0);
+        if (bytesRead <= 0) break;
+        recvBuffer.commit(bytesRead);
         
-        // Create a new thread to handle this client
-        // Thread is detached so it runs independently
-        thread clientThread(handleClient, clientSocket, nextClientId, string(clientIP));
-        clientThread.detach();
-        
-        nextClientId++;
+        string_view payload;
+        FrameStatus status;
+        while (linked && (status = recvBuffer.nextFrame(payload)) == FrameStatus::Complete) {
+            RelayMessage relay;
+            if (peer.empty()) {
+                linked = payload.size() > strlen(PEER_HELLO) && payload.compare(0, strlen(PEER_HELLO), PEER_HELLO) == 0;
+                if (linked) {
+                    peer = string(payload.substr(strlen(PEER_HELLO)));
+                    logLine(LogLevel::Info, {"[Server] Peer node ", peer, " linked in."});
+                }
+            } else if (!parseRelay(payload, relay)) {
+                logLine(LogLevel::Error, {"[Error] Peer node ", peer, " sent a malformed relay frame."});
+                linked = false;
+            } else if (filter->accept(relay)) {
+                deliverFromPeer(relay);
+            } else {
+                stats.add(StatRelayDuplicates);
+            }
+        }
+        if (status == FrameStatus::TooLarge) linked = false;
+    }
+    if (!peer.empty() && serverRunning) {
+        logLine(LogLevel::Warning, {"[Server] Peer node ", peer, " disconnected."});
+    }
+}
+
+/**
+ * Class: PeerListener
+ * Purpose: Accepts the links other nodes dial to this one (--peer-port)
+ *          and runs a peerReader thread for each
+ */
+class PeerListener {
+public:
+    explicit PeerListener(uint32_t self) : filter(self) {}
+    ~PeerListener() { stop(); }
+
+    /**
+     * Function: PeerListener::open
+     * Purpose: Binds the peer port and starts accepting
+     * Returns: false if the port cannot be bound
+     */
+    bool open(int port) {
+        listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenSocket == INVALID_SOCKET) return false;
+        int opt = 1;
+        setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = INADDR_ANY;
+        if (bind(listenSocket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+            listen(listenSocket, SOMAXCONN) == SOCKET_ERROR) {
+            closesocket(listenSocket);
+            listenSocket = INVALID_SOCKET;
+            return false;
+        }
+        acceptor = thread([this] { acceptLinks(); });
+        return true;
+    }
+
+    /**
+     * Function: PeerListener::stop
+     * Purpose: Stops accepting, ends every inbound link and waits for
+     *          their threads
+     */
+    void stop() {
+        if (listenSocket == INVALID_SOCKET) return;
+        shutdown(listenSocket, SHUT_RDWR);  // Ends the blocking accept
+        acceptor.join();
+        closesocket(listenSocket);
+        listenSocket = INVALID_SOCKET;
+        for (auto& link : links) shutdown(link->sock, SHUT_RDWR);
+        reapLinks(true);
+    }
+
+private:
+    struct InboundLink {
+        SOCKET sock;
+        thread reader;
+        atomic<bool> finished{false};
+    };
+
+    // Joins and closes the links whose reader has ended (or all of them)
+    void reapLinks(bool all) {
+        for (auto it = links.begin(); it != links.end();) {
+            InboundLink& link = **it;
+            if (!all && !link.finished) {
+                ++it;
+                continue;
+            }
+            link.reader.join();
+            closesocket(link.sock);
+            it = links.erase(it);
+        }
+    }
+
+    void acceptLinks() {
+        while (true) {
+            SOCKET sock = accept(listenSocket, nullptr, nullptr);
+            if (sock == INVALID_SOCKET) {
+                if (!serverRunning) break;
+#ifndef _WIN32
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+#endif
+                break;  // Shut down by stop()
+            }
+            reapLinks(false);  // Links dropped by peers that have since redialled
+            auto link = make_unique<InboundLink>();
+            link->sock = sock;
+            InboundLink* started = link.get();
+            link->reader = thread([this, started] {
+                peerReader(started->sock, &filter);
+                started->finished = true;
+            });
+            links.push_back(move(link));
+        }
+    }
+
+    OriginFilter filter;
+    SOCKET listenSocket = INVALID_SOCKET;
+    thread acceptor;
+    vector<unique_ptr<InboundLink>> links;  // Touched by the acceptor, then by stop()
+};
+
+/**
+ * Function: parsePeers
+ * Purpose: Reads a --peers list, "HOST:PORT[,HOST:PORT...]" (IPv4 hosts)
+ * Returns: false if an entry is malformed
+ */
+bool parsePeers(const string& list, vector<pair<string, int>>& peers) {
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == string::npos) end = list.size();
+        string entry = list.substr(start, end - start);
+        size_t colon = entry.rfind(':');
+        if (colon == string::npos) return false;
+        string host = entry.substr(0, colon);
+        int port = atoi(entry.c_str() + colon + 1);
+        in_addr probe;
+        if (port <= 0 || inet_pton(AF_INET, host.c_str(), &probe) != 1) return false;
+        peers.emplace_back(host, port);
+        start = end + 1;
+    }
+    return !peers.empty();
+}
+
+/**
+ * Function: parseArguments
+ * Purpose: Fills the global configuration from command-line flags
+ * Parameters: argc, argv - As passed to main
+ * Returns: false if an argument is unknown or invalid (usage is printed)
+ * 
+ * Flags accept either "--name value" or "--name=value".
+ */
+bool parseArguments(int argc, char* argv[]) {
+    bool corkGiven = false;
+    for (int i = 1; i < argc; i++) {
+        const char* original = argv[i];
+        string arg = argv[i];
+        string value;
+        size_t eq = arg.find('=');
+        if (eq != string::npos) {
+            value = arg.substr(eq + 1);
+            arg = arg.substr(0, eq);
+        } else if (arg == "--cork") {
+            value = "on";  // Switches take no value
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        }
+
+        if (arg == "--mode" && value == "threads") {
+            config.mode = ServerMode::Threads;
+        } else if (arg == "--mode" && value == "iterative") {
+            config.mode = ServerMode::Iterative;
+        } else if (arg == "--mode" && value == "pool") {
+            config.mode = ServerMode::Pool;
+        } else if (arg == "--mode" && value == "prefork") {
+#ifdef __linux__
+            config.mode = ServerMode::Prefork;
+#else
+            cerr << "[Error] prefork mode is only available on Linux." << endl;
+            return false;
+#endif
+        } else if (arg == "--mode" && value == "coro") {
+#ifdef CORO_SOCKETS
+            config.mode = ServerMode::Coro;
+#else
+            cerr << "[Error] coro mode needs a C++20 build (g++ -std=c++20) on Linux." << endl;
+            return false;
+#endif
+        } else if (arg == "--mode" && value == "epoll") {
+#ifdef __linux__
+            config.mode = ServerMode::Epoll;
+#else
+            cerr << "[Error] epoll mode is only available on Linux." << endl;
+            return false;
+#endif
+        } else if (arg == "--mode" && value == "uring") {
+#ifdef __linux__
+            config.mode = ServerMode::Uring;
+#else
+            cerr << "[Error] io_uring mode is only available on Linux." << endl;
+            return false;
+#endif
+        } else if (arg == "--port" && atoi(value.c_str()) > 0) {
+            config.port = atoi(value.c_str());
+        } else if (arg == "--max-clients" && atoi(value.c_str()) > 0) {
+            config.maxClients = atoi(value.c_str());
+        } else if (arg == "--queue-limit" && atol(value.c_str()) > 0) {
+            config.outbound.highWaterBytes = (size_t)atol(value.c_str());
+        } else if (arg == "--slow-policy" && value == "drop") {
+            config.outbound.policy = SlowConsumerPolicy::DropOldest;
+        } else if (arg == "--slow-policy" && value == "disconnect") {
+            config.outbound.policy = SlowConsumerPolicy::Disconnect;
+        } else if (arg == "--batch-bytes" && atol(value.c_str()) > 0) {
+            config.batch.maxBytes = (size_t)atol(value.c_str());
+        } else if (arg == "--batch-iov" && atoi(value.c_str()) > 0) {
+            config.batch.maxSlices = min(atoi(value.c_str()), MAX_BATCH_SLICES);
+        } else if (arg == "--cork") {
+            config.cork = (value != "off");
+            corkGiven = true;
+        } else if (arg == "--flush-deadline-us" && atoi(value.c_str()) > 0) {
+            config.flushDeadlineUs = atoi(value.c_str());
+        } else if (arg == "--shards" && atoi(value.c_str()) > 0) {
+            config.shards = atoi(value.c_str());
+        } else if (arg == "--stats-port" && atoi(value.c_str()) > 0) {
+            config.statsPort = atoi(value.c_str());
+        } else if (arg == "--log-level" && parseLogLevel(value, config.logLevel)) {
+            // Parsed in the condition
+        } else if (arg == "--log-sample" && atoi(value.c_str()) > 0) {
+            config.logSample = (unsigned)atoi(value.c_str());
+        } else if (arg == "--history-dir" && !value.empty()) {
+#ifdef __linux__
+            config.historyDir = value;
+#else
+            cerr << "[Error] --history-dir is only available on Linux." << endl;
+            return false;
+#endif
+        } else if (arg == "--history-count" && atoi(value.c_str()) >= 0 && !value.empty()) {
+            config.historyCount = atoi(value.c_str());
+        } else if (arg == "--history-seconds" && atoi(value.c_str()) >= 0 && !value.empty()) {
+            config.historySeconds = atoi(value.c_str());
+        } else if (arg == "--history-sync-ms" && atoi(value.c_str()) > 0) {
+            config.historySyncMs = atoi(value.c_str());
+        } else if (arg == "--profile" && parseSocketProfile(value, config.profile)) {
+            // Parsed in the condition
+        } else if (arg == "--unix-socket" && !value.empty()) {
+#ifdef __linux__
+            config.unixSocket = value;
+#else
+            cerr << "[Error] --unix-socket is only available on Linux." << endl;
+            return false;
+#endif
+        } else if (arg == "--udp-port" && atoi(value.c_str()) > 0) {
+#ifdef __linux__
+            config.udpPort = atoi(value.c_str());
+#else
+            cerr << "[Error] --udp-port is only available on Linux." << endl;
+            return false;
+#endif
+        } else if (arg == "--udp-timeout" && atoi(value.c_str()) > 0) {
+            config.udpTimeout = atoi(value.c_str());
+        } else if (arg == "--node-id" && atoi(value.c_str()) > 0) {
+            config.nodeId = atoi(value.c_str());
+        } else if (arg == "--peer-port" && atoi(value.c_str()) > 0) {
+            config.peerPort = atoi(value.c_str());
+        } else if (arg == "--peers" && parsePeers(value, config.peers)) {
+            // Parsed in the condition
+        } else if (arg == "--restart-socket" && !value.empty()) {
+#ifdef __linux__
+            config.restartSocket = value;
+#else
+            cerr << "[Error] --restart-socket is only available on Linux." << endl;
+            return false;
+#endif
+        } else if (arg == "--workers" && value == "auto") {
+            config.workers = max(1u, thread::hardware_concurrency());
+        } else if (arg == "--workers" && atoi(value.c_str()) >= 0 && !value.empty()) {
+            config.workers = (unsigned)atoi(value.c_str());
+        } else if (arg == "--heartbeat" && atoi(value.c_str()) >= 0 && !value.empty()) {
+            config.heartbeat = atoi(value.c_str());
+        } else if (arg == "--read-timeout" && atoi(value.c_str()) >= 0 && !value.empty()) {
+            config.readTimeout = atoi(value.c_str());
+        } else if (arg == "--idle-timeout" && atoi(value.c_str()) >= 0 && !value.empty()) {
+            config.idleTimeout = atoi(value.c_str());
+        } else if (arg == "--write-timeout" && atoi(value.c_str()) >= 0 && !value.empty()) {
+            config.writeTimeout = atoi(value.c_str());
+        } else if (arg == "--pool-threads" && atoi(value.c_str()) > 0) {
+            config.poolThreads = atoi(value.c_str());
+        } else if (arg == "--processes" && atoi(value.c_str()) > 0) {
+            config.processes = atoi(value.c_str());
+        } else if (arg == "--backlog" && atoi(value.c_str()) > 0) {
+            config.backlog = atoi(value.c_str());
+        } else if (arg == "--defer-accept" && atoi(value.c_str()) >= 0 && !value.empty()) {
+            config.deferAccept = atoi(value.c_str());
+        } else if (arg == "--acceptors" && atoi(value.c_str()) > 0) {
+            config.acceptors = atoi(value.c_str());
+        } else {
+            cerr << "[Error] Invalid argument: " << original << endl;
+            cerr << "Usage: server [--mode threads|iterative|pool|prefork|coro|epoll|uring]" << endl
+                 << "              [--pool-threads N] [--processes N] [--port N] [--max-clients N]" << endl
+                 << "              [--queue-limit BYTES] [--slow-policy drop|disconnect]" << endl
+                 << "              [--batch-bytes N] [--batch-iov N] [--cork] [--flush-deadline-us N]" << endl
+                 << "              [--shards N] [--stats-port N]" << endl
+                 << "              [--log-level error|warning|info|debug] [--log-sample N]" << endl
+                 << "              [--history-dir DIR] [--history-count N] [--history-seconds S]" << endl
+                 << "              [--history-sync-ms N] [--profile default|low-latency|throughput]" << endl
+                 << "              [--unix-socket PATH] [--udp-port N] [--udp-timeout SECONDS]" << endl
+                 << "              [--node-id N] [--peer-port N] [--peers HOST:PORT,...]" << endl
+                 << "              [--restart-socket PATH] [--workers N|auto]" << endl
+                 << "              [--heartbeat S] [--read-timeout S] [--idle-timeout S]" << endl
+                 << "              [--write-timeout S] [--backlog N] [--defer-accept S]" << endl
+                 << "              [--acceptors N]" << endl;
+            return false;
+        }
+    }
+
+    if (!config.peers.empty() && config.peerPort == 0) {
+        cerr << "[Error] --peers needs --peer-port (peers send to this node on their own links)." << endl;
+        return false;
+    }
+    if (config.mode == ServerMode::Prefork &&
+        (!config.peers.empty() || config.nodeId > 0 || !config.historyDir.empty() ||
+         !config.unixSocket.empty() || config.udpPort > 0)) {
+        // The workers form a cluster of their own, and these are opened once per server
+        cerr << "[Error] --mode prefork cannot be combined with --peers, --node-id, --history-dir, "
+             << "--unix-socket or --udp-port." << endl;
+        return false;
+    }
+    if (config.outbound.highWaterBytes < FRAME_HEADER_SIZE + MAX_FRAME_PAYLOAD + MAX_PREFIX_SIZE) {
+        // Below that, one large message would overflow every client's queue on its own
+        cerr << "[Error] --queue-limit must be at least "
+             << FRAME_HEADER_SIZE + MAX_FRAME_PAYLOAD + MAX_PREFIX_SIZE << " bytes (the largest frame)." << endl;
+        return false;
+    }
+    if (config.peerPort > 0 && config.nodeId == 0) {
+        config.nodeId = config.port;  // Unique among the nodes on one host
+    }
+    if (!config.restartSocket.empty() && config.mode != ServerMode::Epoll) {
+        // Threads block in recv and io_uring keeps receives in flight, so only
+        // the epoll loop can stop with every byte accounted for
+        cerr << "[Error] --restart-socket needs --mode epoll." << endl;
+        return false;
+    }
+    if (config.readTimeout > 0 && config.readTimeout <= config.heartbeat) {
+        // A live client needs time to answer the heartbeat
+        cerr << "[Error] --read-timeout must be longer than --heartbeat." << endl;
+        return false;
+    }
+    if (config.workers > 0 && !threadedMode()) {
+        // The event loops already spread their work over --shards threads
+        cerr << "[Error] --workers needs --mode threads, iterative or pool." << endl;
+        return false;
+    }
+    if (config.shards > 1 && config.mode != ServerMode::Epoll && config.mode != ServerMode::Uring) {
+        cerr << "[Error] --shards needs --mode epoll or --mode uring." << endl;
+        return false;
+    }
+    if (config.acceptors > 1 && config.mode != ServerMode::Threads) {
+        // Pool threads all accept already; the event loops scale with --shards
+        cerr << "[Error] --acceptors needs --mode threads." << endl;
+        return false;
+    }
+    if (config.mode == ServerMode::Coro && corkGiven) {
+        // A writer coroutine sends as soon as it is resumed; it has no timer to wait for
+        cerr << "[Error] --cork is not available in coro mode." << endl;
+        return false;
+    }
+    // The profiles include the matching flush policy unless --cork says otherwise
+    if (config.profile == SocketProfile::Throughput && !corkGiven && config.mode != ServerMode::Coro) {
+        config.cork = true;
+    }
+    if (config.profile == SocketProfile::LowLatency && config.cork) {
+        cerr << "[Error] --cork contradicts --profile low-latency." << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Function: openServerSocket
+ * Purpose: Creates, binds and listens on the chat server's TCP socket
+ * Returns: The listening socket, or INVALID_SOCKET (the error is printed)
+ */
+SOCKET openServerSocket() {
+    // Step 1: Create a TCP socket
+    SOCKET serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (serverSocket == INVALID_SOCKET) {
+        cerr << "[Error] Failed to create socket!" << endl;
+        return INVALID_SOCKET;
+    }
+    cout << "[Server] Socket created successfully." << endl;
+    
+    // Step 2: Set socket options
+    int opt = 1;
+    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
+#ifdef __linux__
+    if (config.shards > 1) {
+        // Every shard binds its own listener to the same port
+        setsockopt(serverSocket, SOL_SOCKET, SO_REUSEPORT, (char*)&opt, sizeof(opt));
+    }
+#endif
+    applySocketProfile(serverSocket, config.profile);  // Before listen(): buffers set the window scale
+    
+    // Step 3: Configure server address
+    sockaddr_in serverAddress;
+    memset(&serverAddress, 0, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(config.port);
+    serverAddress.sin_addr.s_addr = INADDR_ANY;
+    
+    // Step 4: Bind socket
+    if (bind(serverSocket, (sockaddr*)&serverAddress, sizeof(serverAddress)) == SOCKET_ERROR) {
+        cerr << "[Error] Failed to bind socket to port " << config.port << "!" << endl;
+        closesocket(serverSocket);
+        return INVALID_SOCKET;
+    }
+    cout << "[Server] Socket bound to port " << config.port << "." << endl;
+    
+    // Step 5: Listen for connections (--backlog, room for a reconnect storm)
+    if (!listenForClients(serverSocket)) {
+        cerr << "[Error] Failed to listen on socket!" << endl;
+        closesocket(serverSocket);
+        return INVALID_SOCKET;
+    }
+    return serverSocket;
+}
+
+#ifdef __linux__
+/**
+ * Function: runPreforked
+ * Purpose: Pre-forked model - forks --processes workers that share the
+ *          listening socket, then passes console input on to them and
+ *          waits for them to exit
+ * Parameters: serverSocket - Listening socket, inherited by every worker
+ * Returns: true in a worker, which carries on as an epoll server; false in
+ *          the parent, once every worker has exited
+ * 
+ * Called before any thread is started. The workers are clustered like
+ * separately started servers (see federation.h): worker i is node i with
+ * peer port base + i - 1 (base = --peer-port, else the port + 1000) and
+ * links to all the others, so the clients of every worker share the rooms.
+ * --max-clients applies to each worker, and with --stats-port worker i
+ * serves its statistics on --stats-port + i - 1. A worker dies with the
+ * parent.
+ */
+bool runPreforked(SOCKET serverSocket) {
+    int basePort = config.peerPort > 0 ? config.peerPort : config.port + 1000;
+    pid_t parent = getpid();
+    vector<pid_t> workers;
+    vector<int> consoles;  // Write ends of the workers' stdin pipes
+    
+    for (int i = 1; i <= config.processes; i++) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            cerr << "[Error] Failed to create the console pipe for worker " << i << "!" << endl;
+            break;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (getppid() != parent) _exit(0);  // The parent is already gone
+            dup2(fds[0], STDIN_FILENO);         // The parent's console is this worker's
+            close(fds[0]);
+            close(fds[1]);
+            for (int fd : consoles) close(fd);
+            
+            preforkWorker = i;
+            config.mode = ServerMode::Epoll;
+            config.nodeId = i;
+            config.peerPort = basePort + i - 1;
+            for (int j = 1; j <= config.processes; j++) {
+                if (j != i) config.peers.emplace_back("127.0.0.1", basePort + j - 1);
+            }
+            if (config.statsPort > 0) config.statsPort += i - 1;
+            return true;
+        }
+        close(fds[0]);
+        if (pid < 0) {
+            cerr << "[Error] Failed to fork worker " << i << "!" << endl;
+            close(fds[1]);
+            break;
+        }
+        workers.push_back(pid);
+        consoles.push_back(fds[1]);
+    }
+    closesocket(serverSocket);  // Only the workers accept
+    cout << "[Server] Pre-forked " << workers.size() << " worker processes on port " << config.port
+         << " (peer ports " << basePort << "-" << basePort + config.processes - 1 << ")." << endl;
+    
+    // Broadcasts go to the first worker, which relays them to the others;
+    // "stats" and "quit" go to every worker
+    string line;
+    while (!consoles.empty() && getline(cin, line)) {
+        bool everyone = (line == "quit" || line == "stats");
+        line += '\n';
+        for (size_t i = 0; i < (everyone ? consoles.size() : 1); i++) {
+            if (write(consoles[i], line.data(), line.size()) < 0) {
+                cerr << "[Error] Worker " << i + 1 << " is not reading its console!" << endl;
+            }
+        }
+        if (line == "quit\n") break;
+    }
+    for (int fd : consoles) close(fd);
+    
+    for (size_t i = 0; i < workers.size(); i++) {
+        int status = 0;
+        waitpid(workers[i], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            cerr << "[Error] Worker " << i + 1 << " ended abnormally!" << endl;
+        }
+    }
+    cout << "[Server] Server shutdown complete. Goodbye!" << endl;
+    return false;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    if (!parseArguments(argc, argv)) {
+        return 1;
+    }
+    
+    cout << "==========================================" << endl;
+    cout << "  Task 2: Concurrent Server (Multi-Chat) " << endl;
+    cout << "==========================================" << endl;
+    
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);  // A vanished peer must not kill the whole server
+#endif
+    openReserveFd();  // Lets acceptors refuse connections once out of descriptors
+
+#ifdef _WIN32
+    // Initialize Winsock (Windows only)
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        cerr << "[Error] WSAStartup failed!" << endl;
+        return 1;
+    }
+    cout << "[Server] Winsock initialized successfully." << endl;
+#endif
+
+#ifdef __linux__
+    // A server already running with the same --restart-socket hands over
+    HandoffState inherited;
+    if (!config.restartSocket.empty()) {
+        SOCKET predecessor = connectHandoff(config.restartSocket);
+        if (predecessor != INVALID_SOCKET) {
+            cout << "[Server] Taking over from the running server..." << endl;
+            bool taken = takeOverFrom(predecessor, inherited);
+            closesocket(predecessor);
+            if (!taken) {
+                cerr << "[Error] The running server did not hand over; it carries on." << endl;
+                return 1;
+            }
+            cout << "[Server] Took over " << inherited.listeners.size() << " listener(s) and "
+                 << inherited.clients.size() << " client(s)." << endl;
+        }
+    }
+#endif
+
+    SOCKET serverSocket = INVALID_SOCKET;
+#ifdef __linux__
+    if (!inherited.listeners.empty()) serverSocket = inherited.listeners[0];
+#endif
+    if (serverSocket == INVALID_SOCKET) serverSocket = openServerSocket();
+    if (serverSocket == INVALID_SOCKET) {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return 1;
+    }
+    
+#ifdef __linux__
+    // The workers carry on from here; the parent only relays the console
+    if (config.mode == ServerMode::Prefork && !runPreforked(serverSocket)) {
+        return 0;
+    }
+    
+#endif
+    cout << "[Server] Listening for up to " << config.maxClients << " concurrent connections (backlog "
+         << config.backlog << ")..." << endl;
+    if (config.deferAccept > 0) {
+        cout << "[Server] Connections are accepted once they send (TCP_DEFER_ACCEPT, up to "
+             << config.deferAccept << " s)." << endl;
+    }
+    if (config.profile != SocketProfile::Default) {
+        cout << "[Server] Socket profile " << socketProfileName(config.profile) << ": "
+             << describeSocket(serverSocket) << (config.cork ? ", corked writes." : ".") << endl;
+    }
+    cout << "[Server] Server is ready! Waiting for clients..." << endl;
+    cout << "------------------------------------------" << endl;
+    
+    // From here on per-client output goes through the background log writer
+    AsyncLog::instance().start(config.logLevel, config.logSample);
+    
+    // Cluster links come up before the first client can send anything
+    PeerListener peerListener((uint32_t)config.nodeId);
+    if (config.peerPort > 0) {
+        nodeTag = "@" + to_string(config.nodeId);
+        nodeIncarnation = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+        if (!peerListener.open(config.peerPort)) {
+            cerr << "[Error] Failed to bind peer port " << config.peerPort << "!" << endl;
+        }
+        for (auto& peer : config.peers) {
+            peerLinks.emplace_back(new PeerLink(peer.first, peer.second, (uint32_t)config.nodeId));
+            peerLinks.back()->start();
+        }
+        cout << "[Server] Cluster node " << config.nodeId << ": peer links on port " << config.peerPort
+             << ", relaying to " << config.peers.size() << " peer(s)." << endl;
+    }
+    
+#ifdef __linux__
+    // Chat history is opened before any client can be accepted
+    if (!config.historyDir.empty()) {
+        if (history.open(config.historyDir, config.historySyncMs)) {
+            cout << "[Server] Chat history in " << config.historyDir << "; replaying up to "
+                 << config.historyCount << " messages on join." << endl;
+        } else {
+            cerr << "[Error] Failed to open chat history in " << config.historyDir << "!" << endl;
+        }
+    }
+    
+    // Event loops are set up before the console can post to them
+    vector<unique_ptr<LoopReactor>> loops;
+    if (!registryMode()) {
+        loops = createEventLoops(serverSocket, inherited.listeners);
+    }
+    if (!inherited.clients.empty()) {
+        if (!loops.empty()) {
+            LoopReactor::takeOver(reactors, inherited);
+        } else {
+            for (HandedClient& client : inherited.clients) closesocket(client.sock);
+        }
+    }
+#endif
+    
+    if (registryMode()) {
+        clientRegistry.setCapacity(config.maxClients);
+    }
+    
+#ifdef __linux__
+    // Clients on this host may also come in through a Unix domain socket
+    SOCKET localSocket = INVALID_SOCKET;
+    thread localThread;
+    if (!config.unixSocket.empty() && (registryMode() || !loops.empty())) {
+        localSocket = openLocalListener(config.unixSocket);
+        if (localSocket == INVALID_SOCKET) {
+            cerr << "[Error] Failed to open Unix socket " << config.unixSocket << "!" << endl;
+        } else {
+            bool sharedMemory = loops.empty() || loops[0]->servesSharedMemory();
+            cout << "[Server] Local clients on " << config.unixSocket
+                 << (sharedMemory ? " (shared memory on request)." : " (shared memory needs threads or epoll mode).")
+                 << endl;
+            localThread = thread(localAcceptor, localSocket, reactors);
+        }
+    }
+    
+    // The UDP feed runs on its own thread next to the chosen mode
+    unique_ptr<UdpFeed> feed;
+    thread feedThread;
+    if (config.udpPort > 0) {
+        feed.reset(new UdpFeed());
+        if (!feed->open(config.udpPort)) {
+            cerr << "[Error] Failed to bind UDP port " << config.udpPort << "!" << endl;
+            feed.reset();
+        } else {
+            cout << "[Server] UDP feed on port " << config.udpPort << " (subscribers time out after "
+                 << config.udpTimeout << " s)." << endl;
+            udpFeed = feed.get();
+            feedThread = thread([&feed] { feed->run(); });
+        }
+    }
+#endif
+    
+    // Message processing off the handler threads (threads mode)
+    if (config.workers > 0) {
+        workPool = new WorkStealingPool(config.workers);
+        cout << "[Server] Processing messages on " << workPool->size() << " worker thread(s)." << endl;
+    }
+    if (registryMode() && deadlinesEnabled()) {
+        thread timerThread(connectionTimerThread);  // The event loops run their own wheels
+        timerThread.detach();
+    }
+    
+    // Start server console thread
+    if (registryMode()) acceptListener = serverSocket;  // Shut down by "quit"
+    thread consoleThread(serverConsole);
+    consoleThread.detach();  // Let console run independently
+    
+    // Optional stats endpoint for local scrapers
+    SOCKET statsSocket = INVALID_SOCKET;
+    if (config.statsPort > 0) {
+        statsSocket = openStatsListener(config.statsPort);
+        if (statsSocket == INVALID_SOCKET) {
+            cerr << "[Error] Failed to open stats port " << config.statsPort << "!" << endl;
+        } else {
+            cout << "[Server] Statistics on 127.0.0.1:" << config.statsPort << "." << endl;
+            thread statsThread(statsServer, statsSocket);
+            statsThread.detach();
+        }
+    }
+    
+#ifdef __linux__
+    // The next version of the server takes over through this socket
+    SOCKET restartSocket = INVALID_SOCKET;
+    thread restartThread;
+    if (!config.restartSocket.empty() && !loops.empty()) {
+        restartSocket = openHandoffListener(config.restartSocket);
+        if (restartSocket == INVALID_SOCKET) {
+            cerr << "[Error] Failed to open restart socket " << config.restartSocket << "!" << endl;
+        } else {
+            cout << "[Server] Hot restart: start the new server with --restart-socket "
+                 << config.restartSocket << "." << endl;
+            restartThread = thread(restartListener, restartSocket);
+        }
+    }
+    
+#ifdef CORO_SOCKETS
+    if (config.mode == ServerMode::Coro) {
+        runCoroutines(serverSocket);
+    } else
+#endif
+    if (!threadedMode()) {
+        if (!loops.empty()) runEventLoops(loops);
+    } else
+#endif
+    if (config.mode == ServerMode::Iterative) {
+        runIterative(serverSocket);
+    } else if (config.mode == ServerMode::Pool) {
+        runThreadPool(serverSocket);
+    } else {
+        runThreadPerClient(serverSocket);
     }
     
     // Clean up
+#ifdef __linux__
+    if (restartSocket != INVALID_SOCKET) {
+        shutdown(restartSocket, SHUT_RDWR);  // Ends restartListener
+        restartThread.join();
+        closesocket(restartSocket);
+        unlink(config.restartSocket.c_str());
+    }
+    if (localSocket != INVALID_SOCKET) {
+        shutdown(localSocket, SHUT_RDWR);  // Ends localAcceptor
+        localThread.join();
+        closesocket(localSocket);
+        unlink(config.unixSocket.c_str());
+    }
+    if (feed) {
+        feed->stop();  // After it has sent the shutdown notice
+        feedThread.join();
+    }
+#endif
+    peerListener.stop();
+    for (auto& link : peerLinks) link->stop();  // Kept: detached client threads may still relay
+#ifdef __linux__
+    history.close();              // Syncs the last appended messages
+#endif
+    AsyncLog::instance().stop();  // Write out whatever is still queued
     cout << "[Server] Closing server socket..." << endl;
     closesocket(serverSocket);
+    if (statsSocket != INVALID_SOCKET) {
+        shutdown(statsSocket, SHUT_RDWR);  // Ends the blocking accept in statsServer
+        closesocket(statsSocket);
+    }
+#ifdef __linux__
+    if (successorSocket != INVALID_SOCKET) {
+        udpFeed = nullptr;
+        feed.reset();  // Its port too must be free before the successor opens it
+        sendRecord(successorSocket, string(1, HANDOFF_RELEASED));
+        closesocket(successorSocket);
+    }
+#endif
     
 #ifdef _WIN32
     WSACleanup();
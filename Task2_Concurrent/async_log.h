@@ -0,0 +1,295 @@
+/**
+ * async_log.h - Asynchronous logger for the server's per-message output
+ *
+ * Writing every chat line to the console with `cout << ... << endl` costs a
+ * lock on the stream and a write() system call per line, taken on the very
+ * thread that should be serving clients; with a slow terminal or a full pipe
+ * it blocks that thread outright. Instead each thread that logs appends a
+ * record to its own SpscRing and a single background thread drains all the
+ * rings, formats the lines into one buffer per stream and writes each
+ * buffer with one fwrite() and fflush() per pass.
+ *
+ * A record holds a MessageRef, so logging a chat message that is already
+ * pooled for the broadcast only bumps its reference count. Logging never
+ * waits: if a thread's ring is full the record is dropped and counted, and
+ * the writer reports how many were lost. Producers wake the writer early
+ * once their ring is half full; otherwise it polls every LOG_POLL_MS.
+ *
+ * Records below the configured level are discarded before anything is
+ * allocated, and logSampled() keeps only one in every N calls per thread
+ * for high-volume lines such as chat traffic. Before start() and after
+ * stop() lines are written synchronously.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "message_pool.h"
+#include "spsc_ring.h"
+
+const size_t LOG_RING_CAPACITY = 4096;   // Records buffered per thread
+const int LOG_POLL_MS = 50;              // Writer wake-up interval when idle
+
+// Severity, most severe first; a level is enabled if <= the threshold
+enum class LogLevel { Error, Warning, Info, Debug };
+
+/**
+ * Function: parseLogLevel
+ * Purpose: Converts "error", "warning", "info" or "debug" to a LogLevel
+ * Returns: false if the name is not recognised
+ */
+inline bool parseLogLevel(std::string_view name, LogLevel& level) {
+    if (name == "error") level = LogLevel::Error;
+    else if (name == "warning") level = LogLevel::Warning;
+    else if (name == "info") level = LogLevel::Info;
+    else if (name == "debug") level = LogLevel::Debug;
+    else return false;
+    return true;
+}
+
+struct LogRecord {
+    LogLevel level = LogLevel::Info;
+    MessageRef text;                 // The payload is the log line
+};
+
+/**
+ * Class: AsyncLog
+ * Purpose: Per-thread log rings drained by one background writer thread
+ */
+class AsyncLog {
+public:
+    // Never destroyed: detached threads may still log during shutdown
+    static AsyncLog& instance() {
+        static AsyncLog* log = new AsyncLog();
+        return *log;
+    }
+
+    /**
+     * Function: start
+     * Purpose: Sets the filters and starts the writer thread
+     * Parameters:
+     *   - threshold: Least severe level that is written
+     *   - sample: Keep one in every `sample` logSampled() calls (1 = all)
+     */
+    void start(LogLevel threshold, unsigned sample) {
+        this->threshold.store(threshold, std::memory_order_relaxed);
+        sampleEvery = sample == 0 ? 1 : sample;
+        running.store(true, std::memory_order_release);
+        writer = std::thread(&AsyncLog::writerLoop, this);
+    }
+
+    /**
+     * Function: stop
+     * Purpose: Writes out everything queued so far and stops the writer;
+     *          later records are written synchronously
+     */
+    void stop() {
+        if (!writer.joinable()) return;
+        running.store(false, std::memory_order_release);
+        wake.notify_one();
+        writer.join();
+    }
+
+    bool enabled(LogLevel level) const {
+        return level <= threshold.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Function: write
+     * Purpose: Queues one line (the message's payload) for the writer
+     */
+    void write(LogLevel level, const MessageRef& text) {
+        if (!enabled(level)) return;
+        if (!running.load(std::memory_order_acquire)) {
+            writeNow(level, text.payload());
+            return;
+        }
+
+        Channel& channel = threadChannel();
+        LogRecord record{level, text};
+        if (!channel.ring.push(record)) {
+            channel.dropped.store(channel.dropped.load(std::memory_order_relaxed) + 1,
+                                  std::memory_order_relaxed);
+            return;
+        }
+        // Wake the writer once per half-full ring rather than on every record
+        if (channel.ring.approxSize() >= LOG_RING_CAPACITY / 2 &&
+            !channel.wakeSent.load(std::memory_order_relaxed)) {
+            channel.wakeSent.store(true, std::memory_order_relaxed);
+            wake.notify_one();
+        }
+    }
+
+    // Like write(), but keeps only one in every `sample` calls on this thread
+    void writeSampled(LogLevel level, const MessageRef& text) {
+        if (!enabled(level)) return;
+        thread_local unsigned counter = 0;
+        if (++counter < sampleEvery) return;
+        counter = 0;
+        write(level, text);
+    }
+
+private:
+    AsyncLog() = default;
+
+    // One thread's ring; shared with the writer, which frees it once the
+    // thread has exited and the ring is empty
+    struct Channel {
+        SpscRing<LogRecord> ring{LOG_RING_CAPACITY};
+        std::atomic<uint64_t> dropped{0};     // Written by the producer only
+        uint64_t droppedReported = 0;         // Writer only
+        std::atomic<bool> wakeSent{false};
+        std::atomic<bool> closed{false};
+    };
+
+    // Owns the calling thread's channel and marks it closed on thread exit
+    struct Producer {
+        std::shared_ptr<Channel> channel;
+        ~Producer() {
+            if (channel) channel->closed.store(true, std::memory_order_release);
+        }
+    };
+
+    Channel& threadChannel() {
+        thread_local Producer producer;
+        if (!producer.channel) {
+            producer.channel = std::make_shared<Channel>();
+            std::lock_guard<std::mutex> lock(mutex);
+            channels.push_back(producer.channel);
+        }
+        return *producer.channel;
+    }
+
+    static void writeNow(LogLevel level, std::string_view line) {
+        FILE* stream = level <= LogLevel::Warning ? stderr : stdout;
+        fwrite(line.data(), 1, line.size(), stream);
+        fputc('\n', stream);
+        fflush(stream);
+    }
+
+    static void flushBuffer(std::string& buffer, FILE* stream) {
+        if (buffer.empty()) return;
+        fwrite(buffer.data(), 1, buffer.size(), stream);
+        fflush(stream);
+        buffer.clear();
+    }
+
+    /**
+     * Function: drain
+     * Purpose: Moves every queued record into the output buffers and writes
+     *          them out
+     * Returns: Number of records written
+     */
+    size_t drain(std::vector<std::shared_ptr<Channel>>& snapshot) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            snapshot = channels;
+        }
+
+        size_t written = 0;
+        LogRecord record;
+        for (const std::shared_ptr<Channel>& channel : snapshot) {
+            channel->wakeSent.store(false, std::memory_order_relaxed);
+            while (channel->ring.pop(record)) {
+                std::string& buffer = record.level <= LogLevel::Warning ? errors : output;
+                std::string_view line = record.text.payload();
+                buffer.append(line.data(), line.size());
+                buffer.push_back('\n');
+                record.text.reset();
+                written++;
+            }
+
+            uint64_t dropped = channel->dropped.load(std::memory_order_relaxed);
+            if (dropped != channel->droppedReported) {
+                errors += "[Log] " + std::to_string(dropped - channel->droppedReported) +
+                          " records dropped (log ring full).\n";
+                channel->droppedReported = dropped;
+            }
+        }
+        flushBuffer(errors, stderr);
+        flushBuffer(output, stdout);
+
+        // Forget threads that have exited, once everything they logged is out
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < channels.size();) {
+            Channel& channel = *channels[i];
+            if (channel.closed.load(std::memory_order_acquire) && channel.ring.approxSize() == 0) {
+                channels[i] = channels.back();
+                channels.pop_back();
+            } else {
+                i++;
+            }
+        }
+        snapshot.clear();
+        return written;
+    }
+
+    void writerLoop() {
+        std::vector<std::shared_ptr<Channel>> snapshot;
+        while (running.load(std::memory_order_acquire)) {
+            if (drain(snapshot) > 0) continue;   // Busy: go straight round again
+            // Producers notify without taking the mutex, so a wake-up can be
+            // missed; the timeout bounds how long a line waits
+            std::unique_lock<std::mutex> lock(waitMutex);
+            wake.wait_for(lock, std::chrono::milliseconds(LOG_POLL_MS));
+        }
+        drain(snapshot);
+    }
+
+    std::atomic<LogLevel> threshold{LogLevel::Info};
+    unsigned sampleEvery = 1;
+    std::atomic<bool> running{false};
+
+    std::mutex mutex;                                 // Guards channels (registration only)
+    std::vector<std::shared_ptr<Channel>> channels;
+    std::mutex waitMutex;
+    std::condition_variable wake;
+    std::thread writer;
+
+    std::string output;                               // Writer's batch for stdout
+    std::string errors;                               // Writer's batch for stderr
+};
+
+/**
+ * Function: logMessage
+ * Purpose: Logs the payload of an existing pooled message (no copy)
+ */
+inline void logMessage(LogLevel level, const MessageRef& message) {
+    AsyncLog::instance().write(level, message);
+}
+
+// As logMessage(), subject to --log-sample
+inline void logSampled(LogLevel level, const MessageRef& message) {
+    AsyncLog::instance().writeSampled(level, message);
+}
+
+/**
+ * Function: logLine
+ * Purpose: Builds a log line from parts and logs it; nothing is allocated
+ *          if the level is filtered out
+ *
+ * Example: logLine(LogLevel::Warning, {"[Server] Client ", NumberText(id), " ..."})
+ */
+inline void logLine(LogLevel level, std::initializer_list<std::string_view> parts) {
+    AsyncLog& log = AsyncLog::instance();
+    if (!log.enabled(level)) return;
+    log.write(level, makeMessage(parts));
+}
+
+#endif
@@ -0,0 +1,333 @@
+/**
+ * binary_protocol.h - Typed binary messages (opt-in alternative to text)
+ *
+ * The server's messages are text meant for people: "[Client 3]: hi",
+ * "[Server] Client 5 (10.0.0.7) joined the chat!". A program receiving
+ * them has to parse that text to learn what happened. A client that sends
+ * BINARY_COMMAND gets typed messages instead, one per frame:
+ *
+ *   Chat    client, node, room, text      A chat message
+ *   Join    client, node, flags, room, address
+ *                                         A client entered a room (with
+ *                                         WIRE_CONNECTED: it just connected)
+ *   Leave   client, node, flags, room     A client left a room (with
+ *                                         WIRE_CONNECTED: it disconnected)
+ *   Notice  text                          Anything else the server says
+ *   Error   code, text                    A request was refused
+ *
+ * `node` is the server the client is connected to when servers are
+ * clustered (see federation.h), else 0. A Join or Leave carrying the
+ * receiver's own ID confirms its own move; BINARY_COMMAND is answered with
+ * one, which tells the client its ID and room.
+ *
+ * Layout: a type byte, then a fixed-size header holding the integer fields
+ * (big-endian) and a uint16 length for every string but the last, in
+ * schema order; the string bytes follow, and the last string takes what
+ * is left of the frame. Chat, for instance, is
+ *   uint8 type | uint32 client | uint32 node | uint16 roomLength | room | text
+ * The type byte (1..5) cannot start a text message, so a receiver tells
+ * the two apart by the first byte; anything else (such as history replayed
+ * from the log, which is stored as text) is plain text. Heartbeats stay
+ * empty frames.
+ *
+ * The encoders and decoders are not written by hand: each message type has
+ * a WireSchema listing its fields as member pointers, and the templates
+ * below derive the header layout from it at compile time. Encoding is a
+ * handful of stores at constant offsets plus one memcpy per string, into a
+ * buffer the caller provides; decoding returns string_views into the frame.
+ * Neither allocates.
+ *
+ * A binary client may send Chat, Join (only `room` is used) and Leave
+ * messages as well as plain text and commands.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../common/framing.h"
+
+const char* const BINARY_COMMAND = "/binary";   // Switches a connection to typed messages
+const uint8_t WIRE_CONNECTED = 1;               // Join/Leave flag: connected/disconnected
+const size_t WIRE_MAX_STRING = 0xFFFF;          // Longer strings (except the last) are cut
+
+// First byte of a typed message
+enum class WireType : uint8_t {
+    None = 0,       // Not a typed message (text, or a heartbeat)
+    Chat = 1,
+    Join = 2,
+    Leave = 3,
+    Notice = 4,
+    Error = 5
+};
+
+// WireError codes
+enum WireErrorCode : uint16_t {
+    WIRE_BAD_COMMAND = 1,       // Unusable room name
+    WIRE_ALREADY_IN_ROOM = 2,   // Join for the room the client is in
+    WIRE_BAD_MESSAGE = 3,       // Typed message the server does not accept
+    WIRE_TOO_LONG = 4           // Chat message longer than the server relays
+};
+
+struct WireChat {
+    uint32_t client = 0;
+    uint32_t node = 0;
+    std::string_view room;
+    std::string_view text;
+};
+
+struct WireJoin {
+    uint32_t client = 0;
+    uint32_t node = 0;
+    uint8_t flags = 0;
+    std::string_view room;
+    std::string_view address;   // Set with WIRE_CONNECTED
+};
+
+struct WireLeave {
+    uint32_t client = 0;
+    uint32_t node = 0;
+    uint8_t flags = 0;
+    std::string_view room;
+};
+
+struct WireNotice {
+    std::string_view text;
+};
+
+struct WireError {
+    uint16_t code = 0;
+    std::string_view text;
+};
+
+/**
+ * Struct: WireSchema
+ * Purpose: The message description: type byte and fields, in wire order
+ *
+ * Fields may be unsigned integers or string_views.
+ */
+template <typename T> struct WireSchema;
+
+template <> struct WireSchema<WireChat> {
+    static constexpr WireType type = WireType::Chat;
+    static constexpr auto fields = std::make_tuple(&WireChat::client, &WireChat::node, &WireChat::room,
+                                                   &WireChat::text);
+};
+
+template <> struct WireSchema<WireJoin> {
+    static constexpr WireType type = WireType::Join;
+    static constexpr auto fields = std::make_tuple(&WireJoin::client, &WireJoin::node, &WireJoin::flags,
+                                                   &WireJoin::room, &WireJoin::address);
+};
+
+template <> struct WireSchema<WireLeave> {
+    static constexpr WireType type = WireType::Leave;
+    static constexpr auto fields = std::make_tuple(&WireLeave::client, &WireLeave::node, &WireLeave::flags,
+                                                   &WireLeave::room);
+};
+
+template <> struct WireSchema<WireNotice> {
+    static constexpr WireType type = WireType::Notice;
+    static constexpr auto fields = std::make_tuple(&WireNotice::text);
+};
+
+template <> struct WireSchema<WireError> {
+    static constexpr WireType type = WireType::Error;
+    static constexpr auto fields = std::make_tuple(&WireError::code, &WireError::text);
+};
+
+template <typename Pointer> struct WireMember;
+template <typename Message, typename Field> struct WireMember<Field Message::*> {
+    using type = Field;
+};
+
+/**
+ * Struct: WireLayout
+ * Purpose: Where each field of T sits, worked out at compile time
+ */
+template <typename T>
+struct WireLayout {
+    using Fields = std::remove_cv_t<decltype(WireSchema<T>::fields)>;
+    static constexpr size_t count = std::tuple_size<Fields>::value;
+
+    template <size_t I>
+    using Field = typename WireMember<std::tuple_element_t<I, Fields>>::type;
+
+    template <size_t I>
+    static constexpr bool isString = std::is_same<Field<I>, std::string_view>::value;
+
+    // Header bytes of field I: its value, its length, or nothing (last string)
+    template <size_t I>
+    static constexpr size_t width() {
+        static_assert(isString<I> || std::is_unsigned<Field<I>>::value,
+                      "Wire fields are unsigned integers or string_views");
+        if constexpr (isString<I>) return I + 1 == count ? 0 : 2;
+        else return sizeof(Field<I>);
+    }
+
+    template <size_t... I>
+    static constexpr size_t sumWidths(std::index_sequence<I...>) {
+        return (size_t{0} + ... + width<I>());
+    }
+
+    // Header offset of field I (the type byte comes first)
+    template <size_t I>
+    static constexpr size_t offset = 1 + sumWidths(std::make_index_sequence<I>());
+
+    static constexpr size_t headerSize = offset<count>;
+};
+
+template <typename Unsigned>
+inline void wireStore(char* out, Unsigned value) {
+    for (size_t i = 0; i < sizeof(Unsigned); i++) {
+        out[i] = (char)(value >> (8 * (sizeof(Unsigned) - 1 - i)));
+    }
+}
+
+template <typename Unsigned>
+inline Unsigned wireLoad(const char* in) {
+    const unsigned char* p = (const unsigned char*)in;
+    Unsigned value = 0;
+    for (size_t i = 0; i < sizeof(Unsigned); i++) value = (Unsigned)((value << 8) | p[i]);
+    return value;
+}
+
+// Bytes of field I that follow the header (its string, if it is one)
+template <typename T, size_t I>
+inline size_t wireBodyLength(const T& message) {
+    if constexpr (WireLayout<T>::template isString<I>) {
+        size_t length = (message.*std::get<I>(WireSchema<T>::fields)).size();
+        return (I + 1 < WireLayout<T>::count && length > WIRE_MAX_STRING) ? WIRE_MAX_STRING : length;
+    } else {
+        (void)message;
+        return 0;
+    }
+}
+
+template <typename T, size_t... I>
+inline size_t wireSizeOf(const T& message, std::index_sequence<I...>) {
+    return WireLayout<T>::headerSize + (size_t{0} + ... + wireBodyLength<T, I>(message));
+}
+
+template <typename T, size_t I>
+inline void wirePut(const T& message, char* out, char*& body) {
+    using Layout = WireLayout<T>;
+    const auto& value = message.*std::get<I>(WireSchema<T>::fields);
+    if constexpr (Layout::template isString<I>) {
+        size_t length = wireBodyLength<T, I>(message);
+        if constexpr (Layout::template width<I>() > 0) {
+            wireStore<uint16_t>(out + Layout::template offset<I>, (uint16_t)length);
+        }
+        memcpy(body, value.data(), length);
+        body += length;
+    } else {
+        wireStore(out + Layout::template offset<I>, value);
+    }
+}
+
+template <typename T, size_t I>
+inline bool wireGet(T& message, std::string_view payload, size_t& body) {
+    using Layout = WireLayout<T>;
+    auto& value = message.*std::get<I>(WireSchema<T>::fields);
+    const char* header = payload.data() + Layout::template offset<I>;
+    if constexpr (Layout::template isString<I>) {
+        size_t length = payload.size() - body;
+        if constexpr (Layout::template width<I>() > 0) {
+            size_t announced = wireLoad<uint16_t>(header);
+            if (announced > length) return false;
+            length = announced;
+        }
+        value = payload.substr(body, length);
+        body += length;
+    } else {
+        value = wireLoad<std::remove_reference_t<decltype(value)>>(header);
+    }
+    return true;
+}
+
+template <typename T, size_t... I>
+inline char* wireEncodeFields(const T& message, char* out, std::index_sequence<I...>) {
+    out[0] = (char)WireSchema<T>::type;
+    char* body = out + WireLayout<T>::headerSize;
+    (wirePut<T, I>(message, out, body), ...);
+    return body;
+}
+
+template <typename T, size_t... I>
+inline bool wireDecodeFields(T& message, std::string_view payload, std::index_sequence<I...>) {
+    size_t body = WireLayout<T>::headerSize;
+    return (wireGet<T, I>(message, payload, body) && ...);
+}
+
+/**
+ * Function: wireSize
+ * Purpose: Payload bytes the encoding of `message` takes
+ */
+template <typename T>
+inline size_t wireSize(const T& message) {
+    return wireSizeOf(message, std::make_index_sequence<WireLayout<T>::count>());
+}
+
+/**
+ * Function: wireEncode
+ * Purpose: Writes the payload of a typed message
+ * Parameters:
+ *   - message: What to encode
+ *   - out: Destination, at least wireSize(message) bytes
+ * Returns: The end of what was written
+ */
+template <typename T>
+inline char* wireEncode(const T& message, char* out) {
+    return wireEncodeFields(message, out, std::make_index_sequence<WireLayout<T>::count>());
+}
+
+/**
+ * Function: wireType
+ * Purpose: Which typed message a payload holds (WireType::None for text)
+ */
+inline WireType wireType(std::string_view payload) {
+    if (payload.empty()) return WireType::None;
+    uint8_t type = (uint8_t)payload[0];
+    return (type >= (uint8_t)WireType::Chat && type <= (uint8_t)WireType::Error) ? (WireType)type : WireType::None;
+}
+
+/**
+ * Function: wireDecode
+ * Purpose: Reads a typed message; its strings point into `payload`
+ * Returns: false if the payload is not a well-formed T
+ */
+template <typename T>
+inline bool wireDecode(std::string_view payload, T& message) {
+    if (payload.size() < WireLayout<T>::headerSize || wireType(payload) != WireSchema<T>::type) return false;
+    return wireDecodeFields(message, payload, std::make_index_sequence<WireLayout<T>::count>());
+}
+
+/**
+ * Function: appendWire
+ * Purpose: Appends one framed typed message to an output buffer
+ */
+template <typename T>
+inline void appendWire(std::string& out, const T& message) {
+    size_t length = wireSize(message);
+    size_t start = out.size();
+    out.resize(start + FRAME_HEADER_SIZE + length);
+    writeFrameHeader(&out[start], (uint32_t)length);
+    wireEncode(message, &out[start + FRAME_HEADER_SIZE]);
+}
+
+static_assert(WireLayout<WireChat>::headerSize == 1 + 4 + 4 + 2, "Chat header layout");
+static_assert(WireLayout<WireJoin>::headerSize == 1 + 4 + 4 + 1 + 2, "Join header layout");
+static_assert(WireLayout<WireNotice>::headerSize == 1, "Notice header layout");
+
+#endif
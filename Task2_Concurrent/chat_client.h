@@ -0,0 +1,645 @@
+/**
+ * chat_client.h - Non-blocking, reconnecting chat client library
+ *
+ * The connection logic of Task_2client.cpp, without the console: a
+ * ChatClient owns one non-blocking socket and never blocks. The caller
+ * drives it from its own loop, so one thread can run thousands of clients:
+ *
+ *   ChatClient client(options);
+ *   client.onMessage([](std::string_view text) { ... });
+ *   client.start();
+ *   client.send("hello");                    // Queued, never blocks
+ *   while (running) ChatClient::pollClients(&clientPtr, 1, 100);
+ *
+ * pollClients() waits on any number of clients with one poll() call. A
+ * caller with its own event loop (epoll, ...) instead watches socket() for
+ * reading, and for writing while wantsWrite(), calls handleEvents() when it
+ * fires and tick() by timeoutMs().
+ *
+ * Sends are pipelined: each message is appended to one output buffer and
+ * everything queued goes out in as few send() calls as the socket accepts,
+ * without waiting for earlier messages to be answered. Messages sent while
+ * disconnected wait in the same buffer (up to maxQueuedBytes) and go out
+ * once the connection is back.
+ *
+ * When the connection fails or the server closes it (including "server is
+ * full"), the client reconnects on its own after a backoff that doubles
+ * from reconnectMinMs up to reconnectMaxMs, with random jitter so that many
+ * clients dropped at once do not all return at the same moment. A room
+ * entered with join() is joined again after every reconnect.
+ *
+ * On Linux a client on the server's host can connect to its Unix domain
+ * socket (unixPath) and, with sharedMemory, ask for the shared-memory
+ * transport (see shm_transport.h): the first frame is the request, and
+ * nothing else is sent until the server has answered. Messages then go
+ * through the rings; the socket is only watched for the end of the
+ * connection. A caller with its own event loop also watches bellFd() for
+ * reading and calls handleBell() when it fires. A server that declines
+ * keeps talking over the socket.
+ *
+ * Received messages are passed to the onMessage() callback or, if none is
+ * set, kept for nextMessage(). Heartbeats from the server (empty frames)
+ * are answered with an empty frame and not passed on. With binary set, the
+ * client asks for typed messages on every connection (see
+ * binary_protocol.h) and the payloads passed on are those; read them with
+ * wireType() and wireDecode(). A ChatClient is not thread-safe: all calls
+ * must come from the thread that drives it.
+ *
+ * Include after the platform socket headers (SOCKET must be defined).
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef CHAT_CLIENT_H
+#define CHAT_CLIENT_H
+
+#ifdef _WIN32
+    #include <winsock2.h>
+#else
+    #include <poll.h>
+    #include <fcntl.h>
+    #include <cerrno>
+#endif
+
+#ifdef __linux__
+    #include <sys/un.h>
+    #include "shm_transport.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../common/framing.h"
+#include "../common/socket_profile.h"
+#include "binary_protocol.h"
+
+const int CLIENT_READS_PER_EVENT = 16;   // recv() calls per readable event
+const int CLIENT_FRAMES_PER_BELL = 256;  // Shared-memory frames per doorbell
+
+/**
+ * Struct: ChatClientOptions
+ * Purpose: Where to connect and how to behave when the connection drops
+ */
+struct ChatClientOptions {
+    std::string host = "127.0.0.1";         // IPv4 address
+    int port = 8080;
+    std::string unixPath;                   // Server's Unix socket instead (Linux; host/port unused)
+    bool sharedMemory = false;              // Ask for shared-memory rings (needs unixPath)
+    bool binary = false;                    // Ask for typed messages (binary_protocol.h)
+    SocketProfile profile = SocketProfile::Default;
+    bool reconnect = true;                  // Reconnect after the connection is lost
+    int reconnectMinMs = 100;               // First backoff
+    int reconnectMaxMs = 10000;             // Backoff ceiling
+    size_t maxQueuedBytes = 1 << 20;        // Unsent bytes before send() refuses
+};
+
+/**
+ * Class: ChatClient
+ * Purpose: One non-blocking connection to the chat server
+ */
+class ChatClient {
+public:
+    enum class State {
+        Idle,          // Not started, or stopped with close()
+        Connecting,    // connect() in progress
+        Connected,
+        Waiting        // Connection lost; reconnecting after the backoff
+    };
+
+    using MessageHandler = std::function<void(std::string_view payload)>;
+    using StateHandler = std::function<void(State state, const std::string& reason)>;
+
+    explicit ChatClient(ChatClientOptions options = ChatClientOptions())
+        : options(std::move(options)), backoffMs(this->options.reconnectMinMs),
+          random(std::random_device{}()) {}
+
+    ~ChatClient() { closeSocket(); }
+
+    ChatClient(const ChatClient&) = delete;
+    ChatClient& operator=(const ChatClient&) = delete;
+
+    void onMessage(MessageHandler handler) { messageHandler = std::move(handler); }
+    void onStateChange(StateHandler handler) { stateHandler = std::move(handler); }
+
+    /**
+     * Function: start
+     * Purpose: Begins connecting (returns at once; see onStateChange)
+     * Returns: false if the address is invalid
+     */
+    bool start() {
+        if (state != State::Idle) return true;
+        std::memset(&address, 0, sizeof(address));
+#ifdef __linux__
+        if (!options.unixPath.empty()) {
+            sockaddr_un* local = (sockaddr_un*)&address;
+            if (options.unixPath.size() >= sizeof(local->sun_path)) return false;
+            local->sun_family = AF_UNIX;
+            std::memcpy(local->sun_path, options.unixPath.c_str(), options.unixPath.size() + 1);
+            addressLength = sizeof(sockaddr_un);
+            connectNow();
+            return true;
+        }
+#endif
+        sockaddr_in* inet = (sockaddr_in*)&address;
+        inet->sin_family = AF_INET;
+        inet->sin_port = htons((unsigned short)options.port);
+        if (inet_pton(AF_INET, options.host.c_str(), &inet->sin_addr) <= 0) {
+            return false;
+        }
+        addressLength = sizeof(sockaddr_in);
+        connectNow();
+        return true;
+    }
+
+    /**
+     * Function: close
+     * Purpose: Drops the connection and stops reconnecting; unsent
+     *          messages are discarded
+     */
+    void close() {
+        closeSocket();
+        output.clear();
+        outputSent = 0;
+        setState(State::Idle, "closed");
+    }
+
+    /**
+     * Function: send
+     * Purpose: Queues one message and writes as much as the socket takes
+     * Returns: false if the client is idle or maxQueuedBytes would be
+     *          exceeded (the message is not queued)
+     */
+    bool send(std::string_view payload) {
+        if (state == State::Idle) return false;
+        if (queuedBytes() + FRAME_HEADER_SIZE + payload.size() > options.maxQueuedBytes) return false;
+        appendFrame(output, payload);
+        if (state == State::Connected) flushOutput();
+        return true;
+    }
+
+    // Enters a room, and re-enters it after every reconnect
+    bool join(const std::string& name) {
+        room = name;
+        return send("/join " + name);
+    }
+
+    // Returns to the lobby (also after reconnects)
+    bool leave() {
+        room.clear();
+        return send("/leave");
+    }
+
+    /**
+     * Function: nextMessage
+     * Purpose: Takes the oldest received message when no onMessage()
+     *          handler is set
+     * Returns: false if none is waiting
+     */
+    bool nextMessage(std::string& payload) {
+        if (inbox.empty()) return false;
+        payload = std::move(inbox.front());
+        inbox.pop_front();
+        return true;
+    }
+
+    State currentState() const { return state; }
+    SOCKET socket() const { return sock; }
+
+    // Whether the socket should be watched for writability
+    bool wantsWrite() const {
+        if (state == State::Connecting) return true;
+        return state == State::Connected && !handshaking && !usingSharedMemory() && outputSent < output.size();
+    }
+
+#ifdef __linux__
+    // Doorbell to watch for reading while on shared memory, otherwise -1
+    int bellFd() const { return shm ? shm->dataBell() : -1; }
+
+    bool usingSharedMemory() const { return shm != nullptr; }
+
+    /**
+     * Function: handleBell
+     * Purpose: Delivers the messages waiting in the shared-memory ring and
+     *          writes what fits of the queued output
+     */
+    void handleBell() {
+        if (!shm) return;
+        ShmChannel::drainBell(shm->dataBell());
+        int frames = 0;
+        while (true) {
+            std::string_view payload;
+            ShmRead result = ShmRead::Empty;
+            while (frames < CLIENT_FRAMES_PER_BELL && (result = shm->read(payload)) == ShmRead::Frame) {
+                frames++;
+                if (!deliver(payload)) return;
+            }
+            shm->release();
+            if (result == ShmRead::Corrupt) {
+                lostConnection("malformed shared-memory frame");
+                return;
+            }
+            flushShared();
+            if (!shm) return;
+            if (frames >= CLIENT_FRAMES_PER_BELL) {
+                ShmChannel::ringBell(shm->dataBell());  // Come back for the rest
+                return;
+            }
+            if (shm->idle()) return;
+        }
+    }
+#else
+    int bellFd() const { return -1; }
+    bool usingSharedMemory() const { return false; }
+    void handleBell() {}
+#endif
+
+    size_t queuedBytes() const { return output.size() - outputSent; }
+
+    /**
+     * Function: timeoutMs
+     * Purpose: How long the caller may wait before calling tick()
+     * Returns: Milliseconds, or -1 if no timer is pending
+     */
+    long long timeoutMs() const {
+        if (state != State::Waiting) return -1;
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(retryAt - Clock::now()).count();
+        return std::max<long long>(left, 0);
+    }
+
+    // Runs due timers (the reconnect attempt)
+    void tick() {
+        if (state == State::Waiting && Clock::now() >= retryAt) connectNow();
+    }
+
+    /**
+     * Function: handleEvents
+     * Purpose: Reacts to readiness reported by the caller's poll loop
+     */
+    void handleEvents(bool readable, bool writable) {
+        if (state == State::Connecting) {
+            if (!readable && !writable) return;
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error, &length);
+            if (error != 0) {
+                lostConnection("connect failed: " + std::string(strerror(error)));
+                return;
+            }
+            connected();
+            if (state != State::Connected) return;
+        }
+        if (state != State::Connected) return;
+        if (readable) readAvailable();
+        if (state == State::Connected && (writable || outputSent < output.size())) flushOutput();
+    }
+
+    /**
+     * Function: pollClients
+     * Purpose: Waits for and handles network events on many clients at
+     *          once (one poll() call)
+     * Parameters:
+     *   - clients: The clients to drive
+     *   - count: Number of clients
+     *   - timeoutMs: Longest wait; shortened to the next reconnect timer
+     * Returns: false if poll() itself failed
+     */
+    static bool pollClients(ChatClient* const* clients, size_t count, int timeoutMs) {
+        thread_local std::vector<pollfd> fds;
+        thread_local std::vector<ChatClient*> owners;
+        fds.clear();
+        owners.clear();
+        long long wait = timeoutMs;
+        for (size_t i = 0; i < count; i++) {
+            ChatClient* client = clients[i];
+            long long timer = client->timeoutMs();
+            if (timer >= 0 && (wait < 0 || timer < wait)) wait = timer;
+            if (client->sock == INVALID_SOCKET) continue;
+            pollfd fd{};
+            fd.fd = client->sock;
+            fd.events = POLLIN;
+            if (client->wantsWrite()) fd.events |= POLLOUT;
+            fds.push_back(fd);
+            owners.push_back(client);
+            if (client->bellFd() >= 0) {
+                fd.fd = client->bellFd();
+                fd.events = POLLIN;
+                fds.push_back(fd);
+                owners.push_back(client);
+            }
+        }
+
+#ifdef _WIN32
+        int ready = fds.empty() ? 0 : WSAPoll(fds.data(), (ULONG)fds.size(), (int)wait);
+        if (fds.empty() && wait > 0) Sleep((DWORD)wait);
+#else
+        int ready = poll(fds.data(), fds.size(), (int)wait);
+        if (ready < 0 && errno != EINTR) return false;
+#endif
+        for (size_t i = 0; ready > 0 && i < fds.size(); i++) {
+            short events = fds[i].revents;
+            if (events == 0) continue;
+            if (fds[i].fd != owners[i]->sock) {
+                if (fds[i].fd == owners[i]->bellFd()) owners[i]->handleBell();  // Still on shared memory
+                continue;
+            }
+            bool failed = (events & (POLLERR | POLLHUP)) != 0;
+            owners[i]->handleEvents((events & POLLIN) != 0 || failed, (events & POLLOUT) != 0 || failed);
+        }
+        for (size_t i = 0; i < count; i++) clients[i]->tick();
+        return true;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static bool wouldBlock() {
+#ifdef _WIN32
+        int error = WSAGetLastError();
+        return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS || errno == EINTR;
+#endif
+    }
+
+    static bool makeNonBlocking(SOCKET s) {
+#ifdef _WIN32
+        u_long on = 1;
+        return ioctlsocket(s, FIONBIO, &on) == 0;
+#else
+        int flags = fcntl(s, F_GETFL, 0);
+        return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+    }
+
+    void setState(State next, const std::string& reason) {
+        if (state == next) return;
+        state = next;
+        if (stateHandler) stateHandler(next, reason);
+    }
+
+    // Starts a non-blocking connect (or schedules a retry if it fails at once)
+    void connectNow() {
+        closeSocket();
+        sock = ::socket(address.ss_family, SOCK_STREAM, 0);
+        if (sock == INVALID_SOCKET || !makeNonBlocking(sock)) {
+            lostConnection("cannot create socket");
+            return;
+        }
+        applySocketProfile(sock, options.profile);  // Before connect(): window scale
+        setState(State::Connecting, "connecting");
+        if (::connect(sock, (sockaddr*)&address, addressLength) == 0) {
+            connected();
+        } else if (!wouldBlock()) {
+            lostConnection("connect failed");
+        }
+    }
+
+    void connected() {
+        backoffMs = options.reconnectMinMs;
+        recvBuffer = RecvBuffer();
+        setState(State::Connected, "connected");
+        if (state != State::Connected) return;  // Handler called close()
+        // Typed messages and back into the room, ahead of anything queued meanwhile
+        std::string commands;
+        if (options.binary) appendFrame(commands, BINARY_COMMAND);
+        if (!room.empty()) appendFrame(commands, "/join " + room);
+        output.insert(outputSent, commands);
+#ifdef __linux__
+        if (options.sharedMemory && !options.unixPath.empty()) {
+            // Everything else waits until the server has answered
+            std::string hello = makeFrame(SHM_HELLO);
+            if (::send(sock, hello.data(), hello.size(), MSG_NOSIGNAL) != (ssize_t)hello.size()) {
+                lostConnection("send failed");
+                return;
+            }
+            handshaking = true;
+            return;
+        }
+#endif
+        flush();
+    }
+
+#ifdef __linux__
+    /**
+     * Function: finishHandshake
+     * Purpose: Switches to the rings if the server's answer carried them,
+     *          then sends what was queued meanwhile
+     */
+    void finishHandshake() {
+        handshaking = false;
+        if (receivedFdCount == SHM_DESCRIPTORS) {
+            shm = ShmChannel::attach(receivedFds);
+            receivedFdCount = 0;
+            if (!shm) {
+                lostConnection("unusable shared memory");
+                return;
+            }
+        } else {
+            closeReceivedFds();
+        }
+        flushOutput();
+    }
+
+    // Copies queued frames into the ring until it is full
+    void flushShared() {
+        while (outputSent < output.size()) {
+            size_t written = shm->write(output.data() + outputSent, output.size() - outputSent);
+            if (written == 0) break;   // The doorbell rings when there is room
+            outputSent += written;
+        }
+        if (outputSent == output.size()) {
+            output.clear();
+            outputSent = 0;
+        }
+    }
+
+    void closeReceivedFds() {
+        for (int i = 0; i < receivedFdCount; i++) ::close(receivedFds[i]);
+        receivedFdCount = 0;
+    }
+#endif
+
+    /**
+     * Function: lostConnection
+     * Purpose: Closes the socket and, if enabled, schedules a reconnect
+     *
+     * A message that was only partly written is dropped so the next
+     * connection starts on a frame boundary; whole unsent ones are kept.
+     */
+    void lostConnection(const std::string& reason) {
+        closeSocket();
+        dropPartialFrame();
+        handshaking = false;
+        if (!options.reconnect) {
+            output.clear();
+            outputSent = 0;
+            setState(State::Idle, reason);
+            return;
+        }
+        int jitter = std::uniform_int_distribution<int>(0, backoffMs / 2)(random);
+        retryAt = Clock::now() + std::chrono::milliseconds(backoffMs + jitter);
+        backoffMs = std::min(backoffMs * 2, options.reconnectMaxMs);
+        setState(State::Waiting, reason);
+    }
+
+    void dropPartialFrame() {
+        size_t boundary = 0;
+        while (boundary < outputSent) {
+            boundary += FRAME_HEADER_SIZE + readFrameHeader(output.data() + boundary);
+        }
+        output.erase(0, boundary);
+        outputSent = 0;
+    }
+
+    void closeSocket() {
+        if (sock != INVALID_SOCKET) {
+            ::closesocket(sock);  // Not the member close()
+            sock = INVALID_SOCKET;
+        }
+#ifdef __linux__
+        shm.reset();
+        closeReceivedFds();
+#endif
+    }
+
+    void readAvailable() {
+        for (int i = 0; i < CLIENT_READS_PER_EVENT; i++) {
+            char* space = recvBuffer.prepare(RECV_CHUNK_SIZE);
+            size_t room = recvBuffer.writable();
+#ifdef __linux__
+            int received;
+            if (handshaking) {
+                // The answer to the shared-memory request may carry descriptors
+                int fds[SHM_DESCRIPTORS];
+                int count;
+                received = (int)receiveWithDescriptors(sock, space, room, fds, count);
+                if (count > 0) {
+                    closeReceivedFds();
+                    std::copy(fds, fds + count, receivedFds);
+                    receivedFdCount = count;
+                }
+            } else {
+                received = recv(sock, space, (int)room, 0);
+            }
+#else
+            int received = recv(sock, space, (int)room, 0);
+#endif
+            if (received < 0 && wouldBlock()) break;
+            if (received <= 0) {
+                deliverFrames();
+                lostConnection(received == 0 ? "closed by server" : "receive failed");
+                return;
+            }
+            recvBuffer.commit((size_t)received);
+            if (!deliverFrames()) return;
+            if ((size_t)received < room) break;  // Drained
+        }
+    }
+
+    // Hands every complete frame to the application; false if the
+    // connection was dropped meanwhile
+    bool deliverFrames() {
+        std::string_view payload;
+        FrameStatus status;
+        while ((status = recvBuffer.nextFrame(payload)) == FrameStatus::Complete) {
+            if (!deliver(payload)) return false;
+#ifdef __linux__
+            if (handshaking) {
+                finishHandshake();  // The first frame is the server's answer
+                if (state != State::Connected) return false;
+            }
+#endif
+        }
+        if (status == FrameStatus::TooLarge) {
+            lostConnection("oversized frame from server");
+            return false;
+        }
+        return true;
+    }
+
+    // Passes one message on; false if the handler called close()
+    bool deliver(std::string_view payload) {
+        if (payload.empty()) {
+            appendFrame(output, payload);  // Heartbeat answer
+            flushOutput();
+            return state == State::Connected;
+        }
+        if (!messageHandler) {
+            inbox.emplace_back(payload);
+            return true;
+        }
+        messageHandler(payload);
+        return state == State::Connected;
+    }
+
+    // Sends queued messages by whichever transport is in use
+    void flushOutput() {
+        if (handshaking) return;
+#ifdef __linux__
+        if (shm) {
+            flushShared();
+            return;
+        }
+#endif
+        flush();
+    }
+
+    // Writes queued bytes until the socket would block
+    void flush() {
+#ifdef _WIN32
+        const int flags = 0;
+#else
+        const int flags = MSG_NOSIGNAL;
+#endif
+        while (outputSent < output.size()) {
+            int sent = ::send(sock, output.data() + outputSent, (int)(output.size() - outputSent), flags);
+            if (sent < 0 && wouldBlock()) break;
+            if (sent <= 0) {
+                lostConnection("send failed");
+                return;
+            }
+            outputSent += (size_t)sent;
+        }
+        if (outputSent == output.size()) {
+            output.clear();
+            outputSent = 0;
+        } else if (outputSent > output.size() / 2) {
+            output.erase(0, outputSent);   // Keep the unsent tail at the front
+            outputSent = 0;
+        }
+    }
+
+    ChatClientOptions options;
+    State state = State::Idle;
+    SOCKET sock = INVALID_SOCKET;
+    sockaddr_storage address{};           // sockaddr_in, or sockaddr_un for unixPath
+    socklen_t addressLength = 0;
+    std::string room;                     // Room to re-join after reconnecting
+    bool handshaking = false;             // Shared-memory request sent, answer pending
+#ifdef __linux__
+    std::unique_ptr<ShmChannel> shm;      // Rings in use, or nullptr for the socket
+    int receivedFds[SHM_DESCRIPTORS];     // Descriptors that came with the answer
+    int receivedFdCount = 0;
+#endif
+
+    std::string output;                   // Framed messages not yet fully sent
+    size_t outputSent = 0;                // Bytes of `output` already written
+    RecvBuffer recvBuffer;
+    std::deque<std::string> inbox;        // Without a message handler
+
+    MessageHandler messageHandler;
+    StateHandler stateHandler;
+    int backoffMs;
+    Clock::time_point retryAt;
+    std::mt19937 random;
+};
+
+#endif
@@ -0,0 +1,404 @@
+/**
+ * client_registry.h - Lock-free reads of the client list and rooms
+ *
+ * In threads mode every client has its own handler thread, and each of them
+ * fans messages out to its room. With one mutex around the client list and
+ * rooms, every broadcast queued behind every other broadcast and behind
+ * every connect, disconnect and room change. Here readers take no lock:
+ *
+ *  - A room's members sit in chunks of atomic slots. Joining stores the
+ *    member in a free slot and leaving clears it, O(1) whatever the room's
+ *    size; a broadcast walks the slots and skips the empty ones. Chunks are
+ *    only ever added, so a walk never meets freed memory.
+ *  - Replaced room maps, emptied rooms and removed clients are not freed at
+ *    once but retired to the EpochDomain, which frees them only after every
+ *    reader that might still hold them has left its read-side section
+ *    (epoch-based reclamation). Entering and leaving a section is a store
+ *    to the thread's own cache-line-sized record.
+ *  - Clients sit in a fixed table of slots. Adding or removing one is O(1)
+ *    through a free list, and the handle returned on insert carries the
+ *    slot's generation, so a stale handle never removes the slot's next
+ *    occupant.
+ *
+ * Writers (connect, disconnect, join, leave) still serialise among
+ * themselves on a mutex, but they never wait for readers and readers never
+ * wait for them.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef CLIENT_REGISTRY_H
+#define CLIENT_REGISTRY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const uint64_t EPOCH_IDLE = ~(uint64_t)0;    // Reader record: not in a section
+const size_t EPOCH_COLLECT_BATCH = 32;       // Retirements between two scans of the readers
+const size_t ROOM_CHUNK_SLOTS = 64;          // Member slots per SharedRoom chunk
+
+/**
+ * Class: EpochDomain
+ * Purpose: Defers freeing of unpublished objects until no reader can see them
+ *
+ * An object retired while the global epoch is E is freed once the epoch
+ * reaches E + 2. The epoch only advances when every reader inside a section
+ * entered it in the current epoch, so by then every reader that could have
+ * loaded the object has left. The readers are scanned once per
+ * EPOCH_COLLECT_BATCH retirements rather than on every one.
+ */
+class EpochDomain {
+public:
+    // Never destroyed: detached threads may still exit during shutdown
+    static EpochDomain& instance() {
+        static EpochDomain* domain = new EpochDomain();
+        return *domain;
+    }
+
+    // Starts a read-side section (sections nest)
+    void enter() {
+        ReaderRecord& reader = threadReader();
+        if (reader.depth++ > 0) return;
+        reader.epoch.store(globalEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // Pairs with the fence in collect(): either the writer sees this
+        // record, or this reader sees the writer's new pointer
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void exit() {
+        ReaderRecord& reader = threadReader();
+        if (--reader.depth > 0) return;
+        reader.epoch.store(EPOCH_IDLE, std::memory_order_release);
+    }
+
+    /**
+     * Function: retire
+     * Purpose: Hands over an object that has just been unpublished; it is
+     *          deleted once no reader can still be using it
+     */
+    template <typename T>
+    void retire(T* object) {
+        std::lock_guard<std::mutex> lock(mutex);
+        retired.push_back({globalEpoch.load(std::memory_order_relaxed), (void*)object,
+                           [](void* p) { delete static_cast<T*>(p); }});
+        if (++sinceCollect < EPOCH_COLLECT_BATCH) return;
+        sinceCollect = 0;
+        collect();
+    }
+
+private:
+    EpochDomain() = default;
+
+    struct alignas(64) ReaderRecord {
+        std::atomic<uint64_t> epoch{EPOCH_IDLE};
+        unsigned depth = 0;                   // Owning thread only
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    // Registers the calling thread's record on first use, removes it on exit
+    struct ReaderSlot {
+        ReaderRecord record;
+        ReaderSlot() {
+            EpochDomain& domain = instance();
+            std::lock_guard<std::mutex> lock(domain.mutex);
+            domain.readers.push_back(&record);
+        }
+        ~ReaderSlot() {
+            EpochDomain& domain = instance();
+            std::lock_guard<std::mutex> lock(domain.mutex);
+            domain.readers.erase(std::remove(domain.readers.begin(), domain.readers.end(), &record),
+                                 domain.readers.end());
+        }
+    };
+
+    static ReaderRecord& threadReader() {
+        thread_local ReaderSlot slot;
+        return slot.record;
+    }
+
+    // Advances the epoch if every active reader has caught up, then frees
+    // what is old enough (mutex held)
+    void collect() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t epoch = globalEpoch.load(std::memory_order_relaxed);
+        bool caughtUp = true;
+        for (ReaderRecord* reader : readers) {
+            uint64_t seen = reader->epoch.load(std::memory_order_relaxed);
+            if (seen != EPOCH_IDLE && seen != epoch) {
+                caughtUp = false;
+                break;
+            }
+        }
+        if (caughtUp) {
+            epoch++;
+            globalEpoch.store(epoch, std::memory_order_relaxed);
+        }
+
+        for (size_t i = 0; i < retired.size();) {
+            if (retired[i].epoch + 2 <= epoch) {
+                retired[i].destroy(retired[i].object);
+                retired[i] = retired.back();
+                retired.pop_back();
+            } else {
+                i++;
+            }
+        }
+    }
+
+    std::atomic<uint64_t> globalEpoch{0};     // Only advanced with the mutex held
+    std::mutex mutex;                         // Guards readers and retired
+    std::vector<ReaderRecord*> readers;
+    std::vector<Retired> retired;
+    size_t sinceCollect = 0;                  // Retirements since the last collect()
+};
+
+// Read-side section for the current scope
+struct EpochGuard {
+    EpochGuard() { EpochDomain::instance().enter(); }
+    ~EpochGuard() { EpochDomain::instance().exit(); }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+// Identifies one occupant of a registry slot
+struct SlotHandle {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+};
+
+/**
+ * Class: SlotRegistry
+ * Purpose: Fixed table of items with O(1) insert/remove and lock-free
+ *          iteration
+ *
+ * The registry does not own the items: whoever removes one must retire it
+ * to the EpochDomain (or otherwise keep it alive) while readers may still
+ * be iterating.
+ */
+template <typename T>
+class SlotRegistry {
+public:
+    // Sizes the table; call before the registry is used
+    void setCapacity(size_t capacity) {
+        slots.reset(new Slot[capacity]);
+        this->capacity = capacity;
+        freeSlots.clear();
+        for (size_t i = capacity; i > 0; i--) freeSlots.push_back((uint32_t)(i - 1));
+    }
+
+    /**
+     * Function: insert
+     * Purpose: Puts an item in a free slot
+     * Returns: false if every slot is taken
+     */
+    bool insert(T* item, SlotHandle& handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeSlots.empty()) return false;
+        uint32_t index = freeSlots.back();
+        freeSlots.pop_back();
+        Slot& slot = slots[index];
+        slot.item.store(item, std::memory_order_release);
+        handle.index = index;
+        handle.generation = slot.generation;
+        if (index >= used.load(std::memory_order_relaxed)) used.store(index + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Function: remove
+     * Purpose: Frees the slot named by `handle`
+     * Returns: The removed item, or nullptr if the handle is stale
+     */
+    T* remove(SlotHandle handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (handle.index >= capacity) return nullptr;
+        Slot& slot = slots[handle.index];
+        if (slot.generation != handle.generation) return nullptr;
+        T* item = slot.item.load(std::memory_order_relaxed);
+        slot.item.store(nullptr, std::memory_order_release);
+        slot.generation++;
+        freeSlots.push_back(handle.index);
+        return item;
+    }
+
+    // Calls visit(item) for every occupied slot; use inside an EpochGuard
+    template <typename Visitor>
+    void forEach(Visitor visit) const {
+        size_t end = used.load(std::memory_order_acquire);
+        for (size_t i = 0; i < end; i++) {
+            T* item = slots[i].item.load(std::memory_order_acquire);
+            if (item != nullptr) visit(*item);
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<T*> item{nullptr};
+        uint32_t generation = 0;              // Writers only
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t capacity = 0;
+    std::atomic<size_t> used{0};              // Slots below this have been occupied
+    std::mutex mutex;                         // Serialises writers
+    std::vector<uint32_t> freeSlots;
+};
+
+// ROOM_CHUNK_SLOTS member slots of a SharedRoom (nullptr: free)
+template <typename Member>
+struct SharedRoomChunk {
+    std::atomic<Member*> slots[ROOM_CHUNK_SLOTS];
+    std::atomic<SharedRoomChunk*> next{nullptr};
+
+    SharedRoomChunk() {
+        for (std::atomic<Member*>& slot : slots) slot.store(nullptr, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Struct: SharedRoom
+ * Purpose: One room whose member list can be read without a lock
+ */
+template <typename Member>
+struct SharedRoom {
+    std::string name;                         // Immutable
+    SharedRoomChunk<Member> first;            // Later chunks are chained after it
+    std::atomic<size_t> used{0};              // Slots below this have been occupied
+
+    // Writers only
+    std::vector<SharedRoomChunk<Member>*> chunks;  // By slot / ROOM_CHUNK_SLOTS
+    std::vector<size_t> freeSlots;
+    size_t count = 0;
+
+    SharedRoom() { chunks.push_back(&first); }
+    ~SharedRoom() {
+        for (size_t i = 1; i < chunks.size(); i++) delete chunks[i];
+    }
+};
+
+/**
+ * Class: SharedRoomIndex
+ * Purpose: Room name -> members map whose lookups and member lists are
+ *          read lock-free
+ *
+ * The same rooms as RoomIndex (room_index.h), for when broadcasts run on
+ * many threads at once. A room pointer held by one of its members stays
+ * valid; any other room pointer may only be used inside an EpochGuard
+ * that was entered before it was obtained.
+ *
+ * Writers change their own map under the mutex; readers look names up in
+ * an immutable copy of it, published again whenever a room is created or
+ * deleted (joins into existing rooms leave it alone).
+ *
+ * Member must have a public `size_t roomSlot` field (writers only). A
+ * broadcast walks the slots as they are, not a snapshot: a member who
+ * leaves and rejoins the room while it runs may be visited twice.
+ */
+template <typename Member>
+class SharedRoomIndex {
+public:
+    /**
+     * Function: join
+     * Purpose: Moves a member from `from` (nullptr if none) into a room
+     * Returns: The room joined
+     */
+    SharedRoom<Member>* join(Member& member, SharedRoom<Member>* from, const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (from != nullptr) removeMember(member, *from);
+
+        SharedRoom<Member>*& room = rooms[name];
+        bool created = (room == nullptr);
+        if (created) {
+            room = new SharedRoom<Member>();
+            room->name = name;
+        }
+        addMember(member, *room);
+        if (created) publishRooms();  // With its members, so readers never see it without
+        return room;
+    }
+
+    // Removes a member from its room, deleting the room if it is now empty
+    void leave(Member& member, SharedRoom<Member>& from) {
+        std::lock_guard<std::mutex> lock(mutex);
+        removeMember(member, from);
+    }
+
+    // The room with this name, or nullptr; use inside an EpochGuard
+    SharedRoom<Member>* find(const std::string& name) const {
+        const RoomMap* map = published.load(std::memory_order_acquire);
+        if (map == nullptr) return nullptr;
+        auto it = map->find(name);
+        return it == map->end() ? nullptr : it->second;
+    }
+
+    // Calls visit(member) for each of the room's members; use inside an EpochGuard
+    template <typename Visitor>
+    static void forEachMember(const SharedRoom<Member>& room, Visitor visit) {
+        size_t end = room.used.load(std::memory_order_acquire);
+        const SharedRoomChunk<Member>* chunk = &room.first;
+        for (size_t i = 0; i < end; i++) {
+            if (i > 0 && i % ROOM_CHUNK_SLOTS == 0) chunk = chunk->next.load(std::memory_order_acquire);
+            Member* member = chunk->slots[i % ROOM_CHUNK_SLOTS].load(std::memory_order_acquire);
+            if (member != nullptr) visit(*member);
+        }
+    }
+
+private:
+    using RoomMap = std::unordered_map<std::string, SharedRoom<Member>*>;
+
+    // Replaces the readers' copy of the room map after a room came or went
+    void publishRooms() {
+        const RoomMap* old = published.exchange(new RoomMap(rooms), std::memory_order_acq_rel);
+        if (old != nullptr) EpochDomain::instance().retire(old);
+    }
+
+    // Stores the member in a free slot, chaining a new chunk if there is none
+    void addMember(Member& member, SharedRoom<Member>& room) {
+        size_t slot;
+        if (!room.freeSlots.empty()) {
+            slot = room.freeSlots.back();
+            room.freeSlots.pop_back();
+        } else {
+            slot = room.used.load(std::memory_order_relaxed);
+            if (slot == room.chunks.size() * ROOM_CHUNK_SLOTS) {
+                SharedRoomChunk<Member>* chunk = new SharedRoomChunk<Member>();
+                room.chunks.back()->next.store(chunk, std::memory_order_release);
+                room.chunks.push_back(chunk);
+            }
+        }
+        room.chunks[slot / ROOM_CHUNK_SLOTS]->slots[slot % ROOM_CHUNK_SLOTS].store(&member, std::memory_order_release);
+        if (slot >= room.used.load(std::memory_order_relaxed)) room.used.store(slot + 1, std::memory_order_release);
+        member.roomSlot = slot;
+        room.count++;
+    }
+
+    void removeMember(Member& member, SharedRoom<Member>& room) {
+        size_t slot = member.roomSlot;
+        room.chunks[slot / ROOM_CHUNK_SLOTS]->slots[slot % ROOM_CHUNK_SLOTS].store(nullptr, std::memory_order_release);
+        room.freeSlots.push_back(slot);
+        if (--room.count == 0) {
+            rooms.erase(room.name);
+            publishRooms();
+            EpochDomain::instance().retire(&room);
+        }
+    }
+
+    std::mutex mutex;                                         // Serialises writers
+    RoomMap rooms;                                            // Writers only
+    std::atomic<const RoomMap*> published{nullptr};           // Copy for find()
+};
+
+#endif
@@ -0,0 +1,82 @@
+#!/usr/bin/env bash
+#
+# compare_models.sh - Runs the same load generator workload against every
+# concurrency model of the server and prints one table row per model
+#
+# Each model gets a fresh server on the same port. The load generator
+# connects CLIENTS clients (waiting at most CONNECT_TIMEOUT seconds for
+# their welcome), then SENDERS of them send SIZE byte messages at RATE
+# messages per second each for DURATION seconds. The iterative and pool
+# models only serve one client per thread, so they admit at most 1 and
+# POOL_THREADS clients; the rest stay in the listen backlog. The coro
+# model needs a server built with -std=c++20 (its row is empty otherwise).
+#
+# Usage (Linux, from this directory, with server and loadgen built):
+#   ./compare_models.sh
+#   MODES="threads epoll" CLIENTS=500 DURATION=10 ./compare_models.sh
+#
+# Course: 23CSE312 - Distributed Systems
+# Lab: Socket Programming (Concurrent Chat Application)
+
+SERVER=${SERVER:-./server}
+LOADGEN=${LOADGEN:-./loadgen}
+MODES=${MODES:-"iterative threads pool prefork coro epoll uring"}
+PORT=${PORT:-8090}
+CLIENTS=${CLIENTS:-100}
+SENDERS=${SENDERS:-10}
+RATE=${RATE:-50}
+SIZE=${SIZE:-64}
+DURATION=${DURATION:-5}
+ROOMS=${ROOMS:-1}
+POOL_THREADS=${POOL_THREADS:-16}
+PROCESSES=${PROCESSES:-4}
+CONNECT_TIMEOUT=${CONNECT_TIMEOUT:-3}
+STARTUP_SECONDS=${STARTUP_SECONDS:-2}   # Prefork workers link up with each other first
+
+for program in "$SERVER" "$LOADGEN"; do
+    if [ ! -x "$program" ]; then
+        echo "[Error] $program not found (set SERVER and LOADGEN)." >&2
+        exit 1
+    fi
+done
+
+logs=$(mktemp -d)
+echo "[Compare] $CLIENTS clients, $SENDERS senders at $RATE msg/s, $SIZE bytes, ${DURATION} s; logs in $logs"
+printf '%-10s %10s %9s %10s %14s %10s %10s\n' \
+    model admitted conn/s sent/s delivered/s p50 p99
+
+for mode in $MODES; do
+    # The server's console is a FIFO, so the run can end with "quit"
+    console="$logs/$mode.console"
+    mkfifo "$console"
+    "$SERVER" --mode "$mode" --port "$PORT" --max-clients 100000 \
+        --pool-threads "$POOL_THREADS" --processes "$PROCESSES" \
+        < "$console" > "$logs/$mode.server.log" 2>&1 &
+    server=$!
+    exec 3> "$console"
+    sleep "$STARTUP_SECONDS"
+
+    "$LOADGEN" --port "$PORT" --clients "$CLIENTS" --senders "$SENDERS" --rate "$RATE" \
+        --size "$SIZE" --duration "$DURATION" --rooms "$ROOMS" \
+        --connect-timeout "$CONNECT_TIMEOUT" > "$logs/$mode.loadgen.log" 2>&1
+
+    echo quit >&3
+    exec 3>&-
+    for _ in $(seq 50); do
+        kill -0 "$server" 2>/dev/null || break
+        sleep 0.1
+    done
+    kill "$server" 2>/dev/null
+    wait "$server" 2>/dev/null
+
+    # [LoadGen] Connections: 100 admitted, 0 refused, 0 failed in 0.012 s (8333 conn/s)
+    awk -v mode="$mode" '
+        /Connections:/ { admitted = $3; connRate = $(NF - 1); sub(/\(/, "", connRate) }
+        /Sent:/        { sentRate = $(NF - 1); sub(/\(/, "", sentRate) }
+        /Delivered:/   { for (i = 1; i <= NF; i++) if ($(i + 1) == "msg/s,") { deliveredRate = $i; sub(/\(/, "", deliveredRate) } }
+        /latency:/     { p50 = $5 " " $6; p99 = $8 " " $9 }
+        END {
+            if (admitted == "") admitted = "none"
+            printf "%-10s %10s %9s %10s %14s %10s %10s\n", mode, admitted, connRate, sentRate, deliveredRate, p50, p99
+        }' "$logs/$mode.loadgen.log"
+done
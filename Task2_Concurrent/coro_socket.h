@@ -0,0 +1,391 @@
+/**
+ * coro_socket.h - Awaitable sockets for C++20 coroutine handlers (Linux only)
+ *
+ * A handler thread costs a kernel thread and a stack for every connection
+ * (two, with its writer), mostly spent blocked in recv(). Written as a
+ * coroutine, the same straight-line handler keeps only its frame on the
+ * heap while it waits: a few hundred bytes instead of a stack.
+ *
+ * CoroLoop is an epoll loop on one thread. A socket is registered once,
+ * edge-triggered for input and output; a coroutine that finds it not
+ * ready parks its handle in the CoroSocket and the loop resumes it on the
+ * next edge. The awaitables try the operation first, so a ready socket
+ * costs no trip through the loop:
+ *
+ *   ssize_t n = co_await loop.recv(socket, buffer, sizeof(buffer));
+ *   int fd = co_await loop.accept(socket, address);
+ *   co_await loop.writable(socket);      // After a short write
+ *   co_await loop.yield();               // Let the others run first
+ *   co_await loop.sleep(100);            // Resume in 100 ms
+ *
+ * recv and accept return what the system call returned. Resumed by an
+ * edge, the call is tried once more; in the rare case that it would still
+ * block, the result is -1 with errno EAGAIN and the caller simply awaits
+ * again. A buffer handed to recv is only written when the coroutine runs,
+ * so coroutines of one loop may share it as long as they are done with
+ * the data before their next co_await.
+ *
+ * CoroEvent wakes one waiting coroutine from any thread (a writer
+ * coroutine waiting for output to be queued, for instance). CoroTask is
+ * the handler type: it starts at once and frees its frame when it returns.
+ *
+ * Only built when the compiler implements coroutines (-std=c++20);
+ * CORO_SOCKETS is defined then.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef CORO_SOCKET_H
+#define CORO_SOCKET_H
+
+#if defined(__cpp_impl_coroutine) && defined(__linux__)
+#define CORO_SOCKETS 1
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+/**
+ * Struct: CoroTask
+ * Purpose: Return type of a detached coroutine: runs until its first
+ *          suspension when called, frees its own frame when it finishes
+ */
+struct CoroTask {
+    struct promise_type {
+        CoroTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        // Frame bytes of every live coroutine, for the statistics (kept out
+        // of line: GCC mistakes the inlined pair for mismatched new/delete)
+        [[gnu::noinline]] static void* operator new(size_t size) {
+            frameBytes.fetch_add(size, std::memory_order_relaxed);
+            return ::operator new(size);
+        }
+        [[gnu::noinline]] static void operator delete(void* frame, size_t size) {
+            frameBytes.fetch_sub(size, std::memory_order_relaxed);
+            ::operator delete(frame);
+        }
+        static inline std::atomic<size_t> frameBytes{0};
+    };
+};
+
+/**
+ * Struct: CoroSocket
+ * Purpose: A socket registered with a CoroLoop and the coroutines parked
+ *          on it (at most one per direction)
+ */
+struct CoroSocket {
+    int fd = -1;
+    std::coroutine_handle<> reader;     // Waits for input (or hang-up)
+    std::coroutine_handle<> writer;     // Waits for output space
+};
+
+/**
+ * Struct: CoroIo
+ * Purpose: Awaitable for one non-blocking system call on a CoroSocket
+ */
+template <typename Attempt>
+struct CoroIo {
+    CoroSocket& socket;
+    bool output;                        // Waits for writability, else readability
+    Attempt attempt;                    // The call; returns its result, errno set on -1
+    long long result = 0;
+
+    static bool wouldBlock(long long result) {
+        return result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    bool await_ready() {
+        result = attempt();
+        return !wouldBlock(result);
+    }
+    void await_suspend(std::coroutine_handle<> handle) {
+        (output ? socket.writer : socket.reader) = handle;
+    }
+    long long await_resume() {
+        if (wouldBlock(result)) result = attempt();
+        return result;
+    }
+};
+
+template <typename Attempt>
+CoroIo<Attempt> makeCoroIo(CoroSocket& socket, bool output, Attempt attempt) {
+    return CoroIo<Attempt>{socket, output, attempt};
+}
+
+/**
+ * Class: CoroLoop
+ * Purpose: Resumes the coroutines waiting on its sockets (one thread)
+ *
+ * watch(), unwatch(), the awaitables and runOnce() belong to the loop's
+ * thread; post() may be called from any thread.
+ */
+class CoroLoop {
+public:
+    CoroLoop() = default;
+    CoroLoop(const CoroLoop&) = delete;
+    CoroLoop& operator=(const CoroLoop&) = delete;
+
+    ~CoroLoop() {
+        if (wakeFd >= 0) close(wakeFd);
+        if (epollFd >= 0) close(epollFd);
+    }
+
+    /**
+     * Function: init
+     * Purpose: Creates the epoll instance and its wake-up eventfd
+     * Returns: true if the loop can run
+     */
+    bool init() {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0) return false;
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = wakeFd;
+        return epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) == 0;
+    }
+
+    /**
+     * Function: watch
+     * Purpose: Registers a non-blocking socket; `socket` must stay put
+     *          until unwatch()
+     */
+    bool watch(CoroSocket& socket) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = socket.fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, socket.fd, &ev) != 0) return false;
+        if ((size_t)socket.fd >= sockets.size()) sockets.resize((size_t)socket.fd + 1, nullptr);
+        sockets[socket.fd] = &socket;
+        return true;
+    }
+
+    /**
+     * Function: unwatch
+     * Purpose: Deregisters a socket (before it is closed); events for it
+     *          still in the current batch are ignored
+     */
+    void unwatch(CoroSocket& socket) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, socket.fd, nullptr);
+        if ((size_t)socket.fd < sockets.size()) sockets[socket.fd] = nullptr;
+    }
+
+    auto recv(CoroSocket& socket, char* data, size_t length) {
+        return makeCoroIo(socket, false, [&socket, data, length]() -> long long {
+            ssize_t result;
+            do result = ::recv(socket.fd, data, length, 0); while (result < 0 && errno == EINTR);
+            return result;
+        });
+    }
+
+    // The next output edge: room in the socket buffer after a short write
+    auto writable(CoroSocket& socket) {
+        return makeCoroIo(socket, true, []() -> long long {
+            errno = EAGAIN;
+            return -1;
+        });
+    }
+
+    auto accept(CoroSocket& socket, sockaddr_in& address) {
+        return makeCoroIo(socket, false, [&socket, &address]() -> long long {
+            socklen_t length = sizeof(address);
+            int result;
+            do {
+                result = accept4(socket.fd, (sockaddr*)&address, &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            } while (result < 0 && (errno == EINTR || errno == ECONNABORTED));
+            return result;
+        });
+    }
+
+    // Lets the loop's other coroutines (and sockets) go first
+    auto yield() {
+        struct Yield {
+            CoroLoop& loop;
+            bool await_ready() { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { loop.post(handle); }
+            void await_resume() {}
+        };
+        return Yield{*this};
+    }
+
+    // Resumes the coroutine after `ms` milliseconds; meant for the odd
+    // back-off, not for per-connection timers (the sleepers are scanned)
+    auto sleep(int ms) {
+        struct Sleep {
+            CoroLoop& loop;
+            std::chrono::steady_clock::time_point due;
+            bool await_ready() { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { loop.sleepers.push_back({due, handle}); }
+            void await_resume() {}
+        };
+        return Sleep{*this, std::chrono::steady_clock::now() + std::chrono::milliseconds(ms)};
+    }
+
+    /**
+     * Function: post
+     * Purpose: Resumes a coroutine on the loop (callable from any thread)
+     */
+    void post(std::coroutine_handle<> handle) {
+        if (current == this) {
+            ready.push_back(handle);
+            return;
+        }
+        bool first;
+        {
+            std::lock_guard<std::mutex> lock(postedMutex);
+            first = posted.empty();
+            posted.push_back(handle);
+        }
+        if (first) {
+            uint64_t one = 1;
+            ssize_t ignored = write(wakeFd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+    /**
+     * Function: runOnce
+     * Purpose: Waits up to timeoutMs for events (or the next sleeper),
+     *          then resumes everything that became ready
+     */
+    void runOnce(int timeoutMs) {
+        current = this;
+        const int MAX_EVENTS = 256;
+        epoll_event events[MAX_EVENTS];
+        auto now = std::chrono::steady_clock::now();
+        for (const Sleeper& sleeper : sleepers) {
+            long long wait = std::max<long long>(0, std::chrono::ceil<std::chrono::milliseconds>(sleeper.due - now).count());
+            if (timeoutMs < 0 || wait < timeoutMs) timeoutMs = (int)wait;
+        }
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, ready.empty() ? timeoutMs : 0);
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd) {
+                uint64_t value;
+                ssize_t ignored = read(wakeFd, &value, sizeof(value));
+                (void)ignored;
+                std::lock_guard<std::mutex> lock(postedMutex);
+                ready.insert(ready.end(), posted.begin(), posted.end());
+                posted.clear();
+                continue;
+            }
+            CoroSocket* socket = (size_t)fd < sockets.size() ? sockets[fd] : nullptr;
+            if (socket == nullptr) continue;
+            uint32_t flags = events[i].events;
+            // Either side may end the connection: a hang-up or error wakes both
+            if ((flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && socket->reader) {
+                ready.push_back(socket->reader);
+                socket->reader = nullptr;
+            }
+            if ((flags & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && socket->writer) {
+                ready.push_back(socket->writer);
+                socket->writer = nullptr;
+            }
+        }
+        now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < sleepers.size();) {
+            if (sleepers[i].due > now) {
+                i++;
+                continue;
+            }
+            ready.push_back(sleepers[i].handle);
+            sleepers[i] = sleepers.back();
+            sleepers.pop_back();
+        }
+        // Coroutines made ready by these run in the next round, after a poll
+        running.swap(ready);
+        for (std::coroutine_handle<> handle : running) handle.resume();
+        running.clear();
+    }
+
+private:
+    static inline thread_local CoroLoop* current = nullptr;
+
+    struct Sleeper {
+        std::chrono::steady_clock::time_point due;
+        std::coroutine_handle<> handle;
+    };
+
+    int epollFd = -1;
+    int wakeFd = -1;
+    std::vector<CoroSocket*> sockets;               // By descriptor
+    std::vector<Sleeper> sleepers;                  // Waiting in sleep()
+    std::vector<std::coroutine_handle<>> ready;     // To resume in this iteration
+    std::vector<std::coroutine_handle<>> running;   // Being resumed
+    std::mutex postedMutex;                         // Guards posted
+    std::vector<std::coroutine_handle<>> posted;    // From other threads
+};
+
+/**
+ * Class: CoroEvent
+ * Purpose: Auto-reset event one coroutine waits for and any thread sets
+ *
+ * set() before the wait makes the next wait return at once; several set()
+ * calls before a wait count as one.
+ */
+class CoroEvent {
+public:
+    CoroEvent() = default;
+    explicit CoroEvent(CoroLoop& loop) : loop(&loop) {}
+
+    // The loop that resumes the waiter (set before the first wait)
+    void attach(CoroLoop& owner) { loop = &owner; }
+    bool attached() const { return loop != nullptr; }
+
+    void set() {
+        uintptr_t state = this->state.load(std::memory_order_acquire);
+        while (state != SET) {
+            uintptr_t next = (state == IDLE) ? SET : IDLE;  // A waiter takes the signal itself
+            if (this->state.compare_exchange_weak(state, next, std::memory_order_acq_rel)) {
+                if (state != IDLE) loop->post(std::coroutine_handle<>::from_address((void*)state));
+                return;
+            }
+        }
+    }
+
+    struct Awaiter {
+        CoroEvent& event;
+        bool await_ready() {
+            uintptr_t expected = SET;
+            return event.state.compare_exchange_strong(expected, IDLE, std::memory_order_acq_rel);
+        }
+        bool await_suspend(std::coroutine_handle<> handle) {
+            uintptr_t expected = IDLE;
+            if (event.state.compare_exchange_strong(expected, (uintptr_t)handle.address(),
+                                                    std::memory_order_acq_rel)) {
+                return true;
+            }
+            event.state.store(IDLE, std::memory_order_release);  // Set meanwhile: consume it
+            return false;
+        }
+        void await_resume() {}
+    };
+    Awaiter operator co_await() { return Awaiter{*this}; }
+
+private:
+    static const uintptr_t IDLE = 0;
+    static const uintptr_t SET = 1;
+
+    CoroLoop* loop = nullptr;
+    std::atomic<uintptr_t> state{IDLE};     // IDLE, SET or the waiting coroutine
+};
+
+#endif
+#endif
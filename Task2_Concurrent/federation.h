@@ -0,0 +1,351 @@
+/**
+ * federation.h - Relaying room messages between chat server processes
+ *
+ * Several servers started with --peer-port and --peers form a cluster:
+ * every message a node's own clients (or its console) send to a room is
+ * relayed to every peer, and each peer delivers it to its local members of
+ * that room, so clients on any node share the same rooms. Capacity grows
+ * with the number of nodes, since a node only holds its own clients.
+ *
+ * Links are one-way. A node dials every peer on its --peers list and only
+ * sends on those links; what it receives comes in on the links its peers
+ * dialled. A node relays only messages that originated on it and never
+ * forwards what it received, so with every node listing every other node
+ * (a full mesh) each message crosses each link exactly once and cannot
+ * loop.
+ *
+ * Relay frame (inside an ordinary length-prefixed frame, big-endian):
+ *   uint32 origin        Node ID of the server the message came from
+ *   uint64 incarnation   When that server started (ns), so a restart is seen
+ *   uint64 sequence      Numbers the origin's relayed messages 1, 2, 3, ...
+ *   uint8  flags         RELAY_CHAT: a chat message (kept in the history)
+ *   uint8  roomLength    0 for console messages (they went to every room)
+ *   uint16 typedLength   0 if the origin sent no typed encoding
+ *   char   room[roomLength]
+ *   char   typed[typedLength]  The payload binary clients get (binary_protocol.h)
+ *   char   text[]        The message payload as the origin's clients saw it
+ * A link opens with the text frame "/peer <node-id>".
+ *
+ * A PeerLink owns the dialled connection and its own thread. Relaying a
+ * message only appends the encoded frame to the link's buffer under a
+ * mutex; the thread takes everything queued at once and writes it in one
+ * send, so a busy link carries many messages per system call. After a
+ * failure the link reconnects with backoff and sends the unconfirmed
+ * batch again. The OriginFilter on the receiving side drops what it has
+ * already delivered (and anything carrying its own node ID), so a resend,
+ * a peer listed twice or a misconfigured loop never delivers a message
+ * twice.
+ *
+ * Include after the platform socket headers (SOCKET must be defined).
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef FEDERATION_H
+#define FEDERATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "../common/framing.h"
+#include "message_pool.h"
+#include "server_stats.h"
+#include "async_log.h"
+
+const char* const PEER_HELLO = "/peer ";         // First frame on a link, then the node ID
+const size_t PEER_QUEUE_LIMIT = 8 << 20;         // Unsent bytes kept per link while it is down
+const int PEER_RECONNECT_MIN_MS = 100;
+const int PEER_RECONNECT_MAX_MS = 5000;
+const size_t RELAY_HEADER_SIZE = 4 + 8 + 8 + 1 + 1 + 2;
+const uint8_t RELAY_CHAT = 1;                    // Flag: chat message, not a notice
+
+/**
+ * Struct: RelayMessage
+ * Purpose: A decoded relay frame; room, typed and text point into the frame
+ */
+struct RelayMessage {
+    uint32_t origin = 0;
+    uint64_t incarnation = 0;
+    uint64_t sequence = 0;
+    uint8_t flags = 0;
+    std::string_view room;
+    std::string_view typed;
+    std::string_view text;
+};
+
+/**
+ * Function: appendRelay
+ * Purpose: Encodes one relay frame (with its length prefix) onto `out`
+ */
+inline void appendRelay(std::string& out, const RelayMessage& message) {
+    unsigned char header[RELAY_HEADER_SIZE];
+    for (int i = 0; i < 4; i++) header[i] = (unsigned char)(message.origin >> (24 - 8 * i));
+    for (int i = 0; i < 8; i++) header[4 + i] = (unsigned char)(message.incarnation >> (56 - 8 * i));
+    for (int i = 0; i < 8; i++) header[12 + i] = (unsigned char)(message.sequence >> (56 - 8 * i));
+    header[20] = message.flags;
+    header[21] = (unsigned char)message.room.size();
+    header[22] = (unsigned char)(message.typed.size() >> 8);
+    header[23] = (unsigned char)message.typed.size();
+
+    size_t length = RELAY_HEADER_SIZE + message.room.size() + message.typed.size() + message.text.size();
+    size_t start = out.size();
+    out.resize(start + FRAME_HEADER_SIZE + length);
+    char* p = &out[start];
+    writeFrameHeader(p, (uint32_t)length);
+    p += FRAME_HEADER_SIZE;
+    memcpy(p, header, RELAY_HEADER_SIZE);
+    p += RELAY_HEADER_SIZE;
+    memcpy(p, message.room.data(), message.room.size());
+    p += message.room.size();
+    memcpy(p, message.typed.data(), message.typed.size());
+    memcpy(p + message.typed.size(), message.text.data(), message.text.size());
+}
+
+/**
+ * Function: parseRelay
+ * Purpose: Decodes the payload of a relay frame
+ * Returns: false if it is too short for what its header announces
+ */
+inline bool parseRelay(std::string_view payload, RelayMessage& message) {
+    if (payload.size() < RELAY_HEADER_SIZE) return false;
+    const unsigned char* p = (const unsigned char*)payload.data();
+    message.origin = 0;
+    message.incarnation = 0;
+    message.sequence = 0;
+    for (int i = 0; i < 4; i++) message.origin = (message.origin << 8) | p[i];
+    for (int i = 0; i < 8; i++) message.incarnation = (message.incarnation << 8) | p[4 + i];
+    for (int i = 0; i < 8; i++) message.sequence = (message.sequence << 8) | p[12 + i];
+    message.flags = p[20];
+    size_t roomLength = p[21];
+    size_t typedLength = ((size_t)p[22] << 8) | p[23];
+    if (payload.size() < RELAY_HEADER_SIZE + roomLength + typedLength) return false;
+    message.room = payload.substr(RELAY_HEADER_SIZE, roomLength);
+    message.typed = payload.substr(RELAY_HEADER_SIZE + roomLength, typedLength);
+    message.text = payload.substr(RELAY_HEADER_SIZE + roomLength + typedLength);
+    return true;
+}
+
+/**
+ * Class: OriginFilter
+ * Purpose: Lets each relayed message through once, by origin and sequence
+ *
+ * Shared by all of a node's inbound links, so a message that arrives over
+ * two links (a peer listed twice) is still delivered once. Thread-safe.
+ */
+class OriginFilter {
+public:
+    explicit OriginFilter(uint32_t self) : self(self) {}
+
+    /**
+     * Function: accept
+     * Purpose: Decides whether a relayed message is new
+     * Returns: false for our own messages, for ones already accepted and
+     *          for ones from an earlier run of the origin
+     */
+    bool accept(const RelayMessage& message) {
+        if (message.origin == self) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        Seen& seen = origins[message.origin];
+        if (message.incarnation < seen.incarnation) return false;
+        if (message.incarnation > seen.incarnation) {
+            seen.incarnation = message.incarnation;  // The origin restarted
+            seen.sequence = 0;
+        }
+        if (message.sequence <= seen.sequence) return false;
+        seen.sequence = message.sequence;
+        return true;
+    }
+
+private:
+    struct Seen {
+        uint64_t incarnation = 0;
+        uint64_t sequence = 0;      // Highest accepted
+    };
+
+    uint32_t self;
+    std::mutex mutex;
+    std::unordered_map<uint32_t, Seen> origins;
+};
+
+/**
+ * Class: PeerLink
+ * Purpose: The dialled, batched, reconnecting link to one peer
+ */
+class PeerLink {
+public:
+    PeerLink(const std::string& host, int port, uint32_t self)
+        : host(host), port(port), self(self) {}
+
+    ~PeerLink() { stop(); }
+
+    void start() {
+        worker = std::thread([this] { run(); });
+    }
+
+    // Ends the thread; what is still queued is discarded
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) return;
+            stopping = true;
+            if (sock != INVALID_SOCKET) shutdown(sock, SHUT_RDWR);  // Unblocks a send
+        }
+        ready.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+    /**
+     * Function: enqueue
+     * Purpose: Queues encoded relay frames for the link's thread
+     * Returns: false if they were dropped because PEER_QUEUE_LIMIT bytes
+     *          are already waiting (the peer is down or too slow)
+     */
+    bool enqueue(std::string_view frames) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pending.size() + frames.size() > PEER_QUEUE_LIMIT) return false;
+            bool wasEmpty = pending.empty();
+            pending.append(frames.data(), frames.size());
+            if (!wasEmpty) return true;  // The thread has been told already
+        }
+        ready.notify_one();
+        return true;
+    }
+
+    std::string name() const { return host + ":" + std::to_string(port); }
+
+private:
+    SOCKET dial();
+    bool sendAll(SOCKET target, const std::string& data);
+    void run();
+
+    std::string host;
+    int port;
+    uint32_t self;
+
+    std::mutex mutex;               // Guards pending, stopping and sock
+    std::condition_variable ready;
+    std::string pending;            // Encoded frames not yet taken by the thread
+    bool stopping = false;
+    SOCKET sock = INVALID_SOCKET;
+    std::thread worker;
+};
+
+/**
+ * Function: PeerLink::dial
+ * Purpose: Connects to the peer and introduces this node
+ * Returns: The connected socket, or INVALID_SOCKET
+ */
+inline SOCKET PeerLink::dial() {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) return INVALID_SOCKET;
+
+    SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s == INVALID_SOCKET) return INVALID_SOCKET;
+    int on = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char*)&on, sizeof(on));  // Batching is done here
+    std::string hello = makeFrame(std::string(PEER_HELLO) + std::to_string(self));
+    if (connect(s, (sockaddr*)&address, sizeof(address)) != 0 || !sendAll(s, hello)) {
+        closesocket(s);
+        return INVALID_SOCKET;
+    }
+    return s;
+}
+
+/**
+ * Function: PeerLink::sendAll
+ * Purpose: Blocking send of a whole batch
+ * Returns: false if the connection failed part-way
+ */
+inline bool PeerLink::sendAll(SOCKET target, const std::string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        int sent = send(target, data.data() + offset, (int)(data.size() - offset), MSG_NOSIGNAL);
+        if (sent <= 0) {
+#ifndef _WIN32
+            if (sent < 0 && errno == EINTR) continue;
+#endif
+            return false;
+        }
+        threadStats().add(StatWrites);
+        offset += sent;
+    }
+    return true;
+}
+
+/**
+ * Function: PeerLink::run
+ * Purpose: The link's thread - connects, then writes everything queued in
+ *          one batch per wake-up, reconnecting with doubling backoff
+ *
+ * A batch whose send failed is put back in front of the queue: the peer
+ * may have received part of it, which its OriginFilter will drop.
+ */
+inline void PeerLink::run() {
+    int backoffMs = PEER_RECONNECT_MIN_MS;
+    bool everLinked = false;
+    std::string batch;
+
+    while (true) {
+        SOCKET s = dial();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (stopping) {
+                if (s != INVALID_SOCKET) closesocket(s);
+                return;
+            }
+            sock = s;
+            if (s == INVALID_SOCKET) {
+                ready.wait_for(lock, std::chrono::milliseconds(backoffMs), [this] { return stopping; });
+                backoffMs = std::min(backoffMs * 2, PEER_RECONNECT_MAX_MS);
+                continue;
+            }
+        }
+        logLine(LogLevel::Info, {"[Server] Linked to peer ", name(), everLinked ? " again." : "."});
+        everLinked = true;
+        backoffMs = PEER_RECONNECT_MIN_MS;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this, &batch] { return stopping || !batch.empty() || !pending.empty(); });
+                if (stopping) break;
+                if (batch.empty()) {
+                    batch.swap(pending);
+                } else {
+                    batch += pending;  // A batch being resent, then what came since
+                    pending.clear();
+                }
+            }
+            if (!sendAll(s, batch)) break;
+            threadStats().add(StatRelayBatches);
+            batch.clear();
+        }
+
+        bool stopped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sock = INVALID_SOCKET;
+            stopped = stopping;
+        }
+        closesocket(s);
+        if (stopped) return;
+        if (batch.size() > PEER_QUEUE_LIMIT) batch.clear();
+        logLine(LogLevel::Warning, {"[Server] Lost the link to peer ", name(), "; reconnecting."});
+    }
+}
+
+#endif
@@ -0,0 +1,415 @@
+/**
+ * hot_restart.h - Handing a running server's connections to its successor
+ *
+ * With --restart-socket PATH the epoll server listens on a Unix socket at
+ * PATH for its own replacement. A new server started with the same flag
+ * finds the socket, connects and takes over: the old process passes it the
+ * listening socket(s) and every client socket (SCM_RIGHTS), together with
+ * each client's ID, room, whether it asked for typed messages, the bytes
+ * of a frame it had only partly received and the messages still queued
+ * for it. The connections themselves never close, so a deploy costs no
+ * reconnects and no join/leave notices; new connections wait in the
+ * listener's backlog while the two processes change over.
+ *
+ * The transfer runs over a SOCK_SEQPACKET socket, so every record is one
+ * packet and the descriptor attached to it arrives with it:
+ *
+ *   old -> new  'H' version
+ *               'L' + descriptor                        one per listener
+ *               'C' + descriptor  id, ip, room, flags,   one per client
+ *                   lengths, then the first bytes of its data
+ *               'D' the rest of its data, in chunks    (large queues only)
+ *               'E' next client ID, client count
+ *   new -> old  'A' every descriptor has arrived
+ *   old -> new  'R' the old process has let go of its other ports and
+ *                   files (stats, UDP, peer, Unix socket, history), so
+ *                   the new one can open them
+ *
+ * A client's data is its partial inbound frame followed by its queued
+ * outbound frames, whole; the count of bytes of the first frame that were
+ * already written tells the new process where to resume. Until 'A' the old
+ * server can still resume as if nothing had happened.
+ *
+ * Linux only (SCM_RIGHTS on SOCK_SEQPACKET).
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef HOT_RESTART_H
+#define HOT_RESTART_H
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+const uint32_t HANDOFF_VERSION = 2;
+const size_t HANDOFF_RECORD_BYTES = 64 * 1024;   // Largest packet (client data is split)
+const uint32_t HANDOFF_BINARY = 1;               // Client flag: sent BINARY_COMMAND
+
+const char HANDOFF_HELLO = 'H';
+const char HANDOFF_LISTENER = 'L';
+const char HANDOFF_CLIENT = 'C';
+const char HANDOFF_DATA = 'D';
+const char HANDOFF_END = 'E';
+const char HANDOFF_ACK = 'A';
+const char HANDOFF_RELEASED = 'R';
+
+/**
+ * Struct: HandedClient
+ * Purpose: One client connection as it passes between the processes
+ */
+struct HandedClient {
+    int sock = -1;
+    uint32_t id = 0;
+    std::string ip;
+    std::string room;
+    bool binary = false;            // Sent BINARY_COMMAND (see binary_protocol.h)
+    std::string inbound;            // Received bytes of a frame not yet complete
+    std::string outbound;           // Queued frames, whole, oldest first
+    uint32_t outboundSent = 0;      // Bytes of the first queued frame already written
+};
+
+/**
+ * Struct: HandoffState
+ * Purpose: Everything the new process takes over
+ */
+struct HandoffState {
+    std::vector<int> listeners;     // Shard listeners, first shard first
+    uint32_t nextClientId = 1;
+    std::vector<HandedClient> clients;
+};
+
+/**
+ * Class: RecordWriter
+ * Purpose: Builds one record - a type byte, then big-endian fields
+ */
+class RecordWriter {
+public:
+    explicit RecordWriter(char type) { bytes.push_back(type); }
+
+    void put32(uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) bytes.push_back((char)(value >> shift));
+    }
+
+    // A length-prefixed string
+    void putText(std::string_view text) {
+        put32((uint32_t)text.size());
+        bytes.append(text.data(), text.size());
+    }
+
+    void putBytes(std::string_view data) { bytes.append(data.data(), data.size()); }
+
+    const std::string& record() const { return bytes; }
+    size_t room() const { return HANDOFF_RECORD_BYTES - std::min(bytes.size(), HANDOFF_RECORD_BYTES); }
+
+private:
+    std::string bytes;
+};
+
+/**
+ * Class: RecordReader
+ * Purpose: Reads the fields of a received record; a read past the end
+ *          clears ok() instead of failing on the spot
+ */
+class RecordReader {
+public:
+    explicit RecordReader(std::string_view record) : rest(record.substr(record.empty() ? 0 : 1)) {}
+
+    uint32_t get32() {
+        if (rest.size() < 4) return fail();
+        const unsigned char* p = (const unsigned char*)rest.data();
+        uint32_t value = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        rest.remove_prefix(4);
+        return value;
+    }
+
+    std::string getText() {
+        uint32_t length = get32();
+        if (rest.size() < length) {
+            fail();
+            return std::string();
+        }
+        std::string text(rest.substr(0, length));
+        rest.remove_prefix(length);
+        return text;
+    }
+
+    std::string_view remaining() const { return rest; }
+    bool ok() const { return valid; }
+
+private:
+    uint32_t fail() {
+        valid = false;
+        rest = std::string_view();
+        return 0;
+    }
+
+    std::string_view rest;
+    bool valid = true;
+};
+
+/**
+ * Function: sendRecord
+ * Purpose: Sends one record as one packet, with a descriptor attached if
+ *          `fd` is not -1
+ * Returns: false unless the whole record was sent
+ */
+inline bool sendRecord(int sock, const std::string& record, int fd = -1) {
+    iovec iov{(void*)record.data(), record.size()};
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd >= 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    ssize_t sent;
+    do {
+        sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return sent == (ssize_t)record.size();
+}
+
+/**
+ * Function: receiveRecord
+ * Purpose: Receives one record and the descriptor that came with it
+ * Parameters:
+ *   - record: Receives the packet
+ *   - fd: Receives the descriptor, or -1 if none was attached
+ * Returns: false on error, end of stream or an empty packet
+ */
+inline bool receiveRecord(int sock, std::string& record, int& fd) {
+    record.resize(HANDOFF_RECORD_BYTES);
+    char control[CMSG_SPACE(sizeof(int) * 4)];
+    iovec iov{&record[0], record.size()};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t received;
+    do {
+        received = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+
+    fd = -1;
+    if (received > 0) {
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+            int n = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            const int* passed = (const int*)CMSG_DATA(cmsg);
+            for (int i = 0; i < n; i++) {
+                if (fd < 0) fd = passed[i];
+                else close(passed[i]);  // One per record; more is a protocol error
+            }
+        }
+    }
+    if (received <= 0 || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        if (fd >= 0) close(fd);
+        fd = -1;
+        return false;
+    }
+    record.resize((size_t)received);
+    return true;
+}
+
+/**
+ * Function: sendHandoff
+ * Purpose: Passes the listeners and clients to the new process (old side)
+ * Returns: false if the new process went away; the descriptors sent so
+ *          far are its problem, ours are all still open
+ */
+inline bool sendHandoff(int sock, const HandoffState& state) {
+    RecordWriter hello(HANDOFF_HELLO);
+    hello.put32(HANDOFF_VERSION);
+    if (!sendRecord(sock, hello.record())) return false;
+
+    for (int listener : state.listeners) {
+        if (!sendRecord(sock, RecordWriter(HANDOFF_LISTENER).record(), listener)) return false;
+    }
+
+    for (const HandedClient& client : state.clients) {
+        RecordWriter record(HANDOFF_CLIENT);
+        record.put32(client.id);
+        record.putText(client.ip);
+        record.putText(client.room);
+        record.put32(client.binary ? HANDOFF_BINARY : 0);
+        record.put32((uint32_t)client.inbound.size());
+        record.put32((uint32_t)client.outbound.size());
+        record.put32(client.outboundSent);
+
+        // Inbound then outbound bytes, starting in the client record itself
+        std::string_view parts[2] = {client.inbound, client.outbound};
+        int part = 0;
+        size_t room = record.room();
+        while (part < 2 && room > 0) {
+            size_t take = std::min(room, parts[part].size());
+            record.putBytes(parts[part].substr(0, take));
+            parts[part].remove_prefix(take);
+            room -= take;
+            if (parts[part].empty()) part++;
+        }
+        if (!sendRecord(sock, record.record(), client.sock)) return false;
+
+        for (; part < 2; part++) {
+            while (!parts[part].empty()) {
+                RecordWriter chunk(HANDOFF_DATA);
+                size_t take = std::min(chunk.room(), parts[part].size());
+                chunk.putBytes(parts[part].substr(0, take));
+                parts[part].remove_prefix(take);
+                if (!sendRecord(sock, chunk.record())) return false;
+            }
+        }
+    }
+
+    RecordWriter end(HANDOFF_END);
+    end.put32(state.nextClientId);
+    end.put32((uint32_t)state.clients.size());
+    return sendRecord(sock, end.record());
+}
+
+/**
+ * Function: receiveHandoff
+ * Purpose: Takes over the listeners and clients (new side), up to and
+ *          including the 'E' record
+ * Returns: false on a broken or malformed transfer; every descriptor
+ *          received is closed again and `state` is left empty
+ */
+inline bool receiveHandoff(int sock, HandoffState& state) {
+    std::string record;
+    int fd;
+    bool ok = receiveRecord(sock, record, fd) && record[0] == HANDOFF_HELLO &&
+              RecordReader(record).get32() == HANDOFF_VERSION;
+    if (fd >= 0) close(fd);
+
+    HandedClient* filling = nullptr;  // Client whose data is still arriving
+    size_t inboundLeft = 0;
+    size_t outboundLeft = 0;
+    auto fill = [&](std::string_view data) {
+        size_t take = std::min(inboundLeft, data.size());
+        filling->inbound.append(data.data(), take);
+        inboundLeft -= take;
+        data.remove_prefix(take);
+        take = std::min(outboundLeft, data.size());
+        filling->outbound.append(data.data(), take);
+        outboundLeft -= take;
+        return take == data.size();
+    };
+
+    bool ended = false;
+    while (ok && !ended && receiveRecord(sock, record, fd)) {
+        RecordReader reader(record);
+        bool dataDue = inboundLeft > 0 || outboundLeft > 0;
+        if (record[0] == HANDOFF_LISTENER && fd >= 0 && !dataDue) {
+            state.listeners.push_back(fd);
+        } else if (record[0] == HANDOFF_CLIENT && fd >= 0 && !dataDue) {
+            state.clients.emplace_back();
+            filling = &state.clients.back();
+            filling->sock = fd;
+            filling->id = reader.get32();
+            filling->ip = reader.getText();
+            filling->room = reader.getText();
+            filling->binary = (reader.get32() & HANDOFF_BINARY) != 0;
+            inboundLeft = reader.get32();
+            outboundLeft = reader.get32();
+            filling->outboundSent = reader.get32();
+            ok = reader.ok() && fill(reader.remaining());
+        } else if (record[0] == HANDOFF_DATA && fd < 0 && dataDue) {
+            ok = fill(reader.remaining());
+        } else if (record[0] == HANDOFF_END && fd < 0 && !dataDue) {
+            state.nextClientId = reader.get32();
+            ok = reader.ok() && reader.get32() == state.clients.size();
+            ended = true;
+        } else {
+            if (fd >= 0) close(fd);
+            ok = false;
+        }
+    }
+
+    if (ok && ended) return true;
+    for (int listener : state.listeners) close(listener);
+    for (HandedClient& client : state.clients) close(client.sock);
+    state = HandoffState();
+    return false;
+}
+
+/**
+ * Function: expectRecord
+ * Purpose: Waits for a one-byte control record ('A' or 'R')
+ * Returns: true if that record arrived
+ */
+inline bool expectRecord(int sock, char type) {
+    std::string record;
+    int fd;
+    bool ok = receiveRecord(sock, record, fd) && record[0] == type;
+    if (fd >= 0) close(fd);
+    return ok;
+}
+
+/**
+ * Function: openHandoffListener
+ * Purpose: Binds the restart socket, readable by this user only (whoever
+ *          connects is given every client)
+ * Returns: The listening socket, or -1 on failure
+ *
+ * A socket file left behind at the path is replaced; any other file is not.
+ */
+inline int openHandoffListener(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) return -1;
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) return -1;
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(path.c_str());
+    }
+    mode_t previous = umask(0077);
+    bool bound = bind(sock, (sockaddr*)&address, sizeof(address)) == 0;
+    umask(previous);
+    if (!bound || listen(sock, 1) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/**
+ * Function: connectHandoff
+ * Purpose: Connects to the restart socket of a running server
+ * Returns: The connected socket, or -1 if no server is listening there
+ */
+inline int connectHandoff(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) return -1;
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) return -1;
+    if (connect(sock, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+#endif
@@ -0,0 +1,377 @@
+/**
+ * io_uring.h - Minimal io_uring wrapper for the concurrent server (Linux only)
+ *
+ * Talks to the kernel through the raw io_uring_setup / io_uring_enter /
+ * io_uring_register system calls and the uapi header, so the server keeps
+ * building with a plain "g++ ... -pthread" and needs no liburing.
+ *
+ * IoUring maps the submission and completion rings and hands out SQEs;
+ * nothing reaches the kernel until submit(), so any number of operations
+ * (e.g. one send per broadcast recipient) go out in a single system call.
+ * ProvidedBuffers lends the kernel a pool of receive buffers it picks from
+ * itself, which lets multishot recv run without a buffer reserved per idle
+ * connection.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+/**
+ * Function: kernelAtLeast
+ * Purpose: Checks the running kernel version (multishot recv and provided
+ *          buffer rings need 6.0; older kernels reject them in odd ways)
+ */
+inline bool kernelAtLeast(int major, int minor) {
+    utsname info;
+    int kernelMajor = 0, kernelMinor = 0;
+    if (uname(&info) != 0 || sscanf(info.release, "%d.%d", &kernelMajor, &kernelMinor) != 2) {
+        return false;
+    }
+    return kernelMajor > major || (kernelMajor == major && kernelMinor >= minor);
+}
+
+/**
+ * Class: IoUring
+ * Purpose: One submission/completion ring pair, owned by a single thread
+ */
+class IoUring {
+public:
+    IoUring() = default;
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring() {
+        if (sqes) munmap(sqes, sqesSize);
+        if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing) munmap(sqRing, sqRingSize);
+        if (ringFd >= 0) close(ringFd);
+    }
+
+    /**
+     * Function: init
+     * Purpose: Creates the ring and maps its shared memory
+     * Parameters: entries - Submission queue size (rounded up by the kernel)
+     * Returns: 0 on success, otherwise a negative errno
+     */
+    int init(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (ringFd < 0) return -errno;
+        features = params.features;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap && cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+
+        sqRing = mapRing(sqRingSize, IORING_OFF_SQ_RING);
+        if (!sqRing) return -errno;
+        cqRing = singleMmap ? sqRing : mapRing(cqRingSize, IORING_OFF_CQ_RING);
+        if (!cqRing) return -errno;
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mapRing(sqesSize, IORING_OFF_SQES));
+        if (!sqes) return -errno;
+
+        char* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        // SQEs are always used in ring order, so the indirection array is
+        // filled once with the identity mapping
+        unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sqEntries; i++) array[i] = i;
+
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        sqeTail = *sqTail;
+        return 0;
+    }
+
+    /**
+     * Function: getSqe
+     * Purpose: Reserves the next submission entry (zeroed)
+     * Returns: nullptr when the submission queue is full - call submit()
+     */
+    io_uring_sqe* getSqe() {
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (sqeTail - head >= sqEntries) return nullptr;
+        io_uring_sqe* sqe = &sqes[sqeTail & sqMask];
+        sqeTail++;
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    /**
+     * Function: submit
+     * Purpose: Passes every reserved SQE to the kernel in one io_uring_enter
+     *          and optionally waits for completions
+     * Parameters:
+     *   - waitNr: Completions to wait for (0 = do not block)
+     *   - timeoutNs: Upper bound on the wait in nanoseconds, or -1 for none
+     *                (ignored on kernels without IORING_FEAT_EXT_ARG)
+     * Returns: Number of SQEs consumed, or a negative errno (-ETIME and
+     *          -EINTR only mean the wait ended early)
+     */
+    int submit(unsigned waitNr = 0, long long timeoutNs = -1) {
+        __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+        unsigned toSubmit = sqeTail - submitted;
+        unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+        __kernel_timespec ts;
+        io_uring_getevents_arg arg;
+        void* argp = nullptr;
+        size_t argSize = 0;
+        if (waitNr > 0 && timeoutNs >= 0 && (features & IORING_FEAT_EXT_ARG)) {
+            ts.tv_sec = timeoutNs / 1000000000;
+            ts.tv_nsec = timeoutNs % 1000000000;
+            memset(&arg, 0, sizeof(arg));
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            argp = &arg;
+            argSize = sizeof(arg);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+
+        int consumed = (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, waitNr, flags, argp, argSize);
+        if (consumed < 0) return -errno;
+        submitted += (unsigned)consumed;
+        return consumed;
+    }
+
+    /**
+     * Function: forEachCompletion
+     * Purpose: Calls handler(const io_uring_cqe&) for every completion that
+     *          has arrived, then releases them back to the kernel
+     * Returns: Number of completions handled
+     */
+    template <typename Handler>
+    unsigned forEachCompletion(Handler handler) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        unsigned handled = 0;
+        while (head != tail) {
+            handler(cqes[head & cqMask]);
+            head++;
+            handled++;
+            // Release each entry at once: the handler may submit and wait
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+        return handled;
+    }
+
+    int fd() const { return ringFd; }
+    bool hasExtArg() const { return (features & IORING_FEAT_EXT_ARG) != 0; }
+
+private:
+    void* mapRing(size_t size, off_t offset) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    int ringFd = -1;
+    unsigned features = 0;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqRingSize = 0, cqRingSize = 0, sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0, sqEntries = 0;
+    unsigned sqeTail = 0;        // Next SQE to hand out (published on submit)
+    unsigned submitted = 0;      // SQEs already consumed by the kernel
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+
+/**
+ * Class: ProvidedBuffers
+ * Purpose: Group of equally sized receive buffers lent to the kernel
+ *
+ * A recv armed with IOSQE_BUFFER_SELECT takes a buffer from the group only
+ * when data actually arrives; the completion names the buffer it used, and
+ * the caller hands it back with recycle() once the bytes are processed.
+ *
+ * The buffers are normally published through a shared buffer ring
+ * (IORING_REGISTER_PBUF_RING), where returning one is a plain memory store.
+ * init() first tries a one-byte pipe read through such a ring, because some
+ * kernels accept the registration yet never hand out its buffers; those
+ * fall back to IORING_OP_PROVIDE_BUFFERS, which costs one SQE per returned buffer but
+ * no extra system call (they ride along with the next submit).
+ */
+class ProvidedBuffers {
+public:
+    ProvidedBuffers() = default;
+    ProvidedBuffers(const ProvidedBuffers&) = delete;
+    ProvidedBuffers& operator=(const ProvidedBuffers&) = delete;
+
+    ~ProvidedBuffers() {
+        if (ring) munmap(ring, ringBytes);
+    }
+
+    /**
+     * Function: init
+     * Purpose: Allocates the buffers and hands them to the kernel
+     * Parameters:
+     *   - owner: Ring the buffers are registered with (must be idle)
+     *   - group: Buffer group id used in SQEs (buf_group)
+     *   - count: Number of buffers (power of two, at most 32768)
+     *   - size: Bytes per buffer
+     * Returns: 0 on success, otherwise a negative errno
+     */
+    int init(IoUring& owner, uint16_t group, unsigned count, unsigned size) {
+        uring = &owner;
+        groupId = group;
+        bufferSize = size;
+        mask = count - 1;
+        storage.reset(new char[(size_t)count * size]);
+
+        if (ringWorks()) return registerRing(count);
+
+        // Legacy provided buffers: one SQE lends the whole group
+        io_uring_sqe* sqe = uring->getSqe();
+        if (sqe == nullptr) return -EBUSY;
+        prepareProvide(sqe, 0, count);
+        sqe->flags = 0;                      // Wait for this one's result
+        int result = uring->submit(1);
+        if (result < 0) return result;
+        uring->forEachCompletion([&](const io_uring_cqe& cqe) { result = cqe.res; });
+        return result < 0 ? result : 0;
+    }
+
+    char* buffer(uint16_t id) { return storage.get() + (size_t)id * bufferSize; }
+
+    // Returns a buffer to the kernel (takes effect on the next publish)
+    void recycle(uint16_t id) {
+        if (ring) {
+            add(id);
+            return;
+        }
+        io_uring_sqe* sqe = uring->getSqe();
+        while (sqe == nullptr) {
+            uring->submit();
+            sqe = uring->getSqe();
+        }
+        prepareProvide(sqe, id, 1);
+    }
+
+    // Makes every recycled buffer visible to the kernel
+    void publish() {
+        if (pending == 0) return;
+        tail += pending;
+        pending = 0;
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    uint16_t group() const { return groupId; }
+    bool usesRing() const { return ring != nullptr; }
+
+private:
+    int registerRing(unsigned count) {
+        ringBytes = count * sizeof(io_uring_buf);
+        void* mem = mmap(nullptr, ringBytes, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (mem == MAP_FAILED) return -errno;
+        ring = static_cast<io_uring_buf_ring*>(mem);
+
+        io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (uint64_t)(uintptr_t)ring;
+        reg.ring_entries = count;
+        reg.bgid = groupId;
+        if (syscall(__NR_io_uring_register, uring->fd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            int error = -errno;
+            munmap(ring, ringBytes);
+            ring = nullptr;
+            return error;
+        }
+
+        for (unsigned id = 0; id < count; id++) add((uint16_t)id);
+        publish();
+        return 0;
+    }
+
+    // Reads one byte from a pipe through a buffer ring on a scratch io_uring
+    // instance, so a kernel that mishandles the ring cannot upset the real one
+    static bool ringWorks() {
+        IoUring scratch;
+        ProvidedBuffers buffers;
+        int fds[2];
+        if (scratch.init(4) != 0 || pipe(fds) != 0) return false;
+
+        buffers.uring = &scratch;
+        buffers.bufferSize = 64;
+        buffers.mask = 1;
+        buffers.storage.reset(new char[2 * 64]);
+        bool works = false;
+        if (buffers.registerRing(2) == 0 && write(fds[1], "x", 1) == 1) {
+            io_uring_sqe* sqe = scratch.getSqe();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fds[0];
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = buffers.groupId;
+            if (scratch.submit(1) >= 0) {
+                scratch.forEachCompletion([&](const io_uring_cqe& cqe) {
+                    works = cqe.res == 1 && (cqe.flags & IORING_CQE_F_BUFFER);
+                });
+            }
+        }
+        close(fds[0]);
+        close(fds[1]);
+        return works;
+    }
+
+    void prepareProvide(io_uring_sqe* sqe, uint16_t firstId, unsigned count) {
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = (int)count;
+        sqe->addr = (uint64_t)(uintptr_t)buffer(firstId);
+        sqe->len = bufferSize;
+        sqe->off = firstId;
+        sqe->buf_group = groupId;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    }
+
+    void add(uint16_t id) {
+        io_uring_buf* slot = &ring->bufs[(tail + pending) & mask];
+        slot->addr = (uint64_t)(uintptr_t)buffer(id);
+        slot->len = bufferSize;
+        slot->bid = id;
+        pending++;
+    }
+
+    IoUring* uring = nullptr;
+    io_uring_buf_ring* ring = nullptr;   // nullptr in legacy mode
+    size_t ringBytes = 0;
+    std::unique_ptr<char[]> storage;
+    uint16_t groupId = 0;
+    unsigned bufferSize = 0;
+    unsigned mask = 0;
+    uint16_t tail = 0;           // Last published tail
+    uint16_t pending = 0;        // Buffers added since the last publish
+};
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ * latency_histogram.h - Fixed-size log-linear latency histogram
+ *
+ * Values (nanoseconds) are counted in buckets whose width grows with the
+ * value: below 2^SUB_BUCKET_BITS every value has its own bucket, above that
+ * each power of two is split into 2^SUB_BUCKET_BITS equal buckets. That
+ * keeps the relative error under about 3% over the whole range of a 64-bit
+ * value in a few thousand counters, so recording is one array increment and
+ * percentiles (p50/p99/p999) can be read off without storing samples.
+ *
+ * Each thread records into its own histogram; they are combined with
+ * merge() when a report is produced. A histogram has a single writer, but
+ * the counters are relaxed atomics updated with a plain load and store (no
+ * locked read-modify-write), so another thread may read or merge it while
+ * it is being recorded into without taking a lock.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+const int SUB_BUCKET_BITS = 5;
+const uint64_t SUB_BUCKETS = (uint64_t)1 << SUB_BUCKET_BITS;
+const size_t HISTOGRAM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+/**
+ * Class: LatencyHistogram
+ * Purpose: Counts latency samples for percentile reporting
+ */
+class LatencyHistogram {
+public:
+    // Owning thread only
+    void record(uint64_t value) {
+        bump(counts[bucketOf(value)], 1);
+        bump(total, 1);
+        bump(sum, value);
+        if (value > max()) maxValue.store(value, std::memory_order_relaxed);
+    }
+
+    // Adds another histogram's samples (this one is owned by the caller)
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) bump(counts[i], read(other.counts[i]));
+        bump(total, other.count());
+        bump(sum, read(other.sum));
+        if (other.max() > max()) maxValue.store(other.max(), std::memory_order_relaxed);
+    }
+
+    /**
+     * Function: percentile
+     * Purpose: Smallest bucket bound that at least `fraction` of the samples
+     *          fall under (e.g. 0.99 for p99)
+     * Returns: Upper bound of that bucket, or 0 if nothing was recorded
+     */
+    uint64_t percentile(double fraction) const {
+        uint64_t samples = count();
+        if (samples == 0) return 0;
+        uint64_t rank = (uint64_t)(fraction * (double)samples);
+        if (rank >= samples) rank = samples - 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            seen += read(counts[i]);
+            if (seen > rank) {
+                uint64_t bound = upperBound(i);
+                return bound < max() ? bound : max();
+            }
+        }
+        return max();
+    }
+
+    uint64_t count() const { return read(total); }
+    uint64_t max() const { return read(maxValue); }
+    uint64_t mean() const { return count() ? read(sum) / count() : 0; }
+    uint64_t sumOfValues() const { return read(sum); }
+
+private:
+    static uint64_t read(const std::atomic<uint64_t>& counter) {
+        return counter.load(std::memory_order_relaxed);
+    }
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(read(counter) + amount, std::memory_order_relaxed);
+    }
+
+    static size_t bucketOf(uint64_t value) {
+        if (value < SUB_BUCKETS) return (size_t)value;
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - SUB_BUCKET_BITS;
+        return (size_t)(shift + 1) * SUB_BUCKETS + (size_t)((value >> shift) - SUB_BUCKETS);
+    }
+
+    // Largest value that falls into bucket `index`
+    static uint64_t upperBound(size_t index) {
+        if (index < SUB_BUCKETS) return index;
+        int shift = (int)(index / SUB_BUCKETS) - 1;
+        uint64_t mantissa = index % SUB_BUCKETS + SUB_BUCKETS;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::atomic<uint64_t> counts[HISTOGRAM_BUCKETS] = {};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> maxValue{0};
+};
+
+#endif
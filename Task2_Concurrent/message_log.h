@@ -0,0 +1,559 @@
+/**
+ * message_log.h - Append-only on-disk chat history with replay (Linux)
+ *
+ * Every chat message is appended to a log made of fixed-size segment files
+ * (HISTORY_SEGMENT_BYTES each, named after their first sequence number)
+ * that are memory-mapped, so appending is a memcpy into the mapping and
+ * replaying is a read straight out of it. Only the newest
+ * HISTORY_SEGMENTS_KEPT segments are kept; older ones are deleted.
+ *
+ * Record layout (native byte order, unaligned):
+ *   uint32 length        Whole record, header to trailer
+ *   uint32 checksum      FNV-1a of everything after this field up to the trailer
+ *   uint64 sequence      Assigned in timestamp order, continues across restarts
+ *   int64  timestamp     Wall-clock nanoseconds when the message was logged;
+ *                        never decreases from one record to the next
+ *   uint64 previous      Sequence of the room's previous record (HISTORY_NONE if first)
+ *   uint8  roomLength    0 for console messages (they went to every room)
+ *   char   room[roomLength]
+ *   char   frame[]       The message exactly as sent on the wire
+ *   uint32 length        Repeated, so a reader can tell a torn record
+ *
+ * Client threads never touch the files. append() hands the message (a
+ * MessageRef, no copy) to the calling thread's SpscRing - or to an overflow
+ * list if the ring is full - and one writer thread copies batches into the
+ * mapping, publishes how far each segment is complete, and msyncs the
+ * written range every sync interval instead of once per message. The
+ * writer empties the rings one after another, so it sorts each batch by
+ * timestamp before numbering it; a message that reaches it after a later
+ * one was already written (its thread was preempted in append) takes that
+ * one's timestamp. Replay relies on timestamps only falling along a chain.
+ *
+ * Each segment keeps a sparse in-memory index (one entry every
+ * HISTORY_INDEX_INTERVAL records) of sequence and offset. Replay follows a
+ * room's `previous` chain back from its newest record and finds each
+ * record through the index, so its cost depends on how much history is
+ * wanted, not on how busy the other rooms were. The index and chains are
+ * rebuilt from the records when an existing log is reopened; a torn record
+ * at the end (from a crash) fails its checksum and is overwritten.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef MESSAGE_LOG_H
+#define MESSAGE_LOG_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "message_pool.h"
+#include "spsc_ring.h"
+
+const size_t HISTORY_SEGMENT_BYTES = 64 << 20;
+const size_t HISTORY_SEGMENTS_KEPT = 8;
+const uint32_t HISTORY_INDEX_INTERVAL = 64;     // Records per sparse index entry
+const size_t HISTORY_RING_CAPACITY = 8192;      // Messages buffered per thread
+const int HISTORY_POLL_MS = 2;                  // Writer's idle wake-up interval
+const size_t HISTORY_HEADER_BYTES = 33;         // length .. roomLength
+const size_t HISTORY_TRAILER_BYTES = 4;
+const uint64_t HISTORY_NONE = ~(uint64_t)0;     // End of a room's chain
+
+/**
+ * Class: MessageLog
+ * Purpose: Segmented, memory-mapped message history
+ *
+ * The append rings are thread_local, so there is one MessageLog per process.
+ */
+class MessageLog {
+public:
+    ~MessageLog() { close(); }
+
+    // Timestamp as stored in records
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Function: open
+     * Purpose: Opens (or creates) the log in `dir` and starts the writer
+     * Parameters:
+     *   - dir: Directory holding the segment files
+     *   - syncMs: Longest appended data stays unsynced, in milliseconds
+     * Returns: false if the directory or a segment cannot be used
+     */
+    bool open(const std::string& dir, int syncMs) {
+        directory = dir;
+        syncInterval = std::chrono::milliseconds(syncMs);
+        mkdir(dir.c_str(), 0755);
+        if (!recover()) return false;
+        if (segments.empty() && !addSegment()) return false;
+
+        running.store(true, std::memory_order_release);
+        writer = std::thread(&MessageLog::writerLoop, this);
+        return true;
+    }
+
+    // Writes out everything appended so far, syncs it and stops the writer
+    void close() {
+        if (!writer.joinable()) return;
+        running.store(false, std::memory_order_release);
+        wake.notify_one();
+        writer.join();
+    }
+
+    bool isOpen() const { return running.load(std::memory_order_acquire); }
+
+    /**
+     * Function: append
+     * Purpose: Queues a message for the log (any thread; never blocks on I/O)
+     * Parameters:
+     *   - message: Framed message as broadcast
+     *   - room: Room it went to, or "" for every room
+     */
+    void append(const MessageRef& message, const std::string& room) {
+        Channel& channel = threadChannel();
+        Entry entry{message, room, now()};
+        if (channel.ring.push(entry)) return;
+        std::lock_guard<std::mutex> lock(overflowMutex);
+        overflow.push_back(std::move(entry));
+    }
+
+    /**
+     * Function: replay
+     * Purpose: Collects a room's most recent messages into one message block
+     * Parameters:
+     *   - room: Room whose history is wanted (console messages are included)
+     *   - maxMessages: At most this many messages
+     *   - maxAgeNs: Only messages younger than this (0 = no age limit)
+     *   - beforeNs: Only messages logged before this time (when the client
+     *               joined; later ones reached it live)
+     *   - maxBytes: Size limit of the result
+     *   - count: Receives the number of messages collected
+     * Returns: The messages' frames back to back, oldest first (empty if none)
+     */
+    MessageRef replay(const std::string& room, size_t maxMessages, int64_t maxAgeNs,
+                      int64_t beforeNs, size_t maxBytes, size_t& count) {
+        count = 0;
+        if (maxMessages == 0) return MessageRef();
+        int64_t cutoff = maxAgeNs > 0 ? now() - maxAgeNs : INT64_MIN;
+
+        std::vector<std::shared_ptr<Segment>> held;            // Keeps the mappings alive
+        std::vector<std::pair<const char*, size_t>> frames;    // Newest first
+        size_t total = 0;
+        {
+            std::lock_guard<std::mutex> lock(metaMutex);
+            held = segments;
+
+            // Walk the room's chain and the console chain, newest first
+            uint64_t next[2] = {headOf(room), headOf("")};
+            while (frames.size() < maxMessages) {
+                int pick = next[0] == HISTORY_NONE ? 1
+                         : next[1] == HISTORY_NONE ? 0
+                         : next[0] > next[1] ? 0 : 1;
+                const char* record = find(next[pick]);
+                if (record == nullptr) break;          // Chain reaches a deleted segment
+                next[pick] = load<uint64_t>(record + 24);
+
+                int64_t timestamp = load<int64_t>(record + 16);
+                if (timestamp < cutoff) break;
+                if (timestamp >= beforeNs) continue;
+                uint32_t length = load<uint32_t>(record);
+                uint8_t roomLength = (uint8_t)record[32];
+                size_t frameLength = length - HISTORY_HEADER_BYTES - roomLength - HISTORY_TRAILER_BYTES;
+                if (total + frameLength > maxBytes) break;
+                frames.push_back({record + HISTORY_HEADER_BYTES + roomLength, frameLength});
+                total += frameLength;
+            }
+        }
+        if (frames.empty()) return MessageRef();
+
+        // One block with every frame, in the order they were sent
+        MessageBlock* block = MessagePool::instance().allocate(total);
+        char* out = block->data();
+        for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+            memcpy(out, it->first, it->second);
+            out += it->second;
+        }
+        block->length = (uint32_t)total;
+        count = frames.size();
+        return MessageRef(block);
+    }
+
+private:
+    struct Entry {
+        MessageRef message;
+        std::string room;             // At most MAX_ROOM_NAME: stored inline
+        int64_t timestamp = 0;
+    };
+
+    struct IndexEntry {
+        uint64_t sequence;
+        size_t offset;
+    };
+
+    // One mapped segment file. Bytes below `committed` are complete records
+    // and never change again.
+    struct Segment {
+        std::string path;
+        uint64_t firstSequence = 0;
+        char* base = nullptr;
+        size_t capacity = 0;
+        std::atomic<size_t> committed{0};
+        std::vector<IndexEntry> index;    // Guarded by metaMutex
+        size_t synced = 0;                // Writer only
+        uint32_t records = 0;             // Writer only
+
+        ~Segment() {
+            if (base != nullptr) munmap(base, capacity);
+        }
+    };
+
+    struct Channel {
+        SpscRing<Entry> ring{HISTORY_RING_CAPACITY};
+        std::atomic<bool> closed{false};
+    };
+
+    // Owns the calling thread's channel and marks it closed on thread exit
+    struct Producer {
+        std::shared_ptr<Channel> channel;
+        ~Producer() {
+            if (channel) channel->closed.store(true, std::memory_order_release);
+        }
+    };
+
+    template <typename T>
+    static T load(const char* at) {
+        T value;
+        memcpy(&value, at, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    static void store(char* at, T value) {
+        memcpy(at, &value, sizeof(T));
+    }
+
+    static uint32_t checksum(const char* data, size_t length) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++) {
+            hash ^= (uint8_t)data[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    Channel& threadChannel() {
+        thread_local Producer producer;
+        if (!producer.channel) {
+            producer.channel = std::make_shared<Channel>();
+            std::lock_guard<std::mutex> lock(channelMutex);
+            channels.push_back(producer.channel);
+        }
+        return *producer.channel;
+    }
+
+    // Newest published record of a room (metaMutex held)
+    uint64_t headOf(const std::string& room) const {
+        auto it = heads.find(room);
+        return it == heads.end() ? HISTORY_NONE : it->second;
+    }
+
+    /**
+     * Function: find
+     * Purpose: Locates a published record by sequence number through the
+     *          sparse index (metaMutex held)
+     * Returns: The record, or nullptr if it is no longer kept
+     */
+    const char* find(uint64_t sequence) const {
+        if (sequence == HISTORY_NONE) return nullptr;
+        auto segmentIt = std::upper_bound(segments.begin(), segments.end(), sequence,
+            [](uint64_t s, const std::shared_ptr<Segment>& segment) { return s < segment->firstSequence; });
+        if (segmentIt == segments.begin()) return nullptr;
+        const Segment& segment = **(segmentIt - 1);
+
+        auto entryIt = std::upper_bound(segment.index.begin(), segment.index.end(), sequence,
+            [](uint64_t s, const IndexEntry& entry) { return s < entry.sequence; });
+        if (entryIt == segment.index.begin()) return nullptr;
+        size_t offset = (entryIt - 1)->offset;
+        size_t committed = segment.committed.load(std::memory_order_acquire);
+        while (offset < committed) {
+            const char* record = segment.base + offset;
+            uint64_t found = load<uint64_t>(record + 8);
+            if (found == sequence) return record;
+            if (found > sequence) break;
+            offset += load<uint32_t>(record);
+        }
+        return nullptr;
+    }
+
+    /**
+     * Function: mapSegment
+     * Purpose: Opens and maps one segment file, creating it at full size if
+     *          it does not exist
+     */
+    std::shared_ptr<Segment> mapSegment(const std::string& path, uint64_t firstSequence) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) return nullptr;
+        if (ftruncate(fd, (off_t)HISTORY_SEGMENT_BYTES) < 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        void* base = mmap(nullptr, HISTORY_SEGMENT_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);  // The mapping keeps the file open
+        if (base == MAP_FAILED) return nullptr;
+
+        auto segment = std::make_shared<Segment>();
+        segment->path = path;
+        segment->firstSequence = firstSequence;
+        segment->base = static_cast<char*>(base);
+        segment->capacity = HISTORY_SEGMENT_BYTES;
+        return segment;
+    }
+
+    // Starts a new segment at nextSequence, deleting the oldest if too many
+    bool addSegment() {
+        char name[32];
+        snprintf(name, sizeof(name), "/%020llu.log", (unsigned long long)nextSequence);
+        std::shared_ptr<Segment> segment = mapSegment(directory + name, nextSequence);
+        if (!segment) return false;
+
+        std::shared_ptr<Segment> expired;
+        {
+            std::lock_guard<std::mutex> lock(metaMutex);
+            segments.push_back(segment);
+            if (segments.size() > HISTORY_SEGMENTS_KEPT) {
+                expired = segments.front();
+                segments.erase(segments.begin());
+
+                // Rooms whose newest record is gone have no history left
+                uint64_t oldest = segments.front()->firstSequence;
+                for (auto it = heads.begin(); it != heads.end();) {
+                    it = it->second < oldest ? heads.erase(it) : std::next(it);
+                }
+                for (auto it = lastInRoom.begin(); it != lastInRoom.end();) {
+                    it = it->second < oldest ? lastInRoom.erase(it) : std::next(it);
+                }
+            }
+        }
+        if (expired) unlink(expired->path.c_str());  // Unmapped once no replay holds it
+        return true;
+    }
+
+    /**
+     * Function: recover
+     * Purpose: Maps the segments already in the directory, finds the end of
+     *          the valid records in each and rebuilds the indexes and chains
+     */
+    bool recover() {
+        std::vector<std::string> names;
+        DIR* dir = opendir(directory.c_str());
+        if (dir == nullptr) return false;
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() == 24 && name.compare(20, 4, ".log") == 0) names.push_back(name);
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());  // Zero-padded: sorts by sequence
+        while (names.size() > HISTORY_SEGMENTS_KEPT) {
+            unlink((directory + "/" + names.front()).c_str());
+            names.erase(names.begin());
+        }
+
+        for (const std::string& name : names) {
+            uint64_t firstSequence = strtoull(name.c_str(), nullptr, 10);
+            std::shared_ptr<Segment> segment = mapSegment(directory + "/" + name, firstSequence);
+            if (!segment) return false;
+            size_t offset = 0;
+            while (offset + HISTORY_HEADER_BYTES + HISTORY_TRAILER_BYTES <= segment->capacity) {
+                const char* record = segment->base + offset;
+                uint32_t length = load<uint32_t>(record);
+                if (length < HISTORY_HEADER_BYTES + HISTORY_TRAILER_BYTES ||
+                    length > segment->capacity - offset ||
+                    load<uint32_t>(record + length - HISTORY_TRAILER_BYTES) != length ||
+                    load<uint32_t>(record + 4) != checksum(record + 8, length - 8 - HISTORY_TRAILER_BYTES)) {
+                    break;
+                }
+                uint64_t sequence = load<uint64_t>(record + 8);
+                if (segment->records++ % HISTORY_INDEX_INTERVAL == 0) segment->index.push_back({sequence, offset});
+                heads[std::string(record + HISTORY_HEADER_BYTES, (uint8_t)record[32])] = sequence;
+                nextSequence = sequence + 1;
+                lastTimestamp = std::max(lastTimestamp, load<int64_t>(record + 16));
+                offset += length;
+            }
+            segment->committed.store(offset, std::memory_order_release);
+            segment->synced = offset;
+            segments.push_back(segment);
+        }
+        lastInRoom = heads;
+        return true;
+    }
+
+    // Copies one message into the current segment (writer only)
+    void write(const Entry& entry) {
+        std::string_view frame = entry.message.frame();
+        size_t length = HISTORY_HEADER_BYTES + entry.room.size() + frame.size() + HISTORY_TRAILER_BYTES;
+        if (length > HISTORY_SEGMENT_BYTES) return;
+
+        Segment* segment = segments.back().get();   // Only this thread changes the list
+        size_t offset = segment->committed.load(std::memory_order_relaxed) + pending;
+        if (offset + length > segment->capacity) {
+            publish();
+            sync(*segment, true);
+            if (!addSegment()) return;
+            segment = segments.back().get();
+            offset = 0;
+        }
+
+        uint64_t& previous = lastInRoom.emplace(entry.room, HISTORY_NONE).first->second;
+        lastTimestamp = std::max(lastTimestamp, entry.timestamp);
+        char* record = segment->base + offset;
+        store<uint32_t>(record, (uint32_t)length);
+        store<uint64_t>(record + 8, nextSequence);
+        store<int64_t>(record + 16, lastTimestamp);
+        store<uint64_t>(record + 24, previous);
+        record[32] = (char)entry.room.size();
+        memcpy(record + HISTORY_HEADER_BYTES, entry.room.data(), entry.room.size());
+        memcpy(record + HISTORY_HEADER_BYTES + entry.room.size(), frame.data(), frame.size());
+        store<uint32_t>(record + length - HISTORY_TRAILER_BYTES, (uint32_t)length);
+        store<uint32_t>(record + 4, checksum(record + 8, length - 8 - HISTORY_TRAILER_BYTES));
+
+        if (segment->records++ % HISTORY_INDEX_INTERVAL == 0) {
+            pendingIndex.push_back({nextSequence, offset});
+        }
+        previous = nextSequence;
+        pendingHeads.push_back(entry.room);
+        nextSequence++;
+        pending += length;
+    }
+
+    // Makes the records written since the last call visible to replay()
+    void publish() {
+        if (pending == 0) return;
+        Segment& segment = *segments.back();
+        std::lock_guard<std::mutex> lock(metaMutex);
+        segment.index.insert(segment.index.end(), pendingIndex.begin(), pendingIndex.end());
+        for (const std::string& room : pendingHeads) heads[room] = lastInRoom[room];
+        segment.committed.store(segment.committed.load(std::memory_order_relaxed) + pending,
+                                std::memory_order_release);
+        pendingIndex.clear();
+        pendingHeads.clear();
+        pending = 0;
+    }
+
+    // Flushes the unsynced part of a segment to disk (writer only)
+    void sync(Segment& segment, bool force) {
+        auto current = std::chrono::steady_clock::now();
+        if (!force && current - lastSync < syncInterval) return;
+        lastSync = current;
+
+        size_t committed = segment.committed.load(std::memory_order_relaxed);
+        if (committed == segment.synced) return;
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t start = segment.synced / page * page;
+        msync(segment.base + start, committed - start, MS_SYNC);
+        segment.synced = committed;
+    }
+
+    /**
+     * Function: drain
+     * Purpose: Writes every queued message to the log
+     * Returns: Number of messages written
+     */
+    size_t drain() {
+        std::vector<std::shared_ptr<Channel>> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(channelMutex);
+            snapshot = channels;
+        }
+
+        Entry entry;
+        for (const std::shared_ptr<Channel>& channel : snapshot) {
+            while (channel->ring.pop(entry)) batch.push_back(std::move(entry));
+        }
+        {
+            std::lock_guard<std::mutex> lock(overflowMutex);
+            for (Entry& spilled : overflow) batch.push_back(std::move(spilled));
+            overflow.clear();
+        }
+
+        // Back into the order the messages were logged in, across threads
+        std::stable_sort(batch.begin(), batch.end(),
+                         [](const Entry& a, const Entry& b) { return a.timestamp < b.timestamp; });
+        for (const Entry& queued : batch) write(queued);
+        size_t written = batch.size();
+        batch.clear();
+        publish();
+
+        // Forget threads that have exited once their rings are empty
+        std::lock_guard<std::mutex> lock(channelMutex);
+        for (size_t i = 0; i < channels.size();) {
+            Channel& channel = *channels[i];
+            if (channel.closed.load(std::memory_order_acquire) && channel.ring.approxSize() == 0) {
+                channels[i] = channels.back();
+                channels.pop_back();
+            } else {
+                i++;
+            }
+        }
+        return written;
+    }
+
+    void writerLoop() {
+        while (running.load(std::memory_order_acquire)) {
+            size_t written = drain();
+            sync(*segments.back(), false);
+            if (written > 0) continue;
+            std::unique_lock<std::mutex> lock(waitMutex);
+            wake.wait_for(lock, std::chrono::milliseconds(HISTORY_POLL_MS));
+        }
+        drain();
+        sync(*segments.back(), true);
+    }
+
+    std::string directory;
+    std::chrono::milliseconds syncInterval{200};
+    std::atomic<bool> running{false};
+    std::thread writer;
+    std::mutex waitMutex;
+    std::condition_variable wake;
+
+    std::mutex metaMutex;                           // Guards segments' list and indexes, and heads
+    std::vector<std::shared_ptr<Segment>> segments; // Oldest first; changed by the writer only
+    std::unordered_map<std::string, uint64_t> heads;    // Room -> newest published record
+
+    std::mutex channelMutex;                        // Guards channels (registration only)
+    std::vector<std::shared_ptr<Channel>> channels;
+    std::mutex overflowMutex;
+    std::vector<Entry> overflow;                    // Messages whose thread's ring was full
+
+    // Writer thread only
+    std::vector<Entry> batch;                       // Being written by drain()
+    uint64_t nextSequence = 0;
+    int64_t lastTimestamp = INT64_MIN;              // Of the newest record
+    size_t pending = 0;                             // Bytes written but not yet published
+    std::vector<IndexEntry> pendingIndex;
+    std::vector<std::string> pendingHeads;          // Rooms written to since the last publish
+    std::unordered_map<std::string, uint64_t> lastInRoom;   // Room -> newest written record
+    std::chrono::steady_clock::time_point lastSync = std::chrono::steady_clock::now();
+};
+
+#endif
@@ -0,0 +1,322 @@
+/**
+ * message_pool.h - Pooled, reference-counted broadcast messages
+ *
+ * A broadcast is formatted exactly once, straight into a block taken from a
+ * size-class slab pool, with the frame header already in place. Every
+ * recipient's outbound queue then holds a MessageRef to that same block;
+ * the block goes back to the pool when the last recipient has sent it.
+ * In steady state a message therefore costs no heap allocation at all.
+ *
+ * Pool layout: blocks of 64 B .. 64 KiB (powers of two) are carved from
+ * 64 KiB slabs that are never returned to the system. Each thread keeps a
+ * small cache of free blocks per size class and only touches the shared,
+ * mutex-protected free list in batches, so allocation and release are
+ * normally lock-free. Messages above the largest class use plain new.
+ *
+ * A message may carry a second block with its typed encoding (see
+ * binary_protocol.h), attached with attachTyped(); it is released together
+ * with the text, and recipients that asked for typed messages are sent it
+ * instead.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <utility>
+
+#include "../common/framing.h"
+#include "binary_protocol.h"
+
+const int MESSAGE_SIZE_CLASSES = 11;           // 64 B, 128 B, ... 64 KiB
+const size_t MESSAGE_MIN_BLOCK = 64;
+const size_t MESSAGE_SLAB_BYTES = 64 * 1024;
+const size_t MESSAGE_CACHE_LIMIT = 64;         // Free blocks kept per thread and class
+const uint8_t MESSAGE_UNPOOLED = 0xFF;         // Size class of oversized blocks
+
+/**
+ * Struct: MessageBlock
+ * Purpose: Header of a pooled message; the frame bytes follow it in memory
+ */
+struct MessageBlock {
+    std::atomic<uint32_t> refs;
+    uint32_t length;          // Bytes of frame data in use
+    uint8_t sizeClass;        // Index into the pool, or MESSAGE_UNPOOLED
+    union {
+        MessageBlock* next;   // Free-list link (only while in the pool)
+        MessageBlock* typed;  // Typed encoding of the same message, or null (only while in use)
+    };
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+/**
+ * Class: MessagePool
+ * Purpose: Slab allocator with per-thread caches for MessageBlocks
+ */
+class MessagePool {
+public:
+    static MessagePool& instance() {
+        static MessagePool* pool = new MessagePool();  // Outlives thread caches
+        return *pool;
+    }
+
+    /**
+     * Function: allocate
+     * Purpose: Returns a block with room for at least `bytes` of frame data
+     *          and a reference count of one
+     */
+    MessageBlock* allocate(size_t bytes) {
+        int cls = sizeClassFor(sizeof(MessageBlock) + bytes);
+        MessageBlock* block;
+
+        if (cls < 0) {
+            block = static_cast<MessageBlock*>(::operator new(sizeof(MessageBlock) + bytes));
+            block->sizeClass = MESSAGE_UNPOOLED;
+        } else {
+            ThreadCache& cache = threadCache();
+            if (cache.head[cls] == nullptr) refill(cache, cls);
+            block = cache.head[cls];
+            cache.head[cls] = block->next;
+            cache.count[cls]--;
+        }
+
+        block->refs.store(1, std::memory_order_relaxed);
+        block->length = 0;
+        block->typed = nullptr;
+        return block;
+    }
+
+    /**
+     * Function: release
+     * Purpose: Returns a block whose reference count reached zero
+     */
+    void release(MessageBlock* block) {
+        if (block->sizeClass == MESSAGE_UNPOOLED) {
+            ::operator delete(block);
+            return;
+        }
+        int cls = block->sizeClass;
+        ThreadCache& cache = threadCache();
+        block->next = cache.head[cls];
+        cache.head[cls] = block;
+        if (++cache.count[cls] > MESSAGE_CACHE_LIMIT) spill(cache, cls, MESSAGE_CACHE_LIMIT / 2);
+    }
+
+    // Total bytes obtained from the system for slabs
+    size_t slabBytes() const { return slabTotal.load(std::memory_order_relaxed); }
+
+private:
+    struct SharedClass {
+        std::mutex lock;
+        MessageBlock* freeList = nullptr;
+        size_t freeCount = 0;
+    };
+
+    struct ThreadCache {
+        MessageBlock* head[MESSAGE_SIZE_CLASSES] = {};
+        size_t count[MESSAGE_SIZE_CLASSES] = {};
+
+        ~ThreadCache() {
+            for (int cls = 0; cls < MESSAGE_SIZE_CLASSES; cls++) {
+                MessagePool::instance().spill(*this, cls, count[cls]);
+            }
+        }
+    };
+
+    MessagePool() = default;
+
+    static ThreadCache& threadCache() {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    static size_t blockSize(int cls) { return MESSAGE_MIN_BLOCK << cls; }
+
+    static int sizeClassFor(size_t bytes) {
+        for (int cls = 0; cls < MESSAGE_SIZE_CLASSES; cls++) {
+            if (bytes <= blockSize(cls)) return cls;
+        }
+        return -1;
+    }
+
+    // Moves up to half a cache worth of blocks from the shared list into the
+    // thread cache, carving a fresh slab if the shared list is empty
+    void refill(ThreadCache& cache, int cls) {
+        SharedClass& shared = classes[cls];
+        {
+            std::lock_guard<std::mutex> guard(shared.lock);
+            size_t wanted = MESSAGE_CACHE_LIMIT / 2;
+            while (shared.freeList != nullptr && wanted-- > 0) {
+                MessageBlock* block = shared.freeList;
+                shared.freeList = block->next;
+                shared.freeCount--;
+                block->next = cache.head[cls];
+                cache.head[cls] = block;
+                cache.count[cls]++;
+            }
+        }
+        if (cache.head[cls] != nullptr) return;
+
+        size_t size = blockSize(cls);
+        size_t slab = size > MESSAGE_SLAB_BYTES / 4 ? size * 4 : MESSAGE_SLAB_BYTES;
+        char* memory = static_cast<char*>(::operator new(slab));
+        slabTotal.fetch_add(slab, std::memory_order_relaxed);
+        for (size_t offset = 0; offset + size <= slab; offset += size) {
+            MessageBlock* block = reinterpret_cast<MessageBlock*>(memory + offset);
+            new (block) MessageBlock();
+            block->sizeClass = (uint8_t)cls;
+            block->next = cache.head[cls];
+            cache.head[cls] = block;
+            cache.count[cls]++;
+        }
+    }
+
+    // Hands `n` blocks from the thread cache back to the shared list
+    void spill(ThreadCache& cache, int cls, size_t n) {
+        if (n == 0) return;
+        SharedClass& shared = classes[cls];
+        std::lock_guard<std::mutex> guard(shared.lock);
+        while (n-- > 0 && cache.head[cls] != nullptr) {
+            MessageBlock* block = cache.head[cls];
+            cache.head[cls] = block->next;
+            cache.count[cls]--;
+            block->next = shared.freeList;
+            shared.freeList = block;
+            shared.freeCount++;
+        }
+    }
+
+    SharedClass classes[MESSAGE_SIZE_CLASSES];
+    std::atomic<size_t> slabTotal{0};
+};
+
+/**
+ * Class: MessageRef
+ * Purpose: Shared handle to an immutable pooled message (one framed message)
+ *
+ * Copying bumps the reference count; the block returns to the pool when the
+ * last handle is destroyed, on whichever thread that happens.
+ */
+class MessageRef {
+public:
+    MessageRef() = default;
+    explicit MessageRef(MessageBlock* block) : block(block) {}
+
+    MessageRef(const MessageRef& other) : block(other.block) {
+        if (block) block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    MessageRef(MessageRef&& other) noexcept : block(other.block) { other.block = nullptr; }
+
+    MessageRef& operator=(MessageRef other) noexcept {
+        std::swap(block, other.block);
+        return *this;
+    }
+
+    ~MessageRef() { reset(); }
+
+    void reset() {
+        if (block && block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            MessageRef typed(block->typed);  // Dropped with it
+            MessagePool::instance().release(block);
+        }
+        block = nullptr;
+    }
+
+    explicit operator bool() const { return block != nullptr; }
+
+    // Whole frame (header + payload), ready for send()
+    std::string_view frame() const { return std::string_view(block->data(), block->length); }
+
+    // Message text without the frame header
+    std::string_view payload() const { return frame().substr(FRAME_HEADER_SIZE); }
+
+    size_t size() const { return block->length; }
+
+    bool hasTyped() const { return block->typed != nullptr; }
+
+    // The typed encoding if there is one, else this message
+    MessageRef typed() const {
+        MessageRef other(block->typed ? block->typed : block);
+        other.block->refs.fetch_add(1, std::memory_order_relaxed);
+        return other;
+    }
+
+    /**
+     * Function: attachTyped
+     * Purpose: Hands the message its typed encoding (before it is shared)
+     */
+    void attachTyped(MessageRef typed) {
+        block->typed = typed.block;
+        typed.block = nullptr;
+    }
+
+private:
+    MessageBlock* block = nullptr;
+};
+
+/**
+ * Struct: NumberText
+ * Purpose: Formats an integer into a stack buffer for use as a message part
+ */
+struct NumberText {
+    char digits[24];
+    size_t length;
+
+    explicit NumberText(long long value) {
+        length = (size_t)(std::to_chars(digits, digits + sizeof(digits), value).ptr - digits);
+    }
+    operator std::string_view() const { return std::string_view(digits, length); }
+};
+
+/**
+ * Function: makeMessage
+ * Purpose: Builds a framed message from parts in a single pooled block
+ * Parameters: parts - Text fragments concatenated to form the payload
+ * Returns: Handle holding the only reference to the new message
+ *
+ * Example: makeMessage({"[Client ", NumberText(id), "]: ", payload})
+ */
+inline MessageRef makeMessage(std::initializer_list<std::string_view> parts) {
+    size_t payloadLength = 0;
+    for (std::string_view part : parts) payloadLength += part.size();
+
+    MessageBlock* block = MessagePool::instance().allocate(FRAME_HEADER_SIZE + payloadLength);
+    char* out = block->data();
+    writeFrameHeader(out, (uint32_t)payloadLength);
+    out += FRAME_HEADER_SIZE;
+    for (std::string_view part : parts) {
+        memcpy(out, part.data(), part.size());
+        out += part.size();
+    }
+    block->length = (uint32_t)(FRAME_HEADER_SIZE + payloadLength);
+    return MessageRef(block);
+}
+
+/**
+ * Function: makeTypedMessage
+ * Purpose: Encodes a typed message (see binary_protocol.h) into a pooled,
+ *          framed block
+ */
+template <typename T>
+inline MessageRef makeTypedMessage(const T& message) {
+    size_t payloadLength = wireSize(message);
+    MessageBlock* block = MessagePool::instance().allocate(FRAME_HEADER_SIZE + payloadLength);
+    writeFrameHeader(block->data(), (uint32_t)payloadLength);
+    wireEncode(message, block->data() + FRAME_HEADER_SIZE);
+    block->length = (uint32_t)(FRAME_HEADER_SIZE + payloadLength);
+    return MessageRef(block);
+}
+
+#endif
@@ -0,0 +1,303 @@
+/**
+ * outbound_queue.h - Bounded per-client send queue for the concurrent server
+ *
+ * Broadcasting only appends to each recipient's queue; the bytes are written
+ * later by whoever owns the socket (the client's writer thread in threads
+ * mode, the event loop in epoll mode). A client that stops reading therefore
+ * only fills its own queue, and once that reaches the high-water mark the
+ * configured slow-consumer policy either drops its oldest messages or asks
+ * the server to disconnect it.
+ *
+ * Writers drain the queue in batches: up to BatchLimits worth of messages
+ * are handed to one gather write (writev) instead of one send() each.
+ *
+ * Entries are MessageRefs, so a broadcast to N clients queues N references
+ * to one shared buffer rather than N copies. The queue is not synchronised;
+ * callers provide locking where needed.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef OUTBOUND_QUEUE_H
+#define OUTBOUND_QUEUE_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "message_pool.h"
+
+// What to do with a client whose queue reaches the high-water mark
+enum class SlowConsumerPolicy {
+    DropOldest,  // Discard the oldest unsent messages to make room
+    Disconnect   // Refuse the message and disconnect the client
+};
+
+struct OutboundLimits {
+    size_t highWaterBytes = 2 << 20;  // Max bytes queued per client (holds a largest frame)
+    SlowConsumerPolicy policy = SlowConsumerPolicy::DropOldest;
+};
+
+const int MAX_BATCH_SLICES = 256;    // Hard cap on messages per gather write
+
+// Upper bounds for one gather write
+struct BatchLimits {
+    size_t maxBytes = 64 * 1024;  // Bytes per writev()
+    int maxSlices = 64;           // Messages (iovecs) per writev()
+};
+
+// One contiguous piece of a gather write (maps onto iovec / WSABUF)
+struct OutboundSlice {
+    const char* data;
+    size_t length;
+};
+
+enum class EnqueueResult {
+    Queued,         // Message accepted
+    DroppedOldest,  // Message accepted after discarding older ones
+    DroppedNew,     // Message discarded: larger than the limit, behind queued data
+    Overflow        // Message refused - disconnect the client
+};
+
+enum class FlushResult {
+    Drained,     // Everything queued has been written
+    WouldBlock,  // Socket buffer full; wait for writability
+    Failed       // Socket error; the client is gone
+};
+
+/**
+ * Class: OutboundQueue
+ * Purpose: FIFO of framed messages with partial-write tracking
+ *
+ * Stored in a growable circular array so that steady-state push/pop does
+ * not allocate.
+ * headOffset records how much of the front message the kernel has already
+ * taken, so a short send() resumes where it stopped instead of truncating
+ * the message. A partially sent front message is never dropped, since that
+ * would corrupt the frame stream the client is parsing. Likewise messages
+ * handed out by gather() stay pinned until advance() reports the write
+ * complete, because an asynchronous writer (io_uring) may still be reading
+ * their buffers.
+ */
+class OutboundQueue {
+public:
+    /**
+     * Function: push
+     * Purpose: Appends a framed message, applying the slow-consumer policy
+     * Parameters:
+     *   - frame: Complete frame (header + payload)
+     *   - limits: High-water mark and policy
+     * Returns: Queued, DroppedOldest, DroppedNew or Overflow
+     *
+     * The mark only counts against a client that has something queued: a
+     * frame always fits into an empty queue, however large. A frame larger
+     * than the mark on its own is therefore never a reason to drop older
+     * messages; behind queued data DropOldest discards the frame itself
+     * (DroppedNew), and Disconnect overflows as for any other frame.
+     */
+    EnqueueResult push(MessageRef frame, const OutboundLimits& limits) {
+        EnqueueResult result = EnqueueResult::Queued;
+
+        if (count > 0 && queuedBytes + frame.size() > limits.highWaterBytes) {
+            if (limits.policy == SlowConsumerPolicy::Disconnect) {
+                return EnqueueResult::Overflow;
+            }
+            if (frame.size() > limits.highWaterBytes) {
+                return EnqueueResult::DroppedNew;
+            }
+            // Keep in-flight messages; drop whole messages behind them
+            size_t keep = (pinned == 0 && headOffset > 0) ? 1 : pinned;
+            while (count > keep && queuedBytes + frame.size() > limits.highWaterBytes) {
+                // Discard entry `keep` by sliding the kept entries onto it
+                for (size_t i = keep; i > 0; i--) {
+                    std::swap(slot(i), slot(i - 1));
+                }
+                dropFront();
+                droppedCount++;
+                result = EnqueueResult::DroppedOldest;
+            }
+        }
+
+        if (count == ring.size()) grow();
+        queuedBytes += frame.size();
+        slot(count) = std::move(frame);
+        count++;
+        return result;
+    }
+
+    /**
+     * Function: pop
+     * Purpose: Removes the front message whole (for blocking writers that
+     *          send each message completely before taking the next)
+     * Returns: false if the queue is empty
+     */
+    bool pop(MessageRef& frame) {
+        if (count == 0) return false;
+        frame = std::move(slot(0));
+        queuedBytes -= frame.size();
+        head = (head + 1) % ring.size();
+        count--;
+        headOffset = 0;
+        return true;
+    }
+
+    /**
+     * Function: popBatch
+     * Purpose: Removes up to one batch of whole messages from the front
+     *          (for blocking writers, which send them outside the lock)
+     * Parameters:
+     *   - out: Receives the messages, at least limits.maxSlices entries
+     *   - limits: Batch size bounds (at least one message is always taken)
+     * Returns: Number of messages removed
+     */
+    size_t popBatch(MessageRef* out, const BatchLimits& limits) {
+        size_t taken = 0;
+        size_t batchBytes = 0;
+        while (count > 0 && taken < (size_t)limits.maxSlices &&
+               (taken == 0 || batchBytes + slot(0).size() <= limits.maxBytes)) {
+            batchBytes += slot(0).size();
+            pop(out[taken++]);
+        }
+        return taken;
+    }
+
+    /**
+     * Function: gather
+     * Purpose: Describes the next batch as slices for a gather write and
+     *          pins those messages until advance() is called
+     * Parameters:
+     *   - slices: Receives up to limits.maxSlices entries
+     *   - limits: Batch size bounds (at least one message is always included)
+     *   - batchBytes: Receives the total length of the slices
+     * Returns: Number of slices filled (0 if the queue is empty)
+     */
+    int gather(OutboundSlice* slices, const BatchLimits& limits, size_t& batchBytes) {
+        int maxSlices = limits.maxSlices < MAX_BATCH_SLICES ? limits.maxSlices : MAX_BATCH_SLICES;
+        int used = 0;
+        batchBytes = 0;
+        for (size_t i = 0; i < count && used < maxSlices; i++) {
+            std::string_view frame = slot(i).frame();
+            size_t skip = (i == 0) ? headOffset : 0;
+            if (used > 0 && batchBytes + frame.size() - skip > limits.maxBytes) break;
+            slices[used++] = {frame.data() + skip, frame.size() - skip};
+            batchBytes += frame.size() - skip;
+        }
+        pinned = (size_t)used;
+        return used;
+    }
+
+    /**
+     * Function: advance
+     * Purpose: Records that `written` bytes of the gathered batch were sent,
+     *          releasing fully sent messages and unpinning the rest
+     */
+    void advance(size_t written) {
+        pinned = 0;
+        consume(written);
+    }
+
+    /**
+     * Function: flushBatched
+     * Purpose: Non-blocking drain using gather writes
+     * Parameters:
+     *   - writev: Callable (const OutboundSlice* slices, int count) with the
+     *             same return convention as flush()
+     *   - limits: Batch size bounds
+     * Returns: Drained, WouldBlock or Failed
+     *
+     * Each call to writev covers as many queued messages as the limits allow,
+     * starting mid-message if an earlier write was short.
+     */
+    template <typename WriteVFn>
+    FlushResult flushBatched(WriteVFn writev, const BatchLimits& limits) {
+        OutboundSlice slices[MAX_BATCH_SLICES];
+
+        while (count > 0) {
+            size_t batchBytes;
+            int used = gather(slices, limits, batchBytes);
+
+            long long written = writev(slices, used);
+            if (written <= 0) {
+                pinned = 0;
+                return written < 0 ? FlushResult::Failed : FlushResult::WouldBlock;
+            }
+            advance((size_t)written);
+            if ((size_t)written < batchBytes) return FlushResult::WouldBlock;
+        }
+        return FlushResult::Drained;
+    }
+
+    /**
+     * Function: flush
+     * Purpose: Writes queued messages until the queue is empty or the
+     *          socket stops accepting data (non-blocking writers)
+     * Parameters: write - Callable (const char* data, size_t length) that
+     *             returns bytes written, 0 if the socket would block, or a
+     *             negative value on error
+     * Returns: Drained, WouldBlock or Failed
+     */
+    template <typename WriteFn>
+    FlushResult flush(WriteFn write) {
+        while (count > 0) {
+            std::string_view frame = slot(0).frame();
+            long long written = write(frame.data() + headOffset, frame.size() - headOffset);
+            if (written < 0) return FlushResult::Failed;
+            if (written == 0) return FlushResult::WouldBlock;
+
+            consume((size_t)written);
+        }
+        return FlushResult::Drained;
+    }
+
+    bool empty() const { return count == 0; }
+    size_t bytes() const { return queuedBytes; }       // Bytes held in the queue
+    size_t depth() const { return count; }             // Messages still to send
+    size_t dropped() const { return droppedCount; }    // Discarded by DropOldest
+
+    // The index-th queued message (0 = oldest) and how much of the oldest
+    // was already sent, for handing the queue over (see hot_restart.h)
+    const MessageRef& peek(size_t index) const { return ring[(head + index) % ring.size()]; }
+    size_t sentOfOldest() const { return headOffset; }
+
+private:
+    MessageRef& slot(size_t index) { return ring[(head + index) % ring.size()]; }
+
+    void dropFront() {
+        queuedBytes -= slot(0).size();
+        slot(0).reset();
+        head = (head + 1) % ring.size();
+        count--;
+    }
+
+    // Advances past `written` bytes, releasing every message fully sent
+    void consume(size_t written) {
+        while (written > 0) {
+            size_t remaining = slot(0).size() - headOffset;
+            if (written < remaining) {
+                headOffset += written;
+                return;
+            }
+            written -= remaining;
+            dropFront();
+            headOffset = 0;
+        }
+    }
+
+    void grow() {
+        std::vector<MessageRef> larger(ring.empty() ? 16 : ring.size() * 2);
+        for (size_t i = 0; i < count; i++) larger[i] = std::move(slot(i));
+        ring.swap(larger);
+        head = 0;
+    }
+
+    std::vector<MessageRef> ring;   // Circular buffer of queued frames
+    size_t head = 0;                // Index of the oldest entry
+    size_t count = 0;               // Entries in use
+    size_t queuedBytes = 0;
+    size_t pinned = 0;              // Leading entries owned by an in-flight write
+    size_t headOffset = 0;          // Bytes of the oldest entry already sent
+    size_t droppedCount = 0;
+};
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ * room_index.h - Chat rooms for the concurrent server
+ *
+ * Every client is a member of exactly one room (DEFAULT_ROOM when it
+ * connects), and chat messages, join and leave notices are delivered only
+ * to the members of the sender's room. The index maps each room name to a
+ * flat vector of its members, so a broadcast walks just that vector instead
+ * of every connected client.
+ *
+ * Each member records which room it is in and its position in that room's
+ * vector, so joining and leaving are O(1): a leaving member is swapped with
+ * the last one and the vector shrinks, without searching. Empty rooms are
+ * removed.
+ *
+ * Clients switch rooms by sending a command as an ordinary chat frame:
+ *   /join <room>   Move to <room>, creating it if nobody is there yet
+ *   /leave         Go back to DEFAULT_ROOM
+ *
+ * The index is not synchronised; callers provide locking where needed.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef ROOM_INDEX_H
+#define ROOM_INDEX_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+const char* const DEFAULT_ROOM = "lobby";
+const size_t MAX_ROOM_NAME = 15;   // Fits std::string's inline buffer: copied without allocating
+
+template <typename Member>
+struct Room;
+
+// Where a member currently is; embedded in the member itself
+template <typename Member>
+struct RoomMembership {
+    Room<Member>* room = nullptr;
+    size_t slot = 0;               // Index in room->members
+};
+
+template <typename Member>
+struct Room {
+    std::string name;
+    std::vector<Member*> members;
+};
+
+/**
+ * Class: RoomIndex
+ * Purpose: Room name -> members map with constant-time membership updates
+ *
+ * Member must have a public `RoomMembership<Member> membership` field.
+ */
+template <typename Member>
+class RoomIndex {
+public:
+    /**
+     * Function: join
+     * Purpose: Moves a member into a room (leaving its current one)
+     * Returns: The room joined
+     */
+    Room<Member>& join(Member& member, const std::string& name) {
+        leave(member);
+        Room<Member>& room = rooms[name];
+        if (room.members.empty()) room.name = name;
+        member.membership.room = &room;
+        member.membership.slot = room.members.size();
+        room.members.push_back(&member);
+        return room;
+    }
+
+    /**
+     * Function: leave
+     * Purpose: Removes a member from its room, deleting the room if it is
+     *          now empty
+     */
+    void leave(Member& member) {
+        Room<Member>* room = member.membership.room;
+        if (room == nullptr) return;
+
+        size_t slot = member.membership.slot;
+        Member* last = room->members.back();
+        room->members[slot] = last;
+        last->membership.slot = slot;
+        room->members.pop_back();
+        member.membership.room = nullptr;
+
+        if (room->members.empty()) rooms.erase(room->name);
+    }
+
+    // The room with this name, or nullptr if nobody is in it
+    Room<Member>* find(const std::string& name) {
+        auto it = rooms.find(name);
+        return it == rooms.end() ? nullptr : &it->second;
+    }
+
+    size_t size() const { return rooms.size(); }
+    void clear() { rooms.clear(); }
+
+private:
+    std::unordered_map<std::string, Room<Member>> rooms;  // Nodes never move
+};
+
+// Room commands a client can send
+enum class RoomCommand {
+    None,     // Ordinary chat message
+    Join,     // "/join <room>"
+    Leave,    // "/leave"
+    Invalid   // Looked like a room command but the name is unusable
+};
+
+/**
+ * Function: validRoomName
+ * Purpose: Whether a name can be used for a room (1..MAX_ROOM_NAME letters,
+ *          digits, '-' or '_')
+ */
+inline bool validRoomName(std::string_view name) {
+    if (name.empty() || name.size() > MAX_ROOM_NAME) return false;
+    for (char c : name) {
+        bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                     (c >= '0' && c <= '9') || c == '-' || c == '_';
+        if (!valid) return false;
+    }
+    return true;
+}
+
+/**
+ * Function: parseRoomCommand
+ * Purpose: Recognises "/join <room>" and "/leave" in a received payload
+ * Parameters:
+ *   - payload: Frame payload from a client
+ *   - room: Receives the room to move to (Join and Leave)
+ * Returns: The command, or None for a normal message
+ *
+ * Room names are 1 to MAX_ROOM_NAME letters, digits, '-' or '_'.
+ */
+inline RoomCommand parseRoomCommand(std::string_view payload, std::string& room) {
+    if (payload == "/leave") {
+        room = DEFAULT_ROOM;
+        return RoomCommand::Leave;
+    }
+    if (payload != "/join" && payload.substr(0, 6) != "/join ") return RoomCommand::None;
+
+    std::string_view name = payload.substr(payload.size() > 6 ? 6 : payload.size());
+    if (!validRoomName(name)) return RoomCommand::Invalid;
+    room.assign(name.data(), name.size());
+    return RoomCommand::Join;
+}
+
+#endif
@@ -0,0 +1,158 @@
+/**
+ * server_stats.h - Hot-path counters and latency histograms for the server
+ *
+ * Every thread that handles traffic (client reader and writer threads,
+ * event-loop shards) updates its own ThreadStats block, a thread_local
+ * returned by threadStats(). An update is a relaxed load and store on a counter
+ * that only that thread writes: no lock, no locked read-modify-write, and
+ * no cache line shared with another writer. The blocks are only summed when
+ * someone asks for a report (the stats port or the "stats" console command).
+ *
+ * The registry mutex is taken only when a thread records its first sample,
+ * when it exits (its totals are folded into a retired block so they
+ * survive it) and by the reader - never per message.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "latency_histogram.h"
+
+// Counters kept per thread; the names are used by the text report
+enum StatCounter {
+    StatMessagesIn,       // Chat frames received from clients
+    StatBytesIn,          // Bytes received from clients
+    StatMessagesOut,      // Frames fully written to clients
+    StatBytesOut,         // Bytes written to clients
+    StatBroadcasts,       // Messages fanned out to a room or to everyone
+    StatFanout,           // Recipients summed over all broadcasts
+    StatWrites,           // Gather writes (send/writev/SENDMSG) issued
+    StatPartialWrites,    // Writes the kernel accepted only part of
+    StatDropped,          // Enqueues that discarded older messages (DropOldest)
+    StatDroppedNew,       // Messages discarded instead, too large to queue (DropOldest)
+    StatSlowDisconnects,  // Clients disconnected for a full queue
+    StatAccepted,         // Connections admitted
+    StatRejected,         // Connections refused because the server was full
+    StatSharedMemory,     // Local clients switched to the shared-memory transport
+    StatDatagramsIn,      // UDP datagrams received
+    StatDatagramsOut,     // UDP datagrams sent
+    StatDatagramCalls,    // recvmmsg/sendmmsg calls that moved datagrams
+    StatDatagramGaps,     // Datagrams missing from subscribers' sequence numbers
+    StatRelayedOut,       // Messages relayed to the peer nodes (once for all peers)
+    StatRelayedIn,        // Messages from peer nodes delivered here
+    StatRelayDuplicates,  // Relayed messages dropped as already delivered or our own
+    StatRelayDropped,     // Relays discarded because a peer link's queue was full
+    StatRelayBatches,     // Batched writes on the peer links
+    StatTakenOver,        // Clients inherited from the previous process (hot restart)
+    StatWorkTasks,        // Tasks run by the --workers pool
+    StatWorkSteals,       // ... of which a worker took from another's deque
+    StatHeartbeats,       // Heartbeats sent to silent clients
+    StatTimeouts,         // Clients disconnected by a read, idle or write deadline
+    STAT_COUNTER_COUNT
+};
+
+const char* const STAT_COUNTER_NAMES[STAT_COUNTER_COUNT] = {
+    "messages_in", "bytes_in", "messages_out", "bytes_out", "broadcasts",
+    "fanout_recipients", "writes", "partial_writes", "dropped_enqueues",
+    "dropped_new", "slow_disconnects", "accepted", "rejected", "shm_clients", "datagrams_in",
+    "datagrams_out", "datagram_calls", "datagram_gaps", "relayed_out", "relayed_in",
+    "relay_duplicates", "relay_dropped", "relay_batches", "taken_over",
+    "work_tasks", "work_steals", "heartbeats", "timeouts"
+};
+
+/**
+ * Class: ThreadStats
+ * Purpose: One thread's counters and histograms (single writer)
+ */
+class alignas(64) ThreadStats {
+public:
+    void add(StatCounter counter, uint64_t amount = 1) {
+        std::atomic<uint64_t>& value = counters[counter];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    uint64_t get(StatCounter counter) const {
+        return counters[counter].load(std::memory_order_relaxed);
+    }
+
+    // Adds another block's totals (this one is owned by the caller)
+    void merge(const ThreadStats& other) {
+        for (int i = 0; i < STAT_COUNTER_COUNT; i++) add((StatCounter)i, other.get((StatCounter)i));
+        recvToBroadcast.merge(other.recvToBroadcast);
+        queueDepth.merge(other.queueDepth);
+    }
+
+    LatencyHistogram recvToBroadcast;  // ns from recv() returning to the last recipient queued
+    LatencyHistogram queueDepth;       // Recipient's queued messages, sampled per enqueue
+
+private:
+    std::atomic<uint64_t> counters[STAT_COUNTER_COUNT] = {};
+};
+
+/**
+ * Class: StatsRegistry
+ * Purpose: Tracks every thread's stats block so a report can sum them
+ */
+class StatsRegistry {
+public:
+    // Never destroyed: detached threads may still exit during shutdown
+    static StatsRegistry& instance() {
+        static StatsRegistry* registry = new StatsRegistry();
+        return *registry;
+    }
+
+    void attach(ThreadStats* stats) {
+        std::lock_guard<std::mutex> lock(mutex);
+        live.push_back(stats);
+    }
+
+    // Keeps an exiting thread's totals
+    void detach(ThreadStats* stats) {
+        std::lock_guard<std::mutex> lock(mutex);
+        retired.merge(*stats);
+        live.erase(std::remove(live.begin(), live.end(), stats), live.end());
+    }
+
+    /**
+     * Function: collect
+     * Purpose: Sums every live and retired block into `total`
+     * Parameters: total - Freshly constructed block owned by the caller
+     */
+    void collect(ThreadStats& total) {
+        std::lock_guard<std::mutex> lock(mutex);
+        total.merge(retired);
+        for (ThreadStats* stats : live) total.merge(*stats);
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<ThreadStats*> live;
+    ThreadStats retired;
+};
+
+// Registers the calling thread's block on first use, folds it in on exit
+struct ThreadStatsSlot {
+    ThreadStats stats;
+    ThreadStatsSlot() { StatsRegistry::instance().attach(&stats); }
+    ~ThreadStatsSlot() { StatsRegistry::instance().detach(&stats); }
+};
+
+/**
+ * Function: threadStats
+ * Purpose: The calling thread's stats block
+ */
+inline ThreadStats& threadStats() {
+    thread_local ThreadStatsSlot slot;
+    return slot.stats;
+}
+
+#endif
@@ -0,0 +1,406 @@
+/**
+ * shm_transport.h - Shared-memory message rings for clients on the server's host
+ *
+ * A client connected over the server's Unix domain socket can ask for its
+ * messages to travel through shared memory instead of the socket. Each
+ * direction is a single-producer/single-consumer byte ring in one memfd
+ * mapping. The rings hold the same length-prefixed frames as the socket
+ * (common/framing.h), so the chat semantics do not change. Sending a
+ * message is a memcpy and a release store; receiving one is an acquire
+ * load, after which the payload is used straight out of the mapping.
+ *
+ * Handshake: the client's first frame on the Unix socket is SHM_HELLO. The
+ * server replies with one frame carrying four descriptors (SCM_RIGHTS):
+ * the memfd and three eventfd "doorbells". The socket stays open only to
+ * detect that either side has gone away.
+ *
+ * Doorbells: a side that finds nothing to read (or no room to write) sets
+ * its waiting flag in the ring header and then re-checks. The other side
+ * rings the doorbell only if it finds the flag set after its own store,
+ * and clears the flag when it does. While both sides keep up, messages
+ * flow with no system call at all; a waiting side costs one eventfd
+ * write. The server has one doorbell for reading and one for writing,
+ * because in threads mode each is waited on by its own thread. The client
+ * is single-threaded, so one doorbell serves it for both.
+ *
+ * A blob handed to write() may hold several frames (a history replay), and
+ * only whole frames are written. A frame never wraps around the end of the
+ * ring: the writer skips to the start (marking the gap with
+ * SHM_PAD_MARKER), so every payload can be read in place.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "../common/framing.h"
+
+const char* const SHM_HELLO = "/shm";                 // Client's request, first frame on the Unix socket
+const size_t SHM_RING_BYTES = 4 << 20;                // Per direction (power of two)
+const uint32_t SHM_MAGIC = 0x43534852;                // "CSHR"
+const uint32_t SHM_VERSION = 1;
+const uint32_t SHM_PAD_MARKER = 0xFFFFFFFF;           // Frame header meaning "continue at offset 0"
+const size_t SHM_DATA_OFFSET = 4096;                  // First ring's data, after the headers
+const int SHM_DESCRIPTORS = 4;                        // memfd + three doorbells
+
+enum class ShmSide { Server, Client };
+
+// Result of reading the next frame from a ring
+enum class ShmRead { Frame, Empty, Corrupt };
+
+/**
+ * Class: ShmChannel
+ * Purpose: One client's pair of shared-memory rings, seen from one side
+ */
+class ShmChannel {
+public:
+    ~ShmChannel() {
+        if (region != nullptr) munmap(region, regionBytes);
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    ShmChannel(const ShmChannel&) = delete;
+    ShmChannel& operator=(const ShmChannel&) = delete;
+
+    /**
+     * Function: create
+     * Purpose: Server side - allocates the mapping and the doorbells
+     * Returns: nullptr on failure
+     */
+    static std::unique_ptr<ShmChannel> create(size_t ringBytes = SHM_RING_BYTES) {
+        std::unique_ptr<ShmChannel> channel(new ShmChannel(ShmSide::Server));
+        channel->fds[0] = memfd_create("chat-shm", MFD_CLOEXEC);
+        for (int i = 1; i < SHM_DESCRIPTORS; i++) channel->fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        for (int fd : channel->fds) {
+            if (fd < 0) return nullptr;
+        }
+        size_t bytes = SHM_DATA_OFFSET + 2 * ringBytes;
+        if (ftruncate(channel->fds[0], (off_t)bytes) != 0 || !channel->map(bytes)) return nullptr;
+
+        Header* header = channel->header();
+        header->ringBytes = ringBytes;
+        header->version = SHM_VERSION;
+        header->magic = SHM_MAGIC;
+        // Both consumers start out waiting, so the first message rings
+        for (Control& control : header->rings) control.consumerWaiting.store(1, std::memory_order_relaxed);
+        channel->setUp();
+        return channel;
+    }
+
+    /**
+     * Function: attach
+     * Purpose: Client side - maps the rings received from the server
+     * Parameters: received - The SHM_DESCRIPTORS descriptors, in order
+     *             (the channel takes ownership, even on failure)
+     * Returns: nullptr if the region is not a channel this code understands
+     */
+    static std::unique_ptr<ShmChannel> attach(const int* received) {
+        std::unique_ptr<ShmChannel> channel(new ShmChannel(ShmSide::Client));
+        for (int i = 0; i < SHM_DESCRIPTORS; i++) channel->fds[i] = received[i];
+        off_t bytes = lseek(channel->fds[0], 0, SEEK_END);
+        if (bytes < (off_t)SHM_DATA_OFFSET || !channel->map((size_t)bytes)) return nullptr;
+
+        Header* header = channel->header();
+        size_t ringBytes = header->ringBytes;
+        if (header->magic != SHM_MAGIC || header->version != SHM_VERSION || ringBytes == 0 ||
+            (ringBytes & (ringBytes - 1)) != 0 || SHM_DATA_OFFSET + 2 * ringBytes != (size_t)bytes) {
+            return nullptr;
+        }
+        channel->setUp();
+        return channel;
+    }
+
+    // Descriptors to pass to the client, in the order attach() expects
+    const int* descriptors() const { return fds; }
+
+    // Becomes readable when there may be something to read
+    int dataBell() const { return side == ShmSide::Server ? fds[2] : fds[1]; }
+    // Becomes readable when there may be room to write
+    int spaceBell() const { return side == ShmSide::Server ? fds[3] : fds[1]; }
+
+    // Resets a doorbell after it fired
+    static void drainBell(int bell) {
+        uint64_t count;
+        ssize_t ignored = ::read(bell, &count, sizeof(count));
+        (void)ignored;
+    }
+
+    // Makes a doorbell readable
+    static void ringBell(int bell) {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(bell, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    /**
+     * Function: write
+     * Purpose: Copies whole frames from `data` into the outbound ring
+     * Returns: Bytes written (a prefix of whole frames); 0 if the first
+     *          frame does not fit, in which case the space doorbell will
+     *          ring once the consumer has made room
+     */
+    size_t write(const char* data, size_t length) {
+        Ring& ring = out;
+        uint64_t tail = ring.control->tail.load(std::memory_order_relaxed);
+        size_t written = 0;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            written = 0;
+            while (written < length) {
+                size_t frame = FRAME_HEADER_SIZE + readFrameHeader(data + written);
+                // Largest run of whole frames that fits before the end of the ring
+                size_t run = 0;
+                size_t offset = (size_t)(tail & ring.mask);
+                size_t contiguous = ring.bytes - offset;
+                while (written + run + frame <= length && run + frame <= contiguous) {
+                    run += frame;
+                    if (written + run >= length) break;
+                    frame = FRAME_HEADER_SIZE + readFrameHeader(data + written + run);
+                }
+                size_t skip = 0;
+                if (run == 0) {
+                    if (frame > ring.bytes / 2) break;          // Could never fit whole
+                    skip = contiguous;                           // Restart at offset 0
+                    run = frame;
+                }
+                uint64_t head = ring.cachedHead;
+                if (tail + skip + run - head > ring.bytes) {
+                    head = ring.cachedHead = ring.control->head.load(std::memory_order_acquire);
+                    if (tail + skip + run - head > ring.bytes) break;
+                }
+                if (skip > 0) {
+                    if (skip >= FRAME_HEADER_SIZE) writeFrameHeader(ring.data + offset, SHM_PAD_MARKER);
+                    tail += skip;
+                    offset = 0;
+                }
+                memcpy(ring.data + offset, data + written, run);
+                tail += run;
+                written += run;
+            }
+            if (written > 0 || attempt > 0) break;
+            // Ring full: ask to be told when there is room, then look again
+            ring.control->producerWaiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            ring.cachedHead = ring.control->head.load(std::memory_order_acquire);
+        }
+        if (written == 0) return 0;
+
+        ring.control->producerWaiting.store(0, std::memory_order_relaxed);
+        ring.control->tail.store(tail, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.control->consumerWaiting.load(std::memory_order_relaxed) &&
+            ring.control->consumerWaiting.exchange(0, std::memory_order_relaxed)) {
+            ringBell(peerDataBell());
+        }
+        return written;
+    }
+
+    /**
+     * Function: read
+     * Purpose: Returns the next frame of the inbound ring, in place
+     * Parameters: payload - Receives the payload; valid until release()
+     * Returns: Frame, Empty, or Corrupt if the peer wrote garbage
+     */
+    ShmRead read(std::string_view& payload) {
+        Ring& ring = in;
+        while (true) {
+            if (readPos == ring.cachedTail) {
+                ring.cachedTail = ring.control->tail.load(std::memory_order_acquire);
+                if (readPos == ring.cachedTail) return ShmRead::Empty;
+            }
+            size_t offset = (size_t)(readPos & ring.mask);
+            size_t contiguous = ring.bytes - offset;
+            if (contiguous < FRAME_HEADER_SIZE) {
+                readPos += contiguous;
+                continue;
+            }
+            uint32_t length = readFrameHeader(ring.data + offset);
+            if (length == SHM_PAD_MARKER) {
+                readPos += contiguous;
+                continue;
+            }
+            size_t frame = FRAME_HEADER_SIZE + (size_t)length;
+            if (length > MAX_FRAME_PAYLOAD || frame > contiguous || readPos + frame > ring.cachedTail) {
+                return ShmRead::Corrupt;
+            }
+            payload = std::string_view(ring.data + offset + FRAME_HEADER_SIZE, length);
+            readPos += frame;
+            return ShmRead::Frame;
+        }
+    }
+
+    /**
+     * Function: release
+     * Purpose: Hands the space of every frame read so far back to the
+     *          producer (invalidates the payloads returned by read())
+     */
+    void release() {
+        Ring& ring = in;
+        if (ring.control->head.load(std::memory_order_relaxed) == readPos) return;
+        ring.control->head.store(readPos, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.control->producerWaiting.load(std::memory_order_relaxed) &&
+            ring.control->producerWaiting.exchange(0, std::memory_order_relaxed)) {
+            ringBell(peerSpaceBell());
+        }
+    }
+
+    /**
+     * Function: idle
+     * Purpose: Announces that this side is about to wait for data
+     * Returns: true if it may now block on dataBell(); false if data
+     *          arrived meanwhile (read again instead)
+     */
+    bool idle() {
+        Ring& ring = in;
+        ring.control->consumerWaiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        ring.cachedTail = ring.control->tail.load(std::memory_order_acquire);
+        if (readPos == ring.cachedTail) return true;
+        ring.control->consumerWaiting.store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Whether the outbound ring has nothing left for the peer to read
+    bool drained() const {
+        return out.control->head.load(std::memory_order_acquire) == out.control->tail.load(std::memory_order_relaxed);
+    }
+
+private:
+    // One direction's indices, each on its own cache line
+    struct Control {
+        alignas(64) std::atomic<uint64_t> tail{0};         // Written by the producer
+        std::atomic<uint32_t> consumerWaiting{0};          // Set by the consumer, cleared by whoever rings
+        alignas(64) std::atomic<uint64_t> head{0};         // Written by the consumer
+        std::atomic<uint32_t> producerWaiting{0};
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t ringBytes;
+        Control rings[2];                                  // [0] client -> server, [1] server -> client
+    };
+    static_assert(sizeof(Header) <= SHM_DATA_OFFSET, "ring headers overlap the data");
+
+    // This side's view of one ring
+    struct Ring {
+        Control* control = nullptr;
+        char* data = nullptr;
+        size_t bytes = 0;
+        size_t mask = 0;
+        uint64_t cachedHead = 0;                           // Producer's copy of head
+        uint64_t cachedTail = 0;                           // Consumer's copy of tail
+    };
+
+    explicit ShmChannel(ShmSide side) : side(side) {}
+
+    Header* header() const { return (Header*)region; }
+
+    bool map(size_t bytes) {
+        void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        if (mapped == MAP_FAILED) return false;
+        region = (char*)mapped;
+        regionBytes = bytes;
+        return true;
+    }
+
+    void setUp() {
+        Header* h = header();
+        size_t ringBytes = h->ringBytes;
+        Ring rings[2];
+        for (int i = 0; i < 2; i++) {
+            rings[i].control = &h->rings[i];
+            rings[i].data = region + SHM_DATA_OFFSET + i * ringBytes;
+            rings[i].bytes = ringBytes;
+            rings[i].mask = ringBytes - 1;
+        }
+        in = rings[side == ShmSide::Server ? 0 : 1];
+        out = rings[side == ShmSide::Server ? 1 : 0];
+        in.cachedTail = in.control->tail.load(std::memory_order_acquire);
+        readPos = in.control->head.load(std::memory_order_relaxed);
+        out.cachedHead = out.control->head.load(std::memory_order_acquire);
+    }
+
+    // The doorbells this side rings for the other
+    int peerDataBell() const { return side == ShmSide::Server ? fds[1] : fds[2]; }
+    int peerSpaceBell() const { return side == ShmSide::Server ? fds[1] : fds[3]; }
+
+    ShmSide side;
+    int fds[SHM_DESCRIPTORS] = {-1, -1, -1, -1};  // memfd, client bell, server read bell, server write bell
+    char* region = nullptr;
+    size_t regionBytes = 0;
+    Ring in;                                      // Ring this side consumes
+    Ring out;                                     // Ring this side produces
+    uint64_t readPos = 0;                         // Consumed up to here; published by release()
+};
+
+/**
+ * Function: sendWithDescriptors
+ * Purpose: Writes one frame on a Unix socket with descriptors attached
+ * Returns: false unless the whole frame was sent
+ */
+inline bool sendWithDescriptors(int sock, std::string_view payload, const int* fds, int count) {
+    std::string frame = makeFrame(payload);
+    iovec iov{(void*)frame.data(), frame.size()};
+    char control[CMSG_SPACE(sizeof(int) * SHM_DESCRIPTORS)] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)frame.size();
+}
+
+/**
+ * Function: receiveWithDescriptors
+ * Purpose: recv() that also collects descriptors passed with the data
+ * Parameters:
+ *   - fds: Receives up to SHM_DESCRIPTORS descriptors
+ *   - count: Receives how many arrived (extra ones are closed)
+ * Returns: As recv()
+ */
+inline ssize_t receiveWithDescriptors(int sock, char* buffer, size_t length, int* fds, int& count) {
+    char control[CMSG_SPACE(sizeof(int) * SHM_DESCRIPTORS)];
+    iovec iov{buffer, length};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t received = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    count = 0;
+    if (received < 0) return received;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        int n = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        const int* passed = (const int*)CMSG_DATA(cmsg);
+        for (int i = 0; i < n; i++) {
+            if (count < SHM_DESCRIPTORS) fds[count++] = passed[i];
+            else close(passed[i]);
+        }
+    }
+    return received;
+}
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * spsc_ring.h - Bounded lock-free single-producer/single-consumer queue
+ *
+ * Used to pass broadcasts between the reactor shards (every ordered pair of
+ * shards gets its own ring) and log records from each thread to the log
+ * writer (see async_log.h), so each ring has exactly one writer thread and
+ * one reader thread and needs no lock, only acquire/release ordering on the
+ * two indices. Each side also keeps a private copy of the other side's
+ * index and only re-reads the shared one when the ring looks full (or
+ * empty), so in steady state the two threads do not bounce each other's
+ * cache line on every operation.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+const size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * Class: SpscRing
+ * Purpose: Fixed-capacity FIFO for one producer thread and one consumer thread
+ */
+template <typename T>
+class SpscRing {
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        slots.reset(new T[size]);
+        mask = size - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /**
+     * Function: push
+     * Purpose: Appends an item (producer thread only)
+     * Returns: false if the ring is full; the item is left untouched
+     */
+    bool push(T& item) {
+        size_t tail = producer.tail.load(std::memory_order_relaxed);
+        if (tail - producer.cachedHead > mask) {
+            producer.cachedHead = consumer.head.load(std::memory_order_acquire);
+            if (tail - producer.cachedHead > mask) return false;
+        }
+        slots[tail & mask] = std::move(item);
+        producer.tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Function: pop
+     * Purpose: Removes the oldest item (consumer thread only)
+     * Returns: false if the ring is empty
+     */
+    bool pop(T& item) {
+        size_t head = consumer.head.load(std::memory_order_relaxed);
+        if (head == consumer.cachedTail) {
+            consumer.cachedTail = producer.tail.load(std::memory_order_acquire);
+            if (head == consumer.cachedTail) return false;
+        }
+        item = std::move(slots[head & mask]);
+        consumer.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Items queued, give or take one the other side is moving right now
+    size_t approxSize() const {
+        return producer.tail.load(std::memory_order_relaxed) - consumer.head.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    // Each side's index sits on its own cache line with its private cache
+    struct alignas(CACHE_LINE_SIZE) ProducerSide {
+        std::atomic<size_t> tail{0};
+        size_t cachedHead = 0;
+    };
+    struct alignas(CACHE_LINE_SIZE) ConsumerSide {
+        std::atomic<size_t> head{0};
+        size_t cachedTail = 0;
+    };
+
+    ProducerSide producer;
+    ConsumerSide consumer;
+    std::unique_ptr<T[]> slots;
+    size_t mask;
+};
+
+#endif
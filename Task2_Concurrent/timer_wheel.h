@@ -0,0 +1,236 @@
+/**
+ * timer_wheel.h - Hierarchical timing wheel for per-connection deadlines
+ *
+ * Every connection needs a timer (heartbeats and the read, idle and write
+ * deadlines), and with 100k connections they are armed and cancelled far
+ * more often than they fire. A sorted heap costs O(log n) per operation and
+ * a thread per connection does not scale, so the server keeps them in a
+ * timing wheel instead: arming and cancelling are O(1), and advancing the
+ * clock only visits the timers that are due.
+ *
+ * Time is counted in ticks. The wheel has TIMER_LEVELS levels of
+ * TIMER_SLOTS slots; level 0 holds the timers due within the next
+ * TIMER_SLOTS ticks, one slot per tick, and each level above covers
+ * TIMER_SLOTS times the span of the one below with one slot per span of
+ * the level below. A timer goes into the lowest level whose span reaches
+ * its expiry. Whenever level 0 wraps around, the next slot of level 1 is
+ * emptied into level 0 (and so on up), so a timer moves down at most
+ * TIMER_LEVELS - 1 times before it fires. Expiries beyond the top level
+ * are clamped to the furthest tick the wheel can hold.
+ *
+ * A timer is a TimerNode embedded in its owner (intrusive, so arming never
+ * allocates); a node unlinks itself when destroyed. The wheel is not
+ * thread-safe: it belongs to one event loop, or is guarded by a mutex.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+const int TIMER_LEVEL_BITS = 6;
+const int TIMER_LEVELS = 4;
+const uint64_t TIMER_SLOTS = 1ULL << TIMER_LEVEL_BITS;               // Slots per level
+const uint64_t TIMER_SLOT_MASK = TIMER_SLOTS - 1;
+const uint64_t TIMER_SPAN = 1ULL << (TIMER_LEVEL_BITS * TIMER_LEVELS);  // Ticks the wheel can look ahead
+
+template <typename T> class TimerWheel;
+
+/**
+ * Struct: TimerNode
+ * Purpose: One timer, embedded in the object it belongs to
+ */
+template <typename T>
+struct TimerNode {
+    T* owner = nullptr;             // Passed to the expiry callback
+
+    TimerNode() = default;
+    TimerNode(const TimerNode&) = delete;
+    TimerNode& operator=(const TimerNode&) = delete;
+    ~TimerNode() {
+        if (wheel) wheel->cancel(*this);
+    }
+
+private:
+    friend class TimerWheel<T>;
+    TimerWheel<T>* wheel = nullptr; // Set while armed
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    uint64_t expires = 0;
+    int level = 0;
+    size_t slot = 0;
+};
+
+/**
+ * Class: TimerWheel
+ * Purpose: O(1) arm and cancel, expiry in tick order
+ */
+template <typename T>
+class TimerWheel {
+public:
+    explicit TimerWheel(uint64_t now = 0) : current(now) {}
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Nodes outliving the wheel are left unarmed
+    ~TimerWheel() {
+        for (int level = 0; level < TIMER_LEVELS; level++) {
+            for (size_t slot = 0; slot < TIMER_SLOTS; slot++) {
+                for (TimerNode<T>* node = slots[level][slot]; node != nullptr; node = node->next) {
+                    node->wheel = nullptr;
+                }
+            }
+        }
+    }
+
+    uint64_t now() const { return current; }
+    size_t size() const { return count; }
+    bool armed(const TimerNode<T>& node) const { return node.wheel == this; }
+
+    /**
+     * Function: arm
+     * Purpose: Schedules (or reschedules) a timer for tick `expires`
+     *
+     * A tick that has already passed fires on the next advance.
+     */
+    void arm(TimerNode<T>& node, uint64_t expires) {
+        if (node.wheel) node.wheel->cancel(node);
+        if (expires <= current) expires = current + 1;
+        if (expires - current >= TIMER_SPAN) expires = current + TIMER_SPAN - 1;
+        node.expires = expires;
+        node.wheel = this;
+        link(node);
+        count++;
+    }
+
+    /**
+     * Function: cancel
+     * Purpose: Removes a timer if it is armed on this wheel
+     */
+    void cancel(TimerNode<T>& node) {
+        if (node.wheel != this) return;
+        unlink(node);
+        node.wheel = nullptr;
+        count--;
+    }
+
+    /**
+     * Function: advance
+     * Purpose: Moves the clock to `now`, calling expired(owner) for every
+     *          timer that came due, in tick order
+     *
+     * A fired timer is no longer armed; the callback may arm it again, or
+     * arm and cancel any other timer. Stretches of ticks with nothing on
+     * level 0 are skipped up to the next cascade.
+     */
+    template <typename Expired>
+    void advance(uint64_t now, Expired&& expired) {
+        while (current < now) {
+            if (count == 0) {
+                current = now;
+                return;
+            }
+            if (occupied[0] == 0) {
+                uint64_t lastOfRound = current | TIMER_SLOT_MASK;
+                if (lastOfRound >= now) {
+                    current = now;
+                    return;
+                }
+                current = lastOfRound;
+            }
+            current++;
+            cascade();
+
+            size_t slot = (size_t)(current & TIMER_SLOT_MASK);
+            TimerNode<T>* node;
+            while ((node = slots[0][slot]) != nullptr) {
+                cancel(*node);
+                expired(*node->owner);
+            }
+        }
+    }
+
+    /**
+     * Function: ticksUntilNext
+     * Purpose: How many ticks the owner may sleep before calling advance
+     * Returns: At least 1, or -1 if nothing is armed
+     *
+     * Timers above level 0 only count from the next cascade, which is at
+     * most TIMER_SLOTS ticks away.
+     */
+    long long ticksUntilNext() const {
+        if (count == 0) return -1;
+        uint64_t index = current & TIMER_SLOT_MASK;
+        long long wait = (long long)(TIMER_SLOTS - index);  // Until the next cascade
+        for (uint64_t distance = 1; distance < (uint64_t)wait; distance++) {
+            if (occupied[0] & (1ULL << ((index + distance) & TIMER_SLOT_MASK))) return (long long)distance;
+        }
+        if (count == perLevel[0]) {
+            // Only level 0 is in use: its earliest slot may lie past the wrap
+            for (uint64_t distance = (uint64_t)wait; distance <= TIMER_SLOTS; distance++) {
+                if (occupied[0] & (1ULL << ((index + distance) & TIMER_SLOT_MASK))) return (long long)distance;
+            }
+        }
+        return wait;
+    }
+
+private:
+    void link(TimerNode<T>& node) {
+        uint64_t delta = node.expires - current;
+        int level = 0;
+        while (level < TIMER_LEVELS - 1 && delta >= (1ULL << ((level + 1) * TIMER_LEVEL_BITS))) level++;
+        size_t slot = (size_t)((node.expires >> (level * TIMER_LEVEL_BITS)) & TIMER_SLOT_MASK);
+
+        node.level = level;
+        node.slot = slot;
+        node.prev = nullptr;
+        node.next = slots[level][slot];
+        if (node.next) node.next->prev = &node;
+        slots[level][slot] = &node;
+        occupied[level] |= 1ULL << slot;
+        perLevel[level]++;
+    }
+
+    void unlink(TimerNode<T>& node) {
+        if (node.prev) {
+            node.prev->next = node.next;
+        } else {
+            slots[node.level][node.slot] = node.next;
+        }
+        if (node.next) node.next->prev = node.prev;
+        if (slots[node.level][node.slot] == nullptr) occupied[node.level] &= ~(1ULL << node.slot);
+        perLevel[node.level]--;
+        node.prev = nullptr;
+        node.next = nullptr;
+    }
+
+    // Re-files the timers of the upper-level slots that start at `current`
+    void cascade() {
+        for (int level = 1; level < TIMER_LEVELS; level++) {
+            if (((current >> ((level - 1) * TIMER_LEVEL_BITS)) & TIMER_SLOT_MASK) != 0) return;
+            size_t slot = (size_t)((current >> (level * TIMER_LEVEL_BITS)) & TIMER_SLOT_MASK);
+            TimerNode<T>* node = slots[level][slot];
+            slots[level][slot] = nullptr;
+            occupied[level] &= ~(1ULL << slot);
+            while (node != nullptr) {
+                TimerNode<T>* next = node->next;
+                perLevel[level]--;
+                link(*node);
+                node = next;
+            }
+        }
+    }
+
+    uint64_t current;               // Last tick processed
+    size_t count = 0;               // Armed timers
+    TimerNode<T>* slots[TIMER_LEVELS][TIMER_SLOTS] = {};
+    uint64_t occupied[TIMER_LEVELS] = {};   // Bit per non-empty slot
+    size_t perLevel[TIMER_LEVELS] = {};     // Armed timers on each level
+};
+
+#endif
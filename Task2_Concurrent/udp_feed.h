@@ -0,0 +1,234 @@
+/**
+ * udp_feed.h - Batched datagram I/O and sequence numbers for the UDP feed
+ *
+ * The server's optional UDP mode (--udp-port) is meant for high-rate feeds
+ * where losing a message is cheaper than waiting for it: there is no
+ * connection, no retransmission and no per-client send queue. Every
+ * datagram is one message:
+ *
+ *   [8-byte big-endian sequence number][payload, no length prefix]
+ *
+ * Each sender numbers its own datagrams 1, 2, 3, ... so the receiver can
+ * tell from a jump in the sequence how many were lost on the way (late
+ * datagrams arriving out of order are delivered but not counted again).
+ * The server numbers what it sends separately for every subscriber, so a
+ * subscriber's gaps are exactly the messages it missed.
+ *
+ * DatagramReceiver wraps recvmmsg() and DatagramSender wraps sendmmsg(),
+ * so a whole batch of datagrams - a burst from many publishers, or one
+ * message fanned out to a whole room - costs one system call. The sender
+ * gathers the per-recipient header and the shared payload with a two-entry
+ * iovec, so the payload is never copied per recipient.
+ *
+ * Linux only (recvmmsg/sendmmsg).
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef UDP_FEED_H
+#define UDP_FEED_H
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+const size_t FEED_SEQUENCE_BYTES = 8;         // Header in front of every datagram
+const size_t FEED_MAX_DATAGRAM = 8192;        // Larger datagrams are truncated, then dropped
+const unsigned FEED_BATCH = 64;               // Datagrams per recvmmsg/sendmmsg call
+
+/**
+ * Function: writeSequence
+ * Purpose: Stores a sequence number as the 8-byte big-endian header
+ */
+inline void writeSequence(unsigned char* out, uint64_t sequence) {
+    for (int i = 7; i >= 0; i--) {
+        out[i] = (unsigned char)(sequence & 0xFF);
+        sequence >>= 8;
+    }
+}
+
+/**
+ * Function: readSequence
+ * Purpose: Splits a received datagram into its sequence number and payload
+ * Returns: false if the datagram is too short to carry the header
+ */
+inline bool readSequence(std::string_view datagram, uint64_t& sequence, std::string_view& payload) {
+    if (datagram.size() < FEED_SEQUENCE_BYTES) return false;
+    sequence = 0;
+    for (size_t i = 0; i < FEED_SEQUENCE_BYTES; i++) {
+        sequence = (sequence << 8) | (unsigned char)datagram[i];
+    }
+    payload = datagram.substr(FEED_SEQUENCE_BYTES);
+    return true;
+}
+
+/**
+ * Class: SequenceTracker
+ * Purpose: Counts the datagrams missing from one sender's sequence
+ *
+ * The first datagram seen starts the count wherever its number is (a
+ * subscriber may have been registered again after timing out), and a
+ * sequence restarting at 1 (the sender was restarted) is taken as a new
+ * stream rather than as a late datagram.
+ */
+class SequenceTracker {
+public:
+    /**
+     * Function: observe
+     * Purpose: Records an arriving sequence number
+     * Returns: How many datagrams were skipped just before it (0 if none,
+     *          and for late or repeated ones)
+     */
+    uint64_t observe(uint64_t sequence) {
+        uint64_t skipped = 0;
+        if (expected == 0 || sequence == 1) {
+            expected = sequence;
+        }
+        if (sequence > expected) {
+            skipped = sequence - expected;
+            lost += skipped;
+        }
+        if (sequence >= expected) expected = sequence + 1;
+        return skipped;
+    }
+
+    uint64_t missing() const { return lost; }
+
+private:
+    uint64_t expected = 0;          // 0 until the first datagram
+    uint64_t lost = 0;
+};
+
+/**
+ * Class: DatagramReceiver
+ * Purpose: Receives up to FEED_BATCH datagrams with one recvmmsg() call
+ */
+class DatagramReceiver {
+public:
+    DatagramReceiver() : buffers(FEED_BATCH * FEED_MAX_DATAGRAM) {
+        for (unsigned i = 0; i < FEED_BATCH; i++) {
+            slices[i].iov_base = &buffers[i * FEED_MAX_DATAGRAM];
+            slices[i].iov_len = FEED_MAX_DATAGRAM;
+        }
+    }
+
+    /**
+     * Function: receive
+     * Purpose: Takes whatever datagrams are queued on the socket, without
+     *          blocking
+     * Returns: The number received (0 if none were waiting), -1 on error
+     */
+    int receive(int sock) {
+        for (unsigned i = 0; i < FEED_BATCH; i++) {
+            std::memset(&headers[i], 0, sizeof(headers[i]));
+            headers[i].msg_hdr.msg_name = &addresses[i];
+            headers[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+            headers[i].msg_hdr.msg_iov = &slices[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+        int count;
+        do {
+            count = recvmmsg(sock, headers, FEED_BATCH, MSG_DONTWAIT, nullptr);
+        } while (count < 0 && errno == EINTR);
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        return count;
+    }
+
+    // The i-th datagram of the last batch (empty if it was truncated)
+    std::string_view datagram(int i) const {
+        if (headers[i].msg_hdr.msg_flags & MSG_TRUNC) return std::string_view();
+        return std::string_view(&buffers[i * FEED_MAX_DATAGRAM], headers[i].msg_len);
+    }
+
+    const sockaddr_in& sender(int i) const { return addresses[i]; }
+
+private:
+    std::vector<char> buffers;      // FEED_BATCH slots of FEED_MAX_DATAGRAM bytes
+    mmsghdr headers[FEED_BATCH];
+    iovec slices[FEED_BATCH];
+    sockaddr_in addresses[FEED_BATCH];
+};
+
+/**
+ * Class: DatagramSender
+ * Purpose: Collects outgoing datagrams and sends them with sendmmsg()
+ *
+ * queue() only records the datagram; the payload must stay valid until
+ * flush(), which sends everything queued in batches of FEED_BATCH.
+ */
+class DatagramSender {
+public:
+    void queue(const sockaddr_in& to, uint64_t sequence, std::string_view payload) {
+        Outgoing entry;
+        entry.to = to;
+        writeSequence(entry.header, sequence);
+        entry.payload = payload;
+        pending.push_back(entry);
+    }
+
+    bool empty() const { return pending.empty(); }
+    size_t size() const { return pending.size(); }
+
+    /**
+     * Function: flush
+     * Purpose: Sends every queued datagram
+     * Parameters:
+     *   - sock: UDP socket
+     *   - calls: Incremented per sendmmsg() call
+     * Returns: The number the kernel refused because the socket buffer
+     *          was full (they are dropped - the feed never waits)
+     *
+     * A datagram the kernel rejects for another reason (an unreachable
+     * address) is skipped and the rest of the batch still goes out.
+     */
+    size_t flush(int sock, uint64_t& calls) {
+        size_t refused = 0;
+        size_t next = 0;
+        while (next < pending.size()) {
+            unsigned count = (unsigned)std::min<size_t>(pending.size() - next, FEED_BATCH);
+            for (unsigned i = 0; i < count; i++) {
+                Outgoing& entry = pending[next + i];
+                slices[i][0].iov_base = entry.header;
+                slices[i][0].iov_len = FEED_SEQUENCE_BYTES;
+                slices[i][1].iov_base = const_cast<char*>(entry.payload.data());
+                slices[i][1].iov_len = entry.payload.size();
+                std::memset(&headers[i], 0, sizeof(headers[i]));
+                headers[i].msg_hdr.msg_name = &entry.to;
+                headers[i].msg_hdr.msg_namelen = sizeof(entry.to);
+                headers[i].msg_hdr.msg_iov = slices[i];
+                headers[i].msg_hdr.msg_iovlen = 2;
+            }
+            int sent = sendmmsg(sock, headers, count, MSG_DONTWAIT);
+            calls++;
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+                refused += pending.size() - next;
+                break;
+            }
+            next += sent > 0 ? (size_t)sent : 1;  // Skip the one that failed
+        }
+        pending.clear();
+        return refused;
+    }
+
+private:
+    struct Outgoing {
+        sockaddr_in to;
+        unsigned char header[FEED_SEQUENCE_BYTES];
+        std::string_view payload;
+    };
+
+    std::vector<Outgoing> pending;
+    mmsghdr headers[FEED_BATCH];
+    iovec slices[FEED_BATCH][2];
+};
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ * work_pool.h - Fixed-size work-stealing executor for message processing
+ *
+ * In threads mode each client's handler thread used to do everything for
+ * the messages it received: formatting, logging, history and the fan-out
+ * to the room. A busy client therefore kept one core busy while the rest
+ * idled, and the CPU spent on chat processing had no bound but the number
+ * of connections. With --workers N the handler threads only read and
+ * reassemble frames (socket I/O) and hand them to this pool; N worker
+ * threads do the processing and queue the finished frames for the
+ * clients' writer threads.
+ *
+ * Every worker has its own task deque. A task submitted from outside the
+ * pool goes to the workers in turn; one submitted by a worker stays on
+ * that worker's deque. A worker takes its own tasks oldest first and,
+ * when it runs out, steals the newest task of another worker, so a burst
+ * that lands on one worker spreads over the idle ones. The deques are
+ * guarded by their own mutex each (held only for a push or a pop), so
+ * submitters and thieves rarely meet on the same lock. Workers with
+ * nothing to do sleep on one condition variable; a submit only takes the
+ * sleepers' lock when somebody is asleep.
+ *
+ * The pool does not order tasks. Work that must happen in order (one
+ * client's messages) is kept in order by its submitter, which has at most
+ * one task per client in the pool at a time (see processWork).
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Concurrent Chat Application)
+ */
+
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "server_stats.h"
+
+/**
+ * Class: WorkStealingPool
+ * Purpose: Runs submitted tasks on a fixed set of worker threads
+ *
+ * Lives as long as the process: detached handler threads may still submit
+ * while the server shuts down.
+ */
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * Function: WorkStealingPool
+     * Purpose: Starts `threads` workers (at least one)
+     */
+    explicit WorkStealingPool(unsigned threads) : workers(threads > 0 ? threads : 1) {
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].reset(new Worker());
+        }
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i]->thread = std::thread([this, i] { run(i); });
+        }
+    }
+
+    /**
+     * Function: submit
+     * Purpose: Queues a task (callable from any thread)
+     */
+    void submit(Task task) {
+        size_t target = (currentPool == this) ? currentIndex
+                                               : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+        {
+            std::lock_guard<std::mutex> lock(workers[target]->mutex);
+            workers[target]->tasks.push_back(std::move(task));
+        }
+        queued.fetch_add(1);
+        if (sleeping.load() > 0) {
+            { std::lock_guard<std::mutex> lock(sleepMutex); }  // Not between its check and its wait
+            wakeup.notify_one();
+        }
+    }
+
+    size_t size() const { return workers.size(); }
+
+private:
+    struct Worker {
+        std::mutex mutex;           // Guards tasks
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    // Which pool and worker the calling thread belongs to, if any
+    static inline thread_local WorkStealingPool* currentPool = nullptr;
+    static inline thread_local size_t currentIndex = 0;
+
+    bool takeOwn(size_t index, Task& task) {
+        Worker& worker = *workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) return false;
+        task = std::move(worker.tasks.front());
+        worker.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(size_t thief, Task& task) {
+        for (size_t offset = 1; offset < workers.size(); offset++) {
+            Worker& victim = *workers[(thief + offset) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty()) continue;
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+        return false;
+    }
+
+    void run(size_t index) {
+        currentPool = this;
+        currentIndex = index;
+        ThreadStats& stats = threadStats();
+        Task task;
+        while (true) {
+            if (takeOwn(index, task)) {
+                stats.add(StatWorkTasks);
+            } else if (steal(index, task)) {
+                stats.add(StatWorkTasks);
+                stats.add(StatWorkSteals);
+            } else {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                sleeping.fetch_add(1);
+                wakeup.wait(lock, [this] { return queued.load() > 0; });
+                sleeping.fetch_sub(1);
+                continue;
+            }
+            queued.fetch_sub(1);
+            task();
+            task = nullptr;  // Drops what it captured before the next wait
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> nextWorker{0};  // Round-robin target for outside submits
+    std::atomic<size_t> queued{0};      // Tasks in all deques
+    std::atomic<int> sleeping{0};       // Workers waiting on wakeup
+
+    std::mutex sleepMutex;              // Pairs with wakeup
+    std::condition_variable wakeup;
+};
+
+#endif
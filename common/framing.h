@@ -0,0 +1,203 @@
+/**
+ * framing.h - Length-prefixed message framing shared by the chat programs
+ *
+ * Wire format: every message is a 4-byte big-endian payload length followed
+ * by that many payload bytes. TCP is a byte stream, so without a length
+ * prefix a single recv() may return half a message or several messages
+ * glued together.
+ *
+ * RecvBuffer collects raw bytes from recv() and hands complete frames back
+ * as string_views that point straight into its storage, so a burst of
+ * messages delivered by one recv() is parsed without copying or allocating.
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Chat Application)
+ */
+
+#ifndef CHAT_FRAMING_H
+#define CHAT_FRAMING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+const size_t FRAME_HEADER_SIZE = 4;          // Big-endian uint32 payload length
+const size_t MAX_FRAME_PAYLOAD = 1 << 20;    // Larger frames are a protocol error
+const size_t RECV_CHUNK_SIZE = 4096;         // Free space requested before each recv()
+
+/**
+ * Function: writeFrameHeader
+ * Purpose: Encodes a payload length as a 4-byte big-endian frame header
+ * Parameters:
+ *   - out: Destination, at least FRAME_HEADER_SIZE bytes
+ *   - length: Payload length in bytes
+ */
+inline void writeFrameHeader(char* out, uint32_t length) {
+    out[0] = (char)(length >> 24);
+    out[1] = (char)(length >> 16);
+    out[2] = (char)(length >> 8);
+    out[3] = (char)length;
+}
+
+/**
+ * Function: readFrameHeader
+ * Purpose: Decodes the payload length from a 4-byte big-endian frame header
+ */
+inline uint32_t readFrameHeader(const char* in) {
+    const unsigned char* p = (const unsigned char*)in;
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * Function: appendFrame
+ * Purpose: Appends one framed message (header + payload) to an output buffer
+ */
+inline void appendFrame(std::string& out, std::string_view payload) {
+    char header[FRAME_HEADER_SIZE];
+    writeFrameHeader(header, (uint32_t)payload.size());
+    out.append(header, FRAME_HEADER_SIZE);
+    out.append(payload.data(), payload.size());
+}
+
+/**
+ * Function: makeFrame
+ * Purpose: Returns a single framed message ready to pass to send()
+ */
+inline std::string makeFrame(std::string_view payload) {
+    std::string frame;
+    frame.reserve(FRAME_HEADER_SIZE + payload.size());
+    appendFrame(frame, payload);
+    return frame;
+}
+
+// Result of asking a RecvBuffer for the next message
+enum class FrameStatus {
+    Complete,    // A whole frame was returned
+    Incomplete,  // Need more bytes from the socket
+    TooLarge     // Peer announced a frame above MAX_FRAME_PAYLOAD
+};
+
+/**
+ * Function: parseFrame
+ * Purpose: Extracts the next complete frame from a block of received bytes
+ *          without copying (for data that is already contiguous in memory)
+ * Parameters:
+ *   - input: Unparsed bytes; advanced past the frame on success
+ *   - payload: Receives a view of the frame payload
+ * Returns: Complete, Incomplete (input left untouched) or TooLarge
+ */
+inline FrameStatus parseFrame(std::string_view& input, std::string_view& payload) {
+    if (input.size() < FRAME_HEADER_SIZE) return FrameStatus::Incomplete;
+
+    uint32_t length = readFrameHeader(input.data());
+    if (length > MAX_FRAME_PAYLOAD) return FrameStatus::TooLarge;
+    if (input.size() < FRAME_HEADER_SIZE + length) return FrameStatus::Incomplete;
+
+    payload = input.substr(FRAME_HEADER_SIZE, length);
+    input.remove_prefix(FRAME_HEADER_SIZE + length);
+    return FrameStatus::Complete;
+}
+
+/**
+ * Class: RecvBuffer
+ * Purpose: Per-connection receive buffer and frame parser
+ *
+ * Bytes are appended at the write position by recv() and consumed from the
+ * read position by nextFrame(). Unlike a wrap-around ring, the unread bytes
+ * are always contiguous, so every frame can be returned as a string_view
+ * without first being copied out. Instead of wrapping, prepare() slides the
+ * unread tail (normally a fraction of one frame) back to the front once the
+ * end of the storage is reached, and only grows the storage when that tail
+ * really does not fit. When everything has been consumed both positions
+ * reset to zero, which makes the common case copy-free.
+ *
+ * Usage:
+ *   char* space = buf.prepare(RECV_CHUNK_SIZE);
+ *   int n = recv(sock, space, (int)buf.writable(), 0);
+ *   buf.commit(n);
+ *   while (buf.nextFrame(payload) == FrameStatus::Complete) { ... }
+ *
+ * Views returned by nextFrame() stay valid until the next prepare().
+ */
+class RecvBuffer {
+public:
+    explicit RecvBuffer(size_t initialCapacity = RECV_CHUNK_SIZE)
+        : storage(new char[initialCapacity]), capacity(initialCapacity) {}
+
+    /**
+     * Function: prepare
+     * Purpose: Makes at least minSpace contiguous bytes writable
+     * Returns: Pointer to the first writable byte
+     */
+    char* prepare(size_t minSpace) {
+        if (capacity - writePos >= minSpace) {
+            return storage.get() + writePos;
+        }
+
+        size_t unread = writePos - readPos;
+        if (readPos > 0) {
+            memmove(storage.get(), storage.get() + readPos, unread);
+            readPos = 0;
+            writePos = unread;
+        }
+
+        if (capacity - writePos < minSpace) {
+            size_t newCapacity = capacity * 2;
+            while (newCapacity - writePos < minSpace) newCapacity *= 2;
+            std::unique_ptr<char[]> grown(new char[newCapacity]);
+            memcpy(grown.get(), storage.get(), writePos);
+            storage = std::move(grown);
+            capacity = newCapacity;
+        }
+        return storage.get() + writePos;
+    }
+
+    // Number of bytes that may be written after prepare()
+    size_t writable() const { return capacity - writePos; }
+
+    // Records that n bytes were written into the prepared space
+    void commit(size_t n) { writePos += n; }
+
+    // Bytes received but not yet returned as frames
+    size_t buffered() const { return writePos - readPos; }
+
+    // Those bytes themselves (an incomplete frame, once nextFrame() is done)
+    std::string_view unread() const { return std::string_view(storage.get() + readPos, writePos - readPos); }
+
+    // Copies bytes received elsewhere (e.g. into a kernel-provided buffer)
+    void append(const char* data, size_t length) {
+        memcpy(prepare(length), data, length);
+        commit(length);
+    }
+
+    /**
+     * Function: nextFrame
+     * Purpose: Extracts the next complete frame, if one has fully arrived
+     * Parameters: payload - Receives a view of the frame payload
+     * Returns: Complete, Incomplete (wait for more data) or TooLarge
+     */
+    FrameStatus nextFrame(std::string_view& payload) {
+        if (readPos == writePos) {
+            readPos = writePos = 0;
+            return FrameStatus::Incomplete;
+        }
+
+        std::string_view unread(storage.get() + readPos, writePos - readPos);
+        FrameStatus status = parseFrame(unread, payload);
+        if (status == FrameStatus::Complete) {
+            readPos = writePos - unread.size();
+        }
+        return status;
+    }
+
+private:
+    std::unique_ptr<char[]> storage;  // Uninitialised: no memset per recv
+    size_t capacity;
+    size_t readPos = 0;
+    size_t writePos = 0;
+};
+
+#endif
@@ -0,0 +1,161 @@
+/**
+ * socket_profile.h - Named TCP tuning profiles shared by the chat programs
+ *
+ * Left alone, every socket gets the kernel defaults: Nagle's algorithm on,
+ * default (auto-tuned) buffer sizes and no limit on how much unsent data
+ * the kernel queues. A profile is applied the same way on the listening
+ * socket, on every accepted socket and on the client sockets:
+ *
+ *  - low-latency: TCP_NODELAY, so a short chat line goes out at once
+ *    instead of waiting for the previous segment's ACK; small send and
+ *    receive buffers, so little data can queue up in the kernel ahead of a
+ *    new message; and, where permitted, SO_BUSY_POLL. The server also
+ *    flushes every iteration (no --cork). TCP_QUICKACK is left out: the
+ *    kernel turns it off again by itself, so it would have to be set after
+ *    every recv().
+ *  - throughput: large SO_SNDBUF/SO_RCVBUF for bulk fan-out, Nagle left on,
+ *    and TCP_NOTSENT_LOWAT so that only a bounded amount of the buffer is
+ *    unsent data: the rest waits in the application's queue, where it can
+ *    still be batched with later messages (the server turns on --cork, its
+ *    own batching, for this profile) or dropped under --slow-policy.
+ *
+ * Buffer sizes must be set before listen() or connect() to take part in
+ * the window-scale negotiation, which is why the listener gets the profile
+ * too (Linux also copies it to accepted sockets). The kernel doubles the
+ * requested sizes and caps them at net.core.wmem_max/rmem_max, so
+ * describeSocket() reports the values actually in effect. Setting a size
+ * turns off the kernel's buffer auto-tuning for that socket.
+ *
+ * Include after the platform socket headers (SOCKET must be defined).
+ *
+ * Course: 23CSE312 - Distributed Systems
+ * Lab: Socket Programming (Chat Application)
+ */
+
+#ifndef CHAT_SOCKET_PROFILE_H
+#define CHAT_SOCKET_PROFILE_H
+
+#ifndef _WIN32
+    #include <netinet/tcp.h>
+#endif
+
+#include <string>
+#include <string_view>
+
+enum class SocketProfile { Default, LowLatency, Throughput };
+
+/**
+ * Struct: SocketTuning
+ * Purpose: The options a profile sets; 0 / false leaves the kernel default
+ */
+struct SocketTuning {
+    bool noDelay = false;         // TCP_NODELAY (disable Nagle)
+    int sendBuffer = 0;           // SO_SNDBUF bytes
+    int recvBuffer = 0;           // SO_RCVBUF bytes
+    int notSentLowat = 0;         // TCP_NOTSENT_LOWAT bytes (Linux, macOS)
+    int busyPollUs = 0;           // SO_BUSY_POLL microseconds (Linux)
+};
+
+/**
+ * Function: profileTuning
+ * Purpose: The socket options that make up a profile
+ */
+inline SocketTuning profileTuning(SocketProfile profile) {
+    SocketTuning tuning;
+    if (profile == SocketProfile::LowLatency) {
+        tuning.noDelay = true;
+        tuning.sendBuffer = 64 * 1024;
+        tuning.recvBuffer = 64 * 1024;
+        tuning.busyPollUs = 50;
+    } else if (profile == SocketProfile::Throughput) {
+        tuning.sendBuffer = 4 * 1024 * 1024;
+        tuning.recvBuffer = 4 * 1024 * 1024;
+        tuning.notSentLowat = 128 * 1024;
+    }
+    return tuning;
+}
+
+/**
+ * Function: parseSocketProfile
+ * Purpose: Converts "default", "low-latency" or "throughput" to a profile
+ * Returns: false if the name is not recognised
+ */
+inline bool parseSocketProfile(std::string_view name, SocketProfile& profile) {
+    if (name == "default") profile = SocketProfile::Default;
+    else if (name == "low-latency") profile = SocketProfile::LowLatency;
+    else if (name == "throughput") profile = SocketProfile::Throughput;
+    else return false;
+    return true;
+}
+
+inline const char* socketProfileName(SocketProfile profile) {
+    switch (profile) {
+    case SocketProfile::LowLatency: return "low-latency";
+    case SocketProfile::Throughput: return "throughput";
+    default: return "default";
+    }
+}
+
+/**
+ * Function: applySocketProfile
+ * Purpose: Sets a profile's options on a TCP socket
+ * Parameters:
+ *   - sock: Listening socket before listen(), client socket before
+ *           connect(), or a freshly accepted socket
+ *   - profile: Profile to apply (Default changes nothing)
+ *
+ * Best effort: an option the platform or the process's privileges do not
+ * allow (busy polling beyond net.core.busy_poll needs CAP_NET_ADMIN) is
+ * skipped; describeSocket() shows what took effect.
+ */
+inline void applySocketProfile(SOCKET sock, SocketProfile profile) {
+    SocketTuning tuning = profileTuning(profile);
+    int one = 1;
+    if (tuning.noDelay) {
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    }
+    if (tuning.sendBuffer > 0) {
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (const char*)&tuning.sendBuffer, sizeof(int));
+    }
+    if (tuning.recvBuffer > 0) {
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*)&tuning.recvBuffer, sizeof(int));
+    }
+#ifdef TCP_NOTSENT_LOWAT
+    if (tuning.notSentLowat > 0) {
+        setsockopt(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, (const char*)&tuning.notSentLowat, sizeof(int));
+    }
+#endif
+#ifdef SO_BUSY_POLL
+    if (tuning.busyPollUs > 0) {
+        setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, (const char*)&tuning.busyPollUs, sizeof(int));
+    }
+#endif
+}
+
+/**
+ * Function: describeSocket
+ * Purpose: Reads back the tuning options in effect on a socket
+ * Returns: e.g. "TCP_NODELAY on, SO_SNDBUF 131072, SO_RCVBUF 131072"
+ */
+inline std::string describeSocket(SOCKET sock) {
+    auto read = [sock](int level, int name) {
+        int value = 0;
+        socklen_t length = sizeof(value);
+        if (getsockopt(sock, level, name, (char*)&value, &length) != 0) return -1;
+        return value;
+    };
+    std::string text = read(IPPROTO_TCP, TCP_NODELAY) > 0 ? "TCP_NODELAY on" : "TCP_NODELAY off";
+    text += ", SO_SNDBUF " + std::to_string(read(SOL_SOCKET, SO_SNDBUF));
+    text += ", SO_RCVBUF " + std::to_string(read(SOL_SOCKET, SO_RCVBUF));
+#ifdef TCP_NOTSENT_LOWAT
+    int lowat = read(IPPROTO_TCP, TCP_NOTSENT_LOWAT);
+    if (lowat > 0) text += ", TCP_NOTSENT_LOWAT " + std::to_string(lowat);
+#endif
+#ifdef SO_BUSY_POLL
+    int busyPoll = read(SOL_SOCKET, SO_BUSY_POLL);
+    if (busyPoll > 0) text += ", SO_BUSY_POLL " + std::to_string(busyPoll) + " us";
+#endif
+    return text;
+}
+
+#endif